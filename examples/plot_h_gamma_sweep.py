@@ -22,6 +22,8 @@ def plot_sweep(results_filename : str = 'results_sweep.csv'):
 
     #read results data from file, store it inside a Pandas Dataframe
     results = pd.read_csv(results_filename)
+    #the rows can be in coarse-to-fine order (task_order "progressive"): sort them by the parameters
+    results = results.sort_values(["GAMMA", "H"], kind="stable").reset_index(drop=True)
 
 
     #extract value of the (constant during the convergence sweep) physical parameters
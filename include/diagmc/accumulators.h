@@ -0,0 +1,413 @@
+/**
+ * @file accumulators.h
+ * @brief Header file of the accumulators used to sum the observables: exact sums, whose results do not depend on how the sum is split or ordered,
+ * compensated sums, whose error does not grow with the number of terms, and the binning analysis of the errors of correlated series.
+ * They are used in the hot loops, so their methods are defined inline.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+//number of values summed in plain double precision in a block of BlockedSum, before being added to the compensated total
+#define BLOCKED_SUM_BLOCK_SIZE 1024
+
+//number of levels of BinningAnalysis: the bins of the last level contain 2^(BINNING_LEVELS-1) values
+#define BINNING_LEVELS 40
+//minimum number of bins of a level of BinningAnalysis to be used for the estimate of the error
+#define BINNING_MIN_BINS 256
+//number of values buffered by BinningAnalysis before computing its first levels at once (a power of 2)
+#define BINNING_BUFFER_SIZE 256
+
+
+/**
+ * @class BoundedExactSum
+ *
+ * @brief Exact sum of values in [-1, 1], which are rounded to fixed point with FRACTION_BITS fractional bits
+ * and accumulated in a 128-bit integer (stored as a signed high word and an unsigned low word).
+ * Since the integer sum is exact, the result is the same for any order of the additions and any split into partial sums
+ * merged with merge(): a reduction over parallel threads gives bit-identical results for any number of threads.
+ * The rounding error of each value is at most 2^-(FRACTION_BITS+1), and up to 2^65 values can be summed without overflow.
+ */
+class BoundedExactSum
+{
+    private:
+
+    static constexpr int FRACTION_BITS = 62;   ///< number of fractional bits of the fixed point representation
+
+    std::int64_t _high = 0;     ///< high 64 bits of the two's complement 128-bit sum
+    std::uint64_t _low = 0;     ///< low 64 bits of the two's complement 128-bit sum
+
+
+    /**
+     * @brief Adds a 128-bit integer (high, low) to the sum
+     */
+    void add_integer(std::int64_t high, std::uint64_t low)
+    {
+        std::uint64_t new_low = _low + low;
+        _high += high + (new_low < _low ? 1 : 0);
+        _low = new_low;
+    }
+
+
+    public:
+
+    /**
+     * @brief Adds a value to the sum. Throws an std::invalid_argument exception if the value is not in [-1, 1].
+     *
+     * @param value value in [-1, 1]
+     */
+    void add(double value)
+    {
+        if (!(std::abs(value) <= 1)) throw std::invalid_argument("BoundedExactSum only accepts values in [-1, 1].");
+        std::int64_t fixed = std::llround(std::ldexp(value, FRACTION_BITS));
+        add_integer(fixed < 0 ? -1 : 0, static_cast<std::uint64_t>(fixed)); //sign extension to 128 bits
+    }
+
+    /**
+     * @brief Adds the partial sum of another accumulator
+     *
+     * @param other accumulator
+     */
+    void merge(const BoundedExactSum & other)
+    {
+        add_integer(other._high, other._low);
+    }
+
+    /**
+     * @brief Returns the sum, rounded to double
+     *
+     * @return double
+     */
+    double value() const
+    {
+        //the magnitude of the 128-bit integer is converted as high*2^64 + low, to avoid cancellations for negative sums
+        bool negative = _high < 0;
+        std::uint64_t high = static_cast<std::uint64_t>(_high), low = _low;
+        if (negative)
+        {
+            high = ~high + (low == 0 ? 1 : 0);
+            low = ~low + 1;
+        }
+        double magnitude = std::ldexp(static_cast<double>(high), 64) + static_cast<double>(low);
+        return std::ldexp(negative ? -magnitude : magnitude, -FRACTION_BITS);
+    }
+};
+
+
+/**
+ * @class CompensatedSum
+ *
+ * @brief Sum with Neumaier (improved Kahan-Babuska) compensation: the rounding error of each addition is accumulated
+ * in a separate term, so that the error of the sum does not grow with the number of terms.
+ */
+class CompensatedSum
+{
+    private:
+
+    double _sum = 0;            ///< running sum
+    double _compensation = 0;   ///< accumulated rounding errors of the running sum
+
+
+    public:
+
+    /**
+     * @brief Adds a value to the sum
+     *
+     * @param value value to be added
+     */
+    void add(double value)
+    {
+        double new_sum = _sum + value;
+        //the rounding error is computed from the larger of the two terms
+        if (std::abs(_sum) >= std::abs(value)) _compensation += (_sum - new_sum) + value;
+        else _compensation += (value - new_sum) + _sum;
+        _sum = new_sum;
+    }
+
+    /**
+     * @brief Adds the partial sum of another accumulator
+     *
+     * @param other accumulator
+     */
+    void merge(const CompensatedSum & other)
+    {
+        add(other._sum);
+        _compensation += other._compensation;
+    }
+
+    /**
+     * @brief Returns the compensated sum
+     *
+     * @return double
+     */
+    double value() const
+    {
+        return _sum + _compensation;
+    }
+};
+
+
+/**
+ * @class BlockedSum
+ *
+ * @brief Sum for very long sequences of values in the hot loop of a chain: the values are summed in plain double precision
+ * in blocks of BLOCKED_SUM_BLOCK_SIZE values (a single addition per value, which the compiler can keep in a register),
+ * and each block is then added to a CompensatedSum. The error is that of a sum of BLOCKED_SUM_BLOCK_SIZE terms,
+ * instead of growing with the total number of values, with O(1) memory.
+ */
+class BlockedSum
+{
+    private:
+
+    double _block = 0;              ///< sum of the values of the current block
+    unsigned int _block_count = 0;  ///< number of values in the current block
+    CompensatedSum _total;          ///< compensated sum of the completed blocks
+
+
+    public:
+
+    /**
+     * @brief Adds a value to the sum
+     *
+     * @param value value to be added
+     */
+    void add(double value)
+    {
+        _block += value;
+        if (++_block_count == BLOCKED_SUM_BLOCK_SIZE)
+        {
+            _total.add(_block);
+            _block = 0;
+            _block_count = 0;
+        }
+    }
+
+    /**
+     * @brief Returns the sum of all the values added
+     *
+     * @return double
+     */
+    double value() const
+    {
+        CompensatedSum total = _total;
+        total.add(_block);
+        return total.value();
+    }
+};
+
+
+/**
+ * @class BinningAnalysis
+ *
+ * @brief Streaming binning (blocking) analysis of a time series of correlated values, e.g. an observable along a Markov chain.
+ * The level l contains the averages of consecutive bins of 2^l values, and keeps the sum and the sum of the squares of its bins,
+ * so that the variance of the bin averages can be computed at every level with O(BINNING_LEVELS) memory.
+ * When the bins are longer than the autocorrelation time, the bin averages are independent, and the error of the mean
+ * estimated from their variance reaches a plateau: the error is taken as the largest estimate among the levels with at least
+ * BINNING_MIN_BINS bins.
+ * The values are stored in a buffer of BINNING_BUFFER_SIZE values, and the first levels are computed at once when it is full,
+ * with plain loops over contiguous memory, so that adding a value at every step of a chain costs only a store.
+ */
+class BinningAnalysis
+{
+    private:
+
+    /**
+     * @brief Bins of one level
+     */
+    struct Level
+    {
+        BlockedSum sum;                     ///< sum of the bin averages
+        BlockedSum sum_squares;             ///< sum of the squares of the bin averages
+        unsigned long long N_bins = 0;      ///< number of complete bins
+        double pending = 0;                 ///< average of the first half of the next bin of the upper level
+        bool has_pending = false;           ///< true if pending is set
+    };
+
+    Level _levels[BINNING_LEVELS];                  ///< levels with bins of 1, 2, 4, ... values
+    double _buffer[BINNING_BUFFER_SIZE];            ///< values not yet added to the levels
+    unsigned int _N_buffered = 0;                   ///< number of values in the buffer
+    double _offset = 0;                             ///< first value, subtracted from all the values to reduce cancellations in the variances
+    bool _has_offset = false;                       ///< true if the offset is set
+
+
+    /**
+     * @brief Adds a single bin average to a level, completing the bins of the upper levels
+     */
+    void add_to_level(int first_level, double value)
+    {
+        for (int l = first_level; l < BINNING_LEVELS; ++l)
+        {
+            Level & level = _levels[l];
+            level.sum.add(value);
+            level.sum_squares.add(value * value);
+            ++level.N_bins;
+            if (!level.has_pending)
+            {
+                level.pending = value;
+                level.has_pending = true;
+                return;
+            }
+            value = 0.5 * (level.pending + value);
+            level.has_pending = false;
+        }
+    }
+
+    /**
+     * @brief Adds the full buffer to the levels: since it contains a whole bin of the level log2(BINNING_BUFFER_SIZE),
+     * the lower levels are computed from it in place, halving the values at each level
+     */
+    void flush_buffer()
+    {
+        int level = 0;
+        for (unsigned int n = BINNING_BUFFER_SIZE; n > 1; n /= 2, ++level)
+        {
+            double sum = 0, sum_squares = 0;
+            for (unsigned int i = 0; i < n; ++i)
+            {
+                sum += _buffer[i];
+                sum_squares += _buffer[i] * _buffer[i];
+            }
+            _levels[level].sum.add(sum);
+            _levels[level].sum_squares.add(sum_squares);
+            _levels[level].N_bins += n;
+            for (unsigned int i = 0; i < n / 2; ++i) _buffer[i] = 0.5 * (_buffer[2*i] + _buffer[2*i + 1]);
+        }
+        add_to_level(level, _buffer[0]);
+        _N_buffered = 0;
+    }
+
+    /**
+     * @brief Returns the levels including the values still in the buffer
+     */
+    BinningAnalysis flushed() const
+    {
+        BinningAnalysis analysis = *this;
+        for (unsigned int i = 0; i < _N_buffered; ++i) analysis.add_to_level(0, _buffer[i]);
+        analysis._N_buffered = 0;
+        return analysis;
+    }
+
+    /**
+     * @brief Returns the variance of the bin averages of a level (0 if it has less than two bins)
+     */
+    static double variance(const Level & level)
+    {
+        if (level.N_bins < 2) return 0;
+        double mean = level.sum.value() / level.N_bins;
+        return std::max(0., (level.sum_squares.value() - mean * level.sum.value()) / (level.N_bins - 1));
+    }
+
+
+    public:
+
+    /**
+     * @brief Adds a value of the series
+     *
+     * @param value value to be added
+     */
+    void add(double value)
+    {
+        if (!_has_offset)
+        {
+            _offset = value;
+            _has_offset = true;
+        }
+        _buffer[_N_buffered] = value - _offset;
+        if (++_N_buffered == BINNING_BUFFER_SIZE) flush_buffer();
+    }
+
+    /**
+     * @brief Returns the number of values added
+     *
+     * @return unsigned long long
+     */
+    unsigned long long count() const
+    {
+        return _levels[0].N_bins + _N_buffered;
+    }
+
+    /**
+     * @brief Returns the mean of the values (0 if there are none)
+     *
+     * @return double
+     */
+    double mean() const
+    {
+        return count() > 0 ? _offset + flushed()._levels[0].sum.value() / count() : 0;
+    }
+
+    /**
+     * @brief Returns the sample variance of the values (0 if there are less than two)
+     *
+     * @return double
+     */
+    double sample_variance() const
+    {
+        return variance(flushed()._levels[0]);
+    }
+
+    /**
+     * @brief Returns the statistical error of the mean, taking into account the autocorrelation of the values:
+     * the largest estimate sqrt(variance / N_bins) among the levels with at least BINNING_MIN_BINS bins
+     * (at least level 0, i.e. the naive error of uncorrelated values)
+     *
+     * @return double
+     */
+    double error() const
+    {
+        BinningAnalysis analysis = flushed();
+        double error = count() > 1 ? std::sqrt(variance(analysis._levels[0]) / count()) : 0;
+        for (const Level & level : analysis._levels)
+        {
+            if (level.N_bins < BINNING_MIN_BINS) break;
+            error = std::max(error, std::sqrt(variance(level) / level.N_bins));
+        }
+        return error;
+    }
+
+    /**
+     * @brief Returns the number of bins and the variance of the bin averages of the level with the longest bins among those
+     * with at least BINNING_MIN_BINS bins (level 0 if there are less values): when the bins are longer than the autocorrelation time,
+     * their averages can be used as independent batch means
+     *
+     * @return std::pair<unsigned long long, double>
+     */
+    std::pair<unsigned long long, double> batch_means() const
+    {
+        BinningAnalysis analysis = flushed();
+        int last = 0;
+        while (last + 1 < BINNING_LEVELS && analysis._levels[last + 1].N_bins >= BINNING_MIN_BINS) ++last;
+        return {analysis._levels[last].N_bins, variance(analysis._levels[last])};
+    }
+
+    /**
+     * @brief Returns the effective sample size, i.e. the number of independent values with the same error of the mean:
+     * variance / error^2 (the number of values if the variance is 0)
+     *
+     * @return double
+     */
+    double effective_sample_size() const
+    {
+        double error_squared = error() * error();
+        if (error_squared == 0) return count();
+        return std::min(static_cast<double>(count()), variance(flushed()._levels[0]) / error_squared);
+    }
+
+    /**
+     * @brief Returns the integrated autocorrelation time (in number of values), such that effective_sample_size = count / (2 tau).
+     * It is 0.5 for uncorrelated values.
+     *
+     * @return double
+     */
+    double autocorrelation_time() const
+    {
+        double ESS = effective_sample_size();
+        return ESS > 0 ? 0.5 * count() / ESS : 0.5;
+    }
+};
@@ -0,0 +1,81 @@
+/**
+ * @file affinity.h
+ * @brief Header file of the functions to pin the worker threads to the cores allowed to the process,
+ * spreading them over the NUMA nodes of the machine
+ */
+
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+
+/**
+ * @brief Placement of a worker thread of a ThreadPool
+ */
+struct WorkerPlacement
+{
+    int worker = 0;         ///< index of the worker in the pool
+    int cpu = -1;           ///< logical cpu to which the worker is assigned
+    int node = -1;          ///< NUMA node of the cpu (-1 if unknown)
+    bool pinned = false;    ///< true if the affinity of the worker was actually set to the cpu
+};
+
+
+/**
+ * @brief Returns the logical cpus on which the process is allowed to run (its cpuset), in increasing order.
+ * On systems where the affinity cannot be read, returns all the cpus reported by std::thread::hardware_concurrency.
+ *
+ * @return std::vector<int>
+ */
+std::vector<int> allowed_cpus();
+
+
+/**
+ * @brief Returns the NUMA node of a logical cpu, read from /sys/devices/system/cpu/cpu<N>/node<M>, or -1 if unknown
+ *
+ * @param cpu logical cpu
+ * @return int
+ */
+int numa_node_of_cpu(int cpu);
+
+
+/**
+ * @brief Assigns n_workers workers to the given cpus, alternating between the NUMA nodes, so that the workers
+ * are spread over all the nodes (and their memory controllers) before two of them share a node.
+ * Within a node, the cpus are used in increasing order. If there are more workers than cpus, the cpus are reused cyclically.
+ * Throws an std::invalid_argument exception if cpus is empty, or cpus and nodes have different sizes.
+ *
+ * @param n_workers number of workers
+ * @param cpus allowed logical cpus
+ * @param nodes NUMA node of each cpu (-1 if unknown)
+ * @return std::vector<WorkerPlacement> placement of each worker (not yet pinned)
+ */
+std::vector<WorkerPlacement> plan_worker_placement(int n_workers, const std::vector<int> & cpus, const std::vector<int> & nodes);
+
+
+/**
+ * @brief Sets the affinity of the calling thread to the given cpu.
+ *
+ * @param cpu logical cpu
+ * @return true if the affinity was set,
+ * @return false if it failed, or it is not supported on this system
+ */
+bool pin_current_thread(int cpu);
+
+
+/**
+ * @brief Returns the logical cpu on which the calling thread is running, or -1 if unknown
+ *
+ * @return int
+ */
+int current_cpu();
+
+
+/**
+ * @brief Writes one line for each worker with its cpu, NUMA node and whether it was pinned, for the run log
+ *
+ * @param placements placement of the workers
+ * @param os std::ostream object, e.g. std::cout
+ */
+void print_worker_placement(const std::vector<WorkerPlacement> & placements, std::ostream & os);
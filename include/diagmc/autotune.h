@@ -0,0 +1,104 @@
+/**
+ * @file autotune.h
+ * @brief Header file of the autotuner, which chooses the storage engine, the update probabilities and the measurement interval
+ * of each parameter point from short pilot chains, maximizing the effective samples of the magnetizations
+ */
+
+#pragma once
+
+#include <diagmc/simulation.h>
+#include <diagmc/thread_pool.h>
+#include <ostream>
+#include <vector>
+
+#define AUTOTUNE_PILOT_STEPS_DEFAULT 200000
+
+
+/**
+ * @brief Options of the autotuner: the length of the pilot chains, and the candidates that are compared
+ */
+struct AutotuneOptions
+{
+    unsigned long long pilot_steps = AUTOTUNE_PILOT_STEPS_DEFAULT;                      ///< number of steps of each pilot chain (one tenth for thermalization)
+    std::vector<DiagramEngine> engines = {DiagramEngine::LIST, DiagramEngine::FLAT};    ///< candidate storage engines
+    std::vector<double> flip_probabilities = {0.1, FLIP_PROBABILITY_DEFAULT, 0.5};      ///< candidate probabilities of the SPIN_FLIP update
+    std::vector<bool> delayed_rejection = {false, true};                                ///< candidate kernels of ADD_SEGMENT and REMOVE_SEGMENT (single-stage or delayed rejection)
+};
+
+
+/**
+ * @brief Efficiency of a candidate, measured on its pilot chain
+ */
+struct TuningTrial
+{
+    DiagramEngine engine;               ///< storage engine of the diagram
+    double flip_probability;            ///< probability of the SPIN_FLIP update
+    bool delayed_rejection;             ///< delayed-rejection variants of ADD_SEGMENT and REMOVE_SEGMENT
+    double ESS_per_step_sigmax;         ///< effective samples of sigma_x per measured step of the pilot chain
+    double ESS_per_step_sigmaz;         ///< effective samples of sigma_z per measured step of the pilot chain
+    double ESS_per_second_sigmax;       ///< effective samples of sigma_x per second of the pilot chain
+    double ESS_per_second_sigmaz;       ///< effective samples of sigma_z per second of the pilot chain
+    double autocorrelation_time;        ///< integrated autocorrelation time of sigma_z (in steps)
+
+    /**
+     * @brief Figure of merit of the parameters of the Markov chain (flip probability and kernels): the effective samples per step
+     * of the slowest of the two magnetizations. It only depends on the seeds of the pilot chain, not on the load of the machine,
+     * and it is the same for the two engines, which take the same decisions.
+     *
+     * @return double
+     */
+    double score() const;
+
+    /**
+     * @brief Speed of the candidate: the effective samples per second of the slowest of the two magnetizations,
+     * used to choose between the engines, which do not change the Markov chain
+     *
+     * @return double
+     */
+    double ESS_per_second() const;
+};
+
+
+/**
+ * @brief Result of the tuning of a task: the task with the chosen parameters, and the trials of all the candidates
+ */
+struct TuningResult
+{
+    SimulationTask task;                ///< task with the engine, flip probability, kernels and measurement interval of the best candidate
+    std::vector<TuningTrial> trials;    ///< trials of all the candidates
+    size_t best;                        ///< index of the best trial
+};
+
+
+/**
+ * @brief Runs a pilot chain for each candidate (engine, flip probability and delayed rejection) on the parameter point of the task, with its seeds,
+ * and returns the task with the flip probability and kernels of the candidate with the highest score, and the fastest engine for them.
+ * Since the score does not depend on the run time, with fixed seeds the tuned Markov chain (and so the results of the runs) is reproducible,
+ * while the engine, which only changes the speed, can differ between runs.
+ * If the measurement pipeline is enabled, the measure_interval is set to about twice the autocorrelation time of sigma_z
+ * of the best candidate, since closer snapshots are not independent. The other parameters of the task are unchanged.
+ * Throws an std::invalid_argument exception if there are no candidates, or pilot_steps is 0.
+ *
+ * @param task task to be tuned
+ * @param options options of the autotuner
+ * @return TuningResult
+ */
+TuningResult autotune_task(const SimulationTask & task, const AutotuneOptions & options = AutotuneOptions());
+
+
+/**
+ * @brief Tunes the tasks in place, running the pilot chains on the pool. The tasks with the same parameter point (beta, H, GAMMA)
+ * are tuned once, with the seeds of the first of them. A line with the choice for each parameter point is written to log.
+ * The choices of the flip probability and kernels do not depend on the number of workers or on the load of the machine.
+ * If the symmetry sources of the tasks are given (see symmetry_sources), only the points of the canonical tasks are tuned,
+ * and the tasks obtained by symmetry take the tuning of their source, so that they are still related to it after the tuning.
+ * Throws an std::invalid_argument exception if symmetry_sources is not empty and its size differs from the number of tasks.
+ *
+ * @param tasks tasks to be tuned
+ * @param pool pool of workers running the pilot chains
+ * @param options options of the autotuner
+ * @param log std::ostream object for the report of the choices, e.g. std::cout
+ * @param symmetry_sources (optional) index of the source of each task, empty to tune all the points
+ */
+void autotune_tasks(std::vector<SimulationTask> & tasks, ThreadPool & pool, const AutotuneOptions & options, std::ostream & log,
+    const std::vector<size_t> & symmetry_sources = {});
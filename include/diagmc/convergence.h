@@ -0,0 +1,202 @@
+/**
+ * @file convergence.h
+ * @brief Header file of the online convergence monitor of the chains of a parameter point (Gelman-Rubin R-hat),
+ * which stops all the chains as soon as they agree and the target precision is reached
+ */
+
+#pragma once
+
+#include <diagmc/accumulators.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+//R-hat below which the chains of a point are considered converged, if not set
+#define RHAT_THRESHOLD_DEFAULT 1.01
+//number of samples collected by a chain between two reports to its monitor (a power of 2)
+#define CONVERGENCE_REPORT_INTERVAL 65536
+
+
+/**
+ * @brief Summary of the samples of an observable collected by a chain
+ */
+struct ChainSummary
+{
+    unsigned long long N_samples = 0;   ///< number of samples
+    double mean = 0;                    ///< mean of the samples
+    double variance = 0;                ///< sample variance of the samples
+    double error = 0;                   ///< statistical error of the mean, taking into account the autocorrelation
+    unsigned long long N_batches = 0;   ///< number of batches of consecutive samples longer than the autocorrelation time
+    double batch_variance = 0;          ///< sample variance of the averages of the batches
+
+    /**
+     * @brief Returns the summary of a series, scaling the values by a factor.
+     * The batches are the longest bins of the binning analysis (see BinningAnalysis::batch_means).
+     *
+     * @param analysis binning analysis of the series
+     * @param scale factor multiplying the values
+     * @return ChainSummary
+     */
+    static ChainSummary of(const BinningAnalysis & analysis, double scale = 1);
+};
+
+
+/**
+ * @brief Returns the Gelman-Rubin potential scale reduction factor R-hat of the chains, computed on their batch means:
+ * sqrt(V / W), where W is the average within-chain variance of the batch means, and V = (n-1)/n W + B/n is the pooled estimate of it,
+ * with B/n the variance of the chain means (n is the smallest number of batches of the chains).
+ * Since the batches are longer than the autocorrelation time, B/n is compared with the variance of the means expected from the
+ * autocorrelated samples, W/n, and not with the much larger one of independent samples: R-hat is above 1 as soon as the means
+ * of the chains differ by more than their errors, i.e. when the chains have not mixed yet.
+ * It tends to 1 from above when all the chains sample the same distribution. It is 1 if all the chains have the same constant value,
+ * and infinity if they have different constant values.
+ * Throws an std::invalid_argument exception if there are less than two chains, or a chain has less than two samples or batches.
+ *
+ * @param chains summaries of the same observable for each chain
+ * @return double
+ */
+double gelman_rubin(const std::vector<ChainSummary> & chains);
+
+
+/**
+ * @brief Returns the error of the average of the means of the chains, sqrt(sum of error^2) / number of chains
+ *
+ * @param chains summaries of the same observable for each chain
+ * @return double
+ */
+double combined_error(const std::vector<ChainSummary> & chains);
+
+
+/**
+ * @brief Decision of a ConvergenceMonitor on a report of the chains
+ */
+enum class ConvergenceDecision
+{
+    PENDING,    ///< not all the chains have reported yet: the chain must wait before performing other steps
+    CONTINUE,   ///< the chains have not converged yet
+    STOP        ///< the chains have converged, and must stop at this report
+};
+
+
+/**
+ * @class ConvergenceMonitor
+ *
+ * @brief Online convergence monitor shared by the chains of a parameter point, possibly running on different threads.
+ * Every CONVERGENCE_REPORT_INTERVAL samples (at each report epoch) each chain reports the binning analyses of its sigma_z and order estimators,
+ * and waits until all the chains of the point have reported the same epoch (or have finished).
+ * Then the R-hat of sigma_z and sigma_x and the errors of their averages over the chains are computed,
+ * and if both R-hat are below the threshold and both errors below the target, all the chains stop at that epoch.
+ * Since the decision at each epoch only depends on the samples up to that epoch, every chain stops at the same step
+ * however the chains are scheduled, so the results are reproducible. The chains of a point must therefore run concurrently,
+ * on different threads or interleaved on the same thread, otherwise the first of them waits forever at its first report,
+ * or a chain waiting for a decision must be parked, and resumed by a callback registered with on_decision.
+ */
+class ConvergenceMonitor
+{
+    private:
+
+    unsigned int _N_chains;                     ///< number of chains of the point
+    double _sigmax_scale;                       ///< factor converting the order to the sigma_x estimator, -1/(beta GAMMA)
+    double _target_error;                       ///< target error of the averages of sigma_x and sigma_z over the chains
+    double _rhat_threshold;                     ///< threshold of R-hat below which the chains agree
+
+    mutable std::mutex _mutex;                  ///< protects the state of the reports
+    mutable std::condition_variable _decided;   ///< notified when an epoch is decided
+    std::vector<ChainSummary> _sigmaz;          ///< last summary of sigma_z reported by each chain
+    std::vector<ChainSummary> _sigmax;          ///< last summary of sigma_x reported by each chain
+    std::vector<unsigned long long> _epoch;     ///< last epoch reported by each chain
+    std::vector<bool> _finished;                ///< true for the chains that have finished their steps
+    unsigned long long _decided_epoch = 0;      ///< last decided epoch (0 before the first one)
+    double _R_hat = 0;                          ///< largest R-hat of sigma_x and sigma_z at the last decided epoch (0 if not evaluated)
+    std::atomic<bool> _stop {false};            ///< true when the chains must stop
+    std::vector<std::function<void()>> _resume; ///< callbacks of the parked chains, waiting for the next epoch to be decided
+
+    /**
+     * @brief Decides the next epoch if all the chains have reported it or have finished, and wakes up the waiting chains.
+     * Must be called with the lock held.
+     *
+     * @return std::vector<std::function<void()>> callbacks of the parked chains, to be called after releasing the lock (empty if the epoch is not decided)
+     */
+    std::vector<std::function<void()>> decide_if_complete();
+
+    /**
+     * @brief Returns the decision for an epoch. Must be called with the lock held.
+     */
+    ConvergenceDecision decision_locked(unsigned long long epoch) const;
+
+
+    public:
+
+    /**
+     * @brief Construct a new monitor for the chains of a parameter point.
+     * Throws an std::invalid_argument exception if N_chains < 2, target_error <= 0, or rhat_threshold <= 1.
+     *
+     * @param N_chains number of chains of the point
+     * @param beta inverse temperature of the point
+     * @param GAMMA transverse field of the point
+     * @param target_error target error of the averages of sigma_x and sigma_z over the chains
+     * @param rhat_threshold threshold of R-hat below which the chains agree
+     */
+    ConvergenceMonitor(unsigned int N_chains, double beta, double GAMMA, double target_error, double rhat_threshold = RHAT_THRESHOLD_DEFAULT);
+
+    /**
+     * @brief Records the statistics of a chain at a report epoch, and decides the epoch if all the chains have reported it.
+     * Throws an std::invalid_argument exception if chain >= N_chains, or the epoch is not the one following the last decided epoch.
+     *
+     * @param chain index of the chain in the point
+     * @param epoch report epoch, number of samples of the chain / CONVERGENCE_REPORT_INTERVAL
+     * @param binning_mz binning analysis of the sigma_z estimators of the chain
+     * @param binning_order binning analysis of the orders of the chain
+     * @return ConvergenceDecision the decision for the epoch, PENDING if some chains have not reported it yet
+     */
+    ConvergenceDecision report(unsigned int chain, unsigned long long epoch, const BinningAnalysis & binning_mz, const BinningAnalysis & binning_order);
+
+    /**
+     * @brief Returns the decision for an epoch already reported, without waiting
+     *
+     * @param epoch report epoch
+     * @return ConvergenceDecision
+     */
+    ConvergenceDecision decision(unsigned long long epoch) const;
+
+    /**
+     * @brief Waits until an epoch already reported is decided, and returns the decision
+     *
+     * @param epoch report epoch
+     * @return ConvergenceDecision CONTINUE or STOP
+     */
+    ConvergenceDecision wait_decision(unsigned long long epoch) const;
+
+    /**
+     * @brief Calls resume once an epoch already reported is decided: immediately on the calling thread if it is already decided,
+     * otherwise on the thread whose report (or finish) decides it. It allows a chain to release its thread while it waits.
+     *
+     * @param epoch report epoch
+     * @param resume function resuming the chain, which must not call the monitor
+     */
+    void on_decision(unsigned long long epoch, std::function<void()> resume);
+
+    /**
+     * @brief Records that a chain has finished its steps: the following epochs are decided without it.
+     * Throws an std::invalid_argument exception if chain >= N_chains.
+     *
+     * @param chain index of the chain in the point
+     */
+    void finish(unsigned int chain);
+
+    /**
+     * @brief Returns true if the chains must stop, since they have converged
+     *
+     * @return bool
+     */
+    bool stop_requested() const;
+
+    /**
+     * @brief Returns the largest R-hat of sigma_x and sigma_z at the last decided epoch, or 0 if no epoch was evaluated yet
+     *
+     * @return double
+     */
+    double R_hat() const;
+};
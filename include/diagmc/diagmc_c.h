@@ -0,0 +1,117 @@
+/**
+ * @file diagmc_c.h
+ * @brief Header file of the stable C interface of the libdiagmc shared library, to run the simulations in-process
+ * from other languages (e.g. Python through ctypes/cffi, or Julia through ccall)
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+    #ifdef DIAGMC_BUILDING_LIBRARY
+        #define DIAGMC_API __declspec(dllexport)
+    #else
+        #define DIAGMC_API __declspec(dllimport)
+    #endif
+#else
+    #define DIAGMC_API __attribute__((visibility("default")))
+#endif
+
+/** Version of the interface. It is increased whenever the layout of the structs or the signature of the functions change. */
+#define DIAGMC_ABI_VERSION 2
+
+/** Return codes of the functions */
+#define DIAGMC_SUCCESS 0                ///< the function completed successfully
+#define DIAGMC_ERROR_INVALID_ARGUMENT 1 ///< invalid parameters (e.g. beta <= 0), or NULL pointers
+#define DIAGMC_ERROR_INTERNAL 2         ///< unexpected error during the simulation
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Parameters of a single run of the MCMC algorithm. Same meaning of the parameters of run_simulation.
+ */
+typedef struct diagmc_task
+{
+    double beta;                                    ///< length of the diagram (here representing 1/T). Must be > 0.
+    int initial_s0;                                 ///< spin of the 0-th segment of the diagram at the beginning of the simulation. Must be +1 or -1
+    double H;                                       ///< value of the longitudinal component of magnetic field
+    double GAMMA;                                   ///< value of the transversal component of magnetic field. Must be != 0.
+    unsigned long long N_total_steps;               ///< total number of steps of the MCMC algorithm
+    unsigned long long N_thermalization_steps;      ///< number of initial steps for which statistics is not collected
+    unsigned long long update_choice_seed;          ///< seed for the random number generator to choose WHICH update to attempt
+    unsigned long long diagram_seed;                ///< seed for the diagram, used INSIDE the updates
+} diagmc_task;
+
+
+/**
+ * @brief Results of a single run, with the same meaning of the corresponding variables of SingleRunResults.
+ * The parameters of the run are in the diagmc_task that produced it.
+ */
+typedef struct diagmc_result
+{
+    double measured_sigmax;                         ///< magnetization along x calculated through the MCMC algorithm
+    double measured_sigmaz;                         ///< magnetization along z calculated through the MCMC algorithm
+    unsigned long long N_measures;                  ///< number of samples for which the statistics were collected
+    unsigned long long N_attempted_flips;           ///< number of times the SPIN_FLIP update was attempted
+    unsigned long long N_accepted_flips;            ///< number of times the SPIN_FLIP update was accepted
+    unsigned long long N_attempted_addsegment;      ///< number of times the ADD_SEGMENT update was attempted
+    unsigned long long N_accepted_addsegment;       ///< number of times the ADD_SEGMENT update was accepted
+    unsigned long long N_attempted_removesegment;   ///< number of times the REMOVE_SEGMENT update was attempted
+    unsigned long long N_accepted_removesegment;    ///< number of times the REMOVE_SEGMENT update was accepted
+    unsigned long long max_diagram_order;           ///< maximum diagram order during the whole run
+    double avg_diagram_order;                       ///< average diagram order during the whole run
+    unsigned long long order_p50;                   ///< median of the diagram order
+    unsigned long long order_p99;                   ///< 99th percentile of the diagram order
+    unsigned long long order_p999;                  ///< 99.9th percentile of the diagram order
+    unsigned long long run_time;                    ///< execution time (in nanoseconds) of the Markov Chain loop
+} diagmc_result;
+
+
+/**
+ * @brief Returns the version of the interface implemented by the loaded library (DIAGMC_ABI_VERSION at build time),
+ * to be checked by the caller before using the structs.
+ *
+ * @return int
+ */
+DIAGMC_API int diagmc_abi_version(void);
+
+
+/**
+ * @brief Runs the MCMC algorithm with the parameters in task, writing the results in the caller-provided result.
+ *
+ * @param task parameters of the run
+ * @param result output: results of the run
+ * @return int DIAGMC_SUCCESS, or an error code (the message can be retrieved with diagmc_last_error)
+ */
+DIAGMC_API int diagmc_run_simulation(const diagmc_task * task, diagmc_result * result);
+
+
+/**
+ * @brief Runs n_tasks simulations in parallel on n_threads threads, writing the results of tasks[i] in results[i].
+ * If some of the runs fail, the results of the other ones are still written, and the first error is returned.
+ *
+ * @param tasks array of n_tasks parameters of the runs
+ * @param n_tasks number of runs
+ * @param results output: caller-provided array of n_tasks results
+ * @param n_threads number of threads. Must be >= 1.
+ * @return int DIAGMC_SUCCESS, or an error code (the message can be retrieved with diagmc_last_error)
+ */
+DIAGMC_API int diagmc_run_batch(const diagmc_task * tasks, size_t n_tasks, diagmc_result * results, int n_threads);
+
+
+/**
+ * @brief Returns the message of the last error occurred in the calling thread, or an empty string.
+ * The pointer is valid until the next call to a function of the library from the same thread.
+ *
+ * @return const char*
+ */
+DIAGMC_API const char * diagmc_last_error(void);
+
+
+#ifdef __cplusplus
+}
+#endif
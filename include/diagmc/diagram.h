@@ -7,12 +7,65 @@
 
 #pragma once
 
+#include <diagmc/diagram_snapshot.h>
 #include <list>
 #include <random>
 #include <chrono>
 
 #define EPSILON 1e-10  //theshold for floating point comparison
 
+
+/**
+ * @brief Window of the second stage of the delayed-rejection ADD_SEGMENT update, for a given tau1.
+ * The acceptance rate of the first stage (tau2 uniform in [tau1, tau2max]) is R(d) = C * exp(-k d), with d = tau2 - tau1.
+ * If the new segment has an unfavourable spin (k = 2 H * spin > 0) and C > 1, the proposals with d > width = ln(C)/k are rejected
+ * with finite probability: after a rejection, tau2 is proposed again uniformly in the narrower window [tau1, tau1 + width], where R >= 1.
+ * A width of 0 means that there is no second stage (the first stage is never rejected, or the second stage would never be accepted).
+ */
+struct DelayedRejectionWindow
+{
+    double width = 0;                   ///< length of the window of the second proposal of tau2 (0 if there is no second stage)
+    double rejection_probability = 0;   ///< probability that the first stage is rejected, integrated over tau2 for this tau1
+};
+
+
+/**
+ * @brief Returns the window of the second stage of the delayed-rejection ADD_SEGMENT update
+ *
+ * @param rate_at_tau1 acceptance rate C of the first stage for tau2 = tau1
+ * @param window_length length tau2max - tau1 of the window of the first stage
+ * @param decay decay rate k = 2 H * spin of the acceptance rate with the length of the segment
+ * @return DelayedRejectionWindow
+ */
+DelayedRejectionWindow delayed_rejection_window(double rate_at_tau1, double window_length, double decay);
+
+
+/**
+ * @brief Returns the acceptance rate of the second stage of the delayed-rejection ADD_SEGMENT update,
+ * width * (R - 1) / (window_length * rejection_probability), such that the total probability of adding the segment through
+ * either stage satisfies detailed balance with acceptance_rate_remove_delayed
+ *
+ * @param rate acceptance rate R of the first stage for the proposed segment
+ * @param window_length length tau2max - tau1 of the window of the first stage
+ * @param window window of the second stage
+ * @return double
+ */
+double acceptance_rate_add_second_stage(double rate, double window_length, const DelayedRejectionWindow & window);
+
+
+/**
+ * @brief Returns the acceptance rate of the delayed-rejection REMOVE_SEGMENT update, the reverse of both stages of the ADD_SEGMENT update:
+ * (1 + window_length * rejection_probability / width * min(1, second stage rate)) / R for the segments shorter than the width
+ * of the window, and the usual 1 / R otherwise
+ *
+ * @param rate acceptance rate R of the first stage of the ADD_SEGMENT update that would add the segment
+ * @param window_length length tau2max - tau1 of the window of the first stage
+ * @param segment_length length tau2 - tau1 of the segment to be removed
+ * @param window window of the second stage, for the tau1 of the segment
+ * @return double
+ */
+double acceptance_rate_remove_delayed(double rate, double window_length, double segment_length, const DelayedRejectionWindow & window);
+
 /**
  * @class Diagram_core 
  * 
@@ -145,6 +198,36 @@ class Diagram_core
      */
     std::list<double> get_vertices() const;
 
+    /**
+     * @brief Get a constant reference to the list of _vertices, without copying it
+     * 
+     * @return const std::list<double>& 
+     */
+    const std::list<double> & vertices() const;
+
+    /**
+     * @brief Returns a flat copy of the state of the diagram (s0 and vertices)
+     * 
+     * @return DiagramSnapshot 
+     */
+    DiagramSnapshot snapshot() const;
+
+    /**
+     * @brief Copies the state of the diagram into an existing snapshot, reusing its memory (no allocation if its capacity is enough)
+     * 
+     * @param snapshot snapshot overwritten with the state of the diagram
+     */
+    void snapshot_into(DiagramSnapshot & snapshot) const;
+
+    /**
+     * @brief Sets the state of the diagram (s0 and vertices) to a snapshot, e.g. taken from another diagram with the same beta,
+     * keeping the parameters and the random number generator. The nodes of the list are reused, but walking it costs one cache miss per vertex: use FlatDiagram to clone diagrams frequently.
+     * Throws an std::invalid_argument exception if the snapshot is not valid for the beta of the diagram.
+     * 
+     * @param snapshot state of the diagram
+     */
+    void restore(const DiagramSnapshot & snapshot);
+
 
     /**
      * @brief Returns the acceptance rate for the ADD_SEGMENT update for the given parameters
@@ -208,6 +291,31 @@ class Diagram_core
      */
     bool attempt_spin_flip(double RNacc);
 
+    /**
+     * @brief Attemps the delayed-rejection variant of the ADD_SEGMENT update: the first stage is the same of attempt_add_segment,
+     * and if it is rejected, tau2 is proposed again in the narrower window of delayed_rejection_window (reusing RNacc, which is uniform
+     * in [0, 1] once rescaled to the rejected interval), accepted with acceptance_rate_add_second_stage.
+     * It must be used together with attempt_remove_segment_delayed, which is its reverse.
+     * 
+     * @param RN1 Random number for the extraction of tau1, must be in range [0, 1]
+     * @param RN2 Random number for the extraction of tau2, must be in range [0, 1]
+     * @param RNacc Random number for the acceptance of the first stage, should be in range [0,1]
+     * @param RNacc2 Random number for the acceptance of the second stage, should be in range [0,1]
+     * @return true if update was accepted (in either stage),
+     * @return false if update was rejected
+     */
+    bool attempt_add_segment_delayed(double RN1, double RN2, double RNacc, double RNacc2);
+
+    /**
+     * @brief Attemps the REMOVE_SEGMENT update reversing attempt_add_segment_delayed, with acceptance_rate_remove_delayed
+     * 
+     * @param RN1 Random number for the extraction of first vertex, must be in range [0, 1]
+     * @param RNacc Random number for the acceptance, should be in range [0,1]
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_remove_segment_delayed(double RN1, double RNacc);
+
 
 };
 
@@ -264,6 +372,23 @@ class Diagram: public Diagram_core
      */
     bool attempt_remove_segment(); 
 
+    /**
+     * @brief Attemps the delayed-rejection ADD_SEGMENT update for the current status of the diagram.
+     * It always extracts four random numbers, so that the sequence does not depend on the outcome of the first stage.
+     * 
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_add_segment_delayed();
+
+    /**
+     * @brief Attemps the delayed-rejection REMOVE_SEGMENT update for the current status of the diagram.
+     * 
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_remove_segment_delayed();
+
     /**
      * @brief Attemps the SPIN_FLIP update for the current status of the diagram.
      * 
@@ -0,0 +1,40 @@
+/**
+ * @file diagram_snapshot.h
+ * @brief Header file of the DiagramSnapshot struct, the compact flat copy of the state of a diagram of either engine,
+ * used to clone diagrams, to continue chains and to send diagrams to the measurement threads
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+/**
+ * @brief Flat copy of the state of a diagram (the spin of the first segment and the times of the vertices), without its parameters
+ * and random number generator. Copying it costs a single contiguous copy of the vertices, and copying it into a snapshot
+ * (or a FlatDiagram) that already has enough capacity does not allocate memory.
+ */
+struct DiagramSnapshot
+{
+    int s0 = 1;                     ///< spin of the 0-th segment of the diagram
+    std::vector<double> vertices;   ///< times of the vertices of the diagram
+
+    /**
+     * @brief Returns true if the snapshot is a valid state of a diagram of length beta:
+     * s0 is +1 or -1, and the vertices are an even number of sorted times in [0, beta]
+     *
+     * @param beta length of the diagram
+     * @return bool
+     */
+    bool is_valid(double beta) const
+    {
+        if ((s0 != 1 && s0 != -1) || vertices.size() % 2 != 0) return false;
+        if (vertices.empty()) return true;
+
+        //the order is checked without branches, so that the loop is vectorized
+        bool sorted = true;
+        for (size_t i = 1; i < vertices.size(); ++i) sorted &= vertices[i - 1] <= vertices[i];
+        return sorted && vertices.front() >= 0 && vertices.back() <= beta;
+    }
+};
@@ -0,0 +1,144 @@
+/**
+ * @file exact.h
+ * @brief Header file of the exact (analytical) solution of the two-level system, used as reference for the Monte Carlo results
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+/**
+ * @brief Exact value of the magnetization along z, <sigma_z> = -H/E * tanh(beta*E), with E = sqrt(H^2 + GAMMA^2)
+ *
+ * @param beta       Inverse temperature (length of the diagram). Must be > 0.
+ * @param H          Value of the longitudinal component of magnetic field
+ * @param GAMMA      Value of the transversal component of magnetic field
+ * @return double
+ */
+double exact_sigmaz(double beta, double H, double GAMMA);
+
+
+/**
+ * @brief Exact value of the magnetization along x, <sigma_x> = -GAMMA/E * tanh(beta*E), with E = sqrt(H^2 + GAMMA^2)
+ *
+ * @param beta       Inverse temperature (length of the diagram). Must be > 0.
+ * @param H          Value of the longitudinal component of magnetic field
+ * @param GAMMA      Value of the transversal component of magnetic field
+ * @return double
+ */
+double exact_sigmax(double beta, double H, double GAMMA);
+
+
+/**
+ * @brief Exact value of the energy, <H> = -E * tanh(beta*E), with E = sqrt(H^2 + GAMMA^2)
+ *
+ * @param beta       Inverse temperature (length of the diagram). Must be > 0.
+ * @param H          Value of the longitudinal component of magnetic field
+ * @param GAMMA      Value of the transversal component of magnetic field
+ * @return double
+ */
+double exact_energy(double beta, double H, double GAMMA);
+
+
+/**
+ * @brief Exact average order of the diagrams, <n> = -beta * GAMMA * <sigma_x> = beta * GAMMA^2 / E * tanh(beta*E)
+ *
+ * @param beta       Inverse temperature (length of the diagram). Must be > 0.
+ * @param H          Value of the longitudinal component of magnetic field
+ * @param GAMMA      Value of the transversal component of magnetic field
+ * @return double
+ */
+double exact_average_order(double beta, double H, double GAMMA);
+
+
+/**
+ * @brief Exact probability that the diagram has order n. Only even orders are possible.
+ * It is given by the coefficient of GAMMA^n in the expansion of Z = 2cosh(beta*sqrt(H^2 + GAMMA^2)) in powers of GAMMA^2, divided by Z:
+ * P(2k) = 2/Z * GAMMA^2k * sum_{m>=k} beta^2m * binomial(m,k) * H^(2(m-k)) / (2m)!
+ * For H=0 this is the Poisson-like distribution P(2k) = (beta*GAMMA)^2k / (2k)! / cosh(beta*GAMMA)
+ *
+ * @param n          Order of the diagram
+ * @param beta       Inverse temperature (length of the diagram). Must be > 0.
+ * @param H          Value of the longitudinal component of magnetic field
+ * @param GAMMA      Value of the transversal component of magnetic field. Must be != 0.
+ * @return double
+ */
+double exact_order_probability(size_t n, double beta, double H, double GAMMA);
+
+
+/**
+ * @brief Exact probabilities P(n) of the diagram orders, for n = 0, 1, ..., max_order
+ *
+ * @param max_order  Maximum order included in the distribution
+ * @param beta       Inverse temperature (length of the diagram). Must be > 0.
+ * @param H          Value of the longitudinal component of magnetic field
+ * @param GAMMA      Value of the transversal component of magnetic field. Must be != 0.
+ * @return std::vector<double> with max_order+1 elements
+ */
+std::vector<double> exact_order_distribution(size_t max_order, double beta, double H, double GAMMA);
+
+
+/**
+ * @brief Returns the smallest order n such that the probability of having order <= n is at least p
+ *
+ * @param p          Cumulative probability, in [0,1)
+ * @param beta       Inverse temperature (length of the diagram). Must be > 0.
+ * @param H          Value of the longitudinal component of magnetic field
+ * @param GAMMA      Value of the transversal component of magnetic field. Must be != 0.
+ * @return size_t
+ */
+size_t exact_order_quantile(double p, double beta, double H, double GAMMA);
+
+
+/**
+ * @brief Exact imaginary-time correlation function <sigma_z(0) sigma_z(tau)> = nz^2 + (1 - nz^2) * cosh(E(beta - 2 tau)) / cosh(beta E),
+ * with nz = H/E
+ *
+ * @param tau        Imaginary time, in [0, beta]
+ * @param beta       Inverse temperature (length of the diagram). Must be > 0.
+ * @param H          Value of the longitudinal component of magnetic field
+ * @param GAMMA      Value of the transversal component of magnetic field
+ * @return double
+ */
+double exact_correlation_zz(double tau, double beta, double H, double GAMMA);
+
+
+/**
+ * @brief Exact imaginary-time correlation function <sigma_x(0) sigma_x(tau)> = nx^2 + (1 - nx^2) * cosh(E(beta - 2 tau)) / cosh(beta E),
+ * with nx = GAMMA/E
+ *
+ * @param tau        Imaginary time, in [0, beta]
+ * @param beta       Inverse temperature (length of the diagram). Must be > 0.
+ * @param H          Value of the longitudinal component of magnetic field
+ * @param GAMMA      Value of the transversal component of magnetic field
+ * @return double
+ */
+double exact_correlation_xx(double tau, double beta, double H, double GAMMA);
+
+
+/**
+ * @brief Container for the exact values of the observables on a set of parameter points, stored as one array per observable
+ */
+struct ExactValues
+{
+    std::vector<double> sigmax;         ///< exact magnetization along x for each point
+    std::vector<double> sigmaz;         ///< exact magnetization along z for each point
+    std::vector<double> energy;         ///< exact energy for each point
+    std::vector<double> average_order;  ///< exact average diagram order for each point
+};
+
+
+/**
+ * @brief Vectorized evaluation of the exact observables on a whole set of parameter points (e.g. all the points of a sweep),
+ * where the i-th point is (beta[i], H[i], GAMMA[i]).
+ * The loop works on contiguous arrays without branches, so that it can be vectorized by the compiler.
+ * Throws an std::invalid_argument exception if the three arrays do not have the same size.
+ *
+ * @param beta       Values of the inverse temperature
+ * @param H          Values of the longitudinal component of magnetic field
+ * @param GAMMA      Values of the transversal component of magnetic field
+ * @return ExactValues
+ */
+ExactValues evaluate_exact(const std::vector<double> & beta, const std::vector<double> & H, const std::vector<double> & GAMMA);
@@ -0,0 +1,350 @@
+/**
+ * @file flat_diagram.h
+ * @brief Header file for FlatDiagram and FlatDiagram_core classes, the optimized engine storing the vertices in a contiguous array
+ */
+
+#pragma once
+
+#include <diagmc/diagram.h>
+#include <vector>
+#include <random>
+#include <chrono>
+
+
+/**
+ * @class FlatDiagram_core
+ *
+ * @brief Optimized counterpart of Diagram_core, with the same interface and the same decisions for the same random numbers,
+ * but storing the vertices in a sorted contiguous array (std::vector) instead of a std::list.
+ * The segment containing a time is found by binary search, the vertices of a segment are accessed directly by index,
+ * and the sums over the vertices run over contiguous memory.
+ * As for Diagram_core, it contains only the DETERMINISTIC part of the updates, and should not be used directly aside from testing.
+ */
+class FlatDiagram_core
+{
+
+    protected:
+
+    double _beta;                   ///< length of the diagram (here representing the thermondinamical beta = 1/T)). Must be > 0.
+    int _s0;                        ///< spin of the 0-th segment of the diagram [0---t1]. Must be +1 or -1
+    double _H;                      ///< value of the longitudinal component of magnetic field
+    double _GAMMA;                  ///< Value of the transversal component of magnetic field. Must be != 0.
+    std::vector<double> _vertices;  ///< sorted array containing the times of the diagram vertices
+
+
+    /**
+     * @brief Internal (non-public) member function that checks wether all the parameters are within the allowed values.
+     * Throws an std::invalid_argument exception otherwise, with the same conditions of Diagram_core.
+     *
+     * @param beta       Length of the diagram (here representing the thermondinamical $\beta$ = 1/T). Must be > 0.
+     * @param s0         Spin of the 0-th segment of the diagram [0---t1]. Must be +1 or -1.
+     * @param H          Value of the longitudinal component of magnetic field
+     * @param GAMMA      Value of the transversal component of magnetic field. Must be != 0.
+     * @param vertices   Array containing the times of diagram _vertices, with t1<t2<t3... < _beta (they need to be already sorted)
+     */
+    void assert_parameters_validity(double beta, int s0, double H, double GAMMA, const std::vector<double> & vertices) const;
+
+
+    public:
+
+    /**
+     * @brief Construct a new diagram, setting its defining parameters. The array of vertices is optional:
+     * by default it is the 0-th order diagram [0]-------[beta]
+     *
+     * @param beta       Length of the diagram (here representing the thermondinamical $\beta$ = 1/T). Must be > 0.
+     * @param s0         Spin of the 0-th segment of the diagram [0---t1]. Must be +1 or -1.
+     * @param H          Value of the longitudinal component of magnetic field
+     * @param GAMMA      Value of the transversal component of magnetic field. Must be != 0.
+     * @param vertices   (optional) Array containing the times of diagram _vertices, with t1<t2<t3... < _beta (they need to be already sorted)
+     */
+    FlatDiagram_core(double beta, int s0, double H, double GAMMA, std::vector<double> vertices=std::vector<double>() );
+
+    /**
+     * @brief operator to test wether two FlatDiagram_core objects are equal, within EPSILON.
+     * It is intended for TESTING purposes only, and not to be used within the program.
+     *
+     * @param other other FlatDiagram_core object
+     * @return true
+     * @return false
+     */
+    bool operator==(const FlatDiagram_core & other) const;
+
+    /**
+     * @brief operator to test wether two FlatDiagram_core objects are different. It is the negation of operator==.
+     * It is intended for TESTING purposes only, and not to be used within the program.
+     *
+     * @param other other FlatDiagram_core object
+     * @return true
+     * @return false
+     */
+    bool operator!=(const FlatDiagram_core & other) const;
+
+    /**
+     * @brief Returns the ratio of the weights of the two diagrams, i.e. this->value()/other.value()
+     *
+     * @return double
+     */
+    double operator/(const FlatDiagram_core & other) const;
+
+    /**
+     * @brief Small helper function, performing the sum (... +t4-t3 + t2-t1), in the same order of Diagram_core::sum_deltatau
+     *
+     * @return double
+     */
+    double sum_deltatau() const;
+
+    /**
+     * @brief Returns the value ("weight") of the current diagram
+     *
+     * @return double
+     */
+    double value() const;
+
+    /**
+     * @brief Get the order of the diagram (number of _vertices)
+     *
+     * @return size_t
+     */
+    size_t order() const;
+
+    /**
+     * @brief Get the value of _beta (length of the diagram)
+     *
+     * @return double (>0)
+     */
+    double get_beta() const;
+
+    /**
+     * @brief Get the value of the spin of the 0-th segment of the diagram [0---t1]
+     *
+     * @return int (+1 or -1)
+     */
+    int get_s0() const;
+
+    /**
+     * @brief Get the value of the longitudinal field _H
+     *
+     * @return double
+     */
+    double get_H() const;
+
+    /**
+     * @brief Get the value of the transverse field _GAMMA
+     *
+     * @return double
+     */
+    double get_GAMMA() const;
+
+    /**
+     * @brief Get a copy of the array of _vertices
+     *
+     * @return std::vector<double>
+     */
+    std::vector<double> get_vertices() const;
+
+    /**
+     * @brief Get a constant reference to the array of _vertices, without copying it
+     *
+     * @return const std::vector<double>&
+     */
+    const std::vector<double> & vertices() const;
+
+    /**
+     * @brief Returns a flat copy of the state of the diagram (s0 and vertices)
+     * 
+     * @return DiagramSnapshot 
+     */
+    DiagramSnapshot snapshot() const;
+
+    /**
+     * @brief Copies the state of the diagram into an existing snapshot, reusing its memory (no allocation if its capacity is enough)
+     * 
+     * @param snapshot snapshot overwritten with the state of the diagram
+     */
+    void snapshot_into(DiagramSnapshot & snapshot) const;
+
+    /**
+     * @brief Sets the state of the diagram (s0 and vertices) to a snapshot, e.g. taken from another diagram with the same beta,
+     * keeping the parameters and the random number generator. No memory is allocated if the capacity of the array is enough.
+     * Throws an std::invalid_argument exception if the snapshot is not valid for the beta of the diagram.
+     * 
+     * @param snapshot state of the diagram
+     */
+    void restore(const DiagramSnapshot & snapshot);
+
+    /**
+     * @brief Returns the acceptance rate for the ADD_SEGMENT update for the given parameters (same expression of Diagram_core)
+     *
+     * @param tau1      time of the first vertex of the segment to be added
+     * @param tau2      time of the second vertex of the segment to be added
+     * @param tau2max   maximum value of tau2 for the random extraction
+     * @param new_segment_spin spin of the segment to be added
+     * @return double
+     */
+    double acceptance_rate_add(double tau1, double tau2, double tau2max, double new_segment_spin) const;
+
+    /**
+     * @brief Returns the acceptance rate for the REMOVE_SEGMENT update for the given parameters (same expression of Diagram_core)
+     *
+     * @param tau1      time of the first vertex of the segment to be removed
+     * @param tau2      time of the second vertex of the segment to be removed
+     * @param tau2max   maximum value of tau2 for the random extraction
+     * @param segment_toberemoved_spin spin of the segment to be removed
+     * @return double
+     */
+    double acceptance_rate_remove(double tau1, double tau2, double tau2max, double segment_toberemoved_spin) const;
+
+    /**
+     * @brief Returns the acceptance rate for the SPIN_FLIP update (same expression of Diagram_core)
+     *
+     * @return double
+     */
+    double acceptance_rate_flip() const;
+
+    /**
+     * @brief Attemps the ADD_SEGMENT update for the current status of the diagram,
+     * using the three random numbers given in input. Same decisions of Diagram_core::attempt_add_segment.
+     *
+     * @param RN1 Random number for the extraction of tau1, must be in range [0, 1]
+     * @param RN2 Random number for the extraction of tau2, must be in range [0, 1]
+     * @param RNacc Random number for the acceptance, should be in range [0,1]
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_add_segment(double RN1, double RN2, double RNacc);
+
+    /**
+     * @brief Attemps the REMOVE_SEGMENT update for the current status of the diagram,
+     * using the two random numbers given in input. Same decisions of Diagram_core::attempt_remove_segment.
+     *
+     * @param RN1 Random number for the extraction of first vertex, must be in range [0, 1]
+     * @param RNacc Random number for the acceptance, should be in range [0,1]
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_remove_segment(double RN1, double RNacc);
+
+    /**
+     * @brief Attemps the SPIN_FLIP update for the current status of the diagram,
+     * using the random number given in input. Same decisions of Diagram_core::attempt_spin_flip.
+     *
+     * @param RNacc Random number for the acceptance, should be in range [0,1]
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_spin_flip(double RNacc);
+
+    /**
+     * @brief Attemps the delayed-rejection ADD_SEGMENT update. Same decisions of Diagram_core::attempt_add_segment_delayed.
+     *
+     * @param RN1 Random number for the extraction of tau1, must be in range [0, 1]
+     * @param RN2 Random number for the extraction of tau2, must be in range [0, 1]
+     * @param RNacc Random number for the acceptance of the first stage, should be in range [0,1]
+     * @param RNacc2 Random number for the acceptance of the second stage, should be in range [0,1]
+     * @return true if update was accepted (in either stage),
+     * @return false if update was rejected
+     */
+    bool attempt_add_segment_delayed(double RN1, double RN2, double RNacc, double RNacc2);
+
+    /**
+     * @brief Attemps the delayed-rejection REMOVE_SEGMENT update. Same decisions of Diagram_core::attempt_remove_segment_delayed.
+     *
+     * @param RN1 Random number for the extraction of first vertex, must be in range [0, 1]
+     * @param RNacc Random number for the acceptance, should be in range [0,1]
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_remove_segment_delayed(double RN1, double RNacc);
+
+};
+
+
+/**
+ * @class FlatDiagram
+ *
+ * @brief Optimized counterpart of Diagram, adding the random number generation to FlatDiagram_core.
+ * For the same seed, it extracts the random numbers in the same order of Diagram.
+ */
+class FlatDiagram: public FlatDiagram_core
+{
+
+    private:
+        std::uniform_real_distribution<double> _uniform_dist; ///< uniform distribution for random number generation
+        std::mt19937 _mt_generator;                           ///< Mersenne-Twister random number generator
+
+
+    public:
+
+    /**
+     * @brief Construct a new FlatDiagram object, setting its defining parameters. The array of vertices is optional:
+     * by default it is the 0-th order diagram [0]-------[beta].
+     * Optionally, a seed for the Mersenne-Twister random number generator can be explicitly set.
+     *
+     * @param beta       Length of the diagram (here representing the thermondinamical beta = 1/T). Must be > 0.
+     * @param s0         Spin of the 0-th segment of the diagram [0---t1]. Must be +1 or -1.
+     * @param H          Value of the longitudinal component of magnetic field
+     * @param GAMMA      Value of the transversal component of magnetic field. Must be != 0.
+     * @param vertices   (optional) Array containing the times of diagram _vertices, with t1<t2<t3... (they need to be already sorted)
+     * @param seed       (optional) Seed to initialize the random number generator
+     */
+    FlatDiagram(double beta, int s0, double H, double GAMMA,
+        std::vector<double> vertices=std::vector<double>(),
+        unsigned int seed = std::chrono::system_clock::now().time_since_epoch().count());
+
+    using FlatDiagram_core::operator/ ;
+
+    /**
+     * @brief Attemps the ADD_SEGMENT update for the current status of the diagram.
+     *
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_add_segment();
+
+    /**
+     * @brief Attemps the REMOVE_SEGMENT update for the current status of the diagram.
+     *
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_remove_segment();
+
+    /**
+     * @brief Attemps the SPIN_FLIP update for the current status of the diagram.
+     *
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_spin_flip();
+
+    /**
+     * @brief Attemps the delayed-rejection ADD_SEGMENT update, extracting four random numbers as Diagram::attempt_add_segment_delayed.
+     *
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_add_segment_delayed();
+
+    /**
+     * @brief Attemps the delayed-rejection REMOVE_SEGMENT update for the current status of the diagram.
+     *
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_remove_segment_delayed();
+
+    /**
+     * @brief Reset all diagram parameters with the new values.
+     *
+     * @param beta       Length of the diagram (here representing the thermondinamical beta = 1/T). Must be > 0.
+     * @param s0         Spin of the 0-th segment of the diagram [0---t1]. Must be +1 or -1.
+     * @param H          Value of the longitudinal component of magnetic field
+     * @param GAMMA      Value of the transversal component of magnetic field. Must be != 0.
+     * @param vertices   (optional) Array containing the times of diagram _vertices, with t1<t2<t3... < _beta (they need to be already sorted)
+     * @param seed       (optional) Seed to initialize the random number generator
+     */
+    void reset_diagram(double beta, int s0, double H, double GAMMA,
+        std::vector<double> vertices=std::vector<double>(),
+        unsigned int seed = std::chrono::system_clock::now().time_since_epoch().count());
+
+};
@@ -0,0 +1,148 @@
+/**
+ * @file kernel_benchmark.h
+ * @brief Header file of the kernel benchmark, which compares the single-stage and delayed-rejection updates on both diagram engines,
+ * and measures the cost of the statistics collected at every step of the chains
+ */
+
+#pragma once
+
+#include <diagmc/simulation.h>
+#include <nlohmann/json.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+using json = nlohmann::json;
+
+//base seed of the runs of the benchmark if not set in the settings, so that the chains are the same on every machine
+#define KERNEL_BENCHMARK_SEED_DEFAULT 20261018
+#define KERNEL_BENCHMARK_OUTPUT_FILE_DEFAULT "kernels.csv"
+#define ACCUMULATOR_BENCHMARK_OUTPUT_FILE_DEFAULT "accumulators.csv"
+
+
+/**
+ * @brief Measurements of a run of the kernel benchmark: one parameter point, with one engine and one variant of the updates
+ */
+struct KernelBenchmarkPoint
+{
+    double beta = 0;                        ///< length of the diagram
+    double H = 0;                           ///< longitudinal component of the magnetic field
+    double GAMMA = 0;                       ///< transversal component of the magnetic field
+    DiagramEngine engine = DiagramEngine::LIST; ///< storage engine of the diagram
+    bool delayed_rejection = false;         ///< delayed-rejection (true) or single-stage (false) ADD_SEGMENT and REMOVE_SEGMENT
+    unsigned long long N_steps = 0;         ///< number of Markov chain steps
+    unsigned long long N_draws = 0;         ///< number of random numbers drawn by the steps
+    unsigned long long N_accepted = 0;      ///< number of accepted updates (of all types)
+    double acceptance_add = 0;              ///< fraction of the ADD_SEGMENT updates that were accepted
+    double acceptance_remove = 0;           ///< fraction of the REMOVE_SEGMENT updates that were accepted
+    double accepted_per_draw = 0;           ///< accepted updates per random number drawn
+    double ns_per_step = 0;                 ///< run time of the Markov chain per step, in nanoseconds
+    double accepted_per_ns = 0;             ///< accepted updates per nanosecond of run time
+    double ESS_per_second_sigmax = 0;       ///< effective samples of sigma_x per second of run time
+    double ESS_per_second_sigmaz = 0;       ///< effective samples of sigma_z per second of run time
+};
+
+
+/**
+ * @brief Cost of the statistics collected at every step of a chain, on the samples of a chain at one parameter point
+ */
+struct AccumulatorBenchmarkPoint
+{
+    double beta = 0;                        ///< length of the diagram
+    double H = 0;                           ///< longitudinal component of the magnetic field
+    double GAMMA = 0;                       ///< transversal component of the magnetic field
+    unsigned long long N_samples = 0;       ///< number of samples
+    double ns_per_step = 0;                 ///< time per step of the chain producing the samples (updates only, flat engine), in nanoseconds
+    double ns_per_sample_baseline = 0;      ///< time per sample of plain double running sums of the order and sigma_z, in nanoseconds
+    double ns_per_sample_statistics = 0;    ///< time per sample of ChainStatistics::add_sample, in nanoseconds
+    double overhead = 0;                    ///< extra time per sample of the statistics over the baseline, relative to ns_per_step
+};
+
+
+/**
+ * @brief Returns the number of random numbers drawn by a run: one to choose each update,
+ * three for each ADD_SEGMENT (four with delayed rejection), two for each REMOVE_SEGMENT and one for each SPIN_FLIP
+ *
+ * @param results results of the run
+ * @param delayed_rejection whether the run used the delayed-rejection updates
+ * @return unsigned long long
+ */
+unsigned long long random_draws(const SingleRunResults & results, bool delayed_rejection);
+
+
+/**
+ * @brief Runs the benchmark of the kernels over the parameter points of the sweep described in settings (CALC_TYPE must be "sweep"):
+ * each point is run with the list and flat engines, with the single-stage and the delayed-rejection updates,
+ * one run at a time on the calling thread. All the runs of a point have the same seeds, derived from the seed in settings
+ * (or from KERNEL_BENCHMARK_SEED_DEFAULT), so that the counts do not depend on the machine and only the timings do.
+ *
+ * @param settings dictionary-like nlohmann::json object, with the settings of the sweep
+ * @return std::vector<KernelBenchmarkPoint> four points (list single-stage, list delayed, flat single-stage, flat delayed) for each parameter point
+ */
+std::vector<KernelBenchmarkPoint> run_kernel_benchmark(const json & settings);
+
+
+/**
+ * @brief Measures the cost of the statistics collected at every step (exact and compensated sums, histogram of the orders,
+ * binning analyses) on the samples of a chain with the parameters and seeds of the task (flat engine, single-stage updates),
+ * compared with the plain double running sums of the order and sigma_z that they replace.
+ * The optional reweighting and histogram of the sufficient statistics are not included.
+ * The samples are recorded first, and then fed to the two accumulators in separate timed loops.
+ *
+ * @param task parameters of the chain (the N_total_steps - N_thermalization_steps samples after thermalization are used)
+ * @return AccumulatorBenchmarkPoint
+ */
+AccumulatorBenchmarkPoint measure_accumulator_cost(const SimulationTask & task);
+
+
+/**
+ * @brief Runs measure_accumulator_cost on each parameter point of the sweep described in settings (CALC_TYPE must be "sweep"),
+ * with seeds derived from the seed in settings (or from KERNEL_BENCHMARK_SEED_DEFAULT)
+ *
+ * @param settings dictionary-like nlohmann::json object, with the settings of the sweep
+ * @return std::vector<AccumulatorBenchmarkPoint> one point for each run of the sweep
+ */
+std::vector<AccumulatorBenchmarkPoint> run_accumulator_benchmark(const json & settings);
+
+
+/**
+ * @brief Returns a line containing the titles of the columns of the csv report of the benchmark
+ *
+ * @return std::string
+ */
+std::string kernel_benchmark_output_header();
+
+
+/**
+ * @brief Writes one formatted csv line for each point of the benchmark
+ *
+ * @param points points of the benchmark
+ * @param os std::ostream object, e.g. std::ofstream, or std::cout
+ */
+void write_kernel_benchmark_rows(const std::vector<KernelBenchmarkPoint> & points, std::ostream & os);
+
+
+/**
+ * @brief Returns a line containing the titles of the columns of the csv report of the cost of the statistics
+ *
+ * @return std::string
+ */
+std::string accumulator_benchmark_output_header();
+
+
+/**
+ * @brief Writes one formatted csv line for each point of the benchmark of the cost of the statistics
+ *
+ * @param points points of the benchmark
+ * @param os std::ostream object, e.g. std::ofstream, or std::cout
+ */
+void write_accumulator_benchmark_rows(const std::vector<AccumulatorBenchmarkPoint> & points, std::ostream & os);
+
+
+/**
+ * @brief Call the read_settings function to read the settings of a sweep from file, run the kernel benchmark
+ * and the benchmark of the cost of the statistics, print a summary on standard output,
+ * and write the csv reports (kernel_output_file and accumulator_output_file)
+ *
+ * @param settings_filename Name (path) of the json file containing the settings of the sweep
+ */
+void kernel_benchmark(std::string settings_filename);
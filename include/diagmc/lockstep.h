@@ -0,0 +1,79 @@
+/**
+ * @file lockstep.h
+ * @brief Header file of the differential checker, that runs the reference (Diagram_core) and the optimized (FlatDiagram_core) engines
+ * in lockstep with identical random numbers, and reports the first step in which they take different decisions
+ */
+
+#pragma once
+
+#include <diagmc/simulation.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//relative distance of the acceptance random number from the acceptance rate below which a decision is considered borderline,
+//i.e. a different decision can be caused by the rounding of the acceptance rate, and not by a bug
+#define BORDERLINE_TOLERANCE 1e-12
+
+
+/**
+ * @brief State of one of the two engines, before or after a step
+ */
+struct EngineState
+{
+    int s0;                         ///< spin of the 0-th segment of the diagram
+    std::vector<double> vertices;   ///< times of the vertices of the diagram
+    double sum_deltatau;            ///< result of the sum_deltatau method of the engine
+};
+
+
+/**
+ * @brief Outcome of a lockstep check. If the engines diverged, it contains the full context of the first divergence.
+ */
+struct LockstepReport
+{
+    unsigned long long N_steps_checked = 0;     ///< number of steps in which the two engines were compared (divergent step included)
+    unsigned long long N_borderline_steps = 0;  ///< number of steps with an acceptance random number within BORDERLINE_TOLERANCE from the acceptance rate
+    bool diverged = false;                      ///< true if the engines took a different decision, or ended up in a different state
+
+    //context of the first divergence, only meaningful if diverged is true
+    unsigned long long step = 0;                ///< index of the step in which the divergence occurred
+    std::string update;                         ///< name of the attempted update ("add", "remove" or "flip")
+    std::string reason;                         ///< description of the difference between the engines
+    double RN1 = 0;                             ///< first random number of the update
+    double RN2 = 0;                             ///< second random number of the update (only used by "add")
+    double RNacc = 0;                           ///< acceptance random number of the update
+    double reference_acceptance_rate = 0;       ///< acceptance rate of the proposed update, computed by the reference engine
+    double optimized_acceptance_rate = 0;       ///< acceptance rate of the proposed update, computed by the optimized engine
+    bool borderline = false;                    ///< true if RNacc is within BORDERLINE_TOLERANCE from the acceptance rate
+    bool reference_accepted = false;            ///< decision of the reference engine
+    bool optimized_accepted = false;            ///< decision of the optimized engine
+    EngineState state_before;                   ///< common state of the two engines before the step
+    EngineState reference_after;                ///< state of the reference engine after the step
+    EngineState optimized_after;                ///< state of the optimized engine after the step
+};
+
+
+/**
+ * @brief Runs the reference engine (Diagram_core, std::list storage) and the optimized engine (FlatDiagram_core, contiguous storage)
+ * for task.N_total_steps steps, feeding both with the same random numbers through the attempt_*(RN1, RN2, RNacc) overloads.
+ * The update is chosen with the same probabilities of run_simulation, using update_choice_seed, while the random numbers
+ * of the updates are generated from diagram_seed. If task.delayed_rejection is set, the delayed-rejection variants of
+ * ADD_SEGMENT and REMOVE_SEGMENT are compared, with a fourth random number per step (the reported acceptance rate is the one of the first stage).
+ * After every step the decisions, s0, the vertices (within EPSILON) and sum_deltatau (within EPSILON) are compared,
+ * and the check stops at the first divergence.
+ * Throws an std::invalid_argument exception if the parameters of the task are not valid.
+ *
+ * @param task parameters of the run
+ * @return LockstepReport
+ */
+LockstepReport run_lockstep_check(const SimulationTask & task);
+
+
+/**
+ * @brief Writes a human-readable summary of the lockstep check, with the full context of the divergence (if any)
+ *
+ * @param report result of run_lockstep_check
+ * @param os output stream
+ */
+void print_lockstep_report(const LockstepReport & report, std::ostream & os);
@@ -0,0 +1,202 @@
+/**
+ * @file mbar.h
+ * @brief Header file of the multi-histogram (MBAR/WHAM) analysis, which combines the runs of a sweep at the same beta
+ * to evaluate the observables at any (H, GAMMA) in the region covered by the runs
+ */
+
+#pragma once
+
+#include <diagmc/thread_pool.h>
+#include <cstddef>
+#include <vector>
+
+//default number of bins of M = beta*m_z in the histograms of the runs
+#define HISTOGRAM_BINS_DEFAULT 100
+
+//default parameters of the iterative solution of the self-consistency equations
+#define MBAR_TOLERANCE_DEFAULT 1e-10
+#define MBAR_MAX_ITERATIONS_DEFAULT 100000
+
+
+/**
+ * @class SufficientStatisticsHistogram
+ *
+ * @brief Histogram of the sufficient statistics of the diagrams sampled in a run.
+ * At fixed beta, the logarithm of the weight of a diagram is n*log|GAMMA| - H*M, where n is the (even) order
+ * and M = s0*(beta - 2*sum_deltatau) = beta*m_z, so that the pair (n, M) is all that is needed to reweight a sample to other H and GAMMA.
+ * M in [-beta, beta] is divided in N_bins bins, and for each cell (n, bin) the number of samples and the sum of their M are stored,
+ * so that the mean M of the cell can be used as its representative value.
+ */
+class SufficientStatisticsHistogram
+{
+    private:
+
+    double _beta = 1;                           ///< beta of the run
+    unsigned int _N_bins = 0;                   ///< number of bins of M
+    std::vector<unsigned long long> _counts;    ///< number of samples in each cell, with index (n/2)*N_bins + bin
+    std::vector<double> _sum_M;                 ///< sum of M of the samples in each cell
+
+
+    public:
+
+    /**
+     * @brief Construct an empty histogram (no bins), which does not collect samples
+     */
+    SufficientStatisticsHistogram() = default;
+
+    /**
+     * @brief Construct an empty histogram for a run at beta.
+     * Throws an std::invalid_argument exception if beta is not > 0 or N_bins is 0.
+     *
+     * @param beta      Inverse temperature of the run. Must be > 0.
+     * @param N_bins    Number of bins of M. Must be > 0.
+     */
+    SufficientStatisticsHistogram(double beta, unsigned int N_bins);
+
+    /**
+     * @brief Adds a sample to the histogram
+     *
+     * @param order order n of the diagram (even)
+     * @param M value of s0*(beta - 2*sum_deltatau) of the diagram
+     */
+    void add_sample(size_t order, double M);
+
+    /**
+     * @brief Returns the histogram of the diagrams with all the spins flipped, i.e. with M -> -M,
+     * which is the histogram of the corresponding run at -H.
+     *
+     * @return SufficientStatisticsHistogram
+     */
+    SufficientStatisticsHistogram mirrored() const;
+
+    /**
+     * @brief Get the value of beta of the run
+     *
+     * @return double
+     */
+    double get_beta() const;
+
+    /**
+     * @brief Get the number of bins of M
+     *
+     * @return unsigned int
+     */
+    unsigned int get_N_bins() const;
+
+    /**
+     * @brief Get the number of samples in each cell, with index (n/2)*N_bins + bin
+     *
+     * @return const std::vector<unsigned long long>&
+     */
+    const std::vector<unsigned long long> & get_counts() const;
+
+    /**
+     * @brief Get the sum of M of the samples in each cell, with index (n/2)*N_bins + bin
+     *
+     * @return const std::vector<double>&
+     */
+    const std::vector<double> & get_sum_M() const;
+
+    /**
+     * @brief Total number of samples in the histogram
+     *
+     * @return unsigned long long
+     */
+    unsigned long long N_samples() const;
+};
+
+
+/**
+ * @brief Observables evaluated by the multi-histogram analysis at a point (beta, H, GAMMA)
+ */
+struct MultiHistogramEstimate
+{
+    double sigmax = 0;  ///< estimated magnetization along x
+    double sigmaz = 0;  ///< estimated magnetization along z
+    double ESS = 0;     ///< effective sample size of the weights of the samples at the point: small values mean the point is not covered by the runs
+};
+
+
+/**
+ * @class MultiHistogramSolver
+ *
+ * @brief Combines the histograms of K runs at the same beta and different (H_k, GAMMA_k), solving the self-consistency
+ * equations of the multi-histogram method (MBAR, equivalent to WHAM on the cells of the histograms) for the logarithms g_k
+ * of the partition functions:
+ * g_k = log sum_c N_c exp(u_k(c)) / sum_j N_j exp(u_j(c) - g_j),
+ * where the sums run over the non-empty cells c, N_c is the total number of samples in the cell, N_j the number of samples of run j,
+ * and u_k(c) = n_c log|GAMMA_k| - H_k M_c is the log-weight of the cell for run k. g_0 is fixed to 0.
+ * All the sums are computed in log scale (log-sum-exp), on contiguous arrays of cells, split in chunks among the threads of a pool.
+ * The chunks have a fixed size and their partial sums are merged in a fixed order, so the results do not depend on the number of threads.
+ */
+class MultiHistogramSolver
+{
+    private:
+
+    double _beta;                               ///< common beta of the runs
+    std::vector<double> _log_GAMMA;             ///< log|GAMMA_k| of each run
+    std::vector<double> _H;                     ///< H_k of each run
+    std::vector<double> _log_N_samples;         ///< log(N_k), logarithm of the number of samples of each run
+    std::vector<double> _cell_order;            ///< order n of each non-empty cell
+    std::vector<double> _cell_M;                ///< mean M of each non-empty cell
+    std::vector<double> _cell_log_count;        ///< logarithm of the total number of samples in each non-empty cell
+    std::vector<double> _cell_log_denominator;  ///< log sum_j N_j exp(u_j(c) - g_j) for each non-empty cell
+    std::vector<double> _g;                     ///< logarithms of the partition functions of the runs, with g_0 = 0
+    ThreadPool & _pool;                         ///< pool of threads used for the sums over the cells
+
+
+    /**
+     * @brief Updates _cell_log_denominator with the current values of _g, in parallel over the chunks of cells
+     */
+    void update_denominators();
+
+    /**
+     * @brief Returns, for each point k, log sum_c exp(log_count(c) + n_c log_GAMMA_k - H_k M_c - log_denominator(c)),
+     * with a single pass over the cells, in parallel over the chunks of cells
+     *
+     * @param log_GAMMA log|GAMMA| of each point
+     * @param H longitudinal field of each point
+     * @return std::vector<double>
+     */
+    std::vector<double> log_sums_over_cells(const std::vector<double> & log_GAMMA, const std::vector<double> & H) const;
+
+
+    public:
+
+    /**
+     * @brief Construct the solver from the histograms of the runs and their fields. The histograms must have the same beta and number of bins.
+     * Throws an std::invalid_argument exception if the sizes of the inputs do not match, or the histograms are not compatible or empty.
+     *
+     * @param histograms    histograms of the runs
+     * @param H             longitudinal field of each run
+     * @param GAMMA         transverse field of each run. Must be != 0.
+     * @param pool          pool of threads used by the solver. It must not be used by the caller during the calls to the solver.
+     */
+    MultiHistogramSolver(const std::vector<SufficientStatisticsHistogram> & histograms, const std::vector<double> & H, const std::vector<double> & GAMMA, ThreadPool & pool);
+
+    /**
+     * @brief Solves the self-consistency equations by fixed-point iteration, until the maximum change of the g_k is below tolerance.
+     *
+     * @param tolerance (optional) convergence threshold on the change of the g_k
+     * @param max_iterations (optional) maximum number of iterations
+     * @return int number of iterations performed
+     */
+    int solve(double tolerance = MBAR_TOLERANCE_DEFAULT, int max_iterations = MBAR_MAX_ITERATIONS_DEFAULT);
+
+    /**
+     * @brief Get the logarithms g_k of the partition functions of the runs (relative to the first run)
+     *
+     * @return const std::vector<double>&
+     */
+    const std::vector<double> & log_partition_functions() const;
+
+    /**
+     * @brief Evaluates the magnetizations at (H, GAMMA), at the beta of the runs, reweighting all the samples of all the runs.
+     * It must be called after solve.
+     *
+     * @param H longitudinal field
+     * @param GAMMA transverse field. Must be != 0.
+     * @return MultiHistogramEstimate
+     */
+    MultiHistogramEstimate evaluate(double H, double GAMMA) const;
+};
@@ -0,0 +1,229 @@
+/**
+ * @file measurements.h
+ * @brief Header file of the asynchronous measurement pipeline, in which the Markov chain pushes decimated snapshots of the diagram
+ * to measurement threads that accumulate the expensive observables (correlation function, histogram of the segment lengths)
+ */
+
+#pragma once
+
+#include <diagmc/ring_buffer.h>
+#include <diagmc/accumulators.h>
+#include <diagmc/diagram_snapshot.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//defaults of the options of the measurement pipeline
+#define MEASURE_INTERVAL_DEFAULT 100
+#define N_MEASUREMENT_THREADS_DEFAULT 1
+#define MEASUREMENT_BUFFER_SIZE_DEFAULT 1024
+
+
+/**
+ * @brief Options of the measurement pipeline of a run. The pipeline is enabled if at least one of the observables has bins.
+ */
+struct MeasurementOptions
+{
+    unsigned int correlation_bins = 0;                              ///< number of points tau in [0, beta) of the correlation function (0 to not measure it)
+    unsigned int segment_length_bins = 0;                           ///< number of bins in [0, beta] of the histogram of the segment lengths (0 to not measure it)
+    unsigned long long measure_interval = MEASURE_INTERVAL_DEFAULT; ///< number of steps between two snapshots sent to the pipeline
+    unsigned int N_measurement_threads = N_MEASUREMENT_THREADS_DEFAULT; ///< number of measurement threads consuming the snapshots
+    size_t buffer_size = MEASUREMENT_BUFFER_SIZE_DEFAULT;           ///< capacity of the ring buffer of each measurement thread (power of 2)
+    bool drop_when_full = false;                                    ///< if true, snapshots are dropped when the buffer is full; otherwise the chain waits
+
+    /**
+     * @brief Returns true if at least one observable is measured
+     *
+     * @return bool
+     */
+    bool enabled() const { return correlation_bins > 0 || segment_length_bins > 0; }
+};
+
+
+/**
+ * @brief Observables accumulated by the measurement pipeline during a run
+ */
+struct MeasuredObservables
+{
+    std::vector<double> tau;                        ///< imaginary times of the correlation function, (i + 0.5) * beta / correlation_bins
+    std::vector<double> correlation_zz;             ///< average of (1/beta) * integral of sigma_z(t) sigma_z(t + tau) dt over the snapshots
+    std::vector<double> segment_length;             ///< centers of the bins of the histogram of the segment lengths
+    std::vector<double> segment_length_density;     ///< normalized histogram (probability density) of the lengths of the segments
+    unsigned long long N_snapshots = 0;             ///< number of snapshots measured
+    unsigned long long N_dropped = 0;               ///< number of snapshots dropped because the buffers were full
+};
+
+
+/**
+ * @class MeasurementPipeline
+ *
+ * @brief Pipeline between the thread of the Markov chain (producer) and N_measurement_threads measurement threads.
+ * Each measurement thread owns a SpscRingBuffer of snapshots, and the producer distributes the snapshots among them round-robin.
+ * When the buffer of the next thread is full, the snapshot is either dropped (drop_when_full) or the producer waits (backpressure).
+ * A measurement thread with an empty buffer, and the producer waiting for a full one, sleep on a condition variable instead of spinning,
+ * so that idle measurement threads do not take the cores of the chains. The other side takes the lock to wake them up only when they are asleep,
+ * so pushing and popping stay lock-free while the buffer is neither empty nor full.
+ * Each measurement thread accumulates its own partial observables, which are merged by finish().
+ * The sums are exact (BoundedExactSum), so the results do not depend on the number of measurement threads.
+ */
+class MeasurementPipeline
+{
+    private:
+
+    /**
+     * @brief Private state of a measurement thread, aligned to the cache line.
+     * The partial sums are accumulated in memory allocated by the measurement thread itself,
+     * and stored here only when the thread terminates, so that the threads never write to shared cache lines.
+     */
+    struct alignas(CACHE_LINE_SIZE) Consumer
+    {
+        SpscRingBuffer<DiagramSnapshot> buffer;     ///< snapshots waiting to be measured
+        std::vector<BoundedExactSum> correlation_sum; ///< sum over the snapshots of the correlation function (set at the end)
+        std::vector<unsigned long long> segment_length_counts; ///< counts of the histogram of the segment lengths (set at the end)
+        unsigned long long N_snapshots = 0;         ///< number of snapshots measured (set at the end)
+        std::thread thread;                         ///< measurement thread
+        std::mutex mutex;                           ///< taken only to sleep, and to wake up a sleeping side
+        std::condition_variable not_empty;          ///< notified when a snapshot is pushed to a sleeping measurement thread, or at the end
+        std::condition_variable not_full;           ///< notified when a slot is freed for the sleeping producer
+        std::atomic<bool> consumer_sleeping{false}; ///< true while the measurement thread sleeps on not_empty
+        std::atomic<bool> producer_sleeping{false}; ///< true while the producer sleeps on not_full
+
+        explicit Consumer(size_t capacity) : buffer(capacity) {}
+
+        /**
+         * @brief Producer side: wakes up the measurement thread after commit_push, if it is asleep.
+         * The fence orders the publication of the snapshot with the read of the flag, and pairs with the one in wait_for_snapshot,
+         * so that either the producer sees the flag or the measurement thread sees the snapshot.
+         */
+        void notify_pushed()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (consumer_sleeping.load(std::memory_order_relaxed))
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                not_empty.notify_one();
+            }
+        }
+
+        /**
+         * @brief Producer side: sleeps until a slot of the full buffer is freed, and returns it
+         *
+         * @return DiagramSnapshot* slot where the next snapshot can be written
+         */
+        DiagramSnapshot * wait_for_slot()
+        {
+            DiagramSnapshot * slot = nullptr;
+            std::unique_lock<std::mutex> lock(mutex);
+            producer_sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            not_full.wait(lock, [&]() { return (slot = buffer.try_begin_push()) != nullptr; });
+            producer_sleeping.store(false, std::memory_order_relaxed);
+            return slot;
+        }
+    };
+
+    double _beta;                                   ///< length of the diagrams
+    MeasurementOptions _options;                    ///< options of the pipeline
+    std::vector<std::unique_ptr<Consumer>> _consumers; ///< measurement threads, with their buffers
+    alignas(CACHE_LINE_SIZE) std::atomic<bool> _done{false}; ///< set by finish() to stop the measurement threads once the buffers are empty (read by all of them)
+    alignas(CACHE_LINE_SIZE) size_t _next_consumer = 0;     ///< consumer that receives the next snapshot (round-robin), written by the producer
+    unsigned long long _N_dropped = 0;              ///< number of snapshots dropped
+    bool _finished = false;                         ///< true after finish() was called
+
+
+    /**
+     * @brief Main loop of a measurement thread: measures the snapshots of its buffer until finish() is called and the buffer is empty
+     *
+     * @param consumer state of the thread
+     */
+    void consumer_loop(Consumer & consumer);
+
+    /**
+     * @brief Stops the measurement threads once their buffers are empty, waking up the sleeping ones, and joins them
+     */
+    void stop_consumers();
+
+    /**
+     * @brief Accumulates the observables of a snapshot into the partial sums of a measurement thread
+     *
+     * @param snapshot diagram to be measured
+     * @param correlation_sum sum over the snapshots of the correlation function
+     * @param segment_length_counts counts of the histogram of the segment lengths
+     */
+    void measure(const DiagramSnapshot & snapshot, std::vector<BoundedExactSum> & correlation_sum, std::vector<unsigned long long> & segment_length_counts) const;
+
+
+    public:
+
+    /**
+     * @brief Construct the pipeline for diagrams of length beta, and start the measurement threads.
+     * Throws an std::invalid_argument exception if the options are not valid.
+     *
+     * @param beta length of the diagrams. Must be > 0.
+     * @param options options of the pipeline
+     */
+    MeasurementPipeline(double beta, const MeasurementOptions & options);
+
+    /**
+     * @brief Stops the measurement threads (if finish was not called)
+     */
+    ~MeasurementPipeline();
+
+    MeasurementPipeline(const MeasurementPipeline &) = delete;
+    MeasurementPipeline & operator=(const MeasurementPipeline &) = delete;
+
+    /**
+     * @brief Producer side: sends a snapshot of the diagram to the next measurement thread.
+     * The vertices are copied in place into a preallocated slot of its buffer.
+     *
+     * @param s0 spin of the 0-th segment of the diagram
+     * @param vertices_begin iterator to the first vertex of the diagram
+     * @param vertices_end iterator past the last vertex of the diagram
+     */
+    template <class Iterator>
+    void push(int s0, Iterator vertices_begin, Iterator vertices_end)
+    {
+        Consumer & consumer = *_consumers[_next_consumer];
+        _next_consumer = (_next_consumer + 1) % _consumers.size();
+
+        DiagramSnapshot * slot = consumer.buffer.try_begin_push();
+        if (slot == nullptr)
+        {
+            if (_options.drop_when_full)
+            {
+                ++_N_dropped;
+                return;
+            }
+            slot = consumer.wait_for_slot(); //backpressure: sleep until the measurement thread frees a slot
+        }
+
+        slot->s0 = s0;
+        slot->vertices.assign(vertices_begin, vertices_end);
+        consumer.buffer.commit_push();
+        consumer.notify_pushed();
+    }
+
+    /**
+     * @brief Waits for all the snapshots to be measured, stops the measurement threads, and returns the merged observables
+     *
+     * @return MeasuredObservables
+     */
+    MeasuredObservables finish();
+};
+
+
+/**
+ * @brief Imaginary-time correlation function of a single diagram, (1/beta) * integral over [0, beta] of sigma_z(t) sigma_z(t + tau) dt,
+ * where sigma_z(t) is the spin of the segment containing t, periodic with period beta.
+ *
+ * @param s0 spin of the 0-th segment of the diagram
+ * @param vertices times of the vertices of the diagram
+ * @param beta length of the diagram
+ * @param tau imaginary time, in [0, beta]
+ * @return double
+ */
+double diagram_correlation_zz(int s0, const std::vector<double> & vertices, double beta, double tau);
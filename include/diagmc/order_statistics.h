@@ -0,0 +1,82 @@
+/**
+ * @file order_statistics.h
+ * @brief Header file of the histogram of the diagram orders sampled by a run, resolved with the average sigma_z at each order
+ */
+
+#pragma once
+
+#include <diagmc/accumulators.h>
+#include <cstddef>
+#include <vector>
+
+
+/**
+ * @brief Distribution of the orders of the diagrams sampled by a run, with the average sigma_z estimator at each order.
+ * The orders are always even, so the element i refers to the order 2*i.
+ */
+struct OrderDistribution
+{
+    std::vector<unsigned long long> counts;     ///< number of samples with order 2*i
+    std::vector<double> sigmaz;                 ///< average sigma_z estimator of the samples with order 2*i (0 if there are none)
+
+    /**
+     * @brief Total number of samples
+     *
+     * @return unsigned long long
+     */
+    unsigned long long N_samples() const;
+
+    /**
+     * @brief Returns the p-quantile of the order, i.e. the smallest order n such that a fraction >= p of the samples has order <= n.
+     * It is exact, since the whole distribution is stored. Returns 0 if there are no samples.
+     * Throws an std::invalid_argument exception if p is not in (0, 1].
+     *
+     * @param p probability, in (0, 1]
+     * @return unsigned long long
+     */
+    unsigned long long quantile(double p) const;
+};
+
+
+/**
+ * @class OrderHistogram
+ *
+ * @brief Accumulator of the OrderDistribution of a run, updated at every measured step.
+ * The histogram grows with the maximum order reached, so its memory is O(max order), and each sample costs
+ * an increment and a (blocked) addition. add_sample is defined inline, since it is called in the hot loop of the chain.
+ */
+class OrderHistogram
+{
+    private:
+
+    std::vector<unsigned long long> _counts;    ///< number of samples with order 2*i
+    std::vector<BlockedSum> _sum_mz;            ///< sum of the sigma_z estimators of the samples with order 2*i
+
+
+    public:
+
+    /**
+     * @brief Adds a sample to the histogram
+     *
+     * @param order order of the diagram (even)
+     * @param mz sigma_z estimator of the diagram
+     */
+    void add_sample(size_t order, double mz)
+    {
+        size_t index = order / 2;
+        if (index >= _counts.size())
+        {
+            _counts.resize(index + 1, 0);
+            _sum_mz.resize(index + 1);
+        }
+        ++_counts[index];
+        _sum_mz[index].add(mz);
+    }
+
+    /**
+     * @brief Returns the distribution of the orders, with the average sigma_z at each order
+     *
+     * @return OrderDistribution
+     */
+    OrderDistribution distribution() const;
+};
@@ -0,0 +1,92 @@
+/**
+ * @file planner.h
+ * @brief Header file of the dry-run planner, which estimates run time, output size and memory of a calculation without running it
+ */
+
+#pragma once
+
+#include <diagmc/simulation.h>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+using json = nlohmann::json;
+
+
+/**
+ * @brief Linear cost model for the Markov Chain loop: the time per step is modelled as
+ * ns_per_step = ns_per_step_base + ns_per_step_per_order * (average diagram order),
+ * since the updates and the measurement walk the list of vertices.
+ */
+struct CostModel
+{
+    double ns_per_step_base;       ///< time per step (in nanoseconds) for a 0-th order diagram
+    double ns_per_step_per_order;  ///< additional time per step (in nanoseconds) for each vertex of the diagram
+
+    /**
+     * @brief Returns the predicted time per step (in nanoseconds) for the given average diagram order
+     *
+     * @param average_order expected average order of the diagram during the run
+     * @return double
+     */
+    double ns_per_step(double average_order) const;
+};
+
+
+/**
+ * @brief Calibrates the cost model by running a short built-in benchmark of run_simulation
+ * on a few parameter points with increasing average diagram order, and fitting
+ * the measured ns per step with a straight line (least squares).
+ *
+ * @return CostModel
+ */
+CostModel calibrate_cost_model();
+
+
+/**
+ * @brief Returns an estimate of the maximum order reached by the diagram during a run,
+ * as the quantile of the exact order distribution that is exceeded on average once in the whole run
+ *
+ * @param task parameters of the run
+ * @return double
+ */
+double expected_max_diagram_order(const SimulationTask & task);
+
+
+/**
+ * @brief Returns an estimate of the memory (in bytes) used by the diagram and the random number generator of a run
+ * when the diagram reaches expected_max_diagram_order: with the list engine, one node of std::list<double> per vertex;
+ * with the flat engine, 8 bytes per vertex of the capacity of the std::vector, which grows by doubling.
+ *
+ * @param task parameters of the run (including the engine)
+ * @return double
+ */
+double predicted_diagram_memory(const SimulationTask & task);
+
+
+/**
+ * @brief Returns the wall time needed to execute the tasks with the given durations on n_threads workers,
+ * assigning each task (longest first) to the worker that becomes free first.
+ *
+ * @param task_times Duration of each task
+ * @param n_threads Number of workers (must be > 0)
+ * @return double
+ */
+double predicted_makespan(std::vector<double> task_times, int n_threads);
+
+
+/**
+ * @brief Enumerates the tasks of the calculation described in settings, and prints on standard output
+ * the predicted wall time for different numbers of threads, the size of the output file and
+ * the peak memory used by the diagrams, without running the simulation.
+ *
+ * @param settings dictionary-like nlohmann::json object, with the settings for running the algorithm
+ */
+void print_plan(const json & settings);
+
+
+/**
+ * @brief Call the read_settings function to read settings from file, and print the plan of the calculation
+ *
+ * @param settings_filename Name (path) of the json file containing the settings for the calculation
+ */
+void plan_calculations(std::string settings_filename);
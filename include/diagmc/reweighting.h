@@ -0,0 +1,83 @@
+/**
+ * @file reweighting.h
+ * @brief Header file of the in-run estimator that reweights the magnetizations measured at beta to other values of beta,
+ * by rescaling the vertex times of the sampled diagrams
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+/**
+ * @brief Magnetizations reweighted to a target beta, with the diagnostics of the reweighting
+ */
+struct ReweightedResult
+{
+    double target_beta = 0;         ///< value of beta to which the samples were reweighted
+    double sigmax = 0;              ///< reweighted magnetization along x
+    double sigmaz = 0;              ///< reweighted magnetization along z
+    double ESS = 0;                 ///< effective sample size (sum w)^2 / sum w^2 of the reweighting factors w
+    double ESS_fraction = 0;        ///< ESS divided by the number of samples: values close to 0 mean that the result is not reliable
+};
+
+
+/**
+ * @class BetaReweighter
+ *
+ * @brief Accumulates, sample by sample, the statistics needed to reweight the magnetizations to a list of target betas.
+ * A diagram at beta with vertices t_i is mapped to a diagram at beta' = lambda*beta with vertices lambda*t_i.
+ * Including the Jacobian lambda^n of the vertex times, the ratio of the weights of the two diagrams is
+ * w = lambda^n * exp(-(lambda - 1) * H * beta * m_z), where n is the order and m_z = s0*(beta - 2*sum_deltatau)/beta is the
+ * sigma_z estimator of the diagram, which is invariant under the rescaling. Then
+ * <sigma_z>_beta' = sum(w m_z) / sum(w) and <sigma_x>_beta' = -sum(w n) / (beta' GAMMA sum(w)).
+ * The sums are accumulated in log scale with a running maximum of log(w) (online log-sum-exp), so that they never overflow.
+ */
+class BetaReweighter
+{
+    private:
+
+    double _beta;                           ///< beta of the simulation
+    double _H;                              ///< longitudinal field
+    double _GAMMA;                          ///< transverse field
+    std::vector<double> _target_betas;      ///< values of beta to which the samples are reweighted
+    std::vector<double> _log_lambda;        ///< log(target_beta/beta) for each target
+    std::vector<double> _field_factor;      ///< -(target_beta/beta - 1) * H * beta for each target
+    std::vector<double> _log_max;           ///< running maximum of log(w) for each target
+    std::vector<double> _sum_w;             ///< sum of w * exp(-log_max) for each target
+    std::vector<double> _sum_w2;            ///< sum of w^2 * exp(-2 log_max) for each target
+    std::vector<double> _sum_w_order;       ///< sum of w * n * exp(-log_max) for each target
+    std::vector<double> _sum_w_mz;          ///< sum of w * m_z * exp(-log_max) for each target
+    unsigned long long _N_samples = 0;      ///< number of samples accumulated
+
+
+    public:
+
+    /**
+     * @brief Construct a new BetaReweighter object for a simulation at (beta, H, GAMMA).
+     * Throws an std::invalid_argument exception if beta or any of the target betas is not > 0.
+     *
+     * @param beta          Inverse temperature of the simulation. Must be > 0.
+     * @param H             Value of the longitudinal component of magnetic field
+     * @param GAMMA         Value of the transversal component of magnetic field. Must be != 0.
+     * @param target_betas  Values of beta to which the samples are reweighted. Must be > 0.
+     */
+    BetaReweighter(double beta, double H, double GAMMA, std::vector<double> target_betas);
+
+    /**
+     * @brief Adds a sample, i.e. the current diagram of the Markov chain
+     *
+     * @param order order n of the diagram
+     * @param mz sigma_z estimator of the diagram, s0*(beta - 2*sum_deltatau)/beta
+     */
+    void add_sample(size_t order, double mz);
+
+    /**
+     * @brief Returns the reweighted magnetizations and the diagnostics for each target beta, in the order of the targets.
+     * If no samples were added, all the values are 0.
+     *
+     * @return std::vector<ReweightedResult>
+     */
+    std::vector<ReweightedResult> results() const;
+};
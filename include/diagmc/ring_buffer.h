@@ -0,0 +1,102 @@
+/**
+ * @file ring_buffer.h
+ * @brief Header file of the SpscRingBuffer class, a lock-free bounded queue between one producer and one consumer thread
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+//size of a cache line, used to keep the indices of the producer and of the consumer on different lines
+#define CACHE_LINE_SIZE 64
+
+
+/**
+ * @class SpscRingBuffer
+ *
+ * @brief Lock-free bounded queue for exactly one producer thread and one consumer thread.
+ * The elements live in preallocated slots, which are written and read in place: once the slots have reached
+ * their steady-state size (e.g. the capacity of a std::vector member), pushing and popping do not allocate memory.
+ * The producer writes into the slot returned by try_begin_push and publishes it with commit_push;
+ * the consumer reads the slot returned by try_front and releases it with pop.
+ *
+ * @tparam T type of the elements, default-constructible
+ */
+template <class T>
+class SpscRingBuffer
+{
+    private:
+
+    std::vector<T> _slots;                                      ///< preallocated elements, used circularly
+    size_t _mask;                                               ///< capacity - 1 (the capacity is a power of 2)
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _head{0};      ///< number of elements pushed (written only by the producer)
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _tail{0};      ///< number of elements popped (written only by the consumer)
+
+
+    public:
+
+    /**
+     * @brief Construct a new ring buffer with the given capacity.
+     * Throws an std::invalid_argument exception if the capacity is not a power of 2.
+     *
+     * @param capacity maximum number of elements in the buffer. Must be a power of 2.
+     */
+    explicit SpscRingBuffer(size_t capacity) : _slots(capacity), _mask(capacity - 1)
+    {
+        if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+            throw std::invalid_argument("the capacity of the ring buffer must be a power of 2.");
+    }
+
+    /**
+     * @brief Producer side: returns the slot where the next element can be written, or nullptr if the buffer is full
+     *
+     * @return T*
+     */
+    T * try_begin_push()
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) == _slots.size()) return nullptr;
+        return &_slots[head & _mask];
+    }
+
+    /**
+     * @brief Producer side: publishes the element written in the slot returned by try_begin_push
+     */
+    void commit_push()
+    {
+        _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Consumer side: returns the oldest element, or nullptr if the buffer is empty
+     *
+     * @return T*
+     */
+    T * try_front()
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) return nullptr;
+        return &_slots[tail & _mask];
+    }
+
+    /**
+     * @brief Consumer side: releases the slot returned by try_front, making it available to the producer
+     */
+    void pop()
+    {
+        _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Maximum number of elements in the buffer
+     *
+     * @return size_t
+     */
+    size_t capacity() const
+    {
+        return _slots.size();
+    }
+};
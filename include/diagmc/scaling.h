@@ -0,0 +1,116 @@
+/**
+ * @file scaling.h
+ * @brief Header file of the scaling benchmark, which measures the strong and weak scaling of a sweep with the number of threads
+ */
+
+#pragma once
+
+#include <diagmc/simulation.h>
+#include <nlohmann/json.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+using json = nlohmann::json;
+
+//base seed of the runs of the benchmark if not set in the settings, so that the workload is the same on every machine
+#define SCALING_SEED_DEFAULT 20261018
+#define SCALING_OUTPUT_FILE_DEFAULT "scaling.csv"
+#define SCALING_JSON_FILE_DEFAULT "scaling.json"
+
+
+/**
+ * @brief Measurements of the execution of a set of runs with a given number of threads
+ */
+struct ScalingPoint
+{
+    std::string mode;               ///< "strong" (same runs for every number of threads) or "weak" (runs proportional to the threads)
+    int N_threads = 0;              ///< number of worker threads
+    size_t N_runs = 0;              ///< number of runs executed
+    unsigned long long N_steps = 0; ///< total number of Markov chain steps of the runs
+    double wall_time = 0;           ///< wall time (in seconds) to execute all the runs and write their rows
+    double throughput = 0;          ///< Markov chain steps per second of wall time
+    double speedup = 0;             ///< throughput relative to the point with 1 thread of the same mode
+    double efficiency = 0;          ///< speedup divided by the number of threads
+    double latency_p50 = 0;         ///< median of the run times (in seconds) of the Markov chains of the runs
+    double latency_p99 = 0;         ///< 99th percentile of the run times (in seconds)
+    double latency_max = 0;         ///< maximum of the run times (in seconds)
+    double writer_time = 0;         ///< time (in seconds) spent by the main thread formatting and writing the rows of the results
+    double writer_fraction = 0;     ///< writer_time divided by wall_time
+};
+
+
+/**
+ * @brief Returns the tasks of the weak scaling point with N_threads threads: N_threads copies of the tasks,
+ * with seeds derived from the base seed and from the index of each run, as in a sweep with a fixed seed
+ * (the first copy has the same seeds of the sweep).
+ * Throws an std::invalid_argument exception if N_threads < 1.
+ *
+ * @param tasks tasks of the sweep
+ * @param N_threads number of threads (and of copies)
+ * @param base_seed base seed of the sweep
+ * @return std::vector<SimulationTask>
+ */
+std::vector<SimulationTask> weak_scaling_tasks(const std::vector<SimulationTask> & tasks, int N_threads, unsigned long long base_seed);
+
+
+/**
+ * @brief Executes the tasks on a pool of N_threads workers, as in a sweep (writing the rows of the results in memory, in order),
+ * and measures wall time, throughput, run times and time spent writing the rows. The mode, speedup and efficiency are not set.
+ * Throws an std::invalid_argument exception if N_threads < 1.
+ *
+ * @param tasks tasks to be executed
+ * @param N_threads number of worker threads
+ * @param interleaved_chains number of runs interleaved on each worker
+ * @param pin_threads pin the workers to the cores
+ * @return ScalingPoint
+ */
+ScalingPoint measure_scaling_point(const std::vector<SimulationTask> & tasks, int N_threads, unsigned int interleaved_chains = 1, bool pin_threads = false);
+
+
+/**
+ * @brief Runs the strong and weak scaling benchmark of the sweep described in settings (CALC_TYPE must be "sweep"),
+ * for each number of threads in scaling_threads (by default the powers of 2 up to the number of hardware threads,
+ * and the number of hardware threads itself; 1 is always included, as reference for the speedup).
+ * The seeds are derived from the seed in settings, or from SCALING_SEED_DEFAULT.
+ *
+ * @param settings dictionary-like nlohmann::json object, with the settings of the sweep
+ * @return std::vector<ScalingPoint> the strong scaling points, followed by the weak scaling points
+ */
+std::vector<ScalingPoint> run_scaling_benchmark(const json & settings);
+
+
+/**
+ * @brief Returns a line containing the titles of the columns of the csv report of the benchmark
+ *
+ * @return std::string
+ */
+std::string scaling_output_header();
+
+
+/**
+ * @brief Writes one formatted csv line for each point of the benchmark
+ *
+ * @param points points of the benchmark
+ * @param os std::ostream object, e.g. std::ofstream, or std::cout
+ */
+void write_scaling_rows(const std::vector<ScalingPoint> & points, std::ostream & os);
+
+
+/**
+ * @brief Returns the json report of the benchmark: the description of the machine (hardware threads, SIMD kernels),
+ * the base seed, the number of tasks of the sweep, and the points
+ *
+ * @param points points of the benchmark
+ * @param settings settings of the sweep
+ * @return json
+ */
+json scaling_report(const std::vector<ScalingPoint> & points, const json & settings);
+
+
+/**
+ * @brief Call the read_settings function to read the settings of a sweep from file, run the scaling benchmark,
+ * print a summary on standard output, and write the csv (scaling_output_file) and json (scaling_json_file) reports
+ *
+ * @param settings_filename Name (path) of the json file containing the settings of the sweep
+ */
+void scaling_benchmark(std::string settings_filename);
@@ -0,0 +1,59 @@
+/**
+ * @file server.h
+ * @brief Header file of the daemon mode, in which a long-lived process receives jobs on a local socket and runs them on a warm thread pool
+ */
+
+#pragma once
+
+#include <diagmc/thread_pool.h>
+#include <functional>
+#include <ostream>
+#include <string>
+
+//lines terminating the response to a job
+#define JOB_DONE_LINE "#done"
+#define JOB_ERROR_PREFIX "#error "
+
+
+/**
+ * @brief Executes a single job, i.e. a json object with the same keys of the settings file (except output_file),
+ * sending back the result rows line by line as soon as they are available.
+ * The response consists of the header line of the csv, one line per run, and a final "#done" line.
+ * Only the CALC_TYPEs "single", "sweep" and "convergence-test", whose results are the rows of the runs, are supported.
+ * If the job is not valid (including the other CALC_TYPEs), or a run fails, the response is terminated by a "#error <message>" line instead.
+ *
+ * @param job json string describing the job, on a single line
+ * @param pool pool of worker threads that execute the runs of the job
+ * @param send_line function called with each line of the response (without the trailing newline)
+ */
+void handle_job(const std::string & job, ThreadPool & pool, std::function<void(const std::string &)> send_line);
+
+
+/**
+ * @brief Starts the server, listening on a Unix domain socket at socket_path for jobs, one per line.
+ * Each job is executed by handle_job on a thread pool that is created once at startup, and the response is streamed back.
+ * Multiple jobs can be sent on the same connection, and multiple clients can be connected at the same time.
+ * Each connection is served by its own thread, which is joined as soon as the connection is closed, so that the server
+ * can run for any number of connections. The job {"command": "status"} is answered with the line "connections <n>",
+ * the number of connection threads not yet joined (including its own), followed by "#done".
+ * The server returns when it receives the job {"command": "shutdown"}.
+ * Throws an std::runtime_error if the socket cannot be created, or if sockets are not supported on this platform.
+ *
+ * @param socket_path path of the Unix domain socket
+ * @param n_threads number of worker threads of the pool
+ */
+void run_server(const std::string & socket_path, int n_threads);
+
+
+/**
+ * @brief Local client for the server: sends the job to the server listening at socket_path,
+ * and writes the rows of the response to out.
+ * Throws an std::runtime_error if the connection to the server fails.
+ *
+ * @param socket_path path of the Unix domain socket of the server
+ * @param job json string describing the job, on a single line
+ * @param out stream where the csv rows (header included) are written
+ * @return true if the job was completed successfully,
+ * @return false if the server returned an error, which is printed on standard error
+ */
+bool submit_job(const std::string & socket_path, const std::string & job, std::ostream & out);
@@ -7,13 +7,28 @@
 
 #pragma once
 
+#include <diagmc/simulation.h>
+#include <diagmc/thread_pool.h>
 #include <nlohmann/json.hpp>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
 using json = nlohmann::json;
 
+//tolerance on the parameters used to detect the points related by symmetry
+#define SYMMETRY_TOLERANCE 1e-9
+
+//default number of points of the Green's function measured by the worm algorithm
+#define GREENS_FUNCTION_BINS_DEFAULT 20
+
+//default number of chains interleaved on each worker (also used by the server mode)
+#define INTERLEAVED_CHAINS_DEFAULT 1
+
 
 /**
  * @brief Check that all keys in list_of_keys are present in settings, otherwise 
- * terminate the program with EXIT_FAILURE
+ * throw an std::invalid_argument exception
  * 
  * @param settings dictionary-like nlohmann::json object, with the settings for running the algorithm
  * @param list_of_keys List of strings containing the keys whose presence in settings dictionary has to be checked
@@ -26,7 +41,7 @@ void check_required_keys_presence(const json &  settings, std::vector<std::strin
  * returns a vector of linearly spaced values from min to max (spaced by step).
  * If "which"_min, "which"_max and "which"_step are not present but "which" is,
  * returns a vector with the single value specified by the setting parameter "which".
- * If both previous conditions are not satisfied, terminates the program with EXIT_FAILURE
+ * If both previous conditions are not satisfied, throws an std::invalid_argument exception
  * 
  * @param settings dictionary-like nlohmann::json object, with the settings for running the algorithm
  * @param which Name of the parameter for the algorithm, e.g. "H", or "GAMMA"
@@ -40,7 +55,7 @@ std::vector<double> range_generator(const json &  settings, std::string which);
  * returns a vector of log10-spaced values from min to max (with points_per_decade between each power of 10).
  * If "which"_min, "which"_max and "which"_step are not present but "which" is,
  * returns a vector with the single value specified by the setting parameter "which".
- * If both previous conditions are not satisfied, terminates the program with EXIT_FAILURE
+ * If both previous conditions are not satisfied, throws an std::invalid_argument exception
  * 
  * @param settings dictionary-like nlohmann::json object, with the settings for running the algorithm
  * @param which Name of the parameter for the algorithm, e.g. "N_total_steps"
@@ -57,6 +72,110 @@ std::vector<double> log_range_generator(const json & settings, std::string which
 void print_progress_bar(double progress);
 
 
+/**
+ * @brief Derives the seed of a run from a base seed and an index (e.g. of the run and of the generator),
+ * with the splitmix64 mixing function, so that different indices give statistically independent seeds.
+ * 
+ * @param base_seed base seed of the calculation
+ * @param index index of the seed
+ * @return unsigned long long 
+ */
+unsigned long long derive_seed(unsigned long long base_seed, unsigned long long index);
+
+
+/**
+ * @brief Returns the indices 0..n-1 in van der Corput order: sorted by the value of their bits reversed (on the bits needed for n-1).
+ * Every prefix of the sequence is spread almost uniformly over the range, and each further power of 2 of indices halves the gaps,
+ * e.g. 0, 4, 2, 1, 3 for n = 5.
+ * 
+ * @param n number of indices
+ * @return std::vector<size_t>
+ */
+std::vector<size_t> van_der_corput_order(size_t n);
+
+
+/**
+ * @brief Returns the points of a grid in coarse-to-fine order, as flat indices of the nested order (the last axis varying fastest).
+ * The position of each index in the van der Corput order of its axis defines its refinement level (0 for the first position,
+ * then floor(log2(position)) + 1), and the points are sorted by the largest level of their indices, keeping the nested order
+ * within the same level. The points run first form a coarse grid over the whole range of every axis, which is then refined.
+ * 
+ * @param axis_sizes number of values of each axis of the grid
+ * @return std::vector<size_t>
+ */
+std::vector<size_t> progressive_grid_order(const std::vector<size_t> & axis_sizes);
+
+
+/**
+ * @brief Returns the list of all the runs (with their parameters) that the calculation described in settings
+ * is going to execute, in the same order in which they are executed and written to the output file.
+ * Seeds that are not fixed in settings are assigned here, based on the system clock.
+ * In "sweep" and "mbar" mode, if a base seed is given with "seed", the seeds of the runs are derived from it (see derive_seed).
+ * In "sweep" and "mbar" mode, with "task_order": "progressive" the parameter points are enumerated in coarse-to-fine order
+ * (see progressive_grid_order) instead of the nested order of the loops over beta, H and GAMMA ("nested", default);
+ * the seeds derived from "seed" do not depend on the order.
+ * In "sweep" and "mbar" mode, if a "target_error" is given, the runs of each point (samples_per_point >= 2) share a ConvergenceMonitor,
+ * with the threshold "rhat_threshold" (RHAT_THRESHOLD_DEFAULT if not given).
+ * If required keys are missing, or CALC_TYPE is not valid, throws an std::invalid_argument exception
+ * 
+ * @param settings dictionary-like nlohmann::json object, with the settings for running the algorithm
+ * @return std::vector<SimulationTask> one entry per run
+ */
+std::vector<SimulationTask> enumerate_tasks(const json & settings);
+
+
+/**
+ * @brief Detects the tasks that are related by the symmetries H -> -H and GAMMA -> -GAMMA (see SingleRunResults::mirrored),
+ * returning for each task the index of the task whose run provides its results.
+ * The first task enumerated for each set of points related by symmetry is the canonical one, and is its own source.
+ * The k-th sample of a mirrored point is obtained from the k-th run of the canonical point, if it exists, so that
+ * different samples of the same point are never obtained from the same run.
+ * Parameters are compared with a tolerance SYMMETRY_TOLERANCE, and the sources always precede the tasks they provide.
+ * Only tasks with the same engine, flip probability and kernels (delayed rejection) are related, so that after an autotuning
+ * that differs between two mirrored points each of them is run with its own parameters.
+ * 
+ * @param tasks parameters of the runs
+ * @return std::vector<size_t> index of the source of each task
+ */
+std::vector<size_t> symmetry_sources(const std::vector<SimulationTask> & tasks);
+
+
+/**
+ * @brief Executes the runs on the workers of the pool, calling on_result with the results of each run,
+ * in the same order of the tasks, as soon as they are available.
+ * With use_symmetries, only the canonical tasks (see symmetry_sources) are run, and the results of the other ones are
+ * synthesized from them. These are marked as synthesized, and are not statistically independent from their source.
+ * With interleaved_chains > 1, consecutive runs are grouped in batches of interleaved_chains runs, whose chains are
+ * interleaved on the same worker (see run_simulation_interleaved); the results are the same, only the run time changes.
+ * The runs sharing a convergence monitor (the chains of a point) are never interleaved: each of them is executed in parallel with the others,
+ * in slices (see ResumableRun), and is parked, releasing its worker, while it waits for the other chains at a report of the monitor.
+ * Exceptions thrown by a run are propagated when its result is collected.
+ * Throws an std::invalid_argument exception if interleaved_chains is 0.
+ * 
+ * @param tasks parameters of the runs
+ * @param pool pool of worker threads that execute the runs
+ * @param on_result function called (in the calling thread) with the results of each run
+ * @param use_symmetries (optional) obtain the points related by symmetry from the canonical ones, instead of running them
+ * @param interleaved_chains (optional) number of chains interleaved on each worker
+ */
+void run_tasks(const std::vector<SimulationTask> & tasks, ThreadPool & pool, std::function<void(const SingleRunResults &)> on_result, bool use_symmetries = false, unsigned int interleaved_chains = 1);
+
+
+/**
+ * @brief Executes the runs as a TaskGraph on the workers of the pool, with warm starts: each run continues the final diagram
+ * of the same sample (k-th run) of the previous point with the same beta and H (e.g. the previous GAMMA of a sweep), 
+ * so that the runs along the last axis of the grid form a chain of dependencies, while the different chains run in parallel.
+ * The other runs start from the 0-th order diagram. on_result is called with the results of each run, in the same order of the tasks,
+ * by one worker at a time (not necessarily the calling thread).
+ * Throws an std::invalid_argument exception if a task has a convergence monitor, since the chains of a point are not run concurrently.
+ * 
+ * @param tasks parameters of the runs
+ * @param pool pool of worker threads that execute the runs
+ * @param on_result function called with the results of each run
+ */
+void run_tasks_warm_started(const std::vector<SimulationTask> & tasks, ThreadPool & pool, std::function<void(const SingleRunResults &)> on_result);
+
+
 /**
  * @brief Read settings for the simulation from json file, and returns them as a json dictionary-like object
  * If file cannot be opened, or it is not correctly parsed, or the "CALC_TYPE" key is missing,
@@ -82,6 +201,7 @@ void single_run(const json & settings);
  * sweeping the range between the min and max values indicated in settings,
  * with the step value also specified in settings.
  * If min/max/step values for more than one parameter are provided, all combinations are calculated.
+ * The runs are executed in parallel on N_threads worker threads (1 by default).
  * The results are written in a csv file, with each row corresponding to a single run.
  * 
  * @param settings dictionary-like nlohmann::json object, with the settings for running the algorithm
@@ -102,7 +222,40 @@ void convergence_test(const json & settings);
 
 
 /**
- * @brief Call the read_settings function to read settings from file, and select which calculation to run
+ * @brief Runs a sweep as the sweep function, additionally collecting the histograms of the sufficient statistics of each run
+ * (with histogram_bins bins). Then, for each beta of the sweep, combines the runs with the multi-histogram method (MultiHistogramSolver),
+ * and evaluates the magnetizations on the grid of H_eval and GAMMA_eval values (given as single values or with _min, _max and _step),
+ * writing them in the csv file mbar_output_file, together with the exact values and the effective sample size.
+ * 
+ * @param settings dictionary-like nlohmann::json object, with the settings for running the algorithm
+ */
+void mbar_analysis(const json & settings);
+
+
+/**
+ * @brief Runs the reference and the optimized engines of the diagram in lockstep, with the parameters, N_total_steps and seeds
+ * of a single run, printing the first divergence (with its full context) on standard output.
+ * If the engines diverged, terminates the program with EXIT_FAILURE.
+ *
+ * @param settings dictionary-like nlohmann::json object, with the settings for running the algorithm
+ */
+void lockstep_check(const json & settings);
+
+
+/**
+ * @brief Runs the worm algorithm (run_worm_simulation) with the parameters, N_total_steps, N_thermalization_steps and seeds of a single run,
+ * measuring <sigma_x(0) sigma_x(tau)> on greens_function_bins points (default GREENS_FUNCTION_BINS_DEFAULT) with the optional worm_weight
+ * and worm_update_probability (default WORM_UPDATE_PROBABILITY_DEFAULT),
+ * writing one row per point in the csv file output_file (with the exact values), and printing a summary on standard output.
+ *
+ * @param settings dictionary-like nlohmann::json object, with the settings for running the algorithm
+ */
+void worm_calculation(const json & settings);
+
+
+/**
+ * @brief Call the read_settings function to read settings from file, and select which calculation to run.
+ * If the settings are not valid, terminates the program with EXIT_FAILURE
  * 
  * @param settings_filename Name (path) of the json file containing the settings for the calculation
  */
@@ -0,0 +1,113 @@
+/**
+ * @file simd.h
+ * @brief Header file of the SIMD kernels used in the hot loop of the FlatDiagram engine, with their runtime dispatch.
+ * Each kernel has a scalar, an SSE2, an AVX2 and an AVX-512 variant, compiled in the same binary:
+ * the variant is selected at startup according to the instruction sets supported by the CPU,
+ * so that the same executable runs on all the machines, using the widest vectors available.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+//number of elements below which the searches stop bisecting and count the elements with vector comparisons
+#define SIMD_SEARCH_BLOCK 32
+
+//name of the environment variable that limits the instruction set of the kernels (e.g. DIAGMC_SIMD=avx2)
+#define SIMD_ENVIRONMENT_VARIABLE "DIAGMC_SIMD"
+
+
+/**
+ * @brief Instruction sets of the variants of the kernels, in increasing order of vector width
+ */
+enum class SimdLevel
+{
+    SCALAR,     ///< plain C++, for any CPU
+    SSE2,       ///< 128-bit vectors (2 doubles)
+    AVX2,       ///< 256-bit vectors (4 doubles)
+    AVX512      ///< 512-bit vectors (8 doubles)
+};
+
+
+/**
+ * @brief Returns the name of the instruction set ("scalar", "sse2", "avx2" or "avx512")
+ *
+ * @param level instruction set
+ * @return std::string
+ */
+std::string simd_level_name(SimdLevel level);
+
+
+/**
+ * @brief Returns the instruction set with the given name (the inverse of simd_level_name).
+ * Throws an std::invalid_argument exception if the name is not valid.
+ *
+ * @param name "scalar", "sse2", "avx2" or "avx512"
+ * @return SimdLevel
+ */
+SimdLevel parse_simd_level(const std::string & name);
+
+
+/**
+ * @brief Returns the widest instruction set supported by the CPU (always SCALAR on non-x86 architectures)
+ *
+ * @return SimdLevel
+ */
+SimdLevel supported_simd_level();
+
+
+/**
+ * @brief Returns the instruction set of the kernels in use. At startup, it is the widest supported by the CPU,
+ * limited by the environment variable SIMD_ENVIRONMENT_VARIABLE if set (an invalid value is ignored).
+ *
+ * @return SimdLevel
+ */
+SimdLevel selected_simd_level();
+
+
+/**
+ * @brief Selects the instruction set of the kernels. It should be called before starting the runs.
+ * Throws an std::invalid_argument exception if the instruction set is not supported by the CPU.
+ *
+ * @param level instruction set
+ */
+void select_simd_level(SimdLevel level);
+
+
+/**
+ * @brief Returns the index of the first element of the sorted array greater than x (as std::upper_bound),
+ * using the selected variant of the kernel. All the variants return the same index.
+ *
+ * @param data sorted array
+ * @param n number of elements of the array
+ * @param x value to search
+ * @return size_t index in [0, n]
+ */
+size_t simd_upper_bound(const double * data, size_t n, double x);
+
+
+/**
+ * @brief Returns the index of the first element of the sorted array not less than x (as std::lower_bound),
+ * using the selected variant of the kernel. All the variants return the same index.
+ *
+ * @param data sorted array
+ * @param n number of elements of the array
+ * @param x value to search
+ * @return size_t index in [0, n]
+ */
+size_t simd_lower_bound(const double * data, size_t n, double x);
+
+
+/**
+ * @brief Same as simd_upper_bound, with an explicit instruction set (for testing and benchmarks).
+ * Throws an std::invalid_argument exception if the instruction set is not supported by the CPU.
+ */
+size_t simd_upper_bound(const double * data, size_t n, double x, SimdLevel level);
+
+
+/**
+ * @brief Same as simd_lower_bound, with an explicit instruction set (for testing and benchmarks).
+ * Throws an std::invalid_argument exception if the instruction set is not supported by the CPU.
+ */
+size_t simd_lower_bound(const double * data, size_t n, double x, SimdLevel level);
@@ -8,8 +8,25 @@
 #pragma once
 
 #include <diagmc/diagram.h>
+#include <diagmc/reweighting.h>
+#include <diagmc/mbar.h>
+#include <diagmc/measurements.h>
+#include <diagmc/ring_buffer.h> //CACHE_LINE_SIZE
+#include <diagmc/accumulators.h>
+#include <diagmc/order_statistics.h>
+#include <diagmc/convergence.h>
 #include <ostream>
 #include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+//probability of attempting the SPIN_FLIP update at each step, if not tuned (the three updates are equally likely)
+#define FLIP_PROBABILITY_DEFAULT (1./3)
+//by default the ADD_SEGMENT and REMOVE_SEGMENT updates are the single-stage ones
+#define DELAYED_REJECTION_DEFAULT false
 
 
 /**
@@ -45,10 +62,25 @@ class SingleRunResults
     unsigned long long int N_attempted_removesegment = 0;   ///< Number of times the REMOVE_SEGMENT update was attempted
     unsigned long long int N_accepted_removesegment = 0;    ///< Number of times the REMOVE_SEGMENT update was accepted
     unsigned long long int max_diagram_order = 0;           ///< Maximum diagram order during the whole run
-    unsigned long long int avg_diagram_order = 0;           ///< Average diagram order during the whole run
+    double avg_diagram_order = 0;                           ///< Average diagram order during the whole run
     unsigned long long int run_time = 0;                    ///< Execution time (in nanoseconds) for the Markov Chain loop (not the program run time)
     double measured_sigmax = 0;                             ///< Final value of the magnetization along x calculated through the MCMC algorithm
     double measured_sigmaz = 0;                             ///< Final value of the magnetization along z calculated through the MCMC algorithm
+    double error_sigmax = 0;                                ///< Statistical error of measured_sigmax, from the binning analysis of the samples
+    double error_sigmaz = 0;                                ///< Statistical error of measured_sigmaz, from the binning analysis of the samples
+    double ESS_sigmax = 0;                                  ///< Effective number of independent samples of sigma_x
+    double ESS_sigmaz = 0;                                  ///< Effective number of independent samples of sigma_z
+    bool synthesized = false;                               ///< True if the results were obtained by symmetry from another run, instead of being simulated
+    double R_hat = 0;                                       ///< R-hat of the chains of the parameter point when the run ended (0 if not monitored)
+    bool stopped_early = false;                             ///< True if the run was stopped by its convergence monitor before N_total_steps
+    double flip_probability = FLIP_PROBABILITY_DEFAULT;     ///< Probability of attempting the SPIN_FLIP update (possibly chosen by the autotuner)
+    bool delayed_rejection = DELAYED_REJECTION_DEFAULT;     ///< True if the run used the delayed-rejection segment updates (possibly chosen by the autotuner)
+    std::vector<ReweightedResult> reweighted;               ///< Magnetizations reweighted to the reweight_betas of the run (empty if not requested)
+    SufficientStatisticsHistogram histogram;                ///< Histogram of the order and of beta*m_z of the samples (empty if not requested)
+    MeasuredObservables observables;                        ///< Observables measured asynchronously on the snapshots of the diagram (empty if not requested)
+    OrderDistribution order_distribution;                   ///< Distribution of the sampled orders, with the average sigma_z at each order
+    DiagramSnapshot final_diagram;                          ///< Diagram at the end of the chain, to continue it (empty if not requested with keep_final_diagram)
+    std::thread::id worker_thread;                          ///< Thread that started the Markov chain (not written to the output)
 
 
 
@@ -77,6 +109,22 @@ class SingleRunResults
         );
 
 
+    /**
+     * @brief Returns the results of the run transformed by the symmetries of the model, marked as synthesized.
+     * Flipping all the spins maps a chain at H (starting from initial_s0) to a chain at -H (starting from -initial_s0),
+     * changing the sign of sigma_z. Since the weights depend on GAMMA only through even powers, the chain at -GAMMA is the same,
+     * and only the sign of the sigma_x estimator changes. The statistics of the updates and of the diagram order are unchanged,
+     * and the histogram of the samples is mirrored in M -> -M when H is flipped.
+     * The measured observables (sigma_z correlation function and segment lengths) are invariant under both symmetries,
+     * and the sigma_z resolved by order changes sign when H is flipped, as well as the spin s0 of the final diagram.
+     * 
+     * @param flip_H apply H -> -H
+     * @param flip_GAMMA apply GAMMA -> -GAMMA
+     * @return SingleRunResults 
+     */
+    SingleRunResults mirrored(bool flip_H, bool flip_GAMMA) const;
+
+
     /**
      * @brief Prints a summary of the result of the run on the terminal standard output
      * 
@@ -84,6 +132,16 @@ class SingleRunResults
     void print_results() const;
 
 
+    /**
+     * @brief Returns the efficiency of the run for an observable: its effective number of independent samples
+     * per second of run time of the Markov chain (0 if the run time is 0)
+     * 
+     * @param ESS effective sample size of the observable (ESS_sigmax or ESS_sigmaz)
+     * @return double 
+     */
+    double ESS_per_second(double ESS) const;
+
+
     /**
      * @brief Returns a line containing the titles of the columns of the output file
      * 
@@ -92,6 +150,57 @@ class SingleRunResults
     static std::string ostream_output_header();
 
 
+    /**
+     * @brief Returns a line containing the titles of the columns of the reweighting output file
+     * 
+     * @return std::string 
+     */
+    static std::string reweighted_output_header();
+
+
+    /**
+     * @brief Writes one formatted line for each of the reweighted results of the run, with the parameters of the run,
+     * the reweighted and exact magnetizations at the target beta, and the effective sample size of the reweighting
+     * 
+     * @param os std::ostream object, e.g. std::ofstream, or std::cout
+     */
+    void write_reweighted_rows(std::ostream & os) const;
+
+
+    /**
+     * @brief Returns a line containing the titles of the columns of the observables output file
+     * 
+     * @return std::string 
+     */
+    static std::string observables_output_header();
+
+
+    /**
+     * @brief Writes one formatted line for each point of the measured observables of the run,
+     * with the parameters of the run and, for the correlation function, the exact value
+     * 
+     * @param os std::ostream object, e.g. std::ofstream, or std::cout
+     */
+    void write_observables_rows(std::ostream & os) const;
+
+
+    /**
+     * @brief Returns a line containing the titles of the columns of the order distribution output file
+     * 
+     * @return std::string 
+     */
+    static std::string order_output_header();
+
+
+    /**
+     * @brief Writes one formatted line for each order sampled by the run, with the parameters of the run,
+     * the number and fraction of the samples with that order, and their average sigma_z
+     * 
+     * @param os std::ostream object, e.g. std::ofstream, or std::cout
+     */
+    void write_order_rows(std::ostream & os) const;
+
+
     /**
      * @brief Output stream operator to write a single formatted line with all the parameters and results of the simulation
      * 
@@ -104,6 +213,93 @@ class SingleRunResults
 };
 
 
+/**
+ * @brief Counters and running sums updated at every step of a Markov chain.
+ * The sums keep full precision for chains of any length (up to ~1e16 measures).
+ * They are owned by the chain, in a block aligned to (and padded to a multiple of) the cache line, so that the chains
+ * running on different threads never write to the same cache line (no false sharing). They are copied into the
+ * SingleRunResults of the run only at the end of the chain, by store_results.
+ */
+struct alignas(CACHE_LINE_SIZE) ChainStatistics
+{
+    unsigned long long int N_measures = 0;                  ///< number of samples collected
+    unsigned long long int N_attempted_flips = 0;           ///< number of SPIN_FLIP updates attempted
+    unsigned long long int N_accepted_flips = 0;            ///< number of SPIN_FLIP updates accepted
+    unsigned long long int N_attempted_addsegment = 0;      ///< number of ADD_SEGMENT updates attempted
+    unsigned long long int N_accepted_addsegment = 0;       ///< number of ADD_SEGMENT updates accepted
+    unsigned long long int N_attempted_removesegment = 0;   ///< number of REMOVE_SEGMENT updates attempted
+    unsigned long long int N_accepted_removesegment = 0;    ///< number of REMOVE_SEGMENT updates accepted
+    unsigned long long int max_order = 0;                   ///< maximum order of the sampled diagrams
+    unsigned long long int sum_order = 0;                   ///< sum of the orders of the sampled diagrams (exact, since the orders are integers)
+    BlockedSum sum_mz;                                      ///< sum of the sigma_z estimators of the sampled diagrams, with bounded rounding error
+    OrderHistogram orders;                                  ///< histogram of the sampled orders, with the sum of sigma_z at each order
+    BinningAnalysis binning_mz;                             ///< binning analysis of the sigma_z estimators, for their error
+    BinningAnalysis binning_order;                          ///< binning analysis of the orders, for the error of sigma_x
+
+    /**
+     * @brief Adds a sample of the chain to the sums, the histogram of the orders and the binning analyses (N_measures is not changed)
+     * 
+     * @param order order of the sampled diagram
+     * @param mz sigma_z estimator of the sampled diagram
+     */
+    void add_sample(size_t order, double mz)
+    {
+        sum_order += order;
+        sum_mz.add(mz);
+        orders.add_sample(order, mz);
+        binning_mz.add(mz);
+        binning_order.add(order);
+        max_order = max_order > order ? max_order : order;
+    }
+
+    /**
+     * @brief Writes the statistics and the final magnetizations into the results of the run
+     * 
+     * @param results results of the run
+     * @param beta inverse temperature of the run
+     * @param GAMMA transverse field of the run
+     */
+    void store_results(SingleRunResults & results, double beta, double GAMMA) const;
+};
+
+
+/**
+ * @brief Storage engine of the diagram used by the Markov chain. Both engines take the same decisions for the same random numbers.
+ */
+enum class DiagramEngine
+{
+    LIST,   ///< reference engine (Diagram), storing the vertices in a std::list
+    FLAT    ///< optimized engine (FlatDiagram), storing the vertices in a contiguous sorted array
+};
+
+
+/**
+ * @brief Plain container for the input parameters of a single run of the MCMC algorithm,
+ * used to enumerate the runs of a calculation before executing them.
+ */
+struct SimulationTask
+{
+    double beta;                                    ///< length of the diagram (here representing 1/T). Must be > 0.
+    int initial_s0;                                 ///< spin of the 0-th segment of the diagram [0---t1] at the beginning of the simulation
+    double H;                                       ///< value of the longitudinal component of magnetic field
+    double GAMMA;                                   ///< value of the transversal component of magnetic field. Must be != 0.
+    unsigned long long int N_total_steps;           ///< total number of steps of the MCMC algorithm
+    unsigned long long int N_thermalization_steps;  ///< number of initial steps for which statistics is not collected
+    unsigned long long int update_choice_seed;      ///< seed for the random number generator to choose WHICH update to attempt
+    unsigned long long int diagram_seed;            ///< seed for the diagram, used INSIDE the updates
+    DiagramEngine engine = DiagramEngine::LIST;     ///< storage engine of the diagram
+    std::vector<double> reweight_betas;             ///< values of beta to which the magnetizations are reweighted (none by default)
+    unsigned int histogram_bins = 0;                ///< number of bins of the sufficient statistics histogram (0 to not collect it)
+    MeasurementOptions measurements;                ///< options of the asynchronous measurement pipeline (disabled by default)
+    double flip_probability = FLIP_PROBABILITY_DEFAULT; ///< probability of attempting SPIN_FLIP at each step (ADD_SEGMENT and REMOVE_SEGMENT share the rest). Must be in (0, 1).
+    std::shared_ptr<ConvergenceMonitor> monitor;    ///< convergence monitor shared by the chains of the parameter point (null to always run N_total_steps)
+    unsigned int monitor_chain = 0;                 ///< index of the chain in its monitor
+    std::optional<DiagramSnapshot> initial_diagram; ///< diagram from which the chain starts, e.g. the end of another chain (the 0-th order diagram with initial_s0 if not set)
+    bool keep_final_diagram = false;                ///< store the diagram at the end of the chain in the results, to continue it
+    bool delayed_rejection = DELAYED_REJECTION_DEFAULT; ///< use the delayed-rejection variants of ADD_SEGMENT and REMOVE_SEGMENT
+};
+
+
 /**
  * @brief Runs the Markov Chain Diagrammatic Monte Carlo algorithm for the 2-level spin sistem, with the given parameters,
  * returning the results statistics
@@ -116,6 +312,10 @@ class SingleRunResults
  * @param N_thermalization_steps  Number of initial steps for which statistics is not collected
  * @param update_choice_seed  (optional) Seed for the Mersenne-Twister random number generator to choose WHICH update to attempt.
  * @param diagram_seed (optional) Seed for the diagram, used INSIDE the updates
+ * @param engine (optional) Storage engine of the diagram. The results do not depend on it, only the run time does.
+ * @param reweight_betas (optional) Values of beta to which the magnetizations are reweighted during the run (see BetaReweighter)
+ * @param histogram_bins (optional) Number of bins of the sufficient statistics histogram of the samples (see SufficientStatisticsHistogram), 0 to not collect it
+ * @param measurements (optional) Options of the asynchronous measurement pipeline (see MeasurementPipeline), disabled by default
  * @return SingleRunResults 
  */
 SingleRunResults run_simulation(
@@ -126,5 +326,101 @@ SingleRunResults run_simulation(
         unsigned long long int N_total_steps, 
         unsigned long long int N_thermalization_steps,
         unsigned long long int update_choice_seed = std::chrono::system_clock::now().time_since_epoch().count(), 
-        unsigned long long int diagram_seed = std::chrono::system_clock::now().time_since_epoch().count() 
+        unsigned long long int diagram_seed = std::chrono::system_clock::now().time_since_epoch().count(),
+        DiagramEngine engine = DiagramEngine::LIST,
+        const std::vector<double> & reweight_betas = {},
+        unsigned int histogram_bins = 0,
+        const MeasurementOptions & measurements = {}
     );
+
+
+/**
+ * @brief Overload of run_simulation taking all the parameters of the run from a SimulationTask object.
+ * If the task has a convergence monitor, the other chains of its point must run concurrently (see ConvergenceMonitor).
+ * 
+ * @param task parameters of the run
+ * @return SingleRunResults 
+ */
+SingleRunResults run_simulation(const SimulationTask & task);
+
+
+/**
+ * @brief Runs the Markov chains of several independent runs interleaved on the calling thread.
+ * At each round every chain prefetches the memory of its diagram needed by the next step (the first levels of the bisection of the flat engine;
+ * nothing for the list engine, whose walks follow pointers), and then each chain performs its step,
+ * so that the cache misses of a chain overlap with the work of the others (useful for high-order diagrams, whose vertices do not fit in cache).
+ * The results of each run are the same as those of run_simulation with the same task, except for run_time,
+ * which is the time of the interleaved loop divided by the number of chains.
+ * The chains of a parameter point sharing a convergence monitor can be interleaved, and they wait for each other at each report.
+ * Throws an std::invalid_argument exception if the tasks do not all use the same diagram engine.
+ * 
+ * @param tasks parameters of the runs
+ * @return std::vector<SingleRunResults> results of the runs, in the order of the tasks
+ */
+std::vector<SingleRunResults> run_simulation_interleaved(const std::vector<SimulationTask> & tasks);
+
+
+/**
+ * @class ResumableRun
+ *
+ * @brief Run whose Markov chain is executed in slices, possibly on different threads: each slice ends when the chain has completed its steps,
+ * or when it has reported to its convergence monitor an epoch that is not decided yet. In that case the chain is parked,
+ * releasing the thread, and it can be resumed with another slice once the epoch is decided (see ConvergenceMonitor::on_decision),
+ * so that the chains of a monitored point never block a thread while they wait for each other.
+ * The state of the chain is allocated by the first slice, on the thread executing it.
+ * The results are the same as those of run_simulation with the same task, and run_time is the sum of the times of the slices.
+ */
+class ResumableRun
+{
+    public:
+
+    struct Chain;   ///< state of the Markov chain, for either storage engine
+
+
+    private:
+
+    SimulationTask _task;                       ///< parameters of the run
+    std::unique_ptr<Chain> _chain;              ///< state of the chain (null before the first slice)
+    unsigned long long int _run_time = 0;       ///< total time (in nanoseconds) of the slices
+
+
+    public:
+
+    /**
+     * @brief Construct a new ResumableRun object, without allocating the chain
+     *
+     * @param task parameters of the run
+     */
+    explicit ResumableRun(const SimulationTask & task);
+
+    ~ResumableRun();
+
+    /**
+     * @brief Executes a slice of the chain
+     *
+     * @return true if the chain has completed, false if it is parked waiting for the decision on awaited_epoch
+     */
+    bool advance();
+
+    /**
+     * @brief Returns the epoch of the convergence monitor whose decision the parked chain is waiting for
+     *
+     * @return unsigned long long
+     */
+    unsigned long long awaited_epoch() const;
+
+    /**
+     * @brief Returns the parameters of the run
+     *
+     * @return const SimulationTask&
+     */
+    const SimulationTask & task() const;
+
+    /**
+     * @brief Calculates the final results of a completed run.
+     * Throws an std::invalid_argument exception if the run has not completed its steps.
+     *
+     * @return SingleRunResults
+     */
+    SingleRunResults finish();
+};
@@ -0,0 +1,171 @@
+/**
+ * @file task_graph.h
+ * @brief Header file of the TaskGraph class, a scheduler of tasks with dependencies (run chain, continue chain, merge, write),
+ * executed by the workers of a ThreadPool with work stealing
+ */
+
+#pragma once
+
+#include <diagmc/simulation.h>
+#include <diagmc/thread_pool.h>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <vector>
+
+
+/**
+ * @brief Type of a node of a TaskGraph
+ */
+enum class TaskKind
+{
+    RUN_CHAIN,      ///< runs a Markov chain from the initial diagram of its task
+    CONTINUE_CHAIN, ///< runs a Markov chain starting from the final diagram of another chain
+    MERGE,          ///< combines the results of other nodes into new results
+    WRITE,          ///< consumes the results of a node, in the order in which the write nodes were added
+    GENERIC         ///< any other function
+};
+
+
+//identifier of a node of a TaskGraph: its index, in the order in which the nodes were added
+typedef size_t TaskId;
+
+
+/**
+ * @class TaskGraph
+ *
+ * @brief Directed acyclic graph of tasks, in which each node is executed after all the nodes it depends on.
+ * A node can only depend on nodes added before it, so the graph is acyclic by construction.
+ * The chain and merge nodes store their results in the graph, where the nodes depending on them can read them.
+ *
+ * The graph is executed by the workers of a ThreadPool, each with its own deque of ready nodes: a worker takes the
+ * most recently readied node of its own deque (the successors of the node it has just completed, whose inputs are still in its cache),
+ * and when its deque is empty it steals the oldest node from the deques of the other workers, so that all the cores are kept busy
+ * as long as there are ready nodes. The write nodes are chained to each other, so they are executed one at a time in order.
+ */
+class TaskGraph
+{
+
+    private:
+
+    /**
+     * @brief Node of the graph
+     */
+    struct Node
+    {
+        TaskKind kind;                          ///< type of the node
+        std::function<void()> work;             ///< function executed by the node
+        std::vector<TaskId> successors;         ///< nodes depending on this one
+        unsigned int N_dependencies = 0;        ///< number of nodes this one depends on
+    };
+
+    std::vector<Node> _nodes;                                   ///< nodes of the graph
+    std::vector<std::optional<SingleRunResults>> _results;      ///< results of the chain and merge nodes (set when executed)
+    std::vector<double> _beta;                                  ///< beta of the chain nodes (0 for the other nodes)
+    std::optional<TaskId> _last_write;                          ///< last write node added, on which the next one depends
+    unsigned long long _N_steals = 0;                           ///< number of nodes stolen during the last execution
+
+
+    /**
+     * @brief Adds a node, checking its dependencies. Throws an std::invalid_argument exception if a dependency does not exist.
+     */
+    TaskId add_node(TaskKind kind, std::function<void()> work, const std::vector<TaskId> & dependencies);
+
+
+    public:
+
+    /**
+     * @brief Adds a node executing a function, after all the dependencies have been executed.
+     * Throws an std::invalid_argument exception if a dependency is not a node of the graph.
+     *
+     * @param kind type of the node
+     * @param work function executed by the node
+     * @param dependencies nodes that must be executed before this one
+     * @return TaskId identifier of the new node
+     */
+    TaskId add(TaskKind kind, std::function<void()> work, const std::vector<TaskId> & dependencies = {});
+
+    /**
+     * @brief Adds a node running the Markov chain of a task, whose results (including its final diagram) are stored in the graph
+     *
+     * @param task parameters of the run
+     * @param dependencies nodes that must be executed before this one
+     * @return TaskId identifier of the new node
+     */
+    TaskId add_run_chain(const SimulationTask & task, const std::vector<TaskId> & dependencies = {});
+
+    /**
+     * @brief Adds a node running the Markov chain of a task starting from the final diagram of another chain node (warm start),
+     * with the times of the vertices rescaled to the beta of the task. The chain can have different parameters and seeds,
+     * and its N_thermalization_steps steps are performed from the warm diagram.
+     * Throws an std::invalid_argument exception if chain is not a chain node.
+     *
+     * @param chain chain node that is continued
+     * @param task parameters of the run
+     * @param dependencies other nodes that must be executed before this one
+     * @return TaskId identifier of the new node
+     */
+    TaskId add_continue_chain(TaskId chain, const SimulationTask & task, const std::vector<TaskId> & dependencies = {});
+
+    /**
+     * @brief Adds a node combining the results of other chain or merge nodes into new results, stored in the graph.
+     * Throws an std::invalid_argument exception if an input is not a chain or merge node.
+     *
+     * @param inputs chain or merge nodes whose results are combined
+     * @param merge function returning the combined results, from the results of the inputs (in the same order)
+     * @return TaskId identifier of the new node
+     */
+    TaskId add_merge(const std::vector<TaskId> & inputs, std::function<SingleRunResults(const std::vector<SingleRunResults> &)> merge);
+
+    /**
+     * @brief Adds a node passing the results of a chain or merge node to a function, e.g. to write them to file.
+     * The write nodes are executed one at a time, in the order in which they are added.
+     * Throws an std::invalid_argument exception if input is not a chain or merge node.
+     *
+     * @param input chain or merge node whose results are written
+     * @param write function receiving the results
+     * @return TaskId identifier of the new node
+     */
+    TaskId add_write(TaskId input, std::function<void(const SingleRunResults &)> write);
+
+    /**
+     * @brief Get the number of nodes
+     *
+     * @return size_t
+     */
+    size_t size() const;
+
+    /**
+     * @brief Get the type of a node
+     *
+     * @param id identifier of the node
+     * @return TaskKind
+     */
+    TaskKind kind(TaskId id) const;
+
+    /**
+     * @brief Get the results of a chain or merge node.
+     * Throws an std::invalid_argument exception if the node has no results (it is not a chain or merge node, or it was not executed).
+     *
+     * @param id identifier of the node
+     * @return const SingleRunResults&
+     */
+    const SingleRunResults & results(TaskId id) const;
+
+    /**
+     * @brief Executes all the nodes on the workers of the pool, respecting the dependencies, and returns when all of them are completed.
+     * If a node throws an exception, no further node is started, and the first exception is rethrown after the running nodes are completed.
+     * Nodes must not be added during the execution, and it must not be called from a worker of the pool.
+     *
+     * @param pool pool of workers executing the nodes (all of them are used)
+     */
+    void execute(ThreadPool & pool);
+
+    /**
+     * @brief Get the number of nodes that were stolen from the deque of another worker during the last execution
+     *
+     * @return unsigned long long
+     */
+    unsigned long long N_steals() const;
+
+};
@@ -0,0 +1,111 @@
+/**
+ * @file thread_pool.h
+ * @brief Header file of the ThreadPool class, a fixed set of worker threads executing the runs of a calculation
+ */
+
+#pragma once
+
+#include <diagmc/affinity.h>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+/**
+ * @class ThreadPool
+ *
+ * @brief Fixed-size pool of worker threads, which are created once and kept alive ("warm")
+ * to execute the jobs that are submitted to it, in FIFO order.
+ * The destructor waits for all the submitted jobs to be completed before joining the workers.
+ * Optionally, each worker is pinned to a core allowed to the process, spreading the workers over the NUMA nodes
+ * (see plan_worker_placement). The state of a run (diagram, random number generators, accumulators) is allocated
+ * by the worker executing it, so that with the default first-touch policy its memory is on the node of the worker.
+ */
+class ThreadPool
+{
+
+    private:
+
+    std::vector<std::thread> _workers;              ///< worker threads
+    std::queue<std::function<void()>> _jobs;        ///< jobs waiting to be executed
+    std::mutex _mutex;                              ///< mutex protecting the queue of jobs and the _stop flag
+    std::condition_variable _condition;             ///< condition variable to wake up the workers when a job is available
+    bool _stop = false;                             ///< set by the destructor to terminate the workers once the queue is empty
+    std::vector<WorkerPlacement> _placements;       ///< placement of each worker (empty if the workers are not pinned)
+    int _N_started = 0;                             ///< number of workers that have set their affinity (protected by _mutex)
+
+
+    /**
+     * @brief Main loop of each worker thread: sets its affinity (if required), then waits for jobs and executes them, 
+     * until the pool is destroyed
+     *
+     * @param index index of the worker
+     */
+    void worker_loop(int index);
+
+
+    public:
+
+    /**
+     * @brief Construct a new ThreadPool object, starting the worker threads.
+     * With pin_workers, the constructor returns only after every worker has set its affinity,
+     * before executing any job. Throws an std::invalid_argument exception if n_threads < 1.
+     *
+     * @param n_threads Number of worker threads. Must be >= 1.
+     * @param pin_workers (optional) pin each worker to a core, spreading the workers over the NUMA nodes
+     */
+    explicit ThreadPool(int n_threads, bool pin_workers = false);
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+
+    /**
+     * @brief Destroy the ThreadPool object, after waiting that all the submitted jobs have been executed
+     *
+     */
+    ~ThreadPool();
+
+    /**
+     * @brief Get the number of worker threads
+     *
+     * @return int
+     */
+    int size() const;
+
+    /**
+     * @brief Get the placement of the workers on the cores (empty if the workers are not pinned)
+     *
+     * @return const std::vector<WorkerPlacement>&
+     */
+    const std::vector<WorkerPlacement> & placements() const;
+
+    /**
+     * @brief Add a job to the queue. It will be executed by the first available worker.
+     *
+     * @param job function to be executed
+     */
+    void enqueue(std::function<void()> job);
+
+    /**
+     * @brief Submit a function to be executed by the pool, returning a std::future to retrieve its return value
+     * (or the exception it has thrown)
+     *
+     * @param function function (with no arguments) to be executed
+     * @return std::future of the return value of function
+     */
+    template <class Function>
+    auto submit(Function function) -> std::future<decltype(function())>
+    {
+        //the packaged task is shared, since std::function requires a copyable object
+        auto task = std::make_shared<std::packaged_task<decltype(function())()>>(std::move(function));
+        auto future = task->get_future();
+        enqueue([task]() { (*task)(); });
+        return future;
+    }
+
+};
@@ -0,0 +1,301 @@
+/**
+ * @file worm.h
+ * @brief Header file of the WormDiagram_core and WormDiagram classes, which extend the flat engine with the sector of the
+ * configurations with two open worm ends (sigma_x insertions), and of the worm algorithm measuring <sigma_x(0) sigma_x(tau)>
+ */
+
+#pragma once
+
+#include <diagmc/flat_diagram.h>
+#include <diagmc/simulation.h>
+#include <vector>
+#include <random>
+#include <chrono>
+
+
+//defaults of the options of the worm algorithm
+#define WORM_WEIGHT_DEFAULT 1.              //relative weight (eta * beta^2) of the configurations with the worm open
+#define WORM_UPDATE_PROBABILITY_DEFAULT 0.5 //probability of attempting a worm update (insert/remove or move) at each step, if not set in the settings
+#define WORM_BATCHES 32                     //number of batches of the steps used to estimate the errors of the Green's function
+
+
+/**
+ * @class WormDiagram_core
+ *
+ * @brief Diagram of the flat engine with an additional sector of configurations with two open worm ends, head and tail,
+ * at the times tau_head and tau_tail. Each end is an insertion of sigma_x, which flips the spin like a vertex but without the factor GAMMA,
+ * so that the weight of a configuration with the worm open is eta * GAMMA^n * exp(-H * integral of s(t) dt), with n the number of ordinary vertices:
+ * the configurations with the worm open sample beta * eta * <sigma_x(tau_head) sigma_x(tau_tail)> * Z, with Z sampled by the closed ones.
+ * The ends are stored in the array of the vertices together with the ordinary vertices, so the ADD_SEGMENT and SPIN_FLIP updates
+ * of FlatDiagram_core are valid in both sectors, while REMOVE_SEGMENT rejects the segments ending on a worm end.
+ * As for FlatDiagram_core, it contains only the DETERMINISTIC part of the updates, and should not be used directly aside from testing.
+ */
+class WormDiagram_core : public FlatDiagram_core
+{
+
+    protected:
+
+    double _worm_weight;        ///< relative weight of the open configurations, eta * beta^2. Must be > 0.
+    bool _open = false;         ///< true if the worm ends are in the diagram
+    double _tau_head = 0;       ///< time of the head of the worm (if open)
+    double _tau_tail = 0;       ///< time of the tail of the worm (if open)
+
+
+    /**
+     * @brief Returns the integral of the spin s(t) over [tau_min, tau_max], determined by all the vertices (ordinary and worm ends).
+     * The vertices at tau_min and tau_max, if any, are not counted inside the interval.
+     *
+     * @param tau_min beginning of the interval
+     * @param tau_max end of the interval (>= tau_min)
+     * @return double
+     */
+    double spin_integral(double tau_min, double tau_max) const;
+
+    /**
+     * @brief Moves the vertex at time tau_old to tau_new, keeping the array sorted
+     */
+    void move_vertex(double tau_old, double tau_new);
+
+
+    public:
+
+    /**
+     * @brief Construct a new diagram with the worm closed, setting its defining parameters (as for FlatDiagram_core) and the weight of the worm.
+     * Throws an std::invalid_argument exception if worm_weight is not > 0.
+     *
+     * @param beta       Length of the diagram (here representing the thermondinamical $\beta$ = 1/T). Must be > 0.
+     * @param s0         Spin of the 0-th segment of the diagram [0---t1]. Must be +1 or -1.
+     * @param H          Value of the longitudinal component of magnetic field
+     * @param GAMMA      Value of the transversal component of magnetic field. Must be != 0.
+     * @param vertices   (optional) Array containing the times of diagram _vertices, with t1<t2<t3... < _beta (they need to be already sorted)
+     * @param worm_weight (optional) relative weight eta * beta^2 of the configurations with the worm open. Must be > 0.
+     */
+    WormDiagram_core(double beta, int s0, double H, double GAMMA, std::vector<double> vertices=std::vector<double>(),
+        double worm_weight = WORM_WEIGHT_DEFAULT);
+
+    /**
+     * @brief Returns true if the worm is open (the configuration belongs to the Green's function sector)
+     *
+     * @return bool
+     */
+    bool is_open() const;
+
+    /**
+     * @brief Get the time of the head of the worm (meaningful only if it is open)
+     *
+     * @return double
+     */
+    double get_tau_head() const;
+
+    /**
+     * @brief Get the time of the tail of the worm (meaningful only if it is open)
+     *
+     * @return double
+     */
+    double get_tau_tail() const;
+
+    /**
+     * @brief Returns the separation of the worm ends, (tau_tail - tau_head) mod beta, in [0, beta) (meaningful only if it is open)
+     *
+     * @return double
+     */
+    double worm_tau() const;
+
+    /**
+     * @brief Get the number of ordinary vertices, i.e. the order of the diagram without the worm ends
+     *
+     * @return size_t
+     */
+    size_t ordinary_order() const;
+
+    /**
+     * @brief Returns the value ("weight") of the current configuration, including the factor eta of the open worm
+     *
+     * @return double
+     */
+    double value() const;
+
+    /**
+     * @brief Sets the state of the diagram to a snapshot, as FlatDiagram_core::restore, closing the worm
+     *
+     * @param snapshot state of the diagram (without worm ends)
+     */
+    void restore(const DiagramSnapshot & snapshot);
+
+    /**
+     * @brief Returns the acceptance rate for the WORM_INSERT update, which flips the spin between the two new ends
+     *
+     * @param tau_head time of the head to be inserted
+     * @param tau_tail time of the tail to be inserted
+     * @return double
+     */
+    double acceptance_rate_worm_insert(double tau_head, double tau_tail) const;
+
+    /**
+     * @brief Returns the acceptance rate for the WORM_REMOVE update of the current worm
+     *
+     * @return double
+     */
+    double acceptance_rate_worm_remove() const;
+
+    /**
+     * @brief Returns the acceptance rate for the WORM_MOVE update, moving an end from tau_old to tau_new
+     *
+     * @param tau_old current time of the end
+     * @param tau_new proposed time of the end
+     * @return double
+     */
+    double acceptance_rate_worm_move(double tau_old, double tau_new) const;
+
+    /**
+     * @brief Attemps the REMOVE_SEGMENT update, as FlatDiagram_core::attempt_remove_segment, rejecting it right away
+     * if one of the two vertices of the chosen segment is a worm end
+     *
+     * @param RN1 Random number for the extraction of first vertex, must be in range [0, 1]
+     * @param RNacc Random number for the acceptance, should be in range [0,1]
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_remove_segment(double RN1, double RNacc);
+
+    /**
+     * @brief Attemps the WORM_INSERT update (only if the worm is closed): the head and the tail are extracted uniformly in [0, beta]
+     *
+     * @param RN1 Random number for the extraction of tau_head, must be in range [0, 1]
+     * @param RN2 Random number for the extraction of tau_tail, must be in range [0, 1]
+     * @param RNacc Random number for the acceptance, should be in range [0,1]
+     * @return true if update was accepted,
+     * @return false if update was rejected (or the worm was already open)
+     */
+    bool attempt_worm_insert(double RN1, double RN2, double RNacc);
+
+    /**
+     * @brief Attemps the WORM_REMOVE update (only if the worm is open), the reverse of WORM_INSERT
+     *
+     * @param RNacc Random number for the acceptance, should be in range [0,1]
+     * @return true if update was accepted,
+     * @return false if update was rejected (or the worm was closed)
+     */
+    bool attempt_worm_remove(double RNacc);
+
+    /**
+     * @brief Attemps the WORM_MOVE update (only if the worm is open): one of the two ends is moved to a time extracted uniformly in [0, beta],
+     * flipping the spin between the old and the new time
+     *
+     * @param RN1 Random number for the choice of the end (head if < 0.5), must be in range [0, 1]
+     * @param RN2 Random number for the extraction of the new time, must be in range [0, 1]
+     * @param RNacc Random number for the acceptance, should be in range [0,1]
+     * @return true if update was accepted,
+     * @return false if update was rejected (or the worm was closed)
+     */
+    bool attempt_worm_move(double RN1, double RN2, double RNacc);
+
+};
+
+
+/**
+ * @class WormDiagram
+ *
+ * @brief Adds the random number generation to WormDiagram_core, as FlatDiagram does for FlatDiagram_core
+ */
+class WormDiagram: public WormDiagram_core
+{
+
+    private:
+        std::uniform_real_distribution<double> _uniform_dist; ///< uniform distribution for random number generation
+        std::mt19937 _mt_generator;                           ///< Mersenne-Twister random number generator
+
+
+    public:
+
+    /**
+     * @brief Construct a new WormDiagram object with the worm closed, with the parameters of WormDiagram_core and the seed of the generator
+     *
+     * @param beta       Length of the diagram (here representing the thermondinamical beta = 1/T). Must be > 0.
+     * @param s0         Spin of the 0-th segment of the diagram [0---t1]. Must be +1 or -1.
+     * @param H          Value of the longitudinal component of magnetic field
+     * @param GAMMA      Value of the transversal component of magnetic field. Must be != 0.
+     * @param vertices   (optional) Array containing the times of diagram _vertices, with t1<t2<t3... (they need to be already sorted)
+     * @param worm_weight (optional) relative weight eta * beta^2 of the configurations with the worm open. Must be > 0.
+     * @param seed       (optional) Seed to initialize the random number generator
+     */
+    WormDiagram(double beta, int s0, double H, double GAMMA,
+        std::vector<double> vertices=std::vector<double>(),
+        double worm_weight = WORM_WEIGHT_DEFAULT,
+        unsigned int seed = std::chrono::system_clock::now().time_since_epoch().count());
+
+    /**
+     * @brief Attemps the ADD_SEGMENT update for the current status of the diagram.
+     *
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_add_segment();
+
+    /**
+     * @brief Attemps the REMOVE_SEGMENT update for the current status of the diagram.
+     *
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_remove_segment();
+
+    /**
+     * @brief Attemps the SPIN_FLIP update for the current status of the diagram.
+     *
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_spin_flip();
+
+    /**
+     * @brief Attemps the WORM_INSERT update if the worm is closed, or the WORM_REMOVE update if it is open
+     *
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_worm_insert_remove();
+
+    /**
+     * @brief Attemps the WORM_MOVE update (rejected if the worm is closed)
+     *
+     * @return true if update was accepted,
+     * @return false if update was rejected
+     */
+    bool attempt_worm_move();
+
+};
+
+
+/**
+ * @brief Results of a run of the worm algorithm
+ */
+struct GreensFunctionResults
+{
+    std::vector<double> tau;                    ///< centers of the bins of tau, (i + 0.5) * beta / bins
+    std::vector<double> correlation_xx;         ///< measured <sigma_x(0) sigma_x(tau)>, averaged over the bin
+    std::vector<double> error_correlation_xx;   ///< statistical error of correlation_xx, from the spread of WORM_BATCHES batches of the steps
+    std::vector<double> exact_correlation_xx;   ///< exact <sigma_x(0) sigma_x(tau)> at the center of the bin
+    double open_fraction = 0;                   ///< fraction of the measured steps with the worm open
+    unsigned long long N_measures = 0;          ///< number of measured steps (after thermalization)
+    unsigned long long run_time = 0;            ///< run time of the loop (in nanoseconds)
+};
+
+
+/**
+ * @brief Runs the worm algorithm for the parameters, number of steps and seeds of a task (the engine, the flip probability
+ * and the options of the other estimators of the task are not used), measuring <sigma_x(0) sigma_x(tau)> on bins points in [0, beta).
+ * At each step a worm update is attempted with probability worm_update_probability (half of the times WORM_INSERT/WORM_REMOVE,
+ * half of the times WORM_MOVE), otherwise ADD_SEGMENT, REMOVE_SEGMENT or SPIN_FLIP with equal probability.
+ * Each measured step only increments a counter: the one of the bin of the separation of the ends if the worm is open,
+ * the one of the closed configurations otherwise, and the correlation of bin i is (N_open_i / N_closed) * bins / worm_weight.
+ * Throws an std::invalid_argument exception if bins is 0, or if worm_update_probability is not in (0, 1).
+ *
+ * @param task parameters, number of steps and seeds of the run
+ * @param bins number of bins of tau in [0, beta)
+ * @param worm_weight relative weight eta * beta^2 of the configurations with the worm open
+ * @param worm_update_probability probability of attempting a worm update at each step
+ * @return GreensFunctionResults
+ */
+GreensFunctionResults run_worm_simulation(const SimulationTask & task, unsigned int bins, double worm_weight = WORM_WEIGHT_DEFAULT,
+    double worm_update_probability = WORM_UPDATE_PROBABILITY_DEFAULT);
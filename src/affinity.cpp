@@ -0,0 +1,136 @@
+/**
+ * @file affinity.cpp
+ * @brief Definition of the functions to pin the worker threads to the cores, spreading them over the NUMA nodes
+ */
+
+#include <diagmc/affinity.h>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+std::vector<int> allowed_cpus()
+{
+    std::vector<int> cpus;
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+#endif
+
+    //fallback: all the cpus of the machine
+    if (cpus.empty())
+    {
+        int n_cpus = std::thread::hardware_concurrency();
+        for (int cpu = 0; cpu < (n_cpus > 0 ? n_cpus : 1); ++cpu) cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+
+int numa_node_of_cpu(int cpu)
+{
+    int node = -1;
+
+#ifdef __linux__
+    //the directory of each cpu contains a link node<M> to its NUMA node
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR * directory = opendir(path.c_str());
+    if (directory == nullptr) return -1;
+
+    while (dirent * entry = readdir(directory))
+    {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(0, 4, "node") == 0 && name.find_first_not_of("0123456789", 4) == std::string::npos)
+        {
+            node = std::stoi(name.substr(4));
+            break;
+        }
+    }
+    closedir(directory);
+#else
+    (void) cpu;
+#endif
+
+    return node;
+}
+
+
+std::vector<WorkerPlacement> plan_worker_placement(int n_workers, const std::vector<int> & cpus, const std::vector<int> & nodes)
+{
+    if (cpus.empty()) throw std::invalid_argument("the list of cpus for the workers is empty.");
+    if (cpus.size() != nodes.size()) throw std::invalid_argument("the lists of cpus and of their nodes must have the same size.");
+
+    //cpus of each node, in increasing order
+    std::map<int, std::vector<int>> cpus_of_node;
+    for (size_t i = 0; i < cpus.size(); ++i) cpus_of_node[nodes[i]].push_back(cpus[i]);
+
+    //order of assignment of the cpus: the first cpu of each node, then the second of each node, ...
+    std::vector<std::pair<int, int>> order; //(cpu, node)
+    for (size_t rank = 0; order.size() < cpus.size(); ++rank)
+        for (const auto & [node, node_cpus] : cpus_of_node)
+            if (rank < node_cpus.size()) order.emplace_back(node_cpus[rank], node);
+
+    std::vector<WorkerPlacement> placements;
+    for (int worker = 0; worker < n_workers; ++worker)
+    {
+        WorkerPlacement placement;
+        placement.worker = worker;
+        placement.cpu = order[worker % order.size()].first;
+        placement.node = order[worker % order.size()].second;
+        placements.push_back(placement);
+    }
+
+    return placements;
+}
+
+
+bool pin_current_thread(int cpu)
+{
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void) cpu;
+    return false;
+#endif
+}
+
+
+int current_cpu()
+{
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+
+void print_worker_placement(const std::vector<WorkerPlacement> & placements, std::ostream & os)
+{
+    os << "Worker placement:\n";
+    for (const auto & placement : placements)
+    {
+        os << "worker " << placement.worker << " : cpu " << placement.cpu;
+        if (placement.node >= 0) os << ", NUMA node " << placement.node;
+        else os << ", NUMA node unknown";
+        os << (placement.pinned ? "" : " (not pinned)") << '\n';
+    }
+}
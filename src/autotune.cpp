@@ -0,0 +1,128 @@
+/**
+ * @file autotune.cpp
+ * @brief Definitions of the functions of the autotuner
+ */
+
+#include <diagmc/autotune.h>
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <stdexcept>
+#include <tuple>
+
+
+double TuningTrial::score() const
+{
+    return std::min(ESS_per_step_sigmax, ESS_per_step_sigmaz);
+}
+
+
+double TuningTrial::ESS_per_second() const
+{
+    return std::min(ESS_per_second_sigmax, ESS_per_second_sigmaz);
+}
+
+
+TuningResult autotune_task(const SimulationTask & task, const AutotuneOptions & options)
+{
+    if (options.engines.empty() || options.flip_probabilities.empty() || options.delayed_rejection.empty()) throw std::invalid_argument("the autotuner needs at least one candidate.");
+    if (options.pilot_steps == 0) throw std::invalid_argument("the pilot chains of the autotuner must have at least one step.");
+
+    //the pilot chains only collect the magnetizations, and always run all their steps
+    SimulationTask pilot = task;
+    pilot.N_total_steps = options.pilot_steps;
+    pilot.N_thermalization_steps = options.pilot_steps / 10;
+    pilot.reweight_betas.clear();
+    pilot.histogram_bins = 0;
+    pilot.measurements = MeasurementOptions();
+    pilot.monitor = nullptr;
+
+    TuningResult result {task, {}, 0};
+    for (bool delayed_rejection : options.delayed_rejection)
+        for (double flip_probability : options.flip_probabilities)
+            for (DiagramEngine engine : options.engines)
+            {
+                pilot.engine = engine;
+                pilot.flip_probability = flip_probability;
+                pilot.delayed_rejection = delayed_rejection;
+                SingleRunResults pilot_results = run_simulation(pilot);
+
+                double autocorrelation_time = pilot_results.ESS_sigmaz > 0 ? 0.5 * pilot_results.N_measures / pilot_results.ESS_sigmaz : 0.5;
+                double N_measures = std::max(1ull, pilot_results.N_measures);
+                result.trials.push_back({engine, flip_probability, delayed_rejection,
+                    pilot_results.ESS_sigmax / N_measures, pilot_results.ESS_sigmaz / N_measures,
+                    pilot_results.ESS_per_second(pilot_results.ESS_sigmax), pilot_results.ESS_per_second(pilot_results.ESS_sigmaz), autocorrelation_time});
+            }
+
+    //the parameters of the chain are chosen from the effective samples per step, which are reproducible,
+    //and then the engine from the speed, since the engines give the same chain
+    for (size_t i = 0; i < result.trials.size(); ++i)
+        if (result.trials[i].score() > result.trials[result.best].score()) result.best = i;
+    size_t chosen = result.best;
+    for (size_t i = 0; i < result.trials.size(); ++i)
+    {
+        const TuningTrial & trial = result.trials[i];
+        bool same_chain = trial.flip_probability == result.trials[chosen].flip_probability && trial.delayed_rejection == result.trials[chosen].delayed_rejection;
+        if (same_chain && trial.ESS_per_second() > result.trials[result.best].ESS_per_second()) result.best = i;
+    }
+
+    const TuningTrial & best = result.trials[result.best];
+    result.task.engine = best.engine;
+    result.task.flip_probability = best.flip_probability;
+    result.task.delayed_rejection = best.delayed_rejection;
+    if (task.measurements.enabled())
+        result.task.measurements.measure_interval = std::max(1u, static_cast<unsigned int>(std::ceil(2 * best.autocorrelation_time)));
+
+    return result;
+}
+
+
+void autotune_tasks(std::vector<SimulationTask> & tasks, ThreadPool & pool, const AutotuneOptions & options, std::ostream & log, const std::vector<size_t> & symmetry_sources)
+{
+    if (!symmetry_sources.empty() && symmetry_sources.size() != tasks.size()) throw std::invalid_argument("there must be one symmetry source for each task.");
+
+    //one tuning for each parameter point, in the order of the first task with that point.
+    //The tasks obtained by symmetry are not tuned, and take the tuning of their source (which always precedes them)
+    std::vector<size_t> first_of_point;
+    std::vector<size_t> point_of(tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        if (!symmetry_sources.empty() && symmetry_sources[i] != i)
+        {
+            point_of[i] = point_of[symmetry_sources[i]];
+            continue;
+        }
+        auto same_point = [&](size_t j) { return std::tie(tasks[j].beta, tasks[j].H, tasks[j].GAMMA) == std::tie(tasks[i].beta, tasks[i].H, tasks[i].GAMMA); };
+        auto found = std::find_if(first_of_point.begin(), first_of_point.end(), same_point);
+        point_of[i] = found - first_of_point.begin();
+        if (found == first_of_point.end()) first_of_point.push_back(i);
+    }
+
+    std::vector<std::future<TuningResult>> futures;
+    for (size_t i : first_of_point)
+        futures.push_back(pool.submit([task = tasks[i], &options]() { return autotune_task(task, options); }));
+
+    std::vector<TuningResult> results;
+    for (auto & future : futures) results.push_back(future.get());
+
+    log << "Autotuning:\n";
+    for (const auto & result : results)
+    {
+        const TuningTrial & best = result.trials[result.best];
+        log << "beta = " << result.task.beta << ", H = " << result.task.H << ", GAMMA = " << result.task.GAMMA <<
+            " : engine " << (best.engine == DiagramEngine::FLAT ? "flat" : "list") <<
+            ", flip probability " << best.flip_probability << (best.delayed_rejection ? ", delayed rejection" : "");
+        if (result.task.measurements.enabled()) log << ", measure_interval " << result.task.measurements.measure_interval;
+        log << " (" << best.score() << " effective samples per step, " << best.ESS_per_second() << " per second)\n";
+    }
+
+    //the tuned parameters are copied to all the tasks of each point and to their mirrors, keeping their own seeds and number of steps
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        const SimulationTask & tuned = results[point_of[i]].task;
+        tasks[i].engine = tuned.engine;
+        tasks[i].flip_probability = tuned.flip_probability;
+        tasks[i].delayed_rejection = tuned.delayed_rejection;
+        tasks[i].measurements.measure_interval = tuned.measurements.measure_interval;
+    }
+}
@@ -0,0 +1,139 @@
+/**
+ * @file c_api.cpp
+ * @brief Definitions of the functions of the stable C interface of the libdiagmc shared library
+ */
+
+#include <diagmc/diagmc_c.h>
+#include <diagmc/simulation.h>
+#include <diagmc/thread_pool.h>
+#include <exception>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+//message of the last error, separate for each calling thread
+static thread_local std::string last_error;
+
+
+/**
+ * @brief Runs the simulation for the given task, converting the results to the C struct, 
+ * and any exception to the corresponding error code
+ * 
+ * @param task parameters of the run
+ * @param result output: results of the run
+ * @param error_message output: message of the exception, if any
+ * @return int error code
+ */
+static int run_task(const diagmc_task & task, diagmc_result & result, std::string & error_message)
+{
+    try
+    {
+        SingleRunResults results = run_simulation({task.beta, task.initial_s0, task.H, task.GAMMA, task.N_total_steps, 
+            task.N_thermalization_steps, task.update_choice_seed, task.diagram_seed});
+
+        result.measured_sigmax = results.measured_sigmax;
+        result.measured_sigmaz = results.measured_sigmaz;
+        result.N_measures = results.N_measures;
+        result.N_attempted_flips = results.N_attempted_flips;
+        result.N_accepted_flips = results.N_accepted_flips;
+        result.N_attempted_addsegment = results.N_attempted_addsegment;
+        result.N_accepted_addsegment = results.N_accepted_addsegment;
+        result.N_attempted_removesegment = results.N_attempted_removesegment;
+        result.N_accepted_removesegment = results.N_accepted_removesegment;
+        result.max_diagram_order = results.max_diagram_order;
+        result.avg_diagram_order = results.avg_diagram_order;
+        result.order_p50 = results.order_distribution.quantile(0.5);
+        result.order_p99 = results.order_distribution.quantile(0.99);
+        result.order_p999 = results.order_distribution.quantile(0.999);
+        result.run_time = results.run_time;
+
+        return DIAGMC_SUCCESS;
+    }
+    catch(const std::invalid_argument & e)
+    {
+        error_message = e.what();
+        return DIAGMC_ERROR_INVALID_ARGUMENT;
+    }
+    catch(const std::exception & e)
+    {
+        error_message = e.what();
+        return DIAGMC_ERROR_INTERNAL;
+    }
+}
+
+
+extern "C" {
+
+int diagmc_abi_version(void)
+{
+    return DIAGMC_ABI_VERSION;
+}
+
+
+int diagmc_run_simulation(const diagmc_task * task, diagmc_result * result)
+{
+    last_error.clear();
+
+    if (task == nullptr || result == nullptr)
+    {
+        last_error = "task and result must not be NULL.";
+        return DIAGMC_ERROR_INVALID_ARGUMENT;
+    }
+
+    return run_task(*task, *result, last_error);
+}
+
+
+int diagmc_run_batch(const diagmc_task * tasks, size_t n_tasks, diagmc_result * results, int n_threads)
+{
+    last_error.clear();
+
+    if ((tasks == nullptr || results == nullptr) && n_tasks > 0)
+    {
+        last_error = "tasks and results must not be NULL.";
+        return DIAGMC_ERROR_INVALID_ARGUMENT;
+    }
+    if (n_threads < 1)
+    {
+        last_error = "n_threads must be >= 1.";
+        return DIAGMC_ERROR_INVALID_ARGUMENT;
+    }
+
+    //each run writes directly in its own element of the caller-provided array
+    std::vector<int> error_codes(n_tasks, DIAGMC_SUCCESS);
+    std::vector<std::string> error_messages(n_tasks);
+    try
+    {
+        ThreadPool pool(n_threads);
+        for (size_t i = 0; i < n_tasks; ++i)
+            pool.enqueue([&, i]() { error_codes[i] = run_task(tasks[i], results[i], error_messages[i]); });
+        //the destructor of the pool waits for all the runs to be completed
+    }
+    catch(const std::exception & e)
+    {
+        last_error = e.what();
+        return DIAGMC_ERROR_INTERNAL;
+    }
+
+    //return the first error, if any
+    for (size_t i = 0; i < n_tasks; ++i)
+    {
+        if (error_codes[i] != DIAGMC_SUCCESS)
+        {
+            last_error = "task " + std::to_string(i) + ": " + error_messages[i];
+            return error_codes[i];
+        }
+    }
+
+    return DIAGMC_SUCCESS;
+}
+
+
+const char * diagmc_last_error(void)
+{
+    return last_error.c_str();
+}
+
+}
@@ -0,0 +1,176 @@
+/**
+ * @file convergence.cpp
+ * @brief Definitions of the R-hat diagnostics, and of the ConvergenceMonitor class
+ */
+
+#include <diagmc/convergence.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+
+ChainSummary ChainSummary::of(const BinningAnalysis & analysis, double scale)
+{
+    auto [N_batches, batch_variance] = analysis.batch_means();
+    return {analysis.count(), scale * analysis.mean(), scale * scale * analysis.sample_variance(), std::abs(scale) * analysis.error(),
+        N_batches, scale * scale * batch_variance};
+}
+
+
+double gelman_rubin(const std::vector<ChainSummary> & chains)
+{
+    if (chains.size() < 2) throw std::invalid_argument("R-hat requires at least two chains.");
+
+    unsigned long long n = chains.front().N_batches;
+    double mean = 0, W = 0;
+    for (const auto & chain : chains)
+    {
+        if (chain.N_samples < 2 || chain.N_batches < 2) throw std::invalid_argument("R-hat requires at least two samples and batches per chain.");
+        n = std::min(n, chain.N_batches);
+        mean += chain.mean / chains.size();
+        W += chain.batch_variance / chains.size();
+    }
+
+    //variance of the chain means (B/n)
+    double B_over_n = 0;
+    for (const auto & chain : chains) B_over_n += (chain.mean - mean) * (chain.mean - mean) / (chains.size() - 1);
+
+    if (W == 0) return B_over_n == 0 ? 1 : std::numeric_limits<double>::infinity();
+    double V = (n - 1.) / n * W + B_over_n;
+    return std::sqrt(V / W);
+}
+
+
+double combined_error(const std::vector<ChainSummary> & chains)
+{
+    double sum_squares = 0;
+    for (const auto & chain : chains) sum_squares += chain.error * chain.error;
+    return chains.empty() ? 0 : std::sqrt(sum_squares) / chains.size();
+}
+
+
+ConvergenceMonitor::ConvergenceMonitor(unsigned int N_chains, double beta, double GAMMA, double target_error, double rhat_threshold)
+    : _N_chains(N_chains), _sigmax_scale(-1 / (beta * GAMMA)), _target_error(target_error), _rhat_threshold(rhat_threshold),
+      _sigmaz(N_chains), _sigmax(N_chains), _epoch(N_chains, 0), _finished(N_chains, false)
+{
+    if (N_chains < 2) throw std::invalid_argument("the convergence monitor requires at least two chains per point (samples_per_point).");
+    if (!(target_error > 0)) throw std::invalid_argument("target_error must be > 0.");
+    if (!(rhat_threshold > 1)) throw std::invalid_argument("rhat_threshold must be > 1.");
+}
+
+
+std::vector<std::function<void()>> ConvergenceMonitor::decide_if_complete()
+{
+    //the next epoch is complete when every chain has reported it or has finished, and at least one chain has reported it
+    unsigned long long epoch = _decided_epoch + 1;
+    bool reported = false;
+    for (unsigned int i = 0; i < _N_chains; ++i)
+    {
+        if (_epoch[i] == epoch) reported = true;
+        else if (!_finished[i]) return {};
+    }
+    if (!reported) return {};
+
+    //the point is evaluated only when every chain has enough samples
+    bool enough_samples = true;
+    for (unsigned int i = 0; i < _N_chains; ++i) enough_samples &= _sigmaz[i].N_samples >= 2;
+    if (enough_samples)
+    {
+        _R_hat = std::max(gelman_rubin(_sigmaz), gelman_rubin(_sigmax));
+        if (_R_hat < _rhat_threshold && combined_error(_sigmaz) < _target_error && combined_error(_sigmax) < _target_error) _stop = true;
+    }
+
+    _decided_epoch = epoch;
+    _decided.notify_all();
+
+    //the chains parked at this epoch are resumed
+    std::vector<std::function<void()>> resumed;
+    resumed.swap(_resume);
+    return resumed;
+}
+
+
+ConvergenceDecision ConvergenceMonitor::decision_locked(unsigned long long epoch) const
+{
+    if (epoch > _decided_epoch) return ConvergenceDecision::PENDING;
+    return _stop && epoch == _decided_epoch ? ConvergenceDecision::STOP : ConvergenceDecision::CONTINUE;
+}
+
+
+ConvergenceDecision ConvergenceMonitor::report(unsigned int chain, unsigned long long epoch, const BinningAnalysis & binning_mz, const BinningAnalysis & binning_order)
+{
+    if (chain >= _N_chains) throw std::invalid_argument("index of the chain out of range.");
+
+    //the summaries are computed outside of the lock, since they flush a copy of the binning analyses
+    ChainSummary sigmaz = ChainSummary::of(binning_mz);
+    ChainSummary sigmax = ChainSummary::of(binning_order, _sigmax_scale);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (epoch != _decided_epoch + 1 || _finished[chain]) throw std::invalid_argument("a chain can only report the epoch following the last decided one.");
+    _sigmaz[chain] = sigmaz;
+    _sigmax[chain] = sigmax;
+    _epoch[chain] = epoch;
+
+    std::vector<std::function<void()>> resumed = decide_if_complete();
+    ConvergenceDecision decision = decision_locked(epoch);
+    lock.unlock();
+
+    for (auto & resume : resumed) resume();
+    return decision;
+}
+
+
+ConvergenceDecision ConvergenceMonitor::decision(unsigned long long epoch) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return decision_locked(epoch);
+}
+
+
+ConvergenceDecision ConvergenceMonitor::wait_decision(unsigned long long epoch) const
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _decided.wait(lock, [&]() { return epoch <= _decided_epoch; });
+    return decision_locked(epoch);
+}
+
+
+void ConvergenceMonitor::on_decision(unsigned long long epoch, std::function<void()> resume)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (epoch > _decided_epoch)
+    {
+        _resume.push_back(std::move(resume));
+        return;
+    }
+    lock.unlock();
+    resume();
+}
+
+
+void ConvergenceMonitor::finish(unsigned int chain)
+{
+    if (chain >= _N_chains) throw std::invalid_argument("index of the chain out of range.");
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _finished[chain] = true;
+    std::vector<std::function<void()>> resumed = decide_if_complete();
+    lock.unlock();
+
+    for (auto & resume : resumed) resume();
+}
+
+
+bool ConvergenceMonitor::stop_requested() const
+{
+    return _stop;
+}
+
+
+double ConvergenceMonitor::R_hat() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _R_hat;
+}
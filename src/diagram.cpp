@@ -19,6 +19,36 @@
 #define RNG _uniform_dist(_mt_generator) //extracts a random number uniformly in [0,1]
 
 
+//Delayed rejection of the ADD_SEGMENT update ------------------------------------------------------
+DelayedRejectionWindow delayed_rejection_window(double rate_at_tau1, double window_length, double decay)
+{
+    //the first stage can be rejected only for unfavourable segments longer than ln(C)/k, where the rate drops below 1
+    if (!(decay > 0) || !(rate_at_tau1 > 1)) return {};
+    double width = std::log(rate_at_tau1) / decay;
+    if (width >= window_length) return {};
+
+    //integral over [width, window_length] of (1 - C exp(-k d)), divided by the length of the window
+    double rejection_probability = ((window_length - width) - (1 - rate_at_tau1 * std::exp(-decay * window_length)) / decay) / window_length;
+    return {width, rejection_probability};
+}
+
+double acceptance_rate_add_second_stage(double rate, double window_length, const DelayedRejectionWindow & window)
+{
+    return window.width * (rate - 1) / (window_length * window.rejection_probability);
+}
+
+double acceptance_rate_remove_delayed(double rate, double window_length, double segment_length, const DelayedRejectionWindow & window)
+{
+    //only the segments shorter than the width can be added by the second stage
+    if (!(segment_length < window.width)) return 1 / rate;
+
+    double second_stage = std::min(1., acceptance_rate_add_second_stage(rate, window_length, window));
+    return (1 + window_length * window.rejection_probability / window.width * second_stage) / rate;
+}
+//--------------------------------------------------------------------------------------------------
+
+
+
 bool lists_are_float_equal(const std::list<double>& list1, const std::list<double>& list2, double epsilon) {
     
     // Check if lists have the same size
@@ -238,6 +268,75 @@ bool Diagram_core::attempt_remove_segment(double RN1, double RNacc) {
     return false;
 }
 
+bool Diagram_core::attempt_add_segment_delayed(double RN1, double RN2, double RNacc, double RNacc2) {
+
+    //first stage, as in attempt_add_segment
+    double tau1 = RN1 * _beta; 
+
+    std::list<double>::iterator tau3_it = _vertices.end();
+    int new_segment_index = 0;
+    for (auto i = _vertices.begin(); i != _vertices.end(); ++i)
+    {  
+        if (*i > tau1)
+        {
+            tau3_it = i;
+            break;
+        }
+        ++new_segment_index;       
+    }
+    double tau2max = tau3_it != _vertices.end() ? *tau3_it : _beta ;
+
+    double tau2 = tau1 + RN2 * (tau2max - tau1);  
+    double new_segment_spin = _s0*std::pow(-1, new_segment_index + 1); 
+
+    double rate = acceptance_rate_add(tau1, tau2, tau2max, new_segment_spin);
+    if (!(RNacc < rate))
+    {
+        //second stage, in the narrower window where the rate is >= 1
+        DelayedRejectionWindow window = delayed_rejection_window(acceptance_rate_add(tau1, tau1, tau2max, new_segment_spin), tau2max - tau1, 2 * _H * new_segment_spin);
+        if (window.width == 0) return false;
+
+        //after the rejection RNacc is uniform in [rate, 1), so it is rescaled to [0, 1) to extract the new tau2
+        tau2 = tau1 + (RNacc - rate) / (1 - rate) * window.width;
+        if (!(RNacc2 < acceptance_rate_add_second_stage(acceptance_rate_add(tau1, tau2, tau2max, new_segment_spin), tau2max - tau1, window))) return false;
+    }
+
+    _vertices.insert(tau3_it, tau1);
+    _vertices.insert(tau3_it, tau2);       
+    return true;
+
+}
+
+bool Diagram_core::attempt_remove_segment_delayed(double RN1, double RNacc) {
+
+    if (order() == 0) return false;
+
+    //same choice of the segment of attempt_remove_segment
+    int segment_toberemoved_index = RN1 * (order() - 1) + 1;
+
+    auto tau1_it = _vertices.begin();
+    std::advance(tau1_it, segment_toberemoved_index - 1);
+    auto tau2_it = tau1_it; ++tau2_it;
+    auto tau3_it = tau2_it; ++tau3_it;
+
+    double tau1 = *tau1_it;
+    double tau2 = *tau2_it;
+    double tau2max = tau3_it != _vertices.end() ? *tau3_it : _beta;
+    double segment_toberemoved_spin = _s0 * std::pow(-1, segment_toberemoved_index);
+
+    //rate of the first stage of the reverse ADD_SEGMENT, and window of its second stage
+    double rate = 1 / acceptance_rate_remove(tau1, tau2, tau2max, segment_toberemoved_spin);
+    DelayedRejectionWindow window = delayed_rejection_window(1 / acceptance_rate_remove(tau1, tau1, tau2max, segment_toberemoved_spin),
+        tau2max - tau1, 2 * _H * segment_toberemoved_spin);
+
+    if (RNacc < acceptance_rate_remove_delayed(rate, tau2max - tau1, tau2 - tau1, window))
+    {    
+        _vertices.erase(tau1_it, tau3_it);
+        return true;
+    }
+    return false;
+}
+
 bool Diagram_core::attempt_spin_flip(double RNacc) {
 
     //attempt update, flipping spins of all diagram if accepted (and returning true); doing nothing (and returning false) if rejected         
@@ -283,6 +382,30 @@ std::list<double> Diagram_core::get_vertices() const {
     return _vertices;
 }
 
+const std::list<double> & Diagram_core::vertices() const {
+    return _vertices;
+}
+
+DiagramSnapshot Diagram_core::snapshot() const
+{
+    DiagramSnapshot snapshot;
+    snapshot_into(snapshot);
+    return snapshot;
+}
+
+void Diagram_core::snapshot_into(DiagramSnapshot & snapshot) const
+{
+    snapshot.s0 = _s0;
+    snapshot.vertices.assign(_vertices.begin(), _vertices.end());
+}
+
+void Diagram_core::restore(const DiagramSnapshot & snapshot)
+{
+    if (!snapshot.is_valid(_beta)) throw std::invalid_argument("The snapshot is not a valid diagram of length beta.");
+    _s0 = snapshot.s0;
+    _vertices.assign(snapshot.vertices.begin(), snapshot.vertices.end());
+}
+
 
 //update functions
 bool Diagram::attempt_add_segment() {
@@ -297,6 +420,14 @@ bool Diagram::attempt_spin_flip() {
     return Diagram_core::attempt_spin_flip(RNG);
 }
 
+bool Diagram::attempt_add_segment_delayed() {
+    return Diagram_core::attempt_add_segment_delayed(RNG, RNG, RNG, RNG);
+}
+
+bool Diagram::attempt_remove_segment_delayed() {
+    return Diagram_core::attempt_remove_segment_delayed(RNG, RNG);
+}
+
 void Diagram::reset_diagram(double beta, int s0, double H, double GAMMA, std::list<double> vertices, unsigned int seed) {
 
     //check that parameters are in the correct range of values, throwing exception otherwise.
@@ -0,0 +1,169 @@
+/**
+ * @file exact.cpp
+ * @brief Definitions of the functions for the exact (analytical) solution of the two-level system
+ */
+
+#include <diagmc/exact.h>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+//maximum number of terms of the series for the order distribution, after the first one
+#define MAX_SERIES_TERMS 100000
+
+
+double exact_sigmaz(double beta, double H, double GAMMA)
+{
+    double E = std::sqrt(H * H + GAMMA * GAMMA);
+    return -H / E * std::tanh(beta * E);
+}
+
+
+double exact_sigmax(double beta, double H, double GAMMA)
+{
+    double E = std::sqrt(H * H + GAMMA * GAMMA);
+    return -GAMMA / E * std::tanh(beta * E);
+}
+
+
+double exact_energy(double beta, double H, double GAMMA)
+{
+    double E = std::sqrt(H * H + GAMMA * GAMMA);
+    return -E * std::tanh(beta * E);
+}
+
+
+double exact_average_order(double beta, double H, double GAMMA)
+{
+    double E = std::sqrt(H * H + GAMMA * GAMMA);
+    return beta * GAMMA * GAMMA / E * std::tanh(beta * E);
+}
+
+
+double exact_order_probability(size_t n, double beta, double H, double GAMMA)
+{
+    //only even orders are possible
+    if (n % 2 != 0) return 0;
+    double k = n / 2;
+
+    //log(Z) = log(2cosh(beta*E)), written to avoid overflow for large beta*E
+    double E = std::sqrt(H * H + GAMMA * GAMMA);
+    double logZ = beta * E + std::log1p(std::exp(-2 * beta * E));
+
+    //the terms of the series are calculated in log scale, since each of them can be huge 
+    //(and Z is huge too) even when the probability is not
+    auto log_term = [&](double m)
+    {
+        double log_H2 = (m > k) ? (m - k) * std::log(H * H) : 0; //H^0 = 1 also for H = 0
+        return std::log(2.) + 2 * m * std::log(beta) + k * std::log(GAMMA * GAMMA) + log_H2
+            + std::lgamma(m + 1) - std::lgamma(k + 1) - std::lgamma(m - k + 1) - std::lgamma(2 * m + 1) - logZ;
+    };
+
+    double probability = std::exp(log_term(k));
+    if (std::abs(H) < std::numeric_limits<double>::min()) return probability;
+
+    //sum the terms until they become negligible (the terms first grow and then decrease)
+    double previous_term = probability;
+    for (double m = k + 1; m <= k + MAX_SERIES_TERMS; ++m)
+    {
+        double term = std::exp(log_term(m));
+        probability += term;
+        if (term < previous_term && term < probability * std::numeric_limits<double>::epsilon()) break;
+        previous_term = term;
+    }
+
+    return probability;
+}
+
+
+std::vector<double> exact_order_distribution(size_t max_order, double beta, double H, double GAMMA)
+{
+    std::vector<double> distribution(max_order + 1);
+    for (size_t n = 0; n <= max_order; ++n) distribution[n] = exact_order_probability(n, beta, H, GAMMA);
+    return distribution;
+}
+
+
+size_t exact_order_quantile(double p, double beta, double H, double GAMMA)
+{
+    //accumulate the probability of the even orders, until p is reached
+    double cumulative_probability = 0;
+    size_t n = 0;
+    while (true)
+    {
+        double probability = exact_order_probability(n, beta, H, GAMMA);
+        cumulative_probability += probability;
+        if (cumulative_probability >= p) return n;
+
+        //stop if the remaining probability is lost in the rounding errors of the sum
+        if (n > exact_average_order(beta, H, GAMMA) && probability < std::numeric_limits<double>::epsilon() * cumulative_probability) return n;
+        n += 2;
+    }
+}
+
+
+/**
+ * @brief Common expression of the two correlation functions, nj^2 + (1 - nj^2) * cosh(E(beta - 2 tau)) / cosh(beta E),
+ * written to avoid overflow for large beta*E
+ * 
+ * @param nj2 squared component of the field direction along the measured spin component
+ * @param E energy of the excited state
+ * @param tau imaginary time
+ * @param beta inverse temperature
+ * @return double 
+ */
+static double correlation(double nj2, double E, double tau, double beta)
+{
+    double cosh_ratio = (std::exp(-2 * E * tau) + std::exp(-2 * E * (beta - tau))) / (1 + std::exp(-2 * E * beta));
+    return nj2 + (1 - nj2) * cosh_ratio;
+}
+
+
+double exact_correlation_zz(double tau, double beta, double H, double GAMMA)
+{
+    double E2 = H * H + GAMMA * GAMMA;
+    return correlation(H * H / E2, std::sqrt(E2), tau, beta);
+}
+
+
+double exact_correlation_xx(double tau, double beta, double H, double GAMMA)
+{
+    double E2 = H * H + GAMMA * GAMMA;
+    return correlation(GAMMA * GAMMA / E2, std::sqrt(E2), tau, beta);
+}
+
+
+ExactValues evaluate_exact(const std::vector<double> & beta, const std::vector<double> & H, const std::vector<double> & GAMMA)
+{
+    if (beta.size() != H.size() || beta.size() != GAMMA.size())
+        throw std::invalid_argument("The arrays of beta, H and GAMMA values must have the same size.");
+
+    size_t n_points = beta.size();
+    ExactValues values;
+    values.sigmax.resize(n_points);
+    values.sigmaz.resize(n_points);
+    values.energy.resize(n_points);
+    values.average_order.resize(n_points);
+
+    //raw pointers to contiguous arrays, so that the compiler can vectorize the loop
+    const double * b = beta.data();
+    const double * h = H.data();
+    const double * g = GAMMA.data();
+    double * sx = values.sigmax.data();
+    double * sz = values.sigmaz.data();
+    double * energy = values.energy.data();
+    double * order = values.average_order.data();
+
+    for (size_t i = 0; i < n_points; ++i)
+    {
+        double E = std::sqrt(h[i] * h[i] + g[i] * g[i]);
+        double t = std::tanh(b[i] * E);
+        sx[i] = -g[i] / E * t;
+        sz[i] = -h[i] / E * t;
+        energy[i] = -E * t;
+        order[i] = -b[i] * g[i] * sx[i];
+    }
+
+    return values;
+}
@@ -0,0 +1,346 @@
+/**
+ * @file flat_diagram.cpp
+ * @brief Definitions file for FlatDiagram and FlatDiagram_core classes
+ */
+
+#include <diagmc/flat_diagram.h>
+#include <diagmc/simd.h>
+#include <stdexcept>
+#include <string>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#define RNG _uniform_dist(_mt_generator) //extracts a random number uniformly in [0,1]
+
+
+void FlatDiagram_core::assert_parameters_validity(double beta, int s0, double H, double GAMMA, const std::vector<double> & vertices) const
+{
+    if(! (beta > 0))
+    {
+        throw std::invalid_argument(
+            std::string("beta must be > 0, but ")
+            + std::to_string(beta) + std::string(" was provided.")
+            );
+    }
+
+    if(s0 != 1 && s0 != -1)
+    {
+        throw std::invalid_argument(
+            std::string("The spin can either be +1 or -1, but ")
+            + std::to_string(s0) + std::string(" was provided.")
+            );
+    }
+
+    if(std::abs(GAMMA) < std::numeric_limits<double>::epsilon() )
+    {
+        throw std::invalid_argument(
+            std::string("GAMMA must be different from 0.")
+            );
+    }
+
+    if(vertices.size() % 2 != 0)
+    {
+        throw std::invalid_argument(
+            std::string("The vertices list must contain an even number of elements.")
+            );
+    }
+
+    for(auto v : vertices)
+    {
+        if (v > beta) throw std::invalid_argument("The vertices list contains values > beta.");
+    }
+
+    if(!std::is_sorted(vertices.begin(), vertices.end()))
+    {
+        throw std::invalid_argument("The list used to initialize the diagram was not sorted.");
+    }
+}
+
+//Methods definitions for class FlatDiagram_core ---------------------------------------------------
+FlatDiagram_core::FlatDiagram_core(double beta, int s0, double H, double GAMMA, std::vector<double> vertices)
+    : _beta(beta), _s0(s0), _H(H), _GAMMA(GAMMA), _vertices(std::move(vertices)) {
+
+    //check that parameters are in the correct range of values, throwing exception otherwise.
+    assert_parameters_validity(beta, s0, H, GAMMA, _vertices);
+
+}
+
+bool FlatDiagram_core::operator==(const FlatDiagram_core &other) const
+{
+    if ( std::fabs(this->_beta - other._beta ) < EPSILON
+        && this->_s0 == other._s0
+        && std::fabs(this->_H - other._H) < EPSILON
+        && std::fabs(this->_GAMMA - other._GAMMA) < EPSILON
+        && this->_vertices.size() == other._vertices.size()
+        && std::equal(this->_vertices.begin(), this->_vertices.end(), other._vertices.begin(),
+            [](double a, double b) { return std::fabs(a - b) <= EPSILON; }) ) return true;
+    else return false;
+}
+
+bool FlatDiagram_core::operator!=(const FlatDiagram_core &other) const
+{
+    return !(*this == other);
+}
+
+double FlatDiagram_core::operator/(const FlatDiagram_core &other) const
+{
+    return this->value()/other.value();
+}
+
+double FlatDiagram_core::sum_deltatau() const
+{
+    //sum (... +t4-t3 + t2-t1), accumulated in the same order of the reference engine to give the same rounding
+    const double * vertices = _vertices.data();
+    size_t n = _vertices.size();
+
+    double sum_deltatau = 0;
+    for (size_t i = 0; i < n; i += 2)
+    {
+        sum_deltatau -= vertices[i];      //-t1
+        sum_deltatau += vertices[i + 1];  //+t2
+    }
+
+    return sum_deltatau;
+}
+
+double FlatDiagram_core::value() const
+{
+    return std::pow(_GAMMA, order()) * std::exp(_H * _s0 *( -_beta + 2*sum_deltatau()));
+}
+
+size_t FlatDiagram_core::order() const {
+    return _vertices.size();
+}
+
+
+//acceptance rates for the updates (same expressions of Diagram_core)
+double FlatDiagram_core::acceptance_rate_add(double tau1, double tau2, double tau2max, double new_segment_spin) const {
+    return _GAMMA*_GAMMA * std::exp(-2 * _H * new_segment_spin * (tau2-tau1)) * _beta * (tau2max - tau1) / (_vertices.size() + 1);
+}
+
+double FlatDiagram_core::acceptance_rate_remove(double tau1, double tau2, double tau2max, double segment_toberemoved_spin) const {
+    return std::exp(2 * _H * segment_toberemoved_spin * (tau2-tau1)) * (_vertices.size() - 1) / ( _GAMMA*_GAMMA * _beta * (tau2max-tau1) );
+}
+
+double FlatDiagram_core::acceptance_rate_flip() const {
+    return std::exp(2*_H*_s0*(_beta - 2 * sum_deltatau()));
+}
+
+
+//update functions
+bool FlatDiagram_core::attempt_add_segment(double RN1, double RN2, double RNacc) {
+
+    //extract the time tau1 of the first vertex to be added in uniform([0, _beta])
+    double tau1 = RN1 * _beta;
+
+    //search of the nearest vertex (tau3) after tau1 (with the SIMD kernel selected for the CPU): its position is also the index of the new segment
+    size_t new_segment_index = simd_upper_bound(_vertices.data(), _vertices.size(), tau1);
+    auto tau3_it = _vertices.begin() + new_segment_index;
+    double tau2max = tau3_it != _vertices.end() ? *tau3_it : _beta ;
+
+    //select second vertex in uniform([tau1, tau2max])
+    double tau2 = tau1 + RN2 * (tau2max - tau1);
+
+    //spin of the segment that we will add, s0*(-1)^(index+1)
+    double new_segment_spin = new_segment_index % 2 == 0 ? -_s0 : _s0;
+
+    //attempt update, adding segment if accepted (and returning true); doing nothing (and returning false) if rejected
+    if (RNacc < acceptance_rate_add(tau1, tau2, tau2max, new_segment_spin))
+    {
+        double new_vertices[2] = {tau1, tau2};
+        _vertices.insert(tau3_it, new_vertices, new_vertices + 2);
+        return true;
+    }
+    return false;
+
+}
+
+bool FlatDiagram_core::attempt_remove_segment(double RN1, double RNacc) {
+
+    //cannot remove segment if diagram is 0 order, so reject update right away
+    if (order() == 0) return false;
+
+    //randomly choose segment to be removed
+    int segment_toberemoved_index = RN1 * (order() - 1) + 1; //it starts from 1, since the first segment [0,t1] cannot be removed
+
+    //the vertices of the segment are accessed directly by index
+    size_t tau1_index = segment_toberemoved_index - 1;
+    double tau1 = _vertices[tau1_index];
+    double tau2 = _vertices[tau1_index + 1];
+    double tau2max = tau1_index + 2 < _vertices.size() ? _vertices[tau1_index + 2] : _beta;
+
+    //spin of the segment to be removed, s0*(-1)^index
+    double segment_toberemoved_spin = segment_toberemoved_index % 2 == 0 ? _s0 : -_s0;
+
+    //attempt update, removing segment if accepted (and returning true); doing nothing (and returning false) if rejected
+    if (RNacc < acceptance_rate_remove(tau1, tau2, tau2max, segment_toberemoved_spin))
+    {
+        _vertices.erase(_vertices.begin() + tau1_index, _vertices.begin() + tau1_index + 2);
+        return true;
+    }
+    return false;
+}
+
+bool FlatDiagram_core::attempt_add_segment_delayed(double RN1, double RN2, double RNacc, double RNacc2) {
+
+    //first stage, as in attempt_add_segment
+    double tau1 = RN1 * _beta;
+
+    size_t new_segment_index = simd_upper_bound(_vertices.data(), _vertices.size(), tau1);
+    auto tau3_it = _vertices.begin() + new_segment_index;
+    double tau2max = tau3_it != _vertices.end() ? *tau3_it : _beta ;
+
+    double tau2 = tau1 + RN2 * (tau2max - tau1);
+    double new_segment_spin = new_segment_index % 2 == 0 ? -_s0 : _s0;
+
+    double rate = acceptance_rate_add(tau1, tau2, tau2max, new_segment_spin);
+    if (!(RNacc < rate))
+    {
+        //second stage, in the narrower window where the rate is >= 1 (same decisions of Diagram_core)
+        DelayedRejectionWindow window = delayed_rejection_window(acceptance_rate_add(tau1, tau1, tau2max, new_segment_spin), tau2max - tau1, 2 * _H * new_segment_spin);
+        if (window.width == 0) return false;
+
+        tau2 = tau1 + (RNacc - rate) / (1 - rate) * window.width;
+        if (!(RNacc2 < acceptance_rate_add_second_stage(acceptance_rate_add(tau1, tau2, tau2max, new_segment_spin), tau2max - tau1, window))) return false;
+    }
+
+    double new_vertices[2] = {tau1, tau2};
+    _vertices.insert(tau3_it, new_vertices, new_vertices + 2);
+    return true;
+
+}
+
+bool FlatDiagram_core::attempt_remove_segment_delayed(double RN1, double RNacc) {
+
+    if (order() == 0) return false;
+
+    //same choice of the segment of attempt_remove_segment
+    int segment_toberemoved_index = RN1 * (order() - 1) + 1;
+    size_t tau1_index = segment_toberemoved_index - 1;
+    double tau1 = _vertices[tau1_index];
+    double tau2 = _vertices[tau1_index + 1];
+    double tau2max = tau1_index + 2 < _vertices.size() ? _vertices[tau1_index + 2] : _beta;
+    double segment_toberemoved_spin = segment_toberemoved_index % 2 == 0 ? _s0 : -_s0;
+
+    //rate of the first stage of the reverse ADD_SEGMENT, and window of its second stage
+    double rate = 1 / acceptance_rate_remove(tau1, tau2, tau2max, segment_toberemoved_spin);
+    DelayedRejectionWindow window = delayed_rejection_window(1 / acceptance_rate_remove(tau1, tau1, tau2max, segment_toberemoved_spin),
+        tau2max - tau1, 2 * _H * segment_toberemoved_spin);
+
+    if (RNacc < acceptance_rate_remove_delayed(rate, tau2max - tau1, tau2 - tau1, window))
+    {
+        _vertices.erase(_vertices.begin() + tau1_index, _vertices.begin() + tau1_index + 2);
+        return true;
+    }
+    return false;
+}
+
+bool FlatDiagram_core::attempt_spin_flip(double RNacc) {
+
+    //attempt update, flipping spins of all diagram if accepted (and returning true); doing nothing (and returning false) if rejected
+    if (RNacc < acceptance_rate_flip())
+    {
+        _s0 *= -1;
+        return true;
+    }
+    return false;
+}
+
+
+//getters
+double FlatDiagram_core::get_beta() const {
+    return _beta;
+}
+
+int FlatDiagram_core::get_s0() const {
+    return _s0;
+}
+
+double FlatDiagram_core::get_H() const {
+    return _H;
+}
+
+double FlatDiagram_core::get_GAMMA() const {
+    return _GAMMA;
+}
+
+std::vector<double> FlatDiagram_core::get_vertices() const {
+    return _vertices;
+}
+
+const std::vector<double> & FlatDiagram_core::vertices() const {
+    return _vertices;
+}
+
+DiagramSnapshot FlatDiagram_core::snapshot() const
+{
+    DiagramSnapshot snapshot;
+    snapshot_into(snapshot);
+    return snapshot;
+}
+
+void FlatDiagram_core::snapshot_into(DiagramSnapshot & snapshot) const
+{
+    snapshot.s0 = _s0;
+    snapshot.vertices.assign(_vertices.begin(), _vertices.end());
+}
+
+void FlatDiagram_core::restore(const DiagramSnapshot & snapshot)
+{
+    if (!snapshot.is_valid(_beta)) throw std::invalid_argument("The snapshot is not a valid diagram of length beta.");
+    _s0 = snapshot.s0;
+    _vertices.assign(snapshot.vertices.begin(), snapshot.vertices.end());
+}
+//END FlatDiagram_core class definition
+//--------------------------------------------------------------------------------------------------
+
+
+
+
+
+//Methods definitions for class FlatDiagram --------------------------------------------------------
+FlatDiagram::FlatDiagram(double beta, int s0, double H, double GAMMA,
+    std::vector<double> vertices,
+    unsigned int seed)
+    : FlatDiagram_core(beta, s0, H, GAMMA, std::move(vertices)) , _uniform_dist(0,1), _mt_generator(seed) {}
+
+
+//update functions
+bool FlatDiagram::attempt_add_segment() {
+    return FlatDiagram_core::attempt_add_segment(RNG, RNG, RNG);
+}
+
+bool FlatDiagram::attempt_remove_segment() {
+    return FlatDiagram_core::attempt_remove_segment(RNG, RNG);
+}
+
+bool FlatDiagram::attempt_spin_flip() {
+    return FlatDiagram_core::attempt_spin_flip(RNG);
+}
+
+bool FlatDiagram::attempt_add_segment_delayed() {
+    return FlatDiagram_core::attempt_add_segment_delayed(RNG, RNG, RNG, RNG);
+}
+
+bool FlatDiagram::attempt_remove_segment_delayed() {
+    return FlatDiagram_core::attempt_remove_segment_delayed(RNG, RNG);
+}
+
+void FlatDiagram::reset_diagram(double beta, int s0, double H, double GAMMA, std::vector<double> vertices, unsigned int seed) {
+
+    //check that parameters are in the correct range of values, throwing exception otherwise.
+    assert_parameters_validity(beta, s0, H, GAMMA, vertices);
+
+    //set the new value
+    _beta     = beta;
+    _s0       = s0;
+    _H        = H;
+    _GAMMA    = GAMMA;
+    _vertices = std::move(vertices);
+    _mt_generator.seed(seed);
+
+}
+//--------------------------------------------------------------------------------------------------
@@ -0,0 +1,286 @@
+/**
+ * @file kernel_benchmark.cpp
+ * @brief Definitions of the functions of the benchmark of the single-stage and delayed-rejection updates,
+ * and of the cost of the statistics of the chains
+ */
+
+#include <diagmc/kernel_benchmark.h>
+#include <diagmc/setup.h>
+#include <diagmc/flat_diagram.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+
+unsigned long long random_draws(const SingleRunResults & results, bool delayed_rejection)
+{
+    return results.N_attempted_flips + results.N_attempted_addsegment + results.N_attempted_removesegment //choice of the update
+        + (delayed_rejection ? 4 : 3) * results.N_attempted_addsegment
+        + 2 * results.N_attempted_removesegment
+        + results.N_attempted_flips;
+}
+
+
+/**
+ * @brief Returns the fraction accepted / attempted, or 0 if nothing was attempted
+ */
+static double fraction(unsigned long long accepted, unsigned long long attempted)
+{
+    return attempted > 0 ? double(accepted) / attempted : 0;
+}
+
+
+/**
+ * @brief Returns the tasks of the sweep described in settings, with seeds derived from the seed in settings or from KERNEL_BENCHMARK_SEED_DEFAULT
+ */
+static std::vector<SimulationTask> benchmark_tasks(const json & settings)
+{
+    if (!settings.contains("CALC_TYPE") || settings["CALC_TYPE"] != "sweep")
+        throw std::invalid_argument("the kernel benchmark requires the settings of a sweep (CALC_TYPE \"sweep\").");
+
+    //the runs of the sweep always have seeds derived from a fixed base seed
+    json sweep_settings = settings;
+    sweep_settings["seed"] = settings.contains("seed") ? (unsigned long long) settings["seed"] : KERNEL_BENCHMARK_SEED_DEFAULT;
+    return enumerate_tasks(sweep_settings);
+}
+
+
+std::vector<KernelBenchmarkPoint> run_kernel_benchmark(const json & settings)
+{
+    std::vector<SimulationTask> tasks = benchmark_tasks(settings);
+
+    std::vector<KernelBenchmarkPoint> points;
+    for (SimulationTask task : tasks)
+    {
+        //the runs must have the same number of steps, so they are never stopped early by their convergence monitors
+        task.monitor = nullptr;
+        for (DiagramEngine engine : {DiagramEngine::LIST, DiagramEngine::FLAT})
+            for (bool delayed_rejection : {false, true})
+            {
+                std::cout << "Running beta = " << task.beta << ", H = " << task.H << ", GAMMA = " << task.GAMMA <<
+                    " with the " << (engine == DiagramEngine::FLAT ? "flat" : "list") << " engine and " <<
+                    (delayed_rejection ? "delayed-rejection" : "single-stage") << " updates...\n";
+
+                task.engine = engine;
+                task.delayed_rejection = delayed_rejection;
+                SingleRunResults results = run_simulation(task);
+
+                KernelBenchmarkPoint point;
+                point.beta = task.beta;
+                point.H = task.H;
+                point.GAMMA = task.GAMMA;
+                point.engine = engine;
+                point.delayed_rejection = delayed_rejection;
+                point.N_steps = results.N_attempted_flips + results.N_attempted_addsegment + results.N_attempted_removesegment;
+                point.N_draws = random_draws(results, delayed_rejection);
+                point.N_accepted = results.N_accepted_flips + results.N_accepted_addsegment + results.N_accepted_removesegment;
+                point.acceptance_add = fraction(results.N_accepted_addsegment, results.N_attempted_addsegment);
+                point.acceptance_remove = fraction(results.N_accepted_removesegment, results.N_attempted_removesegment);
+                point.accepted_per_draw = fraction(point.N_accepted, point.N_draws);
+                point.ns_per_step = point.N_steps > 0 ? double(results.run_time) / point.N_steps : 0;
+                point.accepted_per_ns = results.run_time > 0 ? double(point.N_accepted) / results.run_time : 0;
+                point.ESS_per_second_sigmax = results.ESS_per_second(results.ESS_sigmax);
+                point.ESS_per_second_sigmaz = results.ESS_per_second(results.ESS_sigmaz);
+                points.push_back(point);
+            }
+    }
+    return points;
+}
+
+
+AccumulatorBenchmarkPoint measure_accumulator_cost(const SimulationTask & task)
+{
+    AccumulatorBenchmarkPoint point;
+    point.beta = task.beta;
+    point.H = task.H;
+    point.GAMMA = task.GAMMA;
+    point.N_samples = task.N_total_steps > task.N_thermalization_steps ? task.N_total_steps - task.N_thermalization_steps : 0;
+
+    //record the samples of the chain, with the same choice of the updates of the Markov chain loop
+    std::mt19937 mt_generator(task.update_choice_seed);
+    std::uniform_real_distribution<double> uniform_distribution(0, 1);
+    FlatDiagram diagram(task.beta, task.initial_s0, task.H, task.GAMMA, {}, task.diagram_seed);
+    double attempt_add_probability = (1 - task.flip_probability) / 2;
+    std::vector<size_t> orders(point.N_samples);
+    std::vector<double> mz(point.N_samples);
+
+    auto initial_time = std::chrono::steady_clock::now();
+    for (unsigned long long step = 0; step < task.N_total_steps; ++step)
+    {
+        double which_update = uniform_distribution(mt_generator);
+        if (which_update < attempt_add_probability) diagram.attempt_add_segment();
+        else if (which_update < 2 * attempt_add_probability) diagram.attempt_remove_segment();
+        else diagram.attempt_spin_flip();
+
+        if (step >= task.N_thermalization_steps)
+        {
+            orders[step - task.N_thermalization_steps] = diagram.order();
+            mz[step - task.N_thermalization_steps] = (task.beta - 2*diagram.sum_deltatau()) * diagram.get_s0() / task.beta;
+        }
+    }
+    double chain_time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - initial_time).count();
+    if (point.N_samples == 0) return point;
+
+    //baseline: the plain double running sums of the original loop (temp_sigmax, temp_sigmaz and temp_avgorder)
+    initial_time = std::chrono::steady_clock::now();
+    double temp_sigmax = 0, temp_sigmaz = 0, temp_avgorder = 0;
+    for (unsigned long long i = 0; i < point.N_samples; ++i)
+    {
+        temp_sigmax += orders[i];
+        temp_sigmaz += mz[i];
+        temp_avgorder += orders[i];
+    }
+    double baseline_time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - initial_time).count();
+
+    initial_time = std::chrono::steady_clock::now();
+    ChainStatistics statistics;
+    for (unsigned long long i = 0; i < point.N_samples; ++i) statistics.add_sample(orders[i], mz[i]);
+    double statistics_time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - initial_time).count();
+
+    //the results of the loops are used, so that they are not optimized away
+    volatile double sink = temp_sigmax + temp_sigmaz + temp_avgorder + statistics.sum_order + statistics.sum_mz.value() + statistics.binning_mz.count();
+    (void) sink;
+
+    point.ns_per_step = chain_time / task.N_total_steps;
+    point.ns_per_sample_baseline = baseline_time / point.N_samples;
+    point.ns_per_sample_statistics = statistics_time / point.N_samples;
+    point.overhead = (point.ns_per_sample_statistics - point.ns_per_sample_baseline) / point.ns_per_step;
+    return point;
+}
+
+
+std::vector<AccumulatorBenchmarkPoint> run_accumulator_benchmark(const json & settings)
+{
+    std::vector<AccumulatorBenchmarkPoint> points;
+    for (const SimulationTask & task : benchmark_tasks(settings))
+    {
+        std::cout << "Measuring the statistics of beta = " << task.beta << ", H = " << task.H << ", GAMMA = " << task.GAMMA << "...\n";
+        points.push_back(measure_accumulator_cost(task));
+    }
+    return points;
+}
+
+
+std::string kernel_benchmark_output_header()
+{
+    return
+        "beta,"
+        "H,"
+        "GAMMA,"
+        "engine,"
+        "delayed_rejection,"
+        "N_steps,"
+        "N_draws,"
+        "N_accepted,"
+        "acceptance_add,"
+        "acceptance_remove,"
+        "accepted_per_draw,"
+        "ns_per_step,"
+        "accepted_per_ns,"
+        "ESS_per_second_sigmax,"
+        "ESS_per_second_sigmaz\n";
+}
+
+
+void write_kernel_benchmark_rows(const std::vector<KernelBenchmarkPoint> & points, std::ostream & os)
+{
+    for (const auto & point : points)
+    {
+        os <<
+            point.beta << ',' <<
+            point.H << ',' <<
+            point.GAMMA << ',' <<
+            (point.engine == DiagramEngine::FLAT ? "flat" : "list") << ',' <<
+            point.delayed_rejection << ',' <<
+            point.N_steps << ',' <<
+            point.N_draws << ',' <<
+            point.N_accepted << ',' <<
+            point.acceptance_add << ',' <<
+            point.acceptance_remove << ',' <<
+            point.accepted_per_draw << ',' <<
+            point.ns_per_step << ',' <<
+            point.accepted_per_ns << ',' <<
+            point.ESS_per_second_sigmax << ',' <<
+            point.ESS_per_second_sigmaz << '\n';
+    }
+}
+
+
+std::string accumulator_benchmark_output_header()
+{
+    return
+        "beta,"
+        "H,"
+        "GAMMA,"
+        "N_samples,"
+        "ns_per_step,"
+        "ns_per_sample_baseline,"
+        "ns_per_sample_statistics,"
+        "overhead\n";
+}
+
+
+void write_accumulator_benchmark_rows(const std::vector<AccumulatorBenchmarkPoint> & points, std::ostream & os)
+{
+    for (const auto & point : points)
+    {
+        os <<
+            point.beta << ',' <<
+            point.H << ',' <<
+            point.GAMMA << ',' <<
+            point.N_samples << ',' <<
+            point.ns_per_step << ',' <<
+            point.ns_per_sample_baseline << ',' <<
+            point.ns_per_sample_statistics << ',' <<
+            point.overhead << '\n';
+    }
+}
+
+
+void kernel_benchmark(std::string settings_filename)
+{
+    //read settings from json file, and store it in a json object (dictionary-like)
+    json settings = read_settings(settings_filename);
+
+    //terminate the program if the settings are not valid
+    try
+    {
+        std::vector<KernelBenchmarkPoint> points = run_kernel_benchmark(settings);
+
+        std::cout << "\nKernels:\n\n";
+        for (const auto & point : points)
+            std::cout << "beta: " << point.beta << "  H: " << point.H << "  GAMMA: " << point.GAMMA <<
+                "  " << (point.engine == DiagramEngine::FLAT ? "flat" : "list") <<
+                (point.delayed_rejection ? "  delayed     " : "  single-stage") <<
+                "  acceptance add/remove: " << point.acceptance_add << "/" << point.acceptance_remove <<
+                "  accepted/draw: " << point.accepted_per_draw <<
+                "  " << point.ns_per_step << " ns/step" <<
+                "  ESS/s sigma_x: " << point.ESS_per_second_sigmax <<
+                "  ESS/s sigma_z: " << point.ESS_per_second_sigmaz << '\n';
+
+        std::ofstream csv_stream(settings.contains("kernel_output_file") ? std::string(settings["kernel_output_file"]) : KERNEL_BENCHMARK_OUTPUT_FILE_DEFAULT);
+        csv_stream << kernel_benchmark_output_header();
+        write_kernel_benchmark_rows(points, csv_stream);
+
+        std::vector<AccumulatorBenchmarkPoint> accumulator_points = run_accumulator_benchmark(settings);
+
+        std::cout << "\nStatistics collected at every step:\n\n";
+        for (const auto & point : accumulator_points)
+            std::cout << "beta: " << point.beta << "  H: " << point.H << "  GAMMA: " << point.GAMMA <<
+                "  chain: " << point.ns_per_step << " ns/step" <<
+                "  plain sums: " << point.ns_per_sample_baseline << " ns/sample" <<
+                "  statistics: " << point.ns_per_sample_statistics << " ns/sample" <<
+                "  overhead: " << point.overhead * 100 << "%\n";
+
+        std::ofstream accumulator_stream(settings.contains("accumulator_output_file") ? std::string(settings["accumulator_output_file"]) : ACCUMULATOR_BENCHMARK_OUTPUT_FILE_DEFAULT);
+        accumulator_stream << accumulator_benchmark_output_header();
+        write_accumulator_benchmark_rows(accumulator_points, accumulator_stream);
+    }
+    catch(const std::invalid_argument & e)
+    {
+        std::cerr << "\nError: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,207 @@
+/**
+ * @file lockstep.cpp
+ * @brief Definitions of the functions of the differential checker between the reference and the optimized engines
+ */
+
+#include <diagmc/lockstep.h>
+#include <diagmc/diagram.h>
+#include <diagmc/flat_diagram.h>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+
+
+/**
+ * @brief Returns the state of an engine
+ *
+ * @param diagram reference or optimized engine
+ * @return EngineState
+ */
+template <class DiagramType>
+static EngineState engine_state(const DiagramType & diagram)
+{
+    auto vertices = diagram.get_vertices();
+    return {diagram.get_s0(), std::vector<double>(vertices.begin(), vertices.end()), diagram.sum_deltatau()};
+}
+
+
+/**
+ * @brief Acceptance rate of the update proposed with the given random numbers, computed with the acceptance_rate_* method of the engine.
+ * The proposal (tau1, tau2, tau2max and the spin of the segment) is derived from the vertices, as described in Diagram_core.
+ *
+ * @param diagram reference or optimized engine, in the state before the update
+ * @param vertices vertices of the diagram before the update
+ * @param update "add", "remove" or "flip"
+ * @param RN1 first random number of the update
+ * @param RN2 second random number of the update
+ * @return double
+ */
+template <class DiagramType>
+static double proposal_acceptance_rate(const DiagramType & diagram, const std::vector<double> & vertices, const std::string & update, double RN1, double RN2)
+{
+    if (update == "add")
+    {
+        double tau1 = RN1 * diagram.get_beta();
+        size_t index = std::upper_bound(vertices.begin(), vertices.end(), tau1) - vertices.begin();
+        double tau2max = index < vertices.size() ? vertices[index] : diagram.get_beta();
+        double tau2 = tau1 + RN2 * (tau2max - tau1);
+        return diagram.acceptance_rate_add(tau1, tau2, tau2max, index % 2 == 0 ? -diagram.get_s0() : diagram.get_s0());
+    }
+    else if (update == "remove")
+    {
+        if (vertices.empty()) return 0; //the update is rejected right away
+        size_t index = RN1 * (vertices.size() - 1) + 1;
+        double tau2max = index + 1 < vertices.size() ? vertices[index + 1] : diagram.get_beta();
+        return diagram.acceptance_rate_remove(vertices[index - 1], vertices[index], tau2max, index % 2 == 0 ? diagram.get_s0() : -diagram.get_s0());
+    }
+    else return diagram.acceptance_rate_flip();
+}
+
+
+/**
+ * @brief Returns a description of the first difference between the states of the two engines, or an empty string if they are equal
+ *
+ * @param reference state of the reference engine
+ * @param optimized state of the optimized engine
+ * @return std::string
+ */
+static std::string state_difference(const EngineState & reference, const EngineState & optimized)
+{
+    if (reference.s0 != optimized.s0) return "different s0";
+    if (reference.vertices.size() != optimized.vertices.size()) return "different diagram order";
+    for (size_t i = 0; i < reference.vertices.size(); ++i)
+        if (std::fabs(reference.vertices[i] - optimized.vertices[i]) > EPSILON) return "different vertex " + std::to_string(i);
+    if (std::fabs(reference.sum_deltatau - optimized.sum_deltatau) > EPSILON) return "different sum_deltatau";
+    return "";
+}
+
+
+LockstepReport run_lockstep_check(const SimulationTask & task)
+{
+    //the two engines start from the same 0-order diagram
+    Diagram_core reference(task.beta, task.initial_s0, task.H, task.GAMMA);
+    FlatDiagram_core optimized(task.beta, task.initial_s0, task.H, task.GAMMA);
+
+    //objects for random choice of the update, and for the random numbers used inside the updates
+    std::mt19937 update_choice_generator(task.update_choice_seed);
+    std::mt19937 diagram_generator(task.diagram_seed);
+    std::uniform_real_distribution<double> uniform_distribution(0, 1);
+
+    //same probabilities of choosing the updates of run_simulation
+    constexpr double attempt_flip_probability = 1./3;
+    constexpr double attempt_add_probability = (1 - attempt_flip_probability)/2;
+    constexpr double attempt_remove_probability = attempt_add_probability;
+
+    LockstepReport report;
+    for (unsigned long long step = 0; step < task.N_total_steps; ++step)
+    {
+        //random numbers of the step, extracted in a fixed order and passed to both engines
+        double which_update = uniform_distribution(update_choice_generator);
+        double RN1 = uniform_distribution(diagram_generator);
+        double RN2 = uniform_distribution(diagram_generator);
+        double RNacc = uniform_distribution(diagram_generator);
+        double RNacc2 = task.delayed_rejection ? uniform_distribution(diagram_generator) : 0; //second stage of the delayed-rejection ADD_SEGMENT
+
+        std::string update;
+        if (which_update < attempt_add_probability) update = "add";
+        else if (which_update < attempt_add_probability + attempt_remove_probability) update = "remove";
+        else update = "flip";
+
+        //the state before the step is kept to report the context of a divergence
+        std::vector<double> vertices_before = optimized.get_vertices();
+        int s0_before = optimized.get_s0();
+        double sum_deltatau_before = optimized.sum_deltatau();
+
+        double reference_rate = proposal_acceptance_rate(reference, vertices_before, update, RN1, RN2);
+        double optimized_rate = proposal_acceptance_rate(optimized, vertices_before, update, RN1, RN2);
+        bool borderline = std::fabs(RNacc - reference_rate) <= BORDERLINE_TOLERANCE * std::max(std::fabs(reference_rate), std::numeric_limits<double>::min());
+        report.N_borderline_steps += borderline;
+
+        bool reference_accepted, optimized_accepted;
+        if (update == "add")
+        {
+            reference_accepted = task.delayed_rejection ? reference.attempt_add_segment_delayed(RN1, RN2, RNacc, RNacc2) : reference.attempt_add_segment(RN1, RN2, RNacc);
+            optimized_accepted = task.delayed_rejection ? optimized.attempt_add_segment_delayed(RN1, RN2, RNacc, RNacc2) : optimized.attempt_add_segment(RN1, RN2, RNacc);
+        }
+        else if (update == "remove")
+        {
+            reference_accepted = task.delayed_rejection ? reference.attempt_remove_segment_delayed(RN1, RNacc) : reference.attempt_remove_segment(RN1, RNacc);
+            optimized_accepted = task.delayed_rejection ? optimized.attempt_remove_segment_delayed(RN1, RNacc) : optimized.attempt_remove_segment(RN1, RNacc);
+        }
+        else
+        {
+            reference_accepted = reference.attempt_spin_flip(RNacc);
+            optimized_accepted = optimized.attempt_spin_flip(RNacc);
+        }
+        ++report.N_steps_checked;
+
+        //compare the decisions, and then the states after the step
+        EngineState reference_after = engine_state(reference);
+        EngineState optimized_after = engine_state(optimized);
+        std::string reason = reference_accepted != optimized_accepted ? "different acceptance" : state_difference(reference_after, optimized_after);
+        if (reason.empty()) continue;
+
+        //first divergence: store the full context and stop
+        report.diverged = true;
+        report.step = step;
+        report.update = update;
+        report.reason = reason;
+        report.RN1 = RN1;
+        report.RN2 = RN2;
+        report.RNacc = RNacc;
+        report.reference_acceptance_rate = reference_rate;
+        report.optimized_acceptance_rate = optimized_rate;
+        report.borderline = borderline;
+        report.reference_accepted = reference_accepted;
+        report.optimized_accepted = optimized_accepted;
+        report.state_before = {s0_before, vertices_before, sum_deltatau_before};
+        report.reference_after = reference_after;
+        report.optimized_after = optimized_after;
+        break;
+    }
+
+    return report;
+}
+
+
+/**
+ * @brief Writes the state of an engine on a single line
+ *
+ * @param os output stream
+ * @param name label of the state
+ * @param state state of the engine
+ */
+static void print_engine_state(std::ostream & os, const std::string & name, const EngineState & state)
+{
+    os << name << "s0 = " << state.s0 << ", order = " << state.vertices.size() << ", sum_deltatau = " << state.sum_deltatau << ", vertices = [";
+    for (size_t i = 0; i < state.vertices.size(); ++i) os << (i ? ", " : "") << state.vertices[i];
+    os << "]\n";
+}
+
+
+void print_lockstep_report(const LockstepReport & report, std::ostream & os)
+{
+    os << std::setprecision(17);
+    os << "Steps checked     : " << report.N_steps_checked << '\n';
+    os << "Borderline steps  : " << report.N_borderline_steps << '\n';
+
+    if (!report.diverged)
+    {
+        os << "No divergence: the reference and optimized engines took the same decisions at every step.\n";
+        return;
+    }
+
+    os << "\nFirst divergence at step " << report.step << " (" << report.update << " update): " << report.reason << '\n';
+    os << "RN1 = " << report.RN1 << ", RN2 = " << report.RN2 << ", RNacc = " << report.RNacc << '\n';
+    os << "Acceptance rate   : reference = " << report.reference_acceptance_rate << ", optimized = " << report.optimized_acceptance_rate
+       << (report.borderline ? " (borderline: RNacc is within rounding of the acceptance rate)" : "") << '\n';
+    os << "Accepted          : reference = " << report.reference_accepted << ", optimized = " << report.optimized_accepted << '\n';
+    print_engine_state(os, "Before            : ", report.state_before);
+    print_engine_state(os, "Reference after   : ", report.reference_after);
+    print_engine_state(os, "Optimized after   : ", report.optimized_after);
+}
@@ -2,23 +2,101 @@
  * @file main.cpp
  * @brief Main function of the executable for the Diagrammatic Monte Carlo code for a 2-level spin system in a magnetic field.
  * It reads the settings from 'settings.json' file by default. A different filename can be provided as a command-line argument upon execution.
+ * With the --plan option, the calculation is not run, and only its predicted run time, output size and memory are printed.
+ * With the --scaling option, the sweep in the settings file is run as a strong and weak scaling benchmark.
+ * With the --kernels option, the points of the sweep in the settings file are run as a benchmark of the single-stage and delayed-rejection updates.
+ * With the --serve option, the program runs as a server receiving jobs on a Unix domain socket, and with --submit it sends a job to a running server.
  * @author Enrico Pedretti
  * @date 2023-09-03
  */
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <diagmc/setup.h>
+#include <diagmc/planner.h>
+#include <diagmc/scaling.h>
+#include <diagmc/kernel_benchmark.h>
+#include <diagmc/server.h>
+#include <string>
+#include <stdexcept>
+#include <stdlib.h>
 
 
 
 int main(int argc, char** argv)
 {
 
+	std::string option = argc >= 2 ? argv[1] : "";
+
+	//client mode: send the settings file as a job to a running server, and print the resulting csv rows on standard output
+	if (option == "--submit")
+	{
+		if (argc != 4)
+		{
+			std::cerr << "Usage: " << argv[0] << " --submit socket_path settings_filename" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		std::ifstream filestream(argv[3]);
+		std::stringstream job;
+		job << filestream.rdbuf();
+		if (!filestream)
+		{
+			std::cerr << "Unable to open the settings file " << argv[3] << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		try
+		{
+			return submit_job(argv[2], job.str(), std::cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		catch(const std::runtime_error & e)
+		{
+			std::cerr << "Error: " << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
 	std::cout<<"Diagrammatic Monte Carlo code for a two level spin sistem in a magnetic field.\n\n";
 
+	//server mode: run jobs received on a Unix domain socket on a warm pool of threads, until a shutdown command is received
+	if (option == "--serve")
+	{
+		if (argc < 3)
+		{
+			std::cerr << "Usage: " << argv[0] << " --serve socket_path [N_threads]" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		try
+		{
+			run_server(argv[2], argc >= 4 ? std::stoi(argv[3]) : 1);
+		}
+		catch(const std::exception & e)
+		{
+			std::cerr << "Error: " << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+
+	//optional --plan flag, to only print the predicted cost of the calculation, 
+	//--scaling flag, to run the sweep as a scaling benchmark, and --kernels flag, to run it as a benchmark of the updates
+	bool plan_only = option == "--plan";
+	bool scaling_only = option == "--scaling";
+	bool kernels_only = option == "--kernels";
+	int filename_index = (plan_only || scaling_only || kernels_only) ? 2 : 1;
+
+	//name of the settings file, that can be optionally specified by passing it as a command-line argument
+	std::string settings_filename = argc > filename_index ? argv[filename_index] : "settings.json";
 
-	//launch the calculations, optionally specifying which settings file to use by passing it as a command-line argument
-	launch_calculations(argc == 2 ? argv[1] : "settings.json");
+	//launch the calculations, or just print their plan, or run the benchmark
+	if (plan_only) plan_calculations(settings_filename);
+	else if (scaling_only) scaling_benchmark(settings_filename);
+	else if (kernels_only) kernel_benchmark(settings_filename);
+	else launch_calculations(settings_filename);
 
 
 	//option to avoid the terminal to close after the execution if run by double-click on the .exe file on Windows
@@ -0,0 +1,348 @@
+/**
+ * @file mbar.cpp
+ * @brief Definitions of the SufficientStatisticsHistogram and MultiHistogramSolver classes
+ */
+
+#include <diagmc/mbar.h>
+#include <diagmc/thread_pool.h>
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+//number of cells of the chunks in which the sums over the cells are split among the threads.
+//It is fixed, so that the results do not depend on the number of threads
+#define MBAR_CHUNK_SIZE 1024
+
+
+//Methods definitions for class SufficientStatisticsHistogram ---------------------------------------
+SufficientStatisticsHistogram::SufficientStatisticsHistogram(double beta, unsigned int N_bins)
+    : _beta(beta), _N_bins(N_bins)
+{
+    if (!(beta > 0)) throw std::invalid_argument("beta must be > 0, but " + std::to_string(beta) + " was provided.");
+    if (N_bins == 0) throw std::invalid_argument("the number of bins of the histogram must be > 0.");
+}
+
+void SufficientStatisticsHistogram::add_sample(size_t order, double M)
+{
+    //bin of M in [-beta, beta], clamped to absorb the rounding at the edges
+    long bin = std::floor((M + _beta) / (2 * _beta) * _N_bins);
+    bin = std::min(std::max(bin, 0L), (long) _N_bins - 1);
+
+    //only even orders are possible, so the rows of the histogram are indexed by n/2
+    size_t index = (order / 2) * _N_bins + bin;
+    if (index >= _counts.size())
+    {
+        _counts.resize((order / 2 + 1) * _N_bins, 0);
+        _sum_M.resize((order / 2 + 1) * _N_bins, 0);
+    }
+
+    ++_counts[index];
+    _sum_M[index] += M;
+}
+
+SufficientStatisticsHistogram SufficientStatisticsHistogram::mirrored() const
+{
+    //the bins are symmetric around M = 0, so M -> -M reverses the bins of each order
+    SufficientStatisticsHistogram histogram = *this;
+    for (size_t index = 0; index < _counts.size(); ++index)
+    {
+        size_t row = index / _N_bins;
+        size_t mirrored_index = row * _N_bins + (_N_bins - 1 - index % _N_bins);
+        histogram._counts[mirrored_index] = _counts[index];
+        histogram._sum_M[mirrored_index] = -_sum_M[index];
+    }
+    return histogram;
+}
+
+double SufficientStatisticsHistogram::get_beta() const {
+    return _beta;
+}
+
+unsigned int SufficientStatisticsHistogram::get_N_bins() const {
+    return _N_bins;
+}
+
+const std::vector<unsigned long long> & SufficientStatisticsHistogram::get_counts() const {
+    return _counts;
+}
+
+const std::vector<double> & SufficientStatisticsHistogram::get_sum_M() const {
+    return _sum_M;
+}
+
+unsigned long long SufficientStatisticsHistogram::N_samples() const
+{
+    unsigned long long N = 0;
+    for (auto count : _counts) N += count;
+    return N;
+}
+//--------------------------------------------------------------------------------------------------
+
+
+
+
+
+/**
+ * @brief Partial result of a log-sum-exp: the sum is max * sum exp(x - max)
+ */
+struct LogSumExp
+{
+    double max = -std::numeric_limits<double>::infinity();  ///< maximum of the terms
+    double sum = 0;                                         ///< sum of exp(x - max) of the terms
+
+    /**
+     * @brief Adds a term x (in log scale)
+     */
+    void add(double x)
+    {
+        if (x > max)
+        {
+            sum = sum * std::exp(max - x) + 1;
+            max = x;
+        }
+        else sum += std::exp(x - max);
+    }
+
+    /**
+     * @brief Merges another partial result
+     */
+    void merge(const LogSumExp & other)
+    {
+        if (other.sum == 0) return;
+        if (other.max > max)
+        {
+            sum = sum * std::exp(max - other.max) + other.sum;
+            max = other.max;
+        }
+        else sum += other.sum * std::exp(other.max - max);
+    }
+
+    /**
+     * @brief Returns the logarithm of the sum of the exponentials of the terms
+     */
+    double value() const
+    {
+        return max + std::log(sum);
+    }
+};
+
+
+/**
+ * @brief Merges the partial sums with a fixed binary tree over their indices ((0+1)+(2+3))+..., 
+ * so that the result only depends on the partial sums, and not on the order in which they were computed
+ *
+ * @param sums partial sums
+ * @return LogSumExp
+ */
+static LogSumExp pairwise_merge(std::vector<LogSumExp> sums)
+{
+    if (sums.empty()) return LogSumExp();
+    for (size_t stride = 1; stride < sums.size(); stride *= 2)
+        for (size_t i = 0; i + stride < sums.size(); i += 2*stride)
+            sums[i].merge(sums[i + stride]);
+    return sums.front();
+}
+
+
+/**
+ * @brief Splits the range [0, n) in contiguous chunks of MBAR_CHUNK_SIZE elements, calling function(begin, end) for each chunk
+ * on the pool, and returns the results of the chunks in order.
+ * The chunks do not depend on the number of threads of the pool, so neither do the results.
+ *
+ * @param pool pool of threads
+ * @param n size of the range
+ * @param function function called for each chunk
+ * @return std::vector with the results of the chunks
+ */
+template <class Function>
+static auto map_chunks(ThreadPool & pool, size_t n, Function function) -> std::vector<decltype(function(size_t(0), size_t(0)))>
+{
+    std::vector<std::future<decltype(function(size_t(0), size_t(0)))>> futures;
+    for (size_t begin = 0; begin < n; begin += MBAR_CHUNK_SIZE)
+    {
+        size_t end = std::min<size_t>(begin + MBAR_CHUNK_SIZE, n);
+        futures.push_back(pool.submit([&function, begin, end]() { return function(begin, end); }));
+    }
+
+    std::vector<decltype(function(size_t(0), size_t(0)))> results;
+    for (auto & future : futures) results.push_back(future.get());
+    return results;
+}
+
+
+//Methods definitions for class MultiHistogramSolver -----------------------------------------------
+MultiHistogramSolver::MultiHistogramSolver(const std::vector<SufficientStatisticsHistogram> & histograms,
+    const std::vector<double> & H, const std::vector<double> & GAMMA, ThreadPool & pool)
+    : _pool(pool)
+{
+    if (histograms.empty()) throw std::invalid_argument("at least one histogram is needed for the multi-histogram analysis.");
+    if (histograms.size() != H.size() || histograms.size() != GAMMA.size())
+        throw std::invalid_argument("the number of histograms and of the values of H and GAMMA must be the same.");
+
+    _beta = histograms.front().get_beta();
+    unsigned int N_bins = histograms.front().get_N_bins();
+
+    //total count and sum of M of each cell, over all the runs
+    std::vector<unsigned long long> counts;
+    std::vector<double> sum_M;
+    for (size_t k = 0; k < histograms.size(); ++k)
+    {
+        const auto & histogram = histograms[k];
+        if (histogram.get_beta() != _beta || histogram.get_N_bins() != N_bins)
+            throw std::invalid_argument("the histograms of the multi-histogram analysis must have the same beta and number of bins.");
+        if (histogram.N_samples() == 0) throw std::invalid_argument("the histograms of the multi-histogram analysis must not be empty.");
+        if (std::abs(GAMMA[k]) < std::numeric_limits<double>::epsilon()) throw std::invalid_argument("GAMMA must be different from 0.");
+
+        _H.push_back(H[k]);
+        _log_GAMMA.push_back(std::log(std::abs(GAMMA[k])));
+        _log_N_samples.push_back(std::log((double) histogram.N_samples()));
+
+        const auto & histogram_counts = histogram.get_counts();
+        const auto & histogram_sum_M = histogram.get_sum_M();
+        if (histogram_counts.size() > counts.size())
+        {
+            counts.resize(histogram_counts.size(), 0);
+            sum_M.resize(histogram_counts.size(), 0);
+        }
+        for (size_t index = 0; index < histogram_counts.size(); ++index)
+        {
+            counts[index] += histogram_counts[index];
+            sum_M[index] += histogram_sum_M[index];
+        }
+    }
+
+    //contiguous arrays of the non-empty cells
+    for (size_t index = 0; index < counts.size(); ++index)
+    {
+        if (counts[index] == 0) continue;
+        _cell_order.push_back(2. * (index / N_bins));
+        _cell_M.push_back(sum_M[index] / counts[index]);
+        _cell_log_count.push_back(std::log((double) counts[index]));
+    }
+    _cell_log_denominator.assign(_cell_order.size(), 0);
+
+    _g.assign(histograms.size(), 0);
+}
+
+
+void MultiHistogramSolver::update_denominators()
+{
+    map_chunks(_pool, _cell_order.size(), [this](size_t begin, size_t end)
+    {
+        for (size_t c = begin; c < end; ++c)
+        {
+            LogSumExp denominator;
+            for (size_t j = 0; j < _g.size(); ++j)
+                denominator.add(_log_N_samples[j] + _cell_order[c] * _log_GAMMA[j] - _H[j] * _cell_M[c] - _g[j]);
+            _cell_log_denominator[c] = denominator.value();
+        }
+        return 0;
+    });
+}
+
+
+std::vector<double> MultiHistogramSolver::log_sums_over_cells(const std::vector<double> & log_GAMMA, const std::vector<double> & H) const
+{
+    auto partial_sums = map_chunks(_pool, _cell_order.size(), [this, &log_GAMMA, &H](size_t begin, size_t end)
+    {
+        std::vector<LogSumExp> sums(H.size());
+        for (size_t c = begin; c < end; ++c)
+        {
+            double log_count = _cell_log_count[c] - _cell_log_denominator[c];
+            for (size_t k = 0; k < H.size(); ++k)
+                sums[k].add(log_count + _cell_order[c] * log_GAMMA[k] - H[k] * _cell_M[c]);
+        }
+        return sums;
+    });
+
+    std::vector<double> log_sums;
+    for (size_t k = 0; k < H.size(); ++k)
+    {
+        std::vector<LogSumExp> chunk_sums;
+        for (const auto & chunk : partial_sums) chunk_sums.push_back(chunk[k]);
+        log_sums.push_back(pairwise_merge(chunk_sums).value());
+    }
+    return log_sums;
+}
+
+
+int MultiHistogramSolver::solve(double tolerance, int max_iterations)
+{
+    int iteration = 0;
+    while (iteration < max_iterations)
+    {
+        ++iteration;
+
+        update_denominators();
+        std::vector<double> new_g = log_sums_over_cells(_log_GAMMA, _H);
+
+        //the partition functions are determined up to a common factor: fix g_0 = 0
+        double max_change = 0;
+        for (size_t k = 0; k < _g.size(); ++k)
+        {
+            double g = new_g[k] - new_g[0];
+            max_change = std::max(max_change, std::abs(g - _g[k]));
+            _g[k] = g;
+        }
+
+        if (max_change < tolerance) break;
+    }
+
+    update_denominators();
+    return iteration;
+}
+
+
+const std::vector<double> & MultiHistogramSolver::log_partition_functions() const {
+    return _g;
+}
+
+
+MultiHistogramEstimate MultiHistogramSolver::evaluate(double H, double GAMMA) const
+{
+    if (std::abs(GAMMA) < std::numeric_limits<double>::epsilon()) throw std::invalid_argument("GAMMA must be different from 0.");
+    double log_GAMMA = std::log(std::abs(GAMMA));
+
+    //log of the weight of a single sample of each cell at the point, u(c) - log_denominator(c)
+    auto sample_log_weight = [this, log_GAMMA, H](size_t c) { return _cell_order[c] * log_GAMMA - H * _cell_M[c] - _cell_log_denominator[c]; };
+
+    //first pass: maximum of the weights, to normalize them
+    double max_log_weight = -std::numeric_limits<double>::infinity();
+    for (double chunk_max : map_chunks(_pool, _cell_order.size(), [&](size_t begin, size_t end)
+        {
+            double chunk_max = -std::numeric_limits<double>::infinity();
+            for (size_t c = begin; c < end; ++c) chunk_max = std::max(chunk_max, sample_log_weight(c));
+            return chunk_max;
+        }))
+        max_log_weight = std::max(max_log_weight, chunk_max);
+
+    //second pass: weighted sums over the samples of each cell. sums = {sum w, sum w^2, sum w n, sum w M}
+    std::vector<double> sums(4, 0);
+    for (const auto & chunk_sums : map_chunks(_pool, _cell_order.size(), [&](size_t begin, size_t end)
+        {
+            std::vector<double> chunk_sums(4, 0);
+            for (size_t c = begin; c < end; ++c)
+            {
+                double count = std::exp(_cell_log_count[c]);
+                double w = std::exp(sample_log_weight(c) - max_log_weight);
+                chunk_sums[0] += count * w;
+                chunk_sums[1] += count * w * w;
+                chunk_sums[2] += count * w * _cell_order[c];
+                chunk_sums[3] += count * w * _cell_M[c];
+            }
+            return chunk_sums;
+        }))
+        for (size_t i = 0; i < sums.size(); ++i) sums[i] += chunk_sums[i];
+
+    MultiHistogramEstimate estimate;
+    estimate.sigmax = -sums[2] / sums[0] / (_beta * GAMMA);
+    estimate.sigmaz = sums[3] / sums[0] / _beta;
+    estimate.ESS = sums[0] * sums[0] / sums[1];
+    return estimate;
+}
+//--------------------------------------------------------------------------------------------------
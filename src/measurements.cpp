@@ -0,0 +1,204 @@
+/**
+ * @file measurements.cpp
+ * @brief Definition of the asynchronous measurement pipeline and of the observables measured on the snapshots of the diagrams
+ */
+
+#include <diagmc/measurements.h>
+#include <diagmc/simd.h>
+#include <algorithm>
+#include <stdexcept>
+
+
+double diagram_correlation_zz(int s0, const std::vector<double> & vertices, double beta, double tau)
+{
+    size_t n = vertices.size();
+    if (n == 0) return 1;
+
+    //sigma(t+tau) has its discontinuities at the vertices shifted by -tau (modulo beta): starting from the first vertex >= tau,
+    //they are already sorted, and the ones before tau wrap around to the end of [0, beta)
+    size_t k = simd_lower_bound(vertices.data(), n, tau);
+    auto shifted_vertex = [&](size_t j) { return (j + k < n) ? vertices[j + k] - tau : vertices[j + k - n] - tau + beta; };
+
+    //spins at t = 0 of sigma(t) and sigma(t+tau): the segment containing tau is preceded by k vertices
+    int spin = s0;
+    int shifted_spin = (k % 2 == 0) ? s0 : -s0;
+
+    //sweep over the merged discontinuities of the two functions, integrating their product
+    double integral = 0;
+    double t = 0;
+    size_t i = 0, j = 0;
+    while (i < n || j < n)
+    {
+        double next;
+        if (j == n || (i < n && vertices[i] <= shifted_vertex(j)))
+        {
+            next = vertices[i++];
+            integral += spin * shifted_spin * (next - t);
+            spin = -spin;
+        }
+        else
+        {
+            next = shifted_vertex(j++);
+            integral += spin * shifted_spin * (next - t);
+            shifted_spin = -shifted_spin;
+        }
+        t = next;
+    }
+    integral += spin * shifted_spin * (beta - t);
+
+    return integral / beta;
+}
+
+
+MeasurementPipeline::MeasurementPipeline(double beta, const MeasurementOptions & options)
+    : _beta(beta), _options(options)
+{
+    if (beta <= 0) throw std::invalid_argument("beta must be > 0.");
+    if (options.measure_interval == 0) throw std::invalid_argument("measure_interval must be > 0.");
+    if (options.N_measurement_threads == 0) throw std::invalid_argument("N_measurement_threads must be > 0.");
+
+    for (unsigned int i = 0; i < options.N_measurement_threads; ++i)
+        _consumers.push_back(std::make_unique<Consumer>(options.buffer_size));
+
+    //threads are started only after all the consumers are allocated
+    for (auto & consumer : _consumers)
+        consumer->thread = std::thread(&MeasurementPipeline::consumer_loop, this, std::ref(*consumer));
+}
+
+
+MeasurementPipeline::~MeasurementPipeline()
+{
+    stop_consumers();
+}
+
+
+void MeasurementPipeline::stop_consumers()
+{
+    _done = true;
+    for (auto & consumer : _consumers)
+    {
+        //the lock orders the flag with the check of a measurement thread about to sleep, so that the wake up is not lost
+        {
+            std::lock_guard<std::mutex> lock(consumer->mutex);
+            consumer->not_empty.notify_one();
+        }
+        if (consumer->thread.joinable()) consumer->thread.join();
+    }
+}
+
+
+void MeasurementPipeline::consumer_loop(Consumer & consumer)
+{
+    //partial sums owned by this thread
+    std::vector<BoundedExactSum> correlation_sum(_options.correlation_bins);
+    std::vector<unsigned long long> segment_length_counts(_options.segment_length_bins, 0);
+    unsigned long long N_snapshots = 0;
+
+    while (true)
+    {
+        DiagramSnapshot * snapshot = consumer.buffer.try_front();
+        if (snapshot != nullptr)
+        {
+            measure(*snapshot, correlation_sum, segment_length_counts);
+            consumer.buffer.pop();
+            ++N_snapshots;
+
+            //wake up the producer if it is waiting for a free slot (the fence pairs with the one in wait_for_slot)
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (consumer.producer_sleeping.load(std::memory_order_relaxed))
+            {
+                std::lock_guard<std::mutex> lock(consumer.mutex);
+                consumer.not_full.notify_one();
+            }
+        }
+        else if (_done)
+        {
+            //the producer has stopped: empty the buffer before leaving
+            if (consumer.buffer.try_front() == nullptr) break;
+        }
+        else
+        {
+            //sleep until the producer pushes a snapshot or the pipeline is finished (the fence pairs with the one in notify_pushed)
+            std::unique_lock<std::mutex> lock(consumer.mutex);
+            consumer.consumer_sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            consumer.not_empty.wait(lock, [&]() { return consumer.buffer.try_front() != nullptr || _done; });
+            consumer.consumer_sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    consumer.correlation_sum = std::move(correlation_sum);
+    consumer.segment_length_counts = std::move(segment_length_counts);
+    consumer.N_snapshots = N_snapshots;
+}
+
+
+void MeasurementPipeline::measure(const DiagramSnapshot & snapshot, std::vector<BoundedExactSum> & correlation_sum, std::vector<unsigned long long> & segment_length_counts) const
+{
+    const std::vector<double> & vertices = snapshot.vertices;
+
+    for (unsigned int i = 0; i < _options.correlation_bins; ++i)
+    {
+        double tau = (i + 0.5) * _beta / _options.correlation_bins;
+        //the correlation is in [-1, 1] up to rounding errors
+        double correlation = diagram_correlation_zz(snapshot.s0, vertices, _beta, tau);
+        correlation_sum[i].add(std::clamp(correlation, -1., 1.));
+    }
+
+    if (_options.segment_length_bins > 0)
+    {
+        unsigned int N_bins = _options.segment_length_bins;
+        auto add_length = [&](double length)
+        {
+            unsigned int bin = std::min(static_cast<unsigned int>(length / _beta * N_bins), N_bins - 1);
+            ++segment_length_counts[bin];
+        };
+
+        if (vertices.empty()) add_length(_beta);
+        else
+        {
+            for (size_t j = 1; j < vertices.size(); ++j) add_length(vertices[j] - vertices[j-1]);
+            add_length(vertices.front() + _beta - vertices.back()); //the first and the last segments are the same periodic segment
+        }
+    }
+}
+
+
+MeasuredObservables MeasurementPipeline::finish()
+{
+    MeasuredObservables observables;
+    if (_finished) return observables;
+    _finished = true;
+    stop_consumers();
+
+    //merge the partial sums of the measurement threads
+    std::vector<BoundedExactSum> correlation_sum(_options.correlation_bins);
+    std::vector<unsigned long long> segment_length_counts(_options.segment_length_bins, 0);
+    unsigned long long N_segments = 0;
+    for (const auto & consumer : _consumers)
+    {
+        observables.N_snapshots += consumer->N_snapshots;
+        for (unsigned int i = 0; i < _options.correlation_bins; ++i) correlation_sum[i].merge(consumer->correlation_sum[i]);
+        for (unsigned int i = 0; i < _options.segment_length_bins; ++i)
+        {
+            segment_length_counts[i] += consumer->segment_length_counts[i];
+            N_segments += consumer->segment_length_counts[i];
+        }
+    }
+    observables.N_dropped = _N_dropped;
+
+    for (unsigned int i = 0; i < _options.correlation_bins; ++i)
+    {
+        observables.tau.push_back((i + 0.5) * _beta / _options.correlation_bins);
+        observables.correlation_zz.push_back(observables.N_snapshots > 0 ? correlation_sum[i].value() / observables.N_snapshots : 0);
+    }
+
+    double bin_width = _beta / std::max(_options.segment_length_bins, 1u);
+    for (unsigned int i = 0; i < _options.segment_length_bins; ++i)
+    {
+        observables.segment_length.push_back((i + 0.5) * bin_width);
+        observables.segment_length_density.push_back(N_segments > 0 ? segment_length_counts[i] / (N_segments * bin_width) : 0);
+    }
+
+    return observables;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file order_statistics.cpp
+ * @brief Definitions of the OrderDistribution struct and of the OrderHistogram class
+ */
+
+#include <diagmc/order_statistics.h>
+#include <stdexcept>
+
+
+unsigned long long OrderDistribution::N_samples() const
+{
+    unsigned long long N = 0;
+    for (auto count : counts) N += count;
+    return N;
+}
+
+
+unsigned long long OrderDistribution::quantile(double p) const
+{
+    if (!(p > 0 && p <= 1)) throw std::invalid_argument("the probability of the quantile must be in (0, 1].");
+
+    unsigned long long N = N_samples();
+    if (N == 0) return 0;
+
+    //first order at which the cumulative count reaches p*N
+    unsigned long long cumulative = 0;
+    for (size_t i = 0; i < counts.size(); ++i)
+    {
+        cumulative += counts[i];
+        if (cumulative >= p * N) return 2*i;
+    }
+    return 2*(counts.size() - 1);
+}
+
+
+OrderDistribution OrderHistogram::distribution() const
+{
+    OrderDistribution distribution;
+    distribution.counts = _counts;
+    for (size_t i = 0; i < _counts.size(); ++i)
+        distribution.sigmaz.push_back(_counts[i] > 0 ? _sum_mz[i].value() / _counts[i] : 0);
+    return distribution;
+}
@@ -0,0 +1,246 @@
+/**
+ * @file planner.cpp
+ * @brief Definitions of the functions of the dry-run planner, which estimates run time, output size and memory of a calculation without running it
+ */
+
+#include <diagmc/planner.h>
+#include <diagmc/setup.h>
+#include <diagmc/simulation.h>
+#include <diagmc/diagram.h>
+#include <diagmc/flat_diagram.h>
+#include <diagmc/exact.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+//parameters of the built-in benchmark used to calibrate the cost model
+#define CALIBRATION_STEPS 200000
+#define CALIBRATION_THERMALIZATION_STEPS 20000
+
+//approximate size in bytes of a node of std::list<double> (two pointers and the value, plus allocator overhead)
+#define LIST_NODE_BYTES 32
+
+
+double predicted_diagram_memory(const SimulationTask & task)
+{
+    double max_order = expected_max_diagram_order(task);
+    if (task.engine == DiagramEngine::LIST) return sizeof(Diagram) + sizeof(std::mt19937) + LIST_NODE_BYTES * max_order;
+
+    //the capacity of the std::vector of the vertices is the smallest power of 2 holding them
+    double capacity = 1;
+    while (capacity < max_order) capacity *= 2;
+    return sizeof(FlatDiagram) + sizeof(std::mt19937) + sizeof(double) * capacity;
+}
+
+
+double CostModel::ns_per_step(double average_order) const
+{
+    return ns_per_step_base + ns_per_step_per_order * average_order;
+}
+
+
+double expected_max_diagram_order(const SimulationTask & task)
+{
+    //order exceeded with probability 1/N_total_steps at each step
+    double p = 1 - 1. / std::max(2ULL, task.N_total_steps);
+    return exact_order_quantile(p, task.beta, task.H, task.GAMMA);
+}
+
+
+CostModel calibrate_cost_model()
+{
+    //probe points with H=0 and GAMMA=1, for which the average order grows linearly with beta
+    std::vector<double> probe_betas = {1, 4, 16, 64};
+    std::vector<double> orders, ns_per_step;
+
+    for (auto beta : probe_betas)
+    {
+        SingleRunResults results = run_simulation(beta, 1, 0, 1, CALIBRATION_STEPS, CALIBRATION_THERMALIZATION_STEPS, 1111, 2222);
+        orders.push_back(-results.measured_sigmax * beta); //<n> = -beta * GAMMA * <sigma_x>
+        ns_per_step.push_back((double) results.run_time / CALIBRATION_STEPS);
+    }
+
+    //least squares fit of ns_per_step = a + b * order
+    double n = orders.size();
+    double mean_order = 0, mean_ns = 0;
+    for (size_t i = 0; i < orders.size(); ++i)
+    {
+        mean_order += orders[i] / n;
+        mean_ns += ns_per_step[i] / n;
+    }
+    double covariance = 0, variance = 0;
+    for (size_t i = 0; i < orders.size(); ++i)
+    {
+        covariance += (orders[i] - mean_order) * (ns_per_step[i] - mean_ns);
+        variance += (orders[i] - mean_order) * (orders[i] - mean_order);
+    }
+
+    //the cost can only grow with the order, and cannot be negative
+    double slope = variance > 0 ? std::max(0., covariance / variance) : 0;
+    double intercept = std::max(0., mean_ns - slope * mean_order);
+
+    return {intercept, slope};
+}
+
+
+double predicted_makespan(std::vector<double> task_times, int n_threads)
+{
+    //longest tasks first, each assigned to the worker that becomes free first
+    std::sort(task_times.begin(), task_times.end(), std::greater<double>());
+
+    std::priority_queue<double, std::vector<double>, std::greater<double>> worker_free_time;
+    for (int i = 0; i < n_threads; ++i) worker_free_time.push(0);
+
+    double makespan = 0;
+    for (auto time : task_times)
+    {
+        double end_time = worker_free_time.top() + time;
+        worker_free_time.pop();
+        worker_free_time.push(end_time);
+        makespan = std::max(makespan, end_time);
+    }
+
+    return makespan;
+}
+
+
+/**
+ * @brief Returns the number of characters of the row that will be written to the output file for this task,
+ * filling the statistics with their expected magnitude
+ * 
+ * @param task parameters of the run
+ * @param average_order expected average order of the diagram
+ * @param predicted_run_time predicted run time (in nanoseconds) of the Markov chain loop
+ * @return size_t 
+ */
+static size_t predicted_row_size(const SimulationTask & task, double average_order, double predicted_run_time)
+{
+    SingleRunResults results(task.beta, task.initial_s0, task.H, task.GAMMA, task.N_total_steps, 
+        task.N_thermalization_steps, task.update_choice_seed, task.diagram_seed);
+
+    results.measured_sigmax = -0.123456;
+    results.measured_sigmaz = -0.123456;
+    results.error_sigmax = results.error_sigmaz = 0.000123456;
+    results.N_measures = task.N_total_steps - std::min(task.N_total_steps, task.N_thermalization_steps);
+    results.N_attempted_flips = results.N_attempted_addsegment = results.N_attempted_removesegment = task.N_total_steps / 3;
+    results.N_accepted_flips = results.N_accepted_addsegment = results.N_accepted_removesegment = task.N_total_steps / 30;
+    results.max_diagram_order = expected_max_diagram_order(task);
+    results.avg_diagram_order = average_order;
+    results.order_distribution.counts.assign(results.max_diagram_order / 2 + 1, 1); //quantiles of the same magnitude of the maximum order
+    results.run_time = predicted_run_time;
+    results.ESS_sigmax = results.ESS_sigmaz = results.N_measures / 10.;
+    if (task.monitor) results.R_hat = 1.00123;
+
+    std::ostringstream row;
+    row << results;
+    return row.str().size();
+}
+
+
+void print_plan(const json & settings)
+{
+    //enumerate all the runs of the calculation, without executing them
+    std::vector<SimulationTask> tasks = enumerate_tasks(settings);
+
+    std::cout << "Calibrating cost model...\n";
+    CostModel model = calibrate_cost_model();
+
+    //exact average order of all the tasks, evaluated at once
+    std::vector<double> beta_values, H_values, GAMMA_values;
+    for (const auto & task : tasks)
+    {
+        beta_values.push_back(task.beta);
+        H_values.push_back(task.H);
+        GAMMA_values.push_back(task.GAMMA);
+    }
+    std::vector<double> average_orders = evaluate_exact(beta_values, H_values, GAMMA_values).average_order;
+
+    //with use_symmetries, the tasks related by symmetry to a canonical one are not run
+    bool use_symmetries = settings.contains("use_symmetries") && bool(settings["use_symmetries"]);
+    std::vector<size_t> sources = symmetry_sources(tasks);
+    size_t N_canonical = 0;
+    for (size_t i = 0; i < tasks.size(); ++i) N_canonical += sources[i] == i;
+    size_t N_runs = use_symmetries ? N_canonical : tasks.size();
+
+    //predicted run time and memory of each task
+    std::vector<double> task_times;
+    std::vector<double> task_memory;
+    unsigned long long total_steps = 0;
+    size_t output_size = SingleRunResults::ostream_output_header().size();
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        double time = tasks[i].N_total_steps * model.ns_per_step(average_orders[i]);
+        output_size += predicted_row_size(tasks[i], average_orders[i], time);
+        if (use_symmetries && sources[i] != i) continue; //synthesized rows have no cost besides the output
+
+        task_times.push_back(time);
+        task_memory.push_back(predicted_diagram_memory(tasks[i]));
+        total_steps += tasks[i].N_total_steps;
+    }
+
+    //the largest diagrams could be all running at the same time
+    std::sort(task_memory.begin(), task_memory.end(), std::greater<double>());
+
+    std::cout << "\nPlan:\n\n";
+
+    std::cout << "Calculation : " << static_cast<std::string>(settings["CALC_TYPE"]) << '\n';
+    std::cout << "Tasks       : " << tasks.size() << '\n';
+    std::cout << "Runs        : " << N_runs << " (" << tasks.size() - N_runs << " obtained by symmetry";
+    if (!use_symmetries) std::cout << ", " << tasks.size() - N_canonical << " possible with use_symmetries";
+    std::cout << ")\n";
+    std::cout << "Total steps : " << total_steps << '\n';
+
+    std::cout << "\nCost model:\n";
+    std::cout << "ns per step : " << model.ns_per_step_base << " + " << model.ns_per_step_per_order << " * order\n";
+
+    std::cout << "\nOutput:\n";
+    if (settings.contains("output_file")) std::cout << "File        : " << static_cast<std::string>(settings["output_file"]) << '\n';
+    std::cout << "Size        : " << output_size / 1e3 << " kB\n";
+
+    //thread counts: powers of 2 up to the number of hardware threads, the number of hardware threads itself, 
+    //and the number of threads requested in settings
+    std::vector<int> thread_counts;
+    int hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int n_threads = 1; n_threads < hardware_threads; n_threads *= 2) thread_counts.push_back(n_threads);
+    thread_counts.push_back(hardware_threads);
+    if (settings.contains("N_threads")) thread_counts.push_back(settings["N_threads"]);
+    std::sort(thread_counts.begin(), thread_counts.end());
+    thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+
+    std::cout << "\nPredicted wall time and peak diagram memory:\n";
+    for (auto n_threads : thread_counts)
+    {
+        double peak_memory = 0;
+        for (int i = 0; i < n_threads && i < (int) task_memory.size(); ++i) peak_memory += task_memory[i];
+
+        std::cout << "threads: " << n_threads << 
+            "  time: " << predicted_makespan(task_times, n_threads) / 1e9 << " seconds" <<
+            "  memory: " << peak_memory / 1e3 << " kB\n";
+    }
+}
+
+
+void plan_calculations(std::string settings_filename)
+{
+    //read settings from json file, and store it in a json object (dictionary-like)
+    json settings = read_settings(settings_filename);
+
+    //terminate the program if the settings are not valid
+    try
+    {
+        print_plan(settings);
+    }
+    catch(const std::invalid_argument & e)
+    {
+        std::cerr << "\nError: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,85 @@
+/**
+ * @file reweighting.cpp
+ * @brief Definitions of the methods of the BetaReweighter class
+ */
+
+#include <diagmc/reweighting.h>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+BetaReweighter::BetaReweighter(double beta, double H, double GAMMA, std::vector<double> target_betas)
+    : _beta(beta), _H(H), _GAMMA(GAMMA), _target_betas(target_betas)
+{
+    if (!(beta > 0)) throw std::invalid_argument("beta must be > 0, but " + std::to_string(beta) + " was provided.");
+
+    for (auto target_beta : target_betas)
+    {
+        if (!(target_beta > 0)) throw std::invalid_argument("the reweighting betas must be > 0, but " + std::to_string(target_beta) + " was provided.");
+
+        double lambda = target_beta / beta;
+        _log_lambda.push_back(std::log(lambda));
+        _field_factor.push_back(-(lambda - 1) * H * beta);
+    }
+
+    size_t n_targets = target_betas.size();
+    _log_max.assign(n_targets, -std::numeric_limits<double>::infinity());
+    _sum_w.assign(n_targets, 0);
+    _sum_w2.assign(n_targets, 0);
+    _sum_w_order.assign(n_targets, 0);
+    _sum_w_mz.assign(n_targets, 0);
+}
+
+
+void BetaReweighter::add_sample(size_t order, double mz)
+{
+    ++_N_samples;
+
+    for (size_t k = 0; k < _target_betas.size(); ++k)
+    {
+        double log_w = order * _log_lambda[k] + _field_factor[k] * mz;
+
+        //new maximum: rescale the sums, so that the largest factor is always exp(0) = 1
+        if (log_w > _log_max[k])
+        {
+            double rescale = std::exp(_log_max[k] - log_w);
+            _sum_w[k] *= rescale;
+            _sum_w2[k] *= rescale * rescale;
+            _sum_w_order[k] *= rescale;
+            _sum_w_mz[k] *= rescale;
+            _log_max[k] = log_w;
+        }
+
+        double w = std::exp(log_w - _log_max[k]);
+        _sum_w[k] += w;
+        _sum_w2[k] += w * w;
+        _sum_w_order[k] += w * order;
+        _sum_w_mz[k] += w * mz;
+    }
+}
+
+
+std::vector<ReweightedResult> BetaReweighter::results() const
+{
+    std::vector<ReweightedResult> results;
+    for (size_t k = 0; k < _target_betas.size(); ++k)
+    {
+        ReweightedResult result;
+        result.target_beta = _target_betas[k];
+
+        if (_N_samples > 0)
+        {
+            result.sigmax = -_sum_w_order[k] / (_target_betas[k] * _GAMMA * _sum_w[k]);
+            result.sigmaz = _sum_w_mz[k] / _sum_w[k];
+            result.ESS = _sum_w[k] * _sum_w[k] / _sum_w2[k];
+            result.ESS_fraction = result.ESS / _N_samples;
+        }
+
+        results.push_back(result);
+    }
+
+    return results;
+}
@@ -0,0 +1,254 @@
+/**
+ * @file scaling.cpp
+ * @brief Definitions of the functions of the strong and weak scaling benchmark
+ */
+
+#include <diagmc/scaling.h>
+#include <diagmc/setup.h>
+#include <diagmc/thread_pool.h>
+#include <diagmc/simd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+
+std::vector<SimulationTask> weak_scaling_tasks(const std::vector<SimulationTask> & tasks, int N_threads, unsigned long long base_seed)
+{
+    if (N_threads < 1) throw std::invalid_argument("the number of threads must be > 0.");
+
+    std::vector<SimulationTask> weak_tasks;
+    for (int copy = 0; copy < N_threads; ++copy)
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+            SimulationTask task = tasks[i];
+            unsigned long long index = copy * tasks.size() + i;
+            task.update_choice_seed = derive_seed(base_seed, 2*index);
+            task.diagram_seed = derive_seed(base_seed, 2*index + 1);
+            weak_tasks.push_back(task);
+        }
+    return weak_tasks;
+}
+
+
+/**
+ * @brief Returns the p-quantile of the values (nearest rank), or 0 if there are none
+ */
+static double quantile(std::vector<double> values, double p)
+{
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t rank = static_cast<size_t>(std::ceil(p * values.size()));
+    return values[std::max<size_t>(rank, 1) - 1];
+}
+
+
+ScalingPoint measure_scaling_point(const std::vector<SimulationTask> & tasks, int N_threads, unsigned int interleaved_chains, bool pin_threads)
+{
+    if (N_threads < 1) throw std::invalid_argument("the number of threads must be > 0.");
+
+    ScalingPoint point;
+    point.N_threads = N_threads;
+    point.N_runs = tasks.size();
+    for (const auto & task : tasks) point.N_steps += task.N_total_steps;
+
+    //the rows are written in memory, so that the writer overhead does not depend on the file system of the machine
+    std::ostringstream rows;
+    std::vector<double> latencies;
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(N_threads, pin_threads);
+        run_tasks(tasks, pool, [&](const SingleRunResults & results)
+        {
+            auto write_start = std::chrono::steady_clock::now();
+            rows << results;
+            point.writer_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - write_start).count();
+            latencies.push_back(results.run_time / 1e9);
+        }, false, interleaved_chains);
+    }
+    point.wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    point.throughput = point.N_steps / point.wall_time;
+    point.latency_p50 = quantile(latencies, 0.5);
+    point.latency_p99 = quantile(latencies, 0.99);
+    point.latency_max = quantile(latencies, 1);
+    point.writer_fraction = point.writer_time / point.wall_time;
+    return point;
+}
+
+
+/**
+ * @brief Returns the base seed of the benchmark: the seed of the settings, or SCALING_SEED_DEFAULT
+ */
+static unsigned long long scaling_seed(const json & settings)
+{
+    return settings.contains("seed") ? (unsigned long long) settings["seed"] : SCALING_SEED_DEFAULT;
+}
+
+
+std::vector<ScalingPoint> run_scaling_benchmark(const json & settings)
+{
+    if (!settings.contains("CALC_TYPE") || settings["CALC_TYPE"] != "sweep")
+        throw std::invalid_argument("the scaling benchmark requires the settings of a sweep (CALC_TYPE \"sweep\").");
+
+    //the runs of the sweep always have seeds derived from a fixed base seed
+    json sweep_settings = settings;
+    unsigned long long base_seed = scaling_seed(settings);
+    sweep_settings["seed"] = base_seed;
+    std::vector<SimulationTask> tasks = enumerate_tasks(sweep_settings);
+    //the workload must be the same for every point, so the runs are never stopped early by their convergence monitors
+    for (auto & task : tasks) task.monitor = nullptr;
+
+    unsigned int interleaved_chains = settings.contains("interleaved_chains") ? int(settings["interleaved_chains"]) : 1;
+    if (interleaved_chains < 1) throw std::invalid_argument("interleaved_chains in settings.json must be > 0.");
+    bool pin_threads = settings.contains("pin_threads") && bool(settings["pin_threads"]);
+
+    //thread counts, always including 1 as reference
+    std::vector<int> thread_counts = {1};
+    if (settings.contains("scaling_threads"))
+    {
+        for (int N_threads : settings["scaling_threads"])
+        {
+            if (N_threads < 1) throw std::invalid_argument("scaling_threads in settings.json must be > 0.");
+            thread_counts.push_back(N_threads);
+        }
+    }
+    else
+    {
+        int hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+        for (int N_threads = 2; N_threads < hardware_threads; N_threads *= 2) thread_counts.push_back(N_threads);
+        thread_counts.push_back(hardware_threads);
+    }
+    std::sort(thread_counts.begin(), thread_counts.end());
+    thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+
+    std::vector<ScalingPoint> points;
+    for (std::string mode : {"strong", "weak"})
+    {
+        double reference_throughput = 0;
+        for (int N_threads : thread_counts)
+        {
+            std::cout << "Running " << mode << " scaling point with " << N_threads << " threads...\n";
+            ScalingPoint point = measure_scaling_point(mode == "strong" ? tasks : weak_scaling_tasks(tasks, N_threads, base_seed),
+                N_threads, interleaved_chains, pin_threads);
+            point.mode = mode;
+
+            //for the strong scaling this is T1/TN, for the weak scaling it is the scaled speedup N*T1/TN
+            if (N_threads == 1) reference_throughput = point.throughput;
+            point.speedup = point.throughput / reference_throughput;
+            point.efficiency = point.speedup / N_threads;
+            points.push_back(point);
+        }
+    }
+    return points;
+}
+
+
+std::string scaling_output_header()
+{
+    return
+        "mode,"
+        "N_threads,"
+        "N_runs,"
+        "N_steps,"
+        "wall_time,"
+        "throughput,"
+        "speedup,"
+        "efficiency,"
+        "latency_p50,"
+        "latency_p99,"
+        "latency_max,"
+        "writer_time,"
+        "writer_fraction\n";
+}
+
+
+void write_scaling_rows(const std::vector<ScalingPoint> & points, std::ostream & os)
+{
+    for (const auto & point : points)
+    {
+        os <<
+            point.mode << ',' <<
+            point.N_threads << ',' <<
+            point.N_runs << ',' <<
+            point.N_steps << ',' <<
+            point.wall_time << ',' <<
+            point.throughput << ',' <<
+            point.speedup << ',' <<
+            point.efficiency << ',' <<
+            point.latency_p50 << ',' <<
+            point.latency_p99 << ',' <<
+            point.latency_max << ',' <<
+            point.writer_time << ',' <<
+            point.writer_fraction << '\n';
+    }
+}
+
+
+json scaling_report(const std::vector<ScalingPoint> & points, const json & settings)
+{
+    json report;
+    report["hardware_threads"] = std::thread::hardware_concurrency();
+    report["simd_kernels"] = simd_level_name(selected_simd_level());
+    report["seed"] = scaling_seed(settings);
+    report["N_tasks"] = points.empty() ? 0 : points.front().N_runs;
+
+    report["points"] = json::array();
+    for (const auto & point : points)
+    {
+        report["points"].push_back({
+            {"mode", point.mode},
+            {"N_threads", point.N_threads},
+            {"N_runs", point.N_runs},
+            {"N_steps", point.N_steps},
+            {"wall_time", point.wall_time},
+            {"throughput", point.throughput},
+            {"speedup", point.speedup},
+            {"efficiency", point.efficiency},
+            {"latency_p50", point.latency_p50},
+            {"latency_p99", point.latency_p99},
+            {"latency_max", point.latency_max},
+            {"writer_time", point.writer_time},
+            {"writer_fraction", point.writer_fraction}
+        });
+    }
+    return report;
+}
+
+
+void scaling_benchmark(std::string settings_filename)
+{
+    //read settings from json file, and store it in a json object (dictionary-like)
+    json settings = read_settings(settings_filename);
+
+    //terminate the program if the settings are not valid
+    try
+    {
+        std::vector<ScalingPoint> points = run_scaling_benchmark(settings);
+
+        std::cout << "\nScaling:\n\n";
+        for (const auto & point : points)
+            std::cout << point.mode << "  threads: " << point.N_threads <<
+                "  throughput: " << point.throughput << " steps/s" <<
+                "  efficiency: " << point.efficiency * 100 << "%" <<
+                "  p99 latency: " << point.latency_p99 << " s" <<
+                "  writer: " << point.writer_fraction * 100 << "%\n";
+
+        std::ofstream csv_stream(settings.contains("scaling_output_file") ? std::string(settings["scaling_output_file"]) : SCALING_OUTPUT_FILE_DEFAULT);
+        csv_stream << scaling_output_header();
+        write_scaling_rows(points, csv_stream);
+
+        std::ofstream json_stream(settings.contains("scaling_json_file") ? std::string(settings["scaling_json_file"]) : SCALING_JSON_FILE_DEFAULT);
+        json_stream << scaling_report(points, settings).dump(4) << '\n';
+    }
+    catch(const std::invalid_argument & e)
+    {
+        std::cerr << "\nError: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,314 @@
+/**
+ * @file server.cpp
+ * @brief Definitions of the functions of the daemon mode, in which a long-lived process receives jobs on a local socket and runs them on a warm thread pool
+ */
+
+#include <diagmc/server.h>
+#include <diagmc/setup.h>
+#include <diagmc/simulation.h>
+#include <diagmc/thread_pool.h>
+#include <nlohmann/json.hpp>
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define HAS_UNIX_SOCKETS
+#endif
+
+using json = nlohmann::json;
+
+//timeout (in milliseconds) after which blocking socket operations check if the server is shutting down
+#define POLL_TIMEOUT_MS 200
+
+
+/**
+ * @brief Removes the trailing newline from a line produced by the csv output functions
+ * 
+ * @param line string ending with '\n'
+ * @return std::string 
+ */
+static std::string strip_newline(std::string line)
+{
+    if (!line.empty() && line.back() == '\n') line.pop_back();
+    return line;
+}
+
+
+void handle_job(const std::string & job, ThreadPool & pool, std::function<void(const std::string &)> send_line)
+{
+    try
+    {
+        //a job has the same structure of the settings file
+        json settings = json::parse(job);
+        if (!settings.contains("CALC_TYPE")) throw std::invalid_argument("missing CALC_TYPE in job.");
+
+        //only the calculations whose output is one row of results per run can be served
+        if (settings["CALC_TYPE"] != "single" && settings["CALC_TYPE"] != "sweep" && settings["CALC_TYPE"] != "convergence-test")
+            throw std::invalid_argument("CALC_TYPE " + settings["CALC_TYPE"].dump() + " is not supported in server mode (only \"single\", \"sweep\" and \"convergence-test\").");
+
+        std::vector<SimulationTask> tasks = enumerate_tasks(settings);
+
+        //stream back the rows as soon as they are available, in the order of the tasks
+        send_line(strip_newline(SingleRunResults::ostream_output_header()));
+        bool use_symmetries = settings.contains("use_symmetries") && bool(settings["use_symmetries"]);
+        int interleaved_chains = settings.contains("interleaved_chains") ? int(settings["interleaved_chains"]) : INTERLEAVED_CHAINS_DEFAULT;
+        if (interleaved_chains < 1) throw std::invalid_argument("interleaved_chains must be > 0.");
+        run_tasks(tasks, pool, [&](const SingleRunResults & results)
+        {
+            std::ostringstream row;
+            row << results;
+            send_line(strip_newline(row.str()));
+        }, use_symmetries, interleaved_chains);
+
+        send_line(JOB_DONE_LINE);
+    }
+    catch(const std::exception & e)
+    {
+        //invalid jobs must not terminate the server: report the error to the client
+        send_line(JOB_ERROR_PREFIX + std::string(e.what()));
+    }
+}
+
+
+#ifdef HAS_UNIX_SOCKETS
+
+/**
+ * @brief Sends the whole string on the socket, returning false if the connection was closed
+ * 
+ * @param fd file descriptor of the socket
+ * @param data string to be sent
+ * @return true if all the data was sent,
+ * @return false otherwise
+ */
+static bool send_all(int fd, const std::string & data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        #ifdef MSG_NOSIGNAL
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL); //do not raise SIGPIPE if the peer is gone
+        #else
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, 0);
+        #endif
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Reads a line from the socket (without the trailing newline), using buffer to store the data received after it.
+ * Returns false if the connection was closed, or if stop becomes true while waiting.
+ * 
+ * @param fd file descriptor of the socket
+ * @param buffer data already received but not yet returned
+ * @param line the line that was read
+ * @param stop (optional) flag that interrupts the wait
+ * @return true if a line was read,
+ * @return false otherwise
+ */
+static bool receive_line(int fd, std::string & buffer, std::string & line, const std::atomic<bool> * stop = nullptr)
+{
+    while (true)
+    {
+        size_t newline_position = buffer.find('\n');
+        if (newline_position != std::string::npos)
+        {
+            line = buffer.substr(0, newline_position);
+            buffer.erase(0, newline_position + 1);
+            return true;
+        }
+
+        //wait for data, periodically checking if we have to stop
+        pollfd pfd {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, POLL_TIMEOUT_MS);
+        if (stop && *stop) return false;
+        if (ready < 0) return false;
+        if (ready == 0) continue;
+
+        char chunk[4096];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+    }
+}
+
+
+/**
+ * @brief Fills a sockaddr_un with the given path, throwing an std::runtime_error if the path is too long
+ * 
+ * @param socket_path path of the Unix domain socket
+ * @return sockaddr_un 
+ */
+static sockaddr_un make_address(const std::string & socket_path)
+{
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("socket path too long: " + socket_path);
+    socket_path.copy(address.sun_path, socket_path.size());
+    return address;
+}
+
+
+void run_server(const std::string & socket_path, int n_threads)
+{
+    //create the socket, replacing any stale socket file left by a previous server
+    sockaddr_un address = make_address(socket_path);
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) throw std::runtime_error("unable to create socket.");
+
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, (sockaddr *) &address, sizeof(address)) < 0 || listen(listen_fd, SOMAXCONN) < 0)
+    {
+        close(listen_fd);
+        throw std::runtime_error("unable to listen on socket " + socket_path);
+    }
+
+    //warm pool, shared by all the jobs for the whole lifetime of the server
+    ThreadPool pool(n_threads);
+    std::atomic<bool> stop(false);
+
+    /**
+     * @brief Thread serving a connection, with the flag it sets when it has finished and can be joined
+     */
+    struct Connection
+    {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> finished;
+    };
+    std::list<Connection> connections;
+    std::atomic<size_t> N_connection_threads(0);   //connection threads not yet joined, reported by the status command
+
+    std::cout << "Listening on " << socket_path << " with " << n_threads << " worker threads.\n";
+
+    while (!stop)
+    {
+        //join the threads of the closed connections, so that a long-lived server does not accumulate them
+        for (auto it = connections.begin(); it != connections.end();)
+        {
+            if (*it->finished)
+            {
+                it->thread.join();
+                it = connections.erase(it);
+            }
+            else ++it;
+        }
+        N_connection_threads = connections.size();
+
+        //wait for a new connection, periodically checking if we have to stop
+        pollfd pfd {listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, POLL_TIMEOUT_MS) <= 0) continue;
+
+        int client_fd = accept(listen_fd, nullptr, nullptr);
+        if (client_fd < 0) continue;
+
+        //each connection is served by its own lightweight thread, while the runs are executed by the pool
+        auto finished = std::make_shared<std::atomic<bool>>(false);
+        N_connection_threads = connections.size() + 1;
+        connections.push_back({std::thread([client_fd, finished, &pool, &stop, &N_connection_threads]()
+        {
+            std::string buffer, line;
+            while (receive_line(client_fd, buffer, line, &stop))
+            {
+                if (line.empty()) continue;
+
+                //control commands: terminate the server, or report the number of connection threads
+                json request = json::parse(line, nullptr, false);
+                if (request.is_object() && request.value("command", "") == "shutdown")
+                {
+                    stop = true;
+                    send_all(client_fd, std::string(JOB_DONE_LINE) + "\n");
+                    break;
+                }
+                if (request.is_object() && request.value("command", "") == "status")
+                {
+                    send_all(client_fd, "connections " + std::to_string(N_connection_threads) + "\n" + JOB_DONE_LINE + "\n");
+                    continue;
+                }
+
+                bool connection_open = true;
+                handle_job(line, pool, [&](const std::string & response_line)
+                {
+                    if (connection_open) connection_open = send_all(client_fd, response_line + "\n");
+                });
+                if (!connection_open) break;
+            }
+            close(client_fd);
+            *finished = true;
+        }), finished});
+    }
+
+    for (auto & connection : connections) connection.thread.join();
+    close(listen_fd);
+    unlink(socket_path.c_str());
+
+    std::cout << "Server stopped.\n";
+}
+
+
+bool submit_job(const std::string & socket_path, const std::string & job, std::ostream & out)
+{
+    sockaddr_un address = make_address(socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr *) &address, sizeof(address)) < 0)
+    {
+        if (fd >= 0) close(fd);
+        throw std::runtime_error("unable to connect to server at " + socket_path);
+    }
+
+    //the job must be sent on a single line
+    std::string single_line_job = job;
+    for (auto & c : single_line_job) if (c == '\n' || c == '\r') c = ' ';
+    send_all(fd, single_line_job + "\n");
+
+    //print the rows until the end of the response
+    bool success = false;
+    std::string buffer, line;
+    while (receive_line(fd, buffer, line))
+    {
+        if (line == JOB_DONE_LINE)
+        {
+            success = true;
+            break;
+        }
+        if (line.rfind(JOB_ERROR_PREFIX, 0) == 0)
+        {
+            std::cerr << "Error: " << line.substr(std::string(JOB_ERROR_PREFIX).size()) << std::endl;
+            break;
+        }
+        out << line << '\n';
+    }
+    out.flush();
+    close(fd);
+
+    return success;
+}
+
+#else
+
+void run_server(const std::string & socket_path, int n_threads)
+{
+    throw std::runtime_error("the server mode requires Unix domain sockets, which are not supported on this platform.");
+}
+
+
+bool submit_job(const std::string & socket_path, const std::string & job, std::ostream & out)
+{
+    throw std::runtime_error("the server mode requires Unix domain sockets, which are not supported on this platform.");
+}
+
+#endif
@@ -7,15 +7,31 @@
 
 #include <diagmc/setup.h>
 #include <diagmc/simulation.h>
+#include <diagmc/thread_pool.h>
+#include <diagmc/lockstep.h>
+#include <diagmc/mbar.h>
+#include <diagmc/exact.h>
+#include <diagmc/simd.h>
+#include <diagmc/autotune.h>
+#include <diagmc/task_graph.h>
+#include <diagmc/worm.h>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <nlohmann/json.hpp>
 #include <stdlib.h>
 #include <exception>
+#include <stdexcept>
+#include <functional>
+#include <future>
 #include <string>
 #include <vector>
 #include <cmath>
 #include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <tuple>
 
 using json = nlohmann::json;
 
@@ -23,19 +39,25 @@ using json = nlohmann::json;
 #define N_THERMALIZATION_STEPS_DEFAULT 0
 #define INITIAL_S0_DEFAULT 1
 #define SAMPLES_PER_POINT_DEFAULT 1
-#define NEW_SEED std::chrono::system_clock::now().time_since_epoch().count()
+#define N_THREADS_DEFAULT 1
+#define DIAGRAM_ENGINE_DEFAULT DiagramEngine::LIST
+#define USE_SYMMETRIES_DEFAULT false
+#define PIN_THREADS_DEFAULT false
+#define AUTOTUNE_DEFAULT false
+#define TASK_ORDER_DEFAULT "nested"
+#define WARM_START_DEFAULT false
+#define NEW_SEED (unsigned long long) std::chrono::system_clock::now().time_since_epoch().count()
 
 
 
 void check_required_keys_presence(const json &  settings, std::vector<std::string> list_of_keys)
 {
-    //loop over list of keys, checking if each is contained in settings, terminate the program if not present
+    //loop over list of keys, checking if each is contained in settings, throw exception if not present
     for (auto key : list_of_keys)
     {
         if(!settings.contains(key))
         {
-            std::cerr << "Error: missing " << key << " in settings.json." << std::endl;
-            exit(EXIT_FAILURE);        
+            throw std::invalid_argument("missing " + key + " in settings.json.");
         }
     }
 }
@@ -61,10 +83,9 @@ std::vector<double> range_generator(const json & settings, std::string which)
     {
         range_vector.push_back(settings[which]); //in this case the vector contains a single value
     }
-    else //no values of the necessary parameter: terminate program
+    else //no values of the necessary parameter: the calculation cannot be set up
     {
-        std::cerr << "Error: missing " << which << " in settings.json. "<< std::endl;
-        exit(EXIT_FAILURE);        
+        throw std::invalid_argument("missing " + which + " in settings.json.");
     }
 
     return range_vector;
@@ -96,10 +117,9 @@ std::vector<double> log_range_generator(const json & settings, std::string which
     {
         range_vector.push_back(settings[which]); //in this case the vector contains a single value
     }
-    else //no values of the necessary parameter: terminate program
+    else //no values of the necessary parameter: the calculation cannot be set up
     {
-        std::cerr << "Error: incorrect/missing " << which << " in settings.json. "<< std::endl;
-        exit(EXIT_FAILURE);        
+        throw std::invalid_argument("incorrect/missing " + which + " in settings.json.");
     }
 
     return range_vector;
@@ -124,6 +144,425 @@ void print_progress_bar(double progress)
 
 
 
+unsigned long long derive_seed(unsigned long long base_seed, unsigned long long index)
+{
+    //splitmix64 mixing function, applied to the index-th element of the sequence starting at base_seed
+    unsigned long long z = base_seed + (index + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+
+std::vector<size_t> van_der_corput_order(size_t n)
+{
+    unsigned int bits = 0;
+    while (n > (size_t(1) << bits)) ++bits;
+
+    auto reversed = [bits](size_t i)
+    {
+        size_t r = 0;
+        for (unsigned int b = 0; b < bits; ++b) r |= ((i >> b) & 1) << (bits - 1 - b);
+        return r;
+    };
+
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return reversed(a) < reversed(b); });
+    return order;
+}
+
+
+std::vector<size_t> progressive_grid_order(const std::vector<size_t> & axis_sizes)
+{
+    //refinement level of each index of each axis, from its position in the van der Corput order
+    std::vector<std::vector<unsigned int>> levels;
+    size_t N_points = 1;
+    for (size_t n : axis_sizes)
+    {
+        std::vector<unsigned int> level(n);
+        std::vector<size_t> order = van_der_corput_order(n);
+        for (size_t position = 0; position < n; ++position)
+        {
+            unsigned int l = 0;
+            while ((size_t(1) << l) <= position) ++l;
+            level[order[position]] = l;
+        }
+        levels.push_back(level);
+        N_points *= n;
+    }
+
+    //level of each point: the largest level among its indices, decoded from the flat index (last axis fastest)
+    std::vector<unsigned int> point_level(N_points, 0);
+    for (size_t point = 0; point < N_points; ++point)
+    {
+        size_t rest = point;
+        for (size_t axis = axis_sizes.size(); axis-- > 0;)
+        {
+            point_level[point] = std::max(point_level[point], levels[axis][rest % axis_sizes[axis]]);
+            rest /= axis_sizes[axis];
+        }
+    }
+
+    std::vector<size_t> order(N_points);
+    for (size_t i = 0; i < N_points; ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return point_level[a] < point_level[b]; });
+    return order;
+}
+
+
+std::vector<SimulationTask> enumerate_tasks(const json & settings)
+{
+    //list of runs, in the order in which they are executed
+    std::vector<SimulationTask> tasks;
+
+    if(settings["CALC_TYPE"] == "single" || settings["CALC_TYPE"] == "lockstep-check" || settings["CALC_TYPE"] == "worm")
+    {
+        //check presence of required keys in settings.json
+        check_required_keys_presence( settings,
+            {
+                "beta",
+                "H",
+                "GAMMA",
+                "N_total_steps"
+            }
+        );
+
+        //assign default values to optional keys if not present in settings.json
+        int initial_s0 = settings.contains("initial_s0") ? (int) settings["initial_s0"] : INITIAL_S0_DEFAULT;
+        unsigned long long N_thermalization_steps = settings.contains("N_thermalization_steps") ? (unsigned long long) settings["N_thermalization_steps"] : N_THERMALIZATION_STEPS_DEFAULT;
+        unsigned long long int update_choice_seed = settings.contains("update_choice_seed") ? int(settings["update_choice_seed"]) : NEW_SEED;
+        unsigned long long int diagram_seed = settings.contains("diagram_seed") ? int(settings["diagram_seed"]) : NEW_SEED;
+
+        tasks.push_back({settings["beta"], initial_s0, settings["H"], settings["GAMMA"], settings["N_total_steps"], N_thermalization_steps, update_choice_seed, diagram_seed});
+    }
+    else if(settings["CALC_TYPE"] == "sweep" || settings["CALC_TYPE"] == "mbar")
+    {
+        //check existence of required keys in settings.json
+        check_required_keys_presence( settings,
+            {
+                "N_total_steps"
+            }
+        );
+        
+        //generates linearly-spaced list of values for the sweep parameters, based on min, max and step
+        std::vector<double> beta_values = range_generator(settings, "beta");
+        std::vector<double> H_values = range_generator(settings, "H");
+        std::vector<double> GAMMA_values = range_generator(settings, "GAMMA");
+        unsigned long long N_total_steps = settings["N_total_steps"];
+
+        //assign default values to optional keys if not present in settings.json
+        int initial_s0 = settings.contains("initial_s0") ? (int) settings["initial_s0"] : INITIAL_S0_DEFAULT;
+        unsigned long long N_thermalization_steps = settings.contains("N_thermalization_steps") ? (unsigned long long) settings["N_thermalization_steps"] : N_THERMALIZATION_STEPS_DEFAULT;
+        int samples_per_point = settings.contains("samples_per_point") ? int(settings["samples_per_point"]) : SAMPLES_PER_POINT_DEFAULT;
+
+        //with a base seed, the seeds of each run are derived from it and from the index of the run, so that the sweep is reproducible
+        bool fixed_seed = settings.contains("seed");
+        unsigned long long base_seed = fixed_seed ? (unsigned long long) settings["seed"] : 0;
+
+        //order of the parameter points: the nested loops, or coarse-to-fine over the whole grid
+        std::string task_order = settings.contains("task_order") ? std::string(settings["task_order"]) : TASK_ORDER_DEFAULT;
+        if (task_order != "nested" && task_order != "progressive") throw std::invalid_argument("task_order in settings.json must be \"nested\" or \"progressive\".");
+
+        //with a target error, the chains of each point share a convergence monitor, which stops them when they agree and the error is reached
+        bool monitored = settings.contains("target_error");
+        double target_error = monitored ? double(settings["target_error"]) : 0;
+        double rhat_threshold = settings.contains("rhat_threshold") ? double(settings["rhat_threshold"]) : RHAT_THRESHOLD_DEFAULT;
+
+        //nested for loop for the sweep, running every combination of beta, H and GAMMA
+        for (auto beta : beta_values)
+        {
+            for(auto H : H_values)
+            {
+                for (auto GAMMA : GAMMA_values)
+                {
+                    //avoid GAMMA = 0, since it is not allowed: use a value extremely close to 0
+                    if(std::abs(GAMMA) < std::numeric_limits<double>::epsilon()) GAMMA = 1e-10;
+
+                    std::shared_ptr<ConvergenceMonitor> monitor;
+                    if (monitored) monitor = std::make_shared<ConvergenceMonitor>(samples_per_point, beta, GAMMA, target_error, rhat_threshold);
+
+                    //possibility to run multiple times for the same combination of parameters, useful to compute average and stddev
+                    for(int i = 0; i < samples_per_point; ++i)
+                    {
+                        unsigned long long index = tasks.size();
+                        if (fixed_seed)
+                            tasks.push_back({beta, initial_s0, H, GAMMA, N_total_steps, N_thermalization_steps, derive_seed(base_seed, 2*index), derive_seed(base_seed, 2*index + 1)});
+                        else
+                            tasks.push_back({beta, initial_s0, H, GAMMA, N_total_steps, N_thermalization_steps, NEW_SEED, NEW_SEED});
+                        tasks.back().monitor = monitor;
+                        tasks.back().monitor_chain = i;
+                    }
+                }
+            }
+        }
+
+        //the runs are generated (and their seeds derived) in nested order, and then the points are reordered, keeping their runs together
+        if (task_order == "progressive")
+        {
+            std::vector<SimulationTask> nested_tasks = std::move(tasks);
+            tasks.clear();
+            for (size_t point : progressive_grid_order({beta_values.size(), H_values.size(), GAMMA_values.size()}))
+                for (int i = 0; i < samples_per_point; ++i) tasks.push_back(nested_tasks[point * samples_per_point + i]);
+        }
+    }
+    else if(settings["CALC_TYPE"] == "convergence-test")
+    {
+        //check existence of required keys in settings.json
+        check_required_keys_presence( settings,
+            {
+                "beta",
+                "H",
+                "GAMMA"
+            }
+        );
+
+        //generates log-spaced list of values for the sweep parameters, based on min, max and step
+        std::vector<double> N_total_steps_values = log_range_generator(settings, "N_total_steps");
+        std::vector<double> N_thermalization_steps_values;
+
+        //assign default values to optional keys if not present in settings.json
+        int initial_s0 = settings.contains("initial_s0") ? (int) settings["initial_s0"] : 1;
+        if( !settings.contains("N_thermalization_steps") && !settings.contains("N_thermalization_step_max")) N_thermalization_steps_values = {0};
+        else N_thermalization_steps_values = log_range_generator(settings, "N_thermalization_steps");
+        unsigned long long int update_choice_seed = settings.contains("update_choice_seed") ? int(settings["update_choice_seed"]) : NEW_SEED;
+        unsigned long long int diagram_seed = settings.contains("diagram_seed") ? int(settings["diagram_seed"]) : NEW_SEED;
+
+        //nested for loop for the sweep, running every combination of N_total_steps, and N_thermalization_steps
+        for (auto N_total_steps : N_total_steps_values)
+            for(auto N_thermalization_steps : N_thermalization_steps_values)
+                tasks.push_back({settings["beta"], initial_s0, settings["H"], settings["GAMMA"], 
+                    (unsigned long long) N_total_steps, (unsigned long long) N_thermalization_steps, update_choice_seed, diagram_seed});
+    }
+    else
+    {
+        throw std::invalid_argument("invalid CALC_TYPE argument in settings.json. Expected 'single'/'sweep'/'convergence-test'/'lockstep-check'/'mbar'/'worm'.");
+    }
+
+    //optional storage engine of the diagram, the same for all the runs
+    DiagramEngine engine = DIAGRAM_ENGINE_DEFAULT;
+    if (settings.contains("diagram_engine"))
+    {
+        if (settings["diagram_engine"] == "list") engine = DiagramEngine::LIST;
+        else if (settings["diagram_engine"] == "flat") engine = DiagramEngine::FLAT;
+        else throw std::invalid_argument("invalid diagram_engine in settings.json. Expected 'list'/'flat'.");
+    }
+    //optional delayed-rejection variants of the ADD_SEGMENT and REMOVE_SEGMENT updates, for all the runs
+    bool delayed_rejection = settings.contains("delayed_rejection") ? bool(settings["delayed_rejection"]) : DELAYED_REJECTION_DEFAULT;
+
+    //optional list of betas to which the magnetizations of every run are reweighted
+    std::vector<double> reweight_betas;
+    if (settings.contains("reweight_betas"))
+    {
+        if (!settings["reweight_betas"].is_array()) throw std::invalid_argument("reweight_betas in settings.json must be a list of values.");
+        for (const auto & target_beta : settings["reweight_betas"])
+        {
+            if (!(double(target_beta) > 0)) throw std::invalid_argument("the values of reweight_betas in settings.json must be > 0.");
+            reweight_betas.push_back(target_beta);
+        }
+    }
+
+    //the multi-histogram analysis needs the histograms of the sufficient statistics of all the runs
+    unsigned int histogram_bins = 0;
+    if (settings["CALC_TYPE"] == "mbar")
+    {
+        histogram_bins = settings.contains("histogram_bins") ? int(settings["histogram_bins"]) : HISTOGRAM_BINS_DEFAULT;
+        if (histogram_bins == 0) throw std::invalid_argument("histogram_bins in settings.json must be > 0.");
+    }
+
+    //optional asynchronous measurement of the correlation function and of the histogram of the segment lengths
+    MeasurementOptions measurements;
+    if (settings.contains("correlation_bins")) measurements.correlation_bins = int(settings["correlation_bins"]);
+    if (settings.contains("segment_length_bins")) measurements.segment_length_bins = int(settings["segment_length_bins"]);
+    if (settings.contains("measure_interval")) measurements.measure_interval = (unsigned long long) settings["measure_interval"];
+    if (settings.contains("N_measurement_threads")) measurements.N_measurement_threads = int(settings["N_measurement_threads"]);
+    if (settings.contains("measurement_buffer_size")) measurements.buffer_size = (unsigned long long) settings["measurement_buffer_size"];
+    if (settings.contains("drop_measurements_when_full")) measurements.drop_when_full = bool(settings["drop_measurements_when_full"]);
+    if (measurements.enabled())
+    {
+        if (measurements.measure_interval == 0) throw std::invalid_argument("measure_interval in settings.json must be > 0.");
+        if (measurements.N_measurement_threads == 0) throw std::invalid_argument("N_measurement_threads in settings.json must be > 0.");
+        if (measurements.buffer_size == 0 || (measurements.buffer_size & (measurements.buffer_size - 1)) != 0)
+            throw std::invalid_argument("measurement_buffer_size in settings.json must be a power of 2.");
+    }
+
+    for (auto & task : tasks)
+    {
+        task.engine = engine;
+        task.delayed_rejection = delayed_rejection;
+        task.measurements = measurements;
+        task.reweight_betas = reweight_betas;
+        task.histogram_bins = histogram_bins;
+    }
+
+    return tasks;
+}
+
+
+std::vector<size_t> symmetry_sources(const std::vector<SimulationTask> & tasks)
+{
+    //parameters are compared on a grid of step SYMMETRY_TOLERANCE, to absorb the rounding of the ranges (e.g. -0.6 vs 0.6000000000000001)
+    auto grid = [](double x) { return std::llround(x / SYMMETRY_TOLERANCE); };
+
+    //tasks related by symmetry share the same class key, built with |H| and |GAMMA|, and are distinguished by the signs.
+    //The key contains all the parameters of the chain that can be tuned for each point, so that a row is never synthesized
+    //from a run with a different flip probability or kernels, whose parameters and acceptance counters would not describe it
+    using ClassKey = std::tuple<long long, long long, long long, int, unsigned long long, unsigned long long, DiagramEngine, double, bool>;
+    using PointKey = std::tuple<ClassKey, long long, long long>;
+
+    std::map<ClassKey, std::vector<size_t>> class_sources;  //tasks actually run for each class, in order
+    std::map<PointKey, size_t> point_occurrences;           //number of tasks already seen for each signed point (samples_per_point)
+
+    std::vector<size_t> sources(tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        const SimulationTask & task = tasks[i];
+        ClassKey class_key{grid(task.beta), grid(std::abs(task.H)), grid(std::abs(task.GAMMA)), task.initial_s0,
+            task.N_total_steps, task.N_thermalization_steps, task.engine, task.flip_probability, task.delayed_rejection};
+        PointKey point_key{class_key, grid(task.H), grid(task.GAMMA)};
+
+        //the k-th sample of a point is mirrored from the k-th run of its class, if it exists
+        //(it is always at a different point, since the previous samples of this point were the runs 0...k-1 or their mirrors)
+        size_t k = point_occurrences[point_key]++;
+        std::vector<size_t> & runs = class_sources[class_key];
+        if (k < runs.size()) sources[i] = runs[k];
+        else
+        {
+            sources[i] = i;
+            runs.push_back(i);
+        }
+    }
+
+    return sources;
+}
+
+
+/**
+ * @brief Executes a slice of a monitored run on a worker of the pool, and sets its result (a batch of one run) when it completes.
+ * If the run is parked waiting for a decision of its convergence monitor, the worker is released,
+ * and the next slice is submitted to the pool when the epoch is decided: the chains of a point never block the workers,
+ * so they cannot wait for each other forever even if the pool has less workers than chains.
+ */
+static void run_monitored_slice(ThreadPool & pool, std::shared_ptr<ResumableRun> run, std::shared_ptr<std::promise<std::vector<SingleRunResults>>> result)
+{
+    try
+    {
+        if (run->advance()) result->set_value({run->finish()});
+        else run->task().monitor->on_decision(run->awaited_epoch(), [&pool, run, result]()
+        {
+            pool.enqueue([&pool, run, result]() { run_monitored_slice(pool, run, result); });
+        });
+    }
+    catch(...)
+    {
+        //the other chains of the point continue without this one
+        run->task().monitor->finish(run->task().monitor_chain);
+        result->set_exception(std::current_exception());
+    }
+}
+
+
+void run_tasks(const std::vector<SimulationTask> & tasks, ThreadPool & pool, std::function<void(const SingleRunResults &)> on_result, bool use_symmetries, unsigned int interleaved_chains)
+{
+    if (interleaved_chains == 0) throw std::invalid_argument("interleaved_chains must be > 0.");
+
+    //index of the task whose run provides the results of each task: the task itself, unless it is obtained by symmetry
+    std::vector<size_t> sources(tasks.size());
+    if (use_symmetries) sources = symmetry_sources(tasks);
+    else for (size_t i = 0; i < tasks.size(); ++i) sources[i] = i;
+
+    //group the runs in batches of interleaved_chains consecutive runs, each executed by a single worker.
+    //The chains of a batch must use the same engine (they can differ after autotuning), and each chain of a monitored point
+    //forms a batch of its own, executed in slices by the workers, so that the chains of the point run in parallel
+    std::vector<std::vector<size_t>> batches;
+    std::vector<size_t> batch_of(tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        if (sources[i] != i) continue;
+        const SimulationTask * front = batches.empty() ? nullptr : &tasks[batches.back().front()];
+        bool new_batch = !front || front->engine != tasks[i].engine || front->monitor || tasks[i].monitor
+            || batches.back().size() == interleaved_chains;
+        if (new_batch) batches.emplace_back();
+        batch_of[i] = batches.size() - 1;
+        batches.back().push_back(i);
+    }
+
+    //submit all the batches at once, so that every worker of the pool is kept busy
+    std::vector<std::future<std::vector<SingleRunResults>>> futures;
+    for (const auto & batch : batches)
+    {
+        if (tasks[batch.front()].monitor)
+        {
+            auto result = std::make_shared<std::promise<std::vector<SingleRunResults>>>();
+            futures.push_back(result->get_future());
+            auto run = std::make_shared<ResumableRun>(tasks[batch.front()]);
+            pool.enqueue([&pool, run, result]() { run_monitored_slice(pool, run, result); });
+            continue;
+        }
+
+        std::vector<SimulationTask> batch_tasks;
+        for (size_t i : batch) batch_tasks.push_back(tasks[i]);
+        futures.push_back(pool.submit([batch_tasks = std::move(batch_tasks)]() { return run_simulation_interleaved(batch_tasks); }));
+    }
+
+    //collect the results in the order of the tasks, as soon as each of them is available.
+    //The source of a task always precedes it, so its results are already available when it is mirrored
+    std::vector<std::optional<SingleRunResults>> results(tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        if (sources[i] == i)
+        {
+            //the batches are completed in the order of their first task, so the batch of i is collected here the first time
+            if (!results[i])
+            {
+                std::vector<SingleRunResults> batch_results = futures[batch_of[i]].get();
+                for (size_t k = 0; k < batch_results.size(); ++k) results[batches[batch_of[i]][k]] = std::move(batch_results[k]);
+            }
+            on_result(*results[i]);
+        }
+        else
+        {
+            const SimulationTask & source = tasks[sources[i]];
+            on_result(results[sources[i]]->mirrored(tasks[i].H * source.H < 0, tasks[i].GAMMA * source.GAMMA < 0));
+        }
+    }
+}
+
+
+void run_tasks_warm_started(const std::vector<SimulationTask> & tasks, ThreadPool & pool, std::function<void(const SingleRunResults &)> on_result)
+{
+    for (const auto & task : tasks)
+        if (task.monitor) throw std::invalid_argument("the warm-started runs cannot be stopped by a convergence monitor (target_error).");
+
+    TaskGraph graph;
+
+    //last chain node of each sample of the lines with the same beta and H, and number of runs already enumerated for each point
+    std::map<std::tuple<double, double>, std::vector<TaskId>> last_chain;
+    std::map<std::tuple<double, double, double>, size_t> N_samples;
+
+    for (const auto & task : tasks)
+    {
+        size_t sample = N_samples[std::make_tuple(task.beta, task.H, task.GAMMA)]++;
+        std::vector<TaskId> & line = last_chain[std::make_tuple(task.beta, task.H)];
+
+        TaskId chain;
+        if (sample < line.size())
+        {
+            chain = graph.add_continue_chain(line[sample], task);
+            line[sample] = chain;
+        }
+        else
+        {
+            chain = graph.add_run_chain(task);
+            line.push_back(chain);
+        }
+        graph.add_write(chain, on_result);
+    }
+
+    graph.execute(pool);
+}
+
+
 json read_settings(std::string filename)
 {
     
@@ -161,9 +600,10 @@ json read_settings(std::string filename)
         exit(EXIT_FAILURE);        
     }
     
-    if(settings["CALC_TYPE"] != "single" && settings["CALC_TYPE"] != "sweep" && settings["CALC_TYPE"] != "convergence-test")
+    if(settings["CALC_TYPE"] != "single" && settings["CALC_TYPE"] != "sweep" && settings["CALC_TYPE"] != "convergence-test"
+        && settings["CALC_TYPE"] != "lockstep-check" && settings["CALC_TYPE"] != "mbar" && settings["CALC_TYPE"] != "worm")
     {
-        std::cerr << "Error: invalid CALC_TYPE argument in settings.json. Expected 'single'/'sweep'/'convergence-test', but "<< settings["CALC_TYPE"] << "was provided." << std::endl;
+        std::cerr << "Error: invalid CALC_TYPE argument in settings.json. Expected 'single'/'sweep'/'convergence-test'/'lockstep-check'/'mbar'/'worm', but "<< settings["CALC_TYPE"] << "was provided." << std::endl;
         exit(EXIT_FAILURE);        
     }
 
@@ -173,50 +613,142 @@ json read_settings(std::string filename)
 }
 
 
+/**
+ * @brief Returns the name of a secondary output file: the value of filename_key in settings if present,
+ * or by default the output_file name with the suffix inserted before the extension.
+ * 
+ * @param settings dictionary-like nlohmann::json object, with the settings for running the algorithm
+ * @param filename_key key of settings with the explicit name of the file
+ * @param suffix suffix added to the name of output_file
+ * @return std::string 
+ */
+static std::string secondary_output_filename(const json & settings, const std::string & filename_key, const std::string & suffix)
+{
+    if (settings.contains(filename_key)) return settings[filename_key];
+
+    std::string filename = settings["output_file"];
+    //the dot of the extension must be in the last component of the path
+    size_t extension = filename.find_last_of('.');
+    size_t last_separator = filename.find_last_of("/\\");
+    if (extension == std::string::npos || (last_separator != std::string::npos && last_separator > extension)) extension = filename.size();
+    filename.insert(extension, suffix);
+    return filename;
+}
+
+
+/**
+ * @brief If reweight_betas is present in settings, opens the file for the reweighted results, writing its header row.
+ * Its name is reweight_output_file, or by default the output_file name with "_reweighted" before the extension.
+ * Otherwise, the returned stream is not associated with any file.
+ * 
+ * @param settings dictionary-like nlohmann::json object, with the settings for running the algorithm
+ * @return std::ofstream 
+ */
+static std::ofstream open_reweighted_output(const json & settings)
+{
+    std::ofstream reweighted_stream;
+    if (!settings.contains("reweight_betas")) return reweighted_stream;
+
+    reweighted_stream.open(secondary_output_filename(settings, "reweight_output_file", "_reweighted"));
+    reweighted_stream << SingleRunResults::reweighted_output_header();
+    return reweighted_stream;
+}
+
+
+/**
+ * @brief If correlation_bins or segment_length_bins is present in settings, opens the file for the observables measured
+ * by the measurement pipeline, writing its header row.
+ * Its name is observables_output_file, or by default the output_file name with "_observables" before the extension.
+ * Otherwise, the returned stream is not associated with any file.
+ * 
+ * @param settings dictionary-like nlohmann::json object, with the settings for running the algorithm
+ * @return std::ofstream 
+ */
+static std::ofstream open_observables_output(const json & settings)
+{
+    std::ofstream observables_stream;
+    if (!settings.contains("correlation_bins") && !settings.contains("segment_length_bins")) return observables_stream;
+
+    observables_stream.open(secondary_output_filename(settings, "observables_output_file", "_observables"));
+    observables_stream << SingleRunResults::observables_output_header();
+    return observables_stream;
+}
+
+
+/**
+ * @brief If order_histogram is true in settings, opens the file for the distribution of the diagram orders, writing its header row.
+ * Its name is order_output_file, or by default the output_file name with "_orders" before the extension.
+ * Otherwise, the returned stream is not associated with any file.
+ * 
+ * @param settings dictionary-like nlohmann::json object, with the settings for running the algorithm
+ * @return std::ofstream 
+ */
+static std::ofstream open_order_output(const json & settings)
+{
+    std::ofstream order_stream;
+    if (!settings.contains("order_histogram") || !bool(settings["order_histogram"])) return order_stream;
+
+    order_stream.open(secondary_output_filename(settings, "order_output_file", "_orders"));
+    order_stream << SingleRunResults::order_output_header();
+    return order_stream;
+}
+
+
+/**
+ * @brief Returns the options of the autotuner from settings (autotune_pilot_steps), or the default ones
+ * 
+ * @param settings dictionary-like nlohmann::json object, with the settings for running the algorithm
+ * @return AutotuneOptions 
+ */
+static AutotuneOptions read_autotune_options(const json & settings)
+{
+    AutotuneOptions options;
+    if (settings.contains("autotune_pilot_steps")) options.pilot_steps = settings["autotune_pilot_steps"];
+    return options;
+}
+
+
 void single_run(const json & settings)
 {
 
     //PARAMETERS#################################################################
     //check presence of required keys in settings.json
-    check_required_keys_presence( settings,
-        {
-            "beta",
-            "H",
-            "GAMMA",
-            "N_total_steps",
-            "output_file"
-        }
-    );
+    check_required_keys_presence(settings, {"output_file"});
 
-    //assign default values to optional keys if not present in settings.json
-    int initial_s0 = settings.contains("initial_s0") ? (int) settings["initial_s0"] : INITIAL_S0_DEFAULT;
-    unsigned long long N_thermalization_steps = settings.contains("N_thermalization_steps") ? (unsigned long long) settings["N_thermalization_steps"] : N_THERMALIZATION_STEPS_DEFAULT;
-    unsigned long long int update_choice_seed = settings.contains("update_choice_seed") ? int(settings["update_choice_seed"]) : NEW_SEED;
-    unsigned long long int diagram_seed = settings.contains("diagram_seed") ? int(settings["diagram_seed"]) : NEW_SEED;
+    //the single run is the only task of the calculation
+    std::vector<SimulationTask> tasks = enumerate_tasks(settings);
+
+    //optionally choose the engine and the update probabilities with short pilot chains
+    if (settings.contains("autotune") ? bool(settings["autotune"]) : AUTOTUNE_DEFAULT)
+    {
+        ThreadPool pool(1);
+        autotune_tasks(tasks, pool, read_autotune_options(settings), std::cout);
+    }
+    SimulationTask task = tasks.front();
     //############################################################################
 
 
     //open file stream to write results in output file, write the header row containing the titles of the columns
     std::ofstream output_file_stream(static_cast<std::string>(settings["output_file"]));
     output_file_stream << SingleRunResults::ostream_output_header();
+    std::ofstream reweighted_stream = open_reweighted_output(settings);
+    std::ofstream observables_stream = open_observables_output(settings);
+    std::ofstream order_stream = open_order_output(settings);
 
 
     //SIMULATION#################################################################
     std::cout<<"Running single run simulation...\n";
 
     //execute single run simulation, and print results to terminal standard output
-    SingleRunResults results = run_simulation( 
-        settings["beta"],
-        initial_s0, 
-        settings["H"], 
-        settings["GAMMA"], 
-        settings["N_total_steps"], 
-        N_thermalization_steps, 
-        update_choice_seed, 
-        diagram_seed
-    );
+    SingleRunResults results = run_simulation(task);
     output_file_stream << results;    
     output_file_stream.close();
+    results.write_reweighted_rows(reweighted_stream);
+    reweighted_stream.close();
+    results.write_observables_rows(observables_stream);
+    observables_stream.close();
+    results.write_order_rows(order_stream);
+    order_stream.close();
 
     //for single run, also print summary on console standard output
     results.print_results();
@@ -230,68 +762,71 @@ void sweep(const json & settings)
 
     //PARAMETERS#################################################################
     //check existence of required keys in settings.json
-    check_required_keys_presence( settings,
-        {
-            "N_total_steps",
-            "output_file"
-        }
-    );
-    
-    //generates linearly-spaced list of values for the sweep parameters, based on min, max and step
-    std::vector<double> beta_values = range_generator(settings, "beta");
-    std::vector<double> H_values = range_generator(settings, "H");
-    std::vector<double> GAMMA_values = range_generator(settings, "GAMMA");
-    unsigned long long N_total_steps = settings["N_total_steps"];
+    check_required_keys_presence(settings, {"output_file"});
 
+    //list of all the runs for the combinations of beta, H and GAMMA (and samples per point)
+    std::vector<SimulationTask> tasks = enumerate_tasks(settings);
 
     //assign default values to optional keys if not present in settings.json
-    int initial_s0 = settings.contains("initial_s0") ? (int) settings["initial_s0"] : INITIAL_S0_DEFAULT;
-    unsigned long long N_thermalization_steps = settings.contains("N_thermalization_steps") ? (unsigned long long) settings["N_thermalization_steps"] : N_THERMALIZATION_STEPS_DEFAULT;
-    int samples_per_point = settings.contains("samples_per_point") ? int(settings["samples_per_point"]) : SAMPLES_PER_POINT_DEFAULT;
+    int N_threads = settings.contains("N_threads") ? int(settings["N_threads"]) : N_THREADS_DEFAULT;
+    int interleaved_chains = settings.contains("interleaved_chains") ? int(settings["interleaved_chains"]) : INTERLEAVED_CHAINS_DEFAULT;
+    if (interleaved_chains < 1) throw std::invalid_argument("interleaved_chains in settings.json must be > 0.");
+    bool pin_threads = settings.contains("pin_threads") ? bool(settings["pin_threads"]) : PIN_THREADS_DEFAULT;
+    bool autotune = settings.contains("autotune") ? bool(settings["autotune"]) : AUTOTUNE_DEFAULT;
+    bool use_symmetries = settings.contains("use_symmetries") ? bool(settings["use_symmetries"]) : USE_SYMMETRIES_DEFAULT;
+    bool warm_start = settings.contains("warm_start") ? bool(settings["warm_start"]) : WARM_START_DEFAULT;
+    if (warm_start && use_symmetries) throw std::invalid_argument("warm_start in settings.json cannot be combined with use_symmetries.");
+    if (warm_start && settings.contains("target_error")) throw std::invalid_argument("warm_start in settings.json cannot be combined with target_error.");
     //############################################################################
 
     
     //open file stream to write results in output file, write the header row containing the titles of the columns
     std::ofstream output_file_stream(static_cast<std::string>(settings["output_file"]));
     output_file_stream << SingleRunResults::ostream_output_header();
+    std::ofstream reweighted_stream = open_reweighted_output(settings);
+    std::ofstream observables_stream = open_observables_output(settings);
+    std::ofstream order_stream = open_order_output(settings);
 
 
 
     //SIMULATION###################################################################
     std::cout<<"Running sweep simulation...\n";
 
+    //pool of workers executing the runs, optionally pinned to the cores, with their placement reported in the log
+    ThreadPool pool(N_threads, pin_threads);
+    if (pin_threads) print_worker_placement(pool.placements(), std::cout);
+
+    //optionally choose the engine and the update probabilities of each parameter point with short pilot chains
+    //(with use_symmetries, only for the points that are run, whose tuning is copied to their mirrors)
+    if (autotune) autotune_tasks(tasks, pool, read_autotune_options(settings), std::cout, use_symmetries ? symmetry_sources(tasks) : std::vector<size_t>());
+
     //calculates parameters for progress bar, and prints it on standard output
-    int total_number_of_runs = beta_values.size() * H_values.size() * GAMMA_values.size() * samples_per_point;
+    int total_number_of_runs = tasks.size();
     int current_run = 0;
     print_progress_bar(current_run/total_number_of_runs);
     
-    //nested for loop for the sweep, running every combination of beta, H and GAMMA
-    for (auto beta : beta_values)
+    auto write_results = [&](const SingleRunResults & results)
     {
-        for(auto H : H_values)
-        {
-            for (auto GAMMA : GAMMA_values)
-            {       
-                        
-                //avoid GAMMA = 0, since it is not allowed: use a value extremely close to 0
-                if(std::abs(GAMMA) < std::numeric_limits<double>::epsilon()) GAMMA = 1e-10;
-                
-                //possibility to run multiple times for the same combination of parameters, useful to compute average and stddev
-                for(int i = 0; i < samples_per_point; ++i) 
-                {
-                    //launch run for the specific combination of parameters
-                    SingleRunResults results = run_simulation(beta, initial_s0, H, GAMMA, N_total_steps, N_thermalization_steps);
-                    output_file_stream << results; //immediately write results on file, to avoid losing data if program is interrupted
-
-                    //update progress bar
-                    ++current_run;
-                    print_progress_bar( (double) current_run/total_number_of_runs);
-                }                
-            }
-        }
-    }
+        output_file_stream << results; //immediately write results on file, to avoid losing data if program is interrupted
+        results.write_reweighted_rows(reweighted_stream);
+        results.write_observables_rows(observables_stream);
+        results.write_order_rows(order_stream);
+
+        //update progress bar
+        ++current_run;
+        print_progress_bar( (double) current_run/total_number_of_runs);
+    };
+
+    //launch the runs on N_threads workers, writing the results in the order of the tasks.
+    //With use_symmetries, the points related by symmetry to an already enumerated point are not run, but mirrored.
+    //With warm_start, each run starts from the final diagram of the run at the previous GAMMA
+    if (warm_start) run_tasks_warm_started(tasks, pool, write_results);
+    else run_tasks(tasks, pool, write_results, use_symmetries, interleaved_chains);
     std::cout<<std::endl<<"Sweep completed.\n";
     output_file_stream.close();
+    reweighted_stream.close();
+    observables_stream.close();
+    order_stream.close();
     //###############################################################################
     
 }
@@ -302,67 +837,220 @@ void convergence_test(const json & settings)
 
     //PARAMETERS#################################################################
     //check existence of required keys in settings.json
-    check_required_keys_presence( settings,
-        {
-            "beta",
-            "H",
-            "GAMMA",
-            "output_file"
-        }
-    );
+    check_required_keys_presence(settings, {"output_file"});
 
-    //generates log-spaced list of values for the sweep parameters, based on min, max and step
-    std::vector<double> N_total_steps_values = log_range_generator(settings, "N_total_steps");
-    std::vector<double> N_thermalization_steps_values;
+    //list of all the runs for the combinations of N_total_steps and N_thermalization_steps, all with the same seeds
+    std::vector<SimulationTask> tasks = enumerate_tasks(settings);
 
     //assign default values to optional keys if not present in settings.json
-    int initial_s0 = settings.contains("initial_s0") ? (int) settings["initial_s0"] : 1;
-    if( !settings.contains("N_thermalization_steps") && !settings.contains("N_thermalization_step_max")) N_thermalization_steps_values = {0};
-    else N_thermalization_steps_values = log_range_generator(settings, "N_thermalization_steps");
-    unsigned long long int update_choice_seed = settings.contains("update_choice_seed") ? int(settings["update_choice_seed"]) : NEW_SEED;
-    unsigned long long int diagram_seed = settings.contains("diagram_seed") ? int(settings["diagram_seed"]) : NEW_SEED;
+    int N_threads = settings.contains("N_threads") ? int(settings["N_threads"]) : N_THREADS_DEFAULT;
+    int interleaved_chains = settings.contains("interleaved_chains") ? int(settings["interleaved_chains"]) : INTERLEAVED_CHAINS_DEFAULT;
+    if (interleaved_chains < 1) throw std::invalid_argument("interleaved_chains in settings.json must be > 0.");
+    bool pin_threads = settings.contains("pin_threads") ? bool(settings["pin_threads"]) : PIN_THREADS_DEFAULT;
+    bool autotune = settings.contains("autotune") ? bool(settings["autotune"]) : AUTOTUNE_DEFAULT;
     //############################################################################
 
 
     //open file stream to write results in output file, write the header row containing the titles of the columns
     std::ofstream output_file_stream(static_cast<std::string>(settings["output_file"]));
     output_file_stream << SingleRunResults::ostream_output_header();
+    std::ofstream reweighted_stream = open_reweighted_output(settings);
+    std::ofstream observables_stream = open_observables_output(settings);
+    std::ofstream order_stream = open_order_output(settings);
 
 
     //SIMULATION#################################################################
     std::cout<<"Running convergence test...\n";
 
+    //pool of workers executing the runs, optionally pinned to the cores, with their placement reported in the log
+    ThreadPool pool(N_threads, pin_threads);
+    if (pin_threads) print_worker_placement(pool.placements(), std::cout);
+
+    //optionally choose the engine and the update probabilities of each parameter point with short pilot chains
+    if (autotune) autotune_tasks(tasks, pool, read_autotune_options(settings), std::cout);
+
     //calculates parameters for progress bar, and prints it on standard output
-    int total_number_of_runs = N_total_steps_values.size() * N_thermalization_steps_values.size();
+    int total_number_of_runs = tasks.size();
     int current_run = 0;
     print_progress_bar(current_run/total_number_of_runs);
 
-    //nested for loop for the sweep, running every combination of N_total_steps, and N_thermalization_steps
-    for (auto N_total_steps : N_total_steps_values)
+    //launch the runs on N_threads workers, writing the results in the order of the tasks
+    run_tasks(tasks, pool, [&](const SingleRunResults & results)
     {
-        for(auto N_thermalization_steps : N_thermalization_steps_values)
+        output_file_stream << results; //immediately write results on file, to avoid losing data if program is interrupted
+        results.write_reweighted_rows(reweighted_stream);
+        results.write_observables_rows(observables_stream);
+        results.write_order_rows(order_stream);
+
+        //update progress bar
+        ++current_run;
+        print_progress_bar( (double) current_run/total_number_of_runs);
+    }, false, interleaved_chains);
+    std::cout<<std::endl<<"Convergence test completed.\n";
+    output_file_stream.close();
+    reweighted_stream.close();
+    observables_stream.close();
+    order_stream.close();
+    //############################################################################
+}
+
+
+void mbar_analysis(const json & settings)
+{
+
+    //PARAMETERS#################################################################
+    //check existence of required keys in settings.json
+    check_required_keys_presence(settings, {"output_file", "mbar_output_file"});
+
+    //list of all the runs of the sweep, with the collection of the histograms
+    std::vector<SimulationTask> tasks = enumerate_tasks(settings);
+
+    //points where the observables are evaluated, for each beta of the sweep
+    std::vector<double> H_eval_values = range_generator(settings, "H_eval");
+    std::vector<double> GAMMA_eval_values = range_generator(settings, "GAMMA_eval");
+
+    //assign default values to optional keys if not present in settings.json
+    int N_threads = settings.contains("N_threads") ? int(settings["N_threads"]) : N_THREADS_DEFAULT;
+    int interleaved_chains = settings.contains("interleaved_chains") ? int(settings["interleaved_chains"]) : INTERLEAVED_CHAINS_DEFAULT;
+    if (interleaved_chains < 1) throw std::invalid_argument("interleaved_chains in settings.json must be > 0.");
+    bool pin_threads = settings.contains("pin_threads") ? bool(settings["pin_threads"]) : PIN_THREADS_DEFAULT;
+    bool autotune = settings.contains("autotune") ? bool(settings["autotune"]) : AUTOTUNE_DEFAULT;
+    bool use_symmetries = settings.contains("use_symmetries") ? bool(settings["use_symmetries"]) : USE_SYMMETRIES_DEFAULT;
+    //############################################################################
+
+
+    //open file stream to write the results of the runs, as for the sweep
+    std::ofstream output_file_stream(static_cast<std::string>(settings["output_file"]));
+    output_file_stream << SingleRunResults::ostream_output_header();
+    std::ofstream reweighted_stream = open_reweighted_output(settings);
+    std::ofstream observables_stream = open_observables_output(settings);
+    std::ofstream order_stream = open_order_output(settings);
+
+
+    //SIMULATION###################################################################
+    std::cout<<"Running sweep simulation for the multi-histogram analysis...\n";
+
+    //pool of workers executing the runs, optionally pinned to the cores, with their placement reported in the log
+    ThreadPool pool(N_threads, pin_threads);
+    if (pin_threads) print_worker_placement(pool.placements(), std::cout);
+
+    //optionally choose the engine and the update probabilities of each parameter point with short pilot chains
+    //(with use_symmetries, only for the points that are run, whose tuning is copied to their mirrors)
+    if (autotune) autotune_tasks(tasks, pool, read_autotune_options(settings), std::cout, use_symmetries ? symmetry_sources(tasks) : std::vector<size_t>());
+
+    int total_number_of_runs = tasks.size();
+    int current_run = 0;
+    print_progress_bar(current_run/total_number_of_runs);
+
+    //the runs are grouped by beta, since only runs with the same beta sample the same configuration space
+    struct BetaGroup
+    {
+        std::vector<SufficientStatisticsHistogram> histograms;
+        std::vector<double> H;
+        std::vector<double> GAMMA;
+    };
+    std::map<double, BetaGroup> groups;
+
+    size_t task_index = 0;
+    run_tasks(tasks, pool, [&](const SingleRunResults & results)
+    {
+        output_file_stream << results;
+        results.write_reweighted_rows(reweighted_stream);
+        results.write_observables_rows(observables_stream);
+        results.write_order_rows(order_stream);
+
+        BetaGroup & group = groups[tasks[task_index].beta];
+        group.histograms.push_back(results.histogram);
+        group.H.push_back(tasks[task_index].H);
+        group.GAMMA.push_back(tasks[task_index].GAMMA);
+        ++task_index;
+
+        ++current_run;
+        print_progress_bar( (double) current_run/total_number_of_runs);
+    }, use_symmetries, interleaved_chains);
+    std::cout<<std::endl<<"Sweep completed.\n";
+    output_file_stream.close();
+    reweighted_stream.close();
+    observables_stream.close();
+    order_stream.close();
+    //###############################################################################
+
+
+    //ANALYSIS#######################################################################
+    std::cout<<"Solving the multi-histogram equations...\n";
+
+    std::ofstream mbar_stream(static_cast<std::string>(settings["mbar_output_file"]));
+    mbar_stream << "beta,H,GAMMA,mbar_sigmax,mbar_sigmaz,exact_sigmax,exact_sigmaz,deviation_sigmax,deviation_sigmaz,ESS,N_runs\n";
+
+    for (const auto & [beta, group] : groups)
+    {
+        MultiHistogramSolver solver(group.histograms, group.H, group.GAMMA, pool);
+        int iterations = solver.solve();
+        std::cout << "beta = " << beta << ": " << group.histograms.size() << " runs, converged in " << iterations << " iterations.\n";
+
+        for (auto H : H_eval_values)
         {
-            //launch run for the specific combination of parameters
-            SingleRunResults results = run_simulation(
-                settings["beta"],
-                initial_s0, 
-                settings["H"], 
-                settings["GAMMA"], 
-                N_total_steps, 
-                N_thermalization_steps,
-                update_choice_seed,
-                diagram_seed
-            );
-            output_file_stream << results; //immediately write results on file, to avoid losing data if program is interrupted
-            
-            //update progress bar
-            ++current_run;
-            print_progress_bar( (double) current_run/total_number_of_runs);
+            for (auto GAMMA : GAMMA_eval_values)
+            {
+                //avoid GAMMA = 0, as in the sweep
+                if(std::abs(GAMMA) < std::numeric_limits<double>::epsilon()) GAMMA = 1e-10;
+
+                MultiHistogramEstimate estimate = solver.evaluate(H, GAMMA);
+                double sigmax_exact = exact_sigmax(beta, H, GAMMA);
+                double sigmaz_exact = exact_sigmaz(beta, H, GAMMA);
+                mbar_stream << beta << ',' << H << ',' << GAMMA << ',' <<
+                    estimate.sigmax << ',' << estimate.sigmaz << ',' <<
+                    sigmax_exact << ',' << sigmaz_exact << ',' <<
+                    estimate.sigmax - sigmax_exact << ',' << estimate.sigmaz - sigmaz_exact << ',' <<
+                    estimate.ESS << ',' << group.histograms.size() << '\n';
+            }
         }
     }
-    std::cout<<std::endl<<"Convergence test completed.\n";
-    output_file_stream.close();    
-    //############################################################################
+    mbar_stream.close();
+    std::cout<<"Multi-histogram analysis completed.\n";
+    //###############################################################################
+}
+
+
+void lockstep_check(const json & settings)
+{
+    //the check uses the parameters, number of steps and seeds of a single run
+    SimulationTask task = enumerate_tasks(settings).front();
+
+    std::cout<<"Running reference and optimized engines in lockstep...\n\n";
+    LockstepReport report = run_lockstep_check(task);
+    print_lockstep_report(report, std::cout);
+
+    //a divergence is a failure of the calculation, so that the check can be used in scripts
+    if (report.diverged) exit(EXIT_FAILURE);
+}
+
+
+void worm_calculation(const json & settings)
+{
+    check_required_keys_presence(settings, {"output_file"});
+
+    SimulationTask task = enumerate_tasks(settings).front();
+    unsigned int bins = settings.contains("greens_function_bins") ? unsigned(settings["greens_function_bins"]) : GREENS_FUNCTION_BINS_DEFAULT;
+    double worm_weight = settings.contains("worm_weight") ? double(settings["worm_weight"]) : WORM_WEIGHT_DEFAULT;
+    double worm_update_probability = settings.contains("worm_update_probability") ? double(settings["worm_update_probability"]) : WORM_UPDATE_PROBABILITY_DEFAULT;
+
+    std::cout<<"Running worm algorithm simulation...\n";
+    GreensFunctionResults results = run_worm_simulation(task, bins, worm_weight, worm_update_probability);
+
+    //one row per point of the Green's function
+    std::ofstream output_file_stream(static_cast<std::string>(settings["output_file"]));
+    output_file_stream << "beta,H,GAMMA,tau,correlation_xx,error_correlation_xx,exact_correlation_xx\n";
+    for (size_t i = 0; i < results.tau.size(); ++i)
+        output_file_stream << task.beta << ',' << task.H << ',' << task.GAMMA << ',' << results.tau[i] << ',' << 
+            results.correlation_xx[i] << ',' << results.error_correlation_xx[i] << ',' << results.exact_correlation_xx[i] << '\n';
+    output_file_stream.close();
+
+    std::cout << "Fraction of steps with the worm open: " << results.open_fraction << '\n';
+    std::cout << "Time per step: " << (task.N_total_steps > 0 ? double(results.run_time) / task.N_total_steps : 0) << " ns\n";
+    for (size_t i = 0; i < results.tau.size(); ++i)
+        std::cout << "C_xx(" << results.tau[i] << ") : " << results.correlation_xx[i] << " +/- " << results.error_correlation_xx[i] <<
+            " (exact: " << results.exact_correlation_xx[i] << ")\n";
 }
 
 
@@ -371,18 +1059,43 @@ void launch_calculations(std::string settings_filename)
     //read settings from json file, and store it in a json object (dictionary-like)
     json settings = read_settings(settings_filename);
 
+    //report the variant of the SIMD kernels selected for this CPU
+    std::cout << "SIMD kernels: " << simd_level_name(selected_simd_level()) << 
+        " (widest supported: " << simd_level_name(supported_simd_level()) << ")\n";
+
     //select which kind of calculation to run, based on what was specified in the settings file
-    if(settings["CALC_TYPE"] == "single" )
-    {
-        single_run(settings);
-    }
-    else if (settings["CALC_TYPE"] == "sweep")
+    //terminate the program if the settings are not valid
+    try
     {
-        sweep(settings);
+        if(settings["CALC_TYPE"] == "single" )
+        {
+            single_run(settings);
+        }
+        else if (settings["CALC_TYPE"] == "sweep")
+        {
+            sweep(settings);
+        }
+        else if (settings["CALC_TYPE"] == "convergence-test")
+        {
+            convergence_test(settings);
+        }
+        else if (settings["CALC_TYPE"] == "lockstep-check")
+        {
+            lockstep_check(settings);
+        }
+        else if (settings["CALC_TYPE"] == "mbar")
+        {
+            mbar_analysis(settings);
+        }
+        else if (settings["CALC_TYPE"] == "worm")
+        {
+            worm_calculation(settings);
+        }
     }
-    else if (settings["CALC_TYPE"] == "convergence-test")
+    catch(const std::invalid_argument & e)
     {
-        convergence_test(settings);
+        std::cerr << "\nError: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
     }
     
 }
\ No newline at end of file
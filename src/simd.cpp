@@ -0,0 +1,246 @@
+/**
+ * @file simd.cpp
+ * @brief Definitions of the variants of the SIMD kernels, and of their runtime dispatch
+ */
+
+#include <diagmc/simd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <stdexcept>
+
+//the vector variants are compiled with per-function target attributes, so that the rest of the binary runs on any x86 CPU
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+
+std::string simd_level_name(SimdLevel level)
+{
+    switch (level)
+    {
+        case SimdLevel::SSE2: return "sse2";
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::AVX512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+
+SimdLevel parse_simd_level(const std::string & name)
+{
+    for (SimdLevel level : {SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512})
+        if (simd_level_name(level) == name) return level;
+    throw std::invalid_argument("unknown SIMD instruction set " + name + " (valid: scalar, sse2, avx2, avx512).");
+}
+
+
+SimdLevel supported_simd_level()
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse2")) return SimdLevel::SSE2;
+#endif
+    return SimdLevel::SCALAR;
+}
+
+
+
+//VARIANTS OF THE KERNELS######################################################
+
+/**
+ * @brief Counts the elements of the array <= x (INCLUSIVE) or < x, without branches
+ */
+template <bool INCLUSIVE>
+static size_t count_before_scalar(const double * data, size_t n, double x)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) count += INCLUSIVE ? data[i] <= x : data[i] < x;
+    return count;
+}
+
+#ifdef SIMD_X86
+template <bool INCLUSIVE>
+__attribute__((target("sse2")))
+static size_t count_before_sse2(const double * data, size_t n, double x)
+{
+    __m128d value = _mm_set1_pd(x);
+    size_t count = 0, i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128d elements = _mm_loadu_pd(data + i);
+        __m128d before = INCLUSIVE ? _mm_cmple_pd(elements, value) : _mm_cmplt_pd(elements, value);
+        count += __builtin_popcount(_mm_movemask_pd(before));
+    }
+    return count + count_before_scalar<INCLUSIVE>(data + i, n - i, x);
+}
+
+template <bool INCLUSIVE>
+__attribute__((target("avx2")))
+static size_t count_before_avx2(const double * data, size_t n, double x)
+{
+    __m256d value = _mm256_set1_pd(x);
+    size_t count = 0, i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d elements = _mm256_loadu_pd(data + i);
+        __m256d before = _mm256_cmp_pd(elements, value, INCLUSIVE ? _CMP_LE_OQ : _CMP_LT_OQ);
+        count += __builtin_popcount(_mm256_movemask_pd(before));
+    }
+    return count + count_before_scalar<INCLUSIVE>(data + i, n - i, x);
+}
+
+template <bool INCLUSIVE>
+__attribute__((target("avx512f")))
+static size_t count_before_avx512(const double * data, size_t n, double x)
+{
+    __m512d value = _mm512_set1_pd(x);
+    size_t count = 0, i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m512d elements = _mm512_loadu_pd(data + i);
+        count += __builtin_popcount(_mm512_cmp_pd_mask(elements, value, INCLUSIVE ? _CMP_LE_OQ : _CMP_LT_OQ));
+    }
+    //the last elements are compared with a masked load, instead of a scalar loop
+    __mmask8 tail = static_cast<__mmask8>((1u << (n - i)) - 1);
+    __m512d elements = _mm512_maskz_loadu_pd(tail, data + i);
+    count += __builtin_popcount(_mm512_mask_cmp_pd_mask(tail, elements, value, INCLUSIVE ? _CMP_LE_OQ : _CMP_LT_OQ));
+    return count;
+}
+#endif
+
+
+/**
+ * @brief Search in a sorted array: the bisection narrows the range down to SIMD_SEARCH_BLOCK elements,
+ * whose elements before x are then counted with vector comparisons (since the array is sorted, the count is the position of x).
+ * The short final block avoids the mispredicted branches of the last steps of the bisection.
+ */
+template <bool INCLUSIVE, size_t (*COUNT_BEFORE)(const double *, size_t, double)>
+static size_t blocked_search(const double * data, size_t n, double x)
+{
+    size_t first = 0;
+    while (n > SIMD_SEARCH_BLOCK)
+    {
+        size_t half = n / 2;
+        bool before = INCLUSIVE ? data[first + half] <= x : data[first + half] < x;
+        if (before)
+        {
+            first += half + 1;
+            n -= half + 1;
+        }
+        else n = half;
+    }
+    return first + COUNT_BEFORE(data + first, n, x);
+}
+
+//the scalar variant is the reference implementation of the standard library
+static size_t upper_bound_scalar(const double * data, size_t n, double x) { return std::upper_bound(data, data + n, x) - data; }
+static size_t lower_bound_scalar(const double * data, size_t n, double x) { return std::lower_bound(data, data + n, x) - data; }
+//#############################################################################
+
+
+
+//DISPATCH#####################################################################
+
+/**
+ * @brief Table of the variants of the kernels for one instruction set
+ */
+struct SimdKernels
+{
+    size_t (*upper_bound)(const double *, size_t, double);
+    size_t (*lower_bound)(const double *, size_t, double);
+};
+
+
+/**
+ * @brief Returns the table of the kernels of an instruction set.
+ * Throws an std::invalid_argument exception if the instruction set is not supported by the CPU.
+ */
+static const SimdKernels & kernels_of(SimdLevel level)
+{
+    static const SimdKernels scalar {upper_bound_scalar, lower_bound_scalar};
+#ifdef SIMD_X86
+    static const SimdKernels sse2 {blocked_search<true, count_before_sse2<true>>, blocked_search<false, count_before_sse2<false>>};
+    static const SimdKernels avx2 {blocked_search<true, count_before_avx2<true>>, blocked_search<false, count_before_avx2<false>>};
+    static const SimdKernels avx512 {blocked_search<true, count_before_avx512<true>>, blocked_search<false, count_before_avx512<false>>};
+#endif
+
+    if (level > supported_simd_level())
+        throw std::invalid_argument("the SIMD instruction set " + simd_level_name(level) + " is not supported by this CPU.");
+
+    switch (level)
+    {
+#ifdef SIMD_X86
+        case SimdLevel::SSE2: return sse2;
+        case SimdLevel::AVX2: return avx2;
+        case SimdLevel::AVX512: return avx512;
+#endif
+        default: return scalar;
+    }
+}
+
+
+/**
+ * @brief Instruction set selected at startup: the widest supported, limited by the environment variable if set
+ */
+static SimdLevel startup_simd_level()
+{
+    SimdLevel level = supported_simd_level();
+    const char * requested = std::getenv(SIMD_ENVIRONMENT_VARIABLE);
+    if (requested == nullptr) return level;
+
+    try
+    {
+        return std::min(level, parse_simd_level(requested));
+    }
+    catch(const std::invalid_argument &)
+    {
+        return level;
+    }
+}
+
+
+//selected instruction set, and its table of kernels (read at every call, hence atomic)
+static std::atomic<SimdLevel> selected_level {startup_simd_level()};
+static std::atomic<const SimdKernels *> selected_kernels {&kernels_of(selected_level)};
+
+
+SimdLevel selected_simd_level()
+{
+    return selected_level;
+}
+
+
+void select_simd_level(SimdLevel level)
+{
+    selected_kernels = &kernels_of(level);
+    selected_level = level;
+}
+
+
+size_t simd_upper_bound(const double * data, size_t n, double x)
+{
+    return selected_kernels.load(std::memory_order_relaxed)->upper_bound(data, n, x);
+}
+
+
+size_t simd_lower_bound(const double * data, size_t n, double x)
+{
+    return selected_kernels.load(std::memory_order_relaxed)->lower_bound(data, n, x);
+}
+
+
+size_t simd_upper_bound(const double * data, size_t n, double x, SimdLevel level)
+{
+    return kernels_of(level).upper_bound(data, n, x);
+}
+
+
+size_t simd_lower_bound(const double * data, size_t n, double x, SimdLevel level)
+{
+    return kernels_of(level).lower_bound(data, n, x);
+}
+//#############################################################################
@@ -6,10 +6,19 @@
  */
 
 #include <diagmc/simulation.h>
+#include <diagmc/simd.h>
 #include <diagmc/diagram.h>
+#include <diagmc/flat_diagram.h>
+#include <diagmc/exact.h>
+#include <algorithm>
 #include <chrono>
+#include <list>
+#include <memory>
+#include <stdexcept>
 #include <iostream>
 #include <string>
+#include <type_traits>
+#include <utility>
 
 
 SingleRunResults::SingleRunResults(
@@ -36,6 +45,15 @@ std::string SingleRunResults::ostream_output_header()
         "GAMMA,"
         "measured_sigmax,"
         "measured_sigmaz,"
+        "exact_sigmax,"
+        "exact_sigmaz,"
+        "deviation_sigmax,"
+        "deviation_sigmaz,"
+        "error_sigmax,"
+        "error_sigmaz,"
+        "ESS_per_second_sigmax,"
+        "ESS_per_second_sigmaz,"
+        "R_hat,"
         "N_measures,"
         "N_attempted_flips,"
         "N_accepted_flips,"
@@ -45,15 +63,26 @@ std::string SingleRunResults::ostream_output_header()
         "N_accepted_removesegment,"
         "max_diagram_order,"
         "avg_diagram_order,"
+        "order_p50,"
+        "order_p99,"
+        "order_p999,"
         "run_time,"
         "N_total_steps,"
         "N_thermalization_steps," 
         "update_choice_seed,"
-        "diagram_seed\n";
+        "diagram_seed,"
+        "synthesized,"
+        "stopped_early,"
+        "flip_probability,"
+        "delayed_rejection\n";
 }
 
 std::ostream & operator<<(std::ostream &os, const SingleRunResults &results)
 {
+    //theoretical values for comparison
+    double sigmax_exact = exact_sigmax(results.beta, results.H, results.GAMMA);
+    double sigmaz_exact = exact_sigmaz(results.beta, results.H, results.GAMMA);
+
     return os << 
             results.beta << ',' <<
             results.initial_s0 << ',' <<
@@ -61,6 +90,15 @@ std::ostream & operator<<(std::ostream &os, const SingleRunResults &results)
             results.GAMMA << ',' <<
             results.measured_sigmax << ',' <<
             results.measured_sigmaz << ',' <<
+            sigmax_exact << ',' <<
+            sigmaz_exact << ',' <<
+            results.measured_sigmax - sigmax_exact << ',' <<
+            results.measured_sigmaz - sigmaz_exact << ',' <<
+            results.error_sigmax << ',' <<
+            results.error_sigmaz << ',' <<
+            results.ESS_per_second(results.ESS_sigmax) << ',' <<
+            results.ESS_per_second(results.ESS_sigmaz) << ',' <<
+            results.R_hat << ',' <<
             results.N_measures << ',' <<
             results.N_attempted_flips << ',' <<
             results.N_accepted_flips << ',' <<
@@ -70,21 +108,182 @@ std::ostream & operator<<(std::ostream &os, const SingleRunResults &results)
             results.N_accepted_removesegment << ',' <<
             results.max_diagram_order << ',' <<
             results.avg_diagram_order << ',' <<
+            results.order_distribution.quantile(0.5) << ',' <<
+            results.order_distribution.quantile(0.99) << ',' <<
+            results.order_distribution.quantile(0.999) << ',' <<
             results.run_time << ',' <<
             results.N_total_steps << ',' <<
             results.N_thermalization_steps << ',' << 
             results.update_choice_seed << ',' << 
-            results.diagram_seed << std::endl;
+            results.diagram_seed << ',' <<
+            results.synthesized << ',' <<
+            results.stopped_early << ',' <<
+            results.flip_probability << ',' <<
+            results.delayed_rejection << std::endl;
 }
 
 
 
+std::string SingleRunResults::reweighted_output_header()
+{
+    return 
+        "beta,"
+        "H,"
+        "GAMMA,"
+        "target_beta,"
+        "reweighted_sigmax,"
+        "reweighted_sigmaz,"
+        "exact_sigmax,"
+        "exact_sigmaz,"
+        "ESS,"
+        "ESS_fraction,"
+        "N_measures,"
+        "update_choice_seed,"
+        "diagram_seed\n";
+}
+
+
+void SingleRunResults::write_reweighted_rows(std::ostream & os) const
+{
+    for (const auto & result : reweighted)
+    {
+        os << 
+            beta << ',' <<
+            H << ',' <<
+            GAMMA << ',' <<
+            result.target_beta << ',' <<
+            result.sigmax << ',' <<
+            result.sigmaz << ',' <<
+            exact_sigmax(result.target_beta, H, GAMMA) << ',' <<
+            exact_sigmaz(result.target_beta, H, GAMMA) << ',' <<
+            result.ESS << ',' <<
+            result.ESS_fraction << ',' <<
+            N_measures << ',' <<
+            update_choice_seed << ',' <<
+            diagram_seed << '\n';
+    }
+}
+
+
+std::string SingleRunResults::observables_output_header()
+{
+    return 
+        "beta,"
+        "H,"
+        "GAMMA,"
+        "observable,"
+        "x,"
+        "value,"
+        "exact,"
+        "N_snapshots,"
+        "N_dropped,"
+        "update_choice_seed,"
+        "diagram_seed\n";
+}
+
+
+void SingleRunResults::write_observables_rows(std::ostream & os) const
+{
+    auto write_row = [&](const char * observable, double x, double value, const std::string & exact)
+    {
+        os << 
+            beta << ',' <<
+            H << ',' <<
+            GAMMA << ',' <<
+            observable << ',' <<
+            x << ',' <<
+            value << ',' <<
+            exact << ',' <<
+            observables.N_snapshots << ',' <<
+            observables.N_dropped << ',' <<
+            update_choice_seed << ',' <<
+            diagram_seed << '\n';
+    };
+
+    for (size_t i = 0; i < observables.tau.size(); ++i)
+        write_row("correlation_zz", observables.tau[i], observables.correlation_zz[i], 
+            std::to_string(exact_correlation_zz(observables.tau[i], beta, H, GAMMA)));
+
+    for (size_t i = 0; i < observables.segment_length.size(); ++i)
+        write_row("segment_length_density", observables.segment_length[i], observables.segment_length_density[i], "");
+}
+
+
+std::string SingleRunResults::order_output_header()
+{
+    return 
+        "beta,"
+        "H,"
+        "GAMMA,"
+        "order,"
+        "count,"
+        "fraction,"
+        "sigmaz_at_order,"
+        "N_measures,"
+        "update_choice_seed,"
+        "diagram_seed\n";
+}
+
+
+void SingleRunResults::write_order_rows(std::ostream & os) const
+{
+    unsigned long long N_samples = order_distribution.N_samples();
+    for (size_t i = 0; i < order_distribution.counts.size(); ++i)
+    {
+        if (order_distribution.counts[i] == 0) continue;
+        os << 
+            beta << ',' <<
+            H << ',' <<
+            GAMMA << ',' <<
+            2*i << ',' <<
+            order_distribution.counts[i] << ',' <<
+            static_cast<double>(order_distribution.counts[i]) / N_samples << ',' <<
+            order_distribution.sigmaz[i] << ',' <<
+            N_measures << ',' <<
+            update_choice_seed << ',' <<
+            diagram_seed << '\n';
+    }
+}
+
+
+double SingleRunResults::ESS_per_second(double ESS) const
+{
+    return run_time > 0 ? ESS / (run_time / 1e9) : 0;
+}
+
+
+SingleRunResults SingleRunResults::mirrored(bool flip_H, bool flip_GAMMA) const
+{
+    SingleRunResults results = *this;
+
+    if (flip_H)
+    {
+        results.H = -H;
+        results.initial_s0 = -initial_s0;
+        results.measured_sigmaz = -measured_sigmaz;
+        for (auto & result : results.reweighted) result.sigmaz = -result.sigmaz;
+        if (histogram.get_N_bins() > 0) results.histogram = histogram.mirrored();
+        for (auto & sigmaz : results.order_distribution.sigmaz) sigmaz = -sigmaz;
+        results.final_diagram.s0 = -final_diagram.s0;
+    }
+
+    if (flip_GAMMA)
+    {
+        results.GAMMA = -GAMMA;
+        results.measured_sigmax = -measured_sigmax;
+        for (auto & result : results.reweighted) result.sigmax = -result.sigmax;
+    }
+
+    results.synthesized = true;
+    return results;
+}
+
+
 void SingleRunResults::print_results() const
 {
     //theoretical values for comparison
-    double E = sqrt(H * H + GAMMA * GAMMA);
-    double mz_exact = -H / E * tanh(beta * E);
-    double mx_exact = -GAMMA / E * tanh(beta * E);
+    double mz_exact = exact_sigmaz(beta, H, GAMMA);
+    double mx_exact = exact_sigmax(beta, H, GAMMA);
 
     std::cout << "\nResults:\n\n";
 
@@ -97,6 +296,10 @@ void SingleRunResults::print_results() const
     std::cout << "\nMeasures:\n";
     std::cout << "sigma_z: " << measured_sigmaz << ".  exact mz: " << mz_exact << ".  diff: " << (measured_sigmaz - mz_exact) / mz_exact * 100<< "%\n";
     std::cout << "sigma_x: " << measured_sigmax << ".  exact mx: " << mx_exact << ".  diff: " << (measured_sigmax - mx_exact) / mx_exact * 100<< "%\n";
+    std::cout << "errors : sigma_z +- " << error_sigmaz << " (" << ESS_sigmaz << " effective samples), sigma_x +- " << error_sigmax << 
+        " (" << ESS_sigmax << " effective samples)\n";
+    if (R_hat > 0)
+        std::cout << "R-hat  : " << R_hat << (stopped_early ? " (converged, stopped early)" : "") << '\n';
 
 
     std::cout << "\nStatistics:\n" <<
@@ -104,114 +307,456 @@ void SingleRunResults::print_results() const
         "Accepted remove:  " << N_accepted_removesegment << "/" << N_attempted_removesegment << " = " << (double)N_accepted_removesegment / N_attempted_removesegment * 100 << "%\n" <<
         "Accepted flips :  " << N_accepted_flips << "/" << N_attempted_flips << " = " << (double)N_accepted_flips / N_attempted_flips * 100 << "%\n" <<
         "Max order      :  " << max_diagram_order << '\n' <<
-        "Average order  :  " << avg_diagram_order << '\n';
+        "Average order  :  " << avg_diagram_order << '\n' <<
+        "Order quantiles:  p50 = " << order_distribution.quantile(0.5) << ", p99 = " << order_distribution.quantile(0.99) << 
+            ", p99.9 = " << order_distribution.quantile(0.999) << '\n';
+    
+    if (!reweighted.empty())
+    {
+        std::cout << "\nReweighted:\n";
+        for (const auto & result : reweighted)
+            std::cout << "beta = " << result.target_beta << 
+                "  sigma_z: " << result.sigmaz << " (exact: " << exact_sigmaz(result.target_beta, H, GAMMA) << ")" <<
+                "  sigma_x: " << result.sigmax << " (exact: " << exact_sigmax(result.target_beta, H, GAMMA) << ")" <<
+                "  ESS: " << result.ESS_fraction * 100 << "%\n";
+    }
+    
+    if (!observables.tau.empty() || !observables.segment_length.empty())
+    {
+        std::cout << "\nMeasured observables:\n";
+        for (size_t i = 0; i < observables.tau.size(); ++i)
+            std::cout << "C_zz(" << observables.tau[i] << ") : " << observables.correlation_zz[i] << 
+                " (exact: " << exact_correlation_zz(observables.tau[i], beta, H, GAMMA) << ")\n";
+        std::cout << "Snapshots measured: " << observables.N_snapshots << ", dropped: " << observables.N_dropped << '\n';
+    }
     
     std::cout << "\nPerformance:\n" <<
-        "Run time:  " << run_time / 1e9 << " seconds (" << run_time/N_total_steps << " ns per step)\n";
+        "Run time:  " << run_time / 1e9 << " seconds (" << run_time/(N_attempted_flips + N_attempted_addsegment + N_attempted_removesegment) << " ns per step)\n" <<
+        "Efficiency:  sigma_z " << ESS_per_second(ESS_sigmaz) << ", sigma_x " << ESS_per_second(ESS_sigmax) << " effective samples per second\n" <<
+        "SIMD kernels: " << simd_level_name(selected_simd_level()) << '\n';
 }
 
 
 
 
-SingleRunResults run_simulation(
-    double beta, 
-    double initial_s0, 
-    double H, 
-    double GAMMA, 
-    unsigned long long int N_total_steps, 
-    unsigned long long int N_thermalization_steps,
-    unsigned long long int update_choice_seed, 
-    unsigned long long int diagram_seed
-    ) 
+//hint to the processor to load the cache line containing address, without waiting for it
+#if defined(__GNUC__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address)
+#endif
+
+
+/**
+ * @brief Prefetches the memory that the next update of a FlatDiagram reads first:
+ * the first levels of the binary search over the array of vertices.
+ */
+static void prefetch_vertices(const FlatDiagram & diagram)
 {
+    const std::vector<double> & vertices = diagram.vertices();
+    size_t n = vertices.size();
+    if (n == 0) return;
+    PREFETCH(vertices.data() + n/2);
+    PREFETCH(vertices.data() + n/4);
+    PREFETCH(vertices.data() + 3*n/4);
+}
+
+
+/**
+ * @brief No-op for a Diagram: its updates walk the list from the first node following the pointers,
+ * so the nodes they visit cannot be prefetched without loading them. Interleaving the chains of the list engine
+ * only overlaps the cache misses of their independent walks.
+ */
+static void prefetch_vertices(const Diagram &) {}
+
 
-    //objects for random choice of the update
-    std::mt19937 mt_generator(update_choice_seed);
-    std::uniform_real_distribution<double> uniform_distribution(0, 1);
-    #define RNG uniform_distribution(mt_generator)
+void ChainStatistics::store_results(SingleRunResults & results, double beta, double GAMMA) const
+{
+    results.N_measures = N_measures;
+    results.N_attempted_flips = N_attempted_flips;
+    results.N_accepted_flips = N_accepted_flips;
+    results.N_attempted_addsegment = N_attempted_addsegment;
+    results.N_accepted_addsegment = N_accepted_addsegment;
+    results.N_attempted_removesegment = N_attempted_removesegment;
+    results.N_accepted_removesegment = N_accepted_removesegment;
+    results.max_diagram_order = max_order;
+    results.avg_diagram_order = static_cast<double>(sum_order) / N_measures;
+    results.measured_sigmax = static_cast<double>(sum_order) / -(N_measures * beta * GAMMA);
+    results.measured_sigmaz = sum_mz.value() / N_measures;
+    results.order_distribution = orders.distribution();
+    results.error_sigmaz = binning_mz.error();
+    results.ESS_sigmaz = binning_mz.effective_sample_size();
+    results.error_sigmax = binning_order.error() / std::abs(beta * GAMMA);
+    results.ESS_sigmax = binning_order.effective_sample_size();
+}
 
 
-    //initialize diagram object, to be a 0-order diagram with the given parameters
-    Diagram diagram(beta, initial_s0, H, GAMMA, {}, diagram_seed);
+/**
+ * @brief Returns the vertices of the initial diagram of the task, in the container of the storage engine (empty for the 0-th order diagram)
+ */
+template <class DiagramType>
+static auto initial_vertices(const SimulationTask & task)
+{
+    using Container = std::decay_t<decltype(std::declval<DiagramType>().vertices())>;
+    if (!task.initial_diagram) return Container();
+    return Container(task.initial_diagram->vertices.begin(), task.initial_diagram->vertices.end());
+}
 
 
-    //initialize results object, inserting the simulation parameters, and setting to 0 the statistics variables.
-    SingleRunResults results(beta, initial_s0, H, GAMMA, N_total_steps, N_thermalization_steps, update_choice_seed, diagram_seed);
+/**
+ * @brief State of the Markov chain of a run, templated on the storage engine of the diagram (Diagram or FlatDiagram).
+ * The loop of run_simulation is split in single steps, so that several chains can be interleaved on the same thread.
+ * The whole state is aligned to the cache line, so that chains allocated by different workers do not share cache lines.
+ */
+template <class DiagramType>
+class alignas(CACHE_LINE_SIZE) MarkovChain
+{
+    private:
+
+    SimulationTask _task;                                       ///< parameters of the run
+    std::mt19937 _mt_generator;                                 ///< random number generator for the choice of the update
+    std::uniform_real_distribution<double> _uniform_distribution{0, 1};
+    DiagramType _diagram;                                       ///< current diagram of the chain
+    SingleRunResults _results;                                  ///< parameters and statistics of the run
+    bool _reweighting;                                          ///< true if the magnetizations are reweighted to other betas
+    BetaReweighter _reweighter;                                 ///< reweighting of the magnetizations to the reweight_betas
+    bool _collect_histogram;                                    ///< true if the histogram of the sufficient statistics is collected
+    std::unique_ptr<MeasurementPipeline> _pipeline;             ///< asynchronous measurement of the snapshots (null if disabled)
+    unsigned long long int _loop_iteration = 0;                 ///< number of steps performed
+    bool _stopped_early = false;                                ///< true if the convergence monitor stopped the chain
+    bool _awaiting_decision = false;                            ///< true if the monitor has not decided on the last report of the chain yet
+    unsigned long long _monitor_epoch = 0;                      ///< last epoch reported to the convergence monitor
+    ChainStatistics _statistics;                                ///< counters and running sums, copied into _results at the end
+    //probabilities of choosing the updates: ADD_SEGMENT and REMOVE_SEGMENT must have the same probability, 
+    //for which the acceptance rates are derived, while the rest is SPIN_FLIP
+    double _attempt_add_probability;
+    double _attempt_remove_probability;
+
+
+    /**
+     * @brief Applies a decision of the convergence monitor on the last report of the chain
+     *
+     * @return false if the decision is still pending
+     */
+    bool apply_decision(ConvergenceDecision decision)
+    {
+        if (decision == ConvergenceDecision::PENDING) return false;
+        _awaiting_decision = false;
+        if (decision == ConvergenceDecision::STOP) _stopped_early = _loop_iteration < _task.N_total_steps;
+        return true;
+    }
 
 
-    //define probabilities of choosing the updates. There is no need in principle for the user to 
-    //modify them, hence they are not exposed as parameters.
-    constexpr double attempt_flip_probability = 1./3;
-    constexpr double attempt_add_probability = (1 - attempt_flip_probability)/2;
-    constexpr double attempt_remove_probability = attempt_add_probability;
+    public:
 
+    /**
+     * @brief Initialize the chain with the initial diagram of the task (by default the 0-order diagram), with the parameters of the task
+     */
+    explicit MarkovChain(const SimulationTask & task)
+        : _task(task), _mt_generator(task.update_choice_seed),
+          _diagram(task.beta, task.initial_diagram ? task.initial_diagram->s0 : task.initial_s0, task.H, task.GAMMA, initial_vertices<DiagramType>(task), task.diagram_seed),
+          _results(task.beta, task.initial_s0, task.H, task.GAMMA, task.N_total_steps, task.N_thermalization_steps, task.update_choice_seed, task.diagram_seed),
+          _reweighting(!task.reweight_betas.empty()), _reweighter(task.beta, task.H, task.GAMMA, task.reweight_betas),
+          _collect_histogram(task.histogram_bins > 0),
+          _attempt_add_probability((1 - task.flip_probability) / 2), _attempt_remove_probability(_attempt_add_probability)
+    {
+        if (!(task.flip_probability > 0 && task.flip_probability < 1)) throw std::invalid_argument("flip_probability must be in (0, 1).");
 
-    //temporary variables to store the partial results
-    double temp_sigmax = 0;
-    double temp_sigmaz = 0;
-    double temp_avgorder = 0;
-    double temp_maxorder = 0;
+        _results.flip_probability = task.flip_probability;
+        _results.delayed_rejection = task.delayed_rejection;
+        _results.worker_thread = std::this_thread::get_id();
 
+        //optional histogram of the sufficient statistics of the samples, for the multi-histogram analysis
+        if (_collect_histogram) _results.histogram = SufficientStatisticsHistogram(task.beta, task.histogram_bins);
 
-    //Performance metrics of the run
-    auto initial_time = std::chrono::high_resolution_clock::now();
+        //optional pipeline measuring the expensive observables on snapshots of the diagram, in separate threads
+        if (task.measurements.enabled()) _pipeline = std::make_unique<MeasurementPipeline>(task.beta, task.measurements);
+    }
 
-    //main loop
-    for (unsigned long long int loop_iteration = 0; loop_iteration < N_total_steps; ++loop_iteration)
+    /**
+     * @brief Returns true when all the N_total_steps steps have been performed, or the convergence monitor stopped the chain,
+     * and the monitor has decided on the last report of the chain
+     */
+    bool done() const { return !_awaiting_decision && (_loop_iteration >= _task.N_total_steps || _stopped_early); }
+
+    /**
+     * @brief Returns true if the chain is waiting for the decision of the convergence monitor on its last report
+     */
+    bool awaiting_decision() const { return _awaiting_decision; }
+
+    /**
+     * @brief Blocks until the convergence monitor has decided on the last report of the chain (if it is waiting for it)
+     */
+    void wait_decision() { if (_awaiting_decision) apply_decision(_task.monitor->wait_decision(_monitor_epoch)); }
+
+    /**
+     * @brief Returns the last epoch reported to the convergence monitor
+     */
+    unsigned long long monitor_epoch() const { return _monitor_epoch; }
+
+    /**
+     * @brief Prefetches the memory of the diagram needed by the next step
+     */
+    void prefetch() const { prefetch_vertices(_diagram); }
+
+    /**
+     * @brief Performs one step of the chain: attempts a random update, and collects the statistics after thermalization
+     */
+    void step()
     {
+        //the chain does not advance until the monitor has decided on its last report, and stops if the monitor says so
+        if (_awaiting_decision && (!apply_decision(_task.monitor->decision(_monitor_epoch)) || _stopped_early)) return;
 
-        double which_update = RNG; //ramdom extraction of the update
+        double which_update = _uniform_distribution(_mt_generator); //ramdom extraction of the update
 
         //select the update and attempt to perform it using the proper Diagram method
-        if (which_update < attempt_add_probability)
+        if (which_update < _attempt_add_probability)
         {
-            ++results.N_attempted_addsegment;
-            results.N_accepted_addsegment += diagram.attempt_add_segment();
+            ++_statistics.N_attempted_addsegment;
+            _statistics.N_accepted_addsegment += _task.delayed_rejection ? _diagram.attempt_add_segment_delayed() : _diagram.attempt_add_segment();
         }
-        else if (which_update < attempt_add_probability + attempt_remove_probability)
+        else if (which_update < _attempt_add_probability + _attempt_remove_probability)
         {
-            ++results.N_attempted_removesegment;
-            results.N_accepted_removesegment += diagram.attempt_remove_segment();
+            ++_statistics.N_attempted_removesegment;
+            _statistics.N_accepted_removesegment += _task.delayed_rejection ? _diagram.attempt_remove_segment_delayed() : _diagram.attempt_remove_segment();
         }
         else
         {
-            ++results.N_attempted_flips;
-            results.N_accepted_flips += diagram.attempt_spin_flip();
+            ++_statistics.N_attempted_flips;
+            _statistics.N_accepted_flips += _diagram.attempt_spin_flip();
         }
-        
+
 
         //collect statistics
-        if (loop_iteration >= N_thermalization_steps)   //measure samples only after thermalization steps (the = since counter starts from 0)
+        if (_loop_iteration >= _task.N_thermalization_steps)   //measure samples only after thermalization steps (the = since counter starts from 0)
         {
-            
-            auto current_diagorder = diagram.order(); //local variable to avoid calling the method multiple times
+            double beta = _task.beta;
+            auto current_diagorder = _diagram.order(); //local variable to avoid calling the method multiple times
 
-            temp_sigmax += current_diagorder;
-            temp_sigmaz += (beta - 2*diagram.sum_deltatau()) * diagram.get_s0() / beta;  
+            double current_mz = (beta - 2*_diagram.sum_deltatau()) * _diagram.get_s0() / beta; //sigma_z estimator of the diagram
 
-            temp_avgorder += current_diagorder;
-            temp_maxorder = temp_maxorder > current_diagorder ? temp_maxorder : current_diagorder;
+            _statistics.add_sample(current_diagorder, current_mz);
+            if (_reweighting) _reweighter.add_sample(current_diagorder, current_mz);
+            if (_collect_histogram) _results.histogram.add_sample(current_diagorder, beta * current_mz);
 
-            ++results.N_measures;
+            if (_pipeline && _statistics.N_measures % _task.measurements.measure_interval == 0)
+                _pipeline->push(_diagram.get_s0(), _diagram.vertices().begin(), _diagram.vertices().end());
 
-        } 
+            ++_statistics.N_measures;
+        }
 
+        ++_loop_iteration;
+
+        //periodic report to the convergence monitor of the point, which may stop the chain at this epoch
+        if (_task.monitor && _loop_iteration > _task.N_thermalization_steps && _statistics.N_measures % CONVERGENCE_REPORT_INTERVAL == 0)
+        {
+            _monitor_epoch = _statistics.N_measures / CONVERGENCE_REPORT_INTERVAL;
+            _awaiting_decision = true;
+            apply_decision(_task.monitor->report(_task.monitor_chain, _monitor_epoch, _statistics.binning_mz, _statistics.binning_order));
+        }
+    }
+
+    /**
+     * @brief Calculates the final results of the run
+     *
+     * @param run_time execution time (in nanoseconds) attributed to the chain
+     * @return SingleRunResults
+     */
+    SingleRunResults finish(unsigned long long int run_time)
+    {
+        if (_pipeline) _results.observables = _pipeline->finish();
+
+        _results.run_time = run_time;
+        _statistics.store_results(_results, _task.beta, _task.GAMMA);
+        _results.reweighted = _reweighter.results();
+        if (_task.keep_final_diagram) _results.final_diagram = _diagram.snapshot();
+
+        //R-hat is read before the chain is marked as finished, so that it is the one of the last epoch of the chain
+        if (_task.monitor)
+        {
+            _results.R_hat = _task.monitor->R_hat();
+            _task.monitor->finish(_task.monitor_chain);
+            _results.stopped_early = _stopped_early;
+        }
+
+        return _results;
+    }
+};
+
+
+/**
+ * @brief Runs the chains of the tasks interleaved on the calling thread, templated on the storage engine of the diagram.
+ * At each round, every active chain first prefetches the memory needed by its next step, and then each of them performs its step,
+ * so that the loads of a chain are in flight while the other chains are working. A single chain is run by a plain loop.
+ */
+template <class DiagramType>
+static std::vector<SingleRunResults> run_markov_chains(const std::vector<SimulationTask> & tasks)
+{
+    std::vector<std::unique_ptr<MarkovChain<DiagramType>>> chains;
+    for (const auto & task : tasks) chains.push_back(std::make_unique<MarkovChain<DiagramType>>(task));
+
+    //Performance metrics of the run
+    auto initial_time = std::chrono::high_resolution_clock::now();
+
+    //main loop: without other chains to overlap with, a single chain does not prefetch
+    if (chains.size() == 1)
+    {
+        MarkovChain<DiagramType> & chain = *chains.front();
+        while (!chain.done())
+        {
+            chain.step();
+            if (chain.awaiting_decision()) chain.wait_decision(); //only after a report to the convergence monitor
+        }
+    }
+    else
+    {
+        std::vector<MarkovChain<DiagramType>*> active;
+        for (auto & chain : chains) if (!chain->done()) active.push_back(chain.get());
+        while (!active.empty())
+        {
+            bool finished = false;
+            for (auto chain : active) chain->prefetch();
+            for (auto chain : active)
+            {
+                chain->step();
+                finished |= chain->done();
+            }
+
+            //if all the chains wait for their convergence monitors, the decision depends on chains running on other threads
+            if (std::all_of(active.begin(), active.end(), [](auto chain) { return chain->awaiting_decision(); })) active.front()->wait_decision();
+
+            //remove the chains that have completed their steps, keeping the order of the others
+            if (finished) active.erase(std::remove_if(active.begin(), active.end(), [](auto chain) { return chain->done(); }), active.end());
+        }
     }
     auto final_time = std::chrono::high_resolution_clock::now();
 
-    //caclulating final results
-    results.run_time = std::chrono::duration_cast<std::chrono::nanoseconds>(final_time - initial_time).count();
-    results.measured_sigmax = temp_sigmax / -(results.N_measures * beta * GAMMA);
-    results.measured_sigmaz = temp_sigmaz / results.N_measures;  
-    results.avg_diagram_order = temp_avgorder / results.N_measures;
-    results.max_diagram_order = temp_maxorder;
+    //the time of the interleaved loop is shared equally among the chains
+    unsigned long long int run_time = std::chrono::duration_cast<std::chrono::nanoseconds>(final_time - initial_time).count();
 
+    std::vector<SingleRunResults> results;
+    for (auto & chain : chains) results.push_back(chain->finish(run_time / chains.size()));
     return results;
+}
+
 
+SingleRunResults run_simulation(
+    double beta, 
+    double initial_s0, 
+    double H, 
+    double GAMMA, 
+    unsigned long long int N_total_steps, 
+    unsigned long long int N_thermalization_steps,
+    unsigned long long int update_choice_seed, 
+    unsigned long long int diagram_seed,
+    DiagramEngine engine,
+    const std::vector<double> & reweight_betas,
+    unsigned int histogram_bins,
+    const MeasurementOptions & measurements
+    ) 
+{
+    SimulationTask task{beta, static_cast<int>(initial_s0), H, GAMMA, N_total_steps, N_thermalization_steps, update_choice_seed, diagram_seed,
+        engine, reweight_betas, histogram_bins, measurements};
+    return run_simulation(task);
+}
+
+
+SingleRunResults run_simulation(const SimulationTask & task)
+{
+    return run_simulation_interleaved({task}).front();
+}
+
+
+std::vector<SingleRunResults> run_simulation_interleaved(const std::vector<SimulationTask> & tasks)
+{
+    if (tasks.empty()) return {};
+    for (const auto & task : tasks)
+        if (task.engine != tasks.front().engine) throw std::invalid_argument("interleaved chains must use the same diagram engine.");
+
+    if (tasks.front().engine == DiagramEngine::FLAT)
+        return run_markov_chains<FlatDiagram>(tasks);
+    else
+        return run_markov_chains<Diagram>(tasks);
+}
+
+
+/**
+ * @brief Interface to the state of the chain of a ResumableRun, independent of the storage engine of the diagram
+ */
+struct ResumableRun::Chain
+{
+    virtual ~Chain() = default;
+
+    /**
+     * @brief Performs steps until the chain is done, or waits for a decision of its convergence monitor
+     */
+    virtual void run_slice() = 0;
+    virtual bool done() const = 0;
+    virtual unsigned long long awaited_epoch() const = 0;
+    virtual SingleRunResults finish(unsigned long long int run_time) = 0;
+};
+
+
+/**
+ * @brief State of the chain of a ResumableRun, templated on the storage engine of the diagram
+ */
+template <class DiagramType>
+struct EngineChain : ResumableRun::Chain
+{
+    MarkovChain<DiagramType> chain;
+
+    explicit EngineChain(const SimulationTask & task) : chain(task) {}
+
+    void run_slice() override
+    {
+        while (!chain.done())
+        {
+            chain.step();
+            if (chain.awaiting_decision()) return;
+        }
+    }
+
+    bool done() const override { return chain.done(); }
+    unsigned long long awaited_epoch() const override { return chain.monitor_epoch(); }
+    SingleRunResults finish(unsigned long long int run_time) override { return chain.finish(run_time); }
+};
+
+
+ResumableRun::ResumableRun(const SimulationTask & task) : _task(task) {}
+
+ResumableRun::~ResumableRun() = default;
+
+
+bool ResumableRun::advance()
+{
+    auto initial_time = std::chrono::high_resolution_clock::now();
+    if (!_chain)
+    {
+        if (_task.engine == DiagramEngine::FLAT) _chain = std::make_unique<EngineChain<FlatDiagram>>(_task);
+        else _chain = std::make_unique<EngineChain<Diagram>>(_task);
+    }
+    _chain->run_slice();
+    auto final_time = std::chrono::high_resolution_clock::now();
+
+    _run_time += std::chrono::duration_cast<std::chrono::nanoseconds>(final_time - initial_time).count();
+    return _chain->done();
 }
 
 
+unsigned long long ResumableRun::awaited_epoch() const
+{
+    return _chain ? _chain->awaited_epoch() : 0;
+}
 
 
+const SimulationTask & ResumableRun::task() const
+{
+    return _task;
+}
 
 
+SingleRunResults ResumableRun::finish()
+{
+    if (!_chain || !_chain->done()) throw std::invalid_argument("the run has not completed its steps.");
+    return _chain->finish(_run_time);
+}
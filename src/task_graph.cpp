@@ -0,0 +1,249 @@
+/**
+ * @file task_graph.cpp
+ * @brief Definitions of the methods of the TaskGraph class
+ */
+
+#include <diagmc/task_graph.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+
+
+TaskId TaskGraph::add_node(TaskKind kind, std::function<void()> work, const std::vector<TaskId> & dependencies)
+{
+    TaskId id = _nodes.size();
+    for (TaskId dependency : dependencies)
+        if (dependency >= id) throw std::invalid_argument("the dependencies of a task must be nodes already in the graph.");
+
+    _nodes.push_back({kind, std::move(work), {}, static_cast<unsigned int>(dependencies.size())});
+    _results.emplace_back();
+    _beta.push_back(0);
+    for (TaskId dependency : dependencies) _nodes[dependency].successors.push_back(id);
+    return id;
+}
+
+
+TaskId TaskGraph::add(TaskKind kind, std::function<void()> work, const std::vector<TaskId> & dependencies)
+{
+    return add_node(kind, std::move(work), dependencies);
+}
+
+
+TaskId TaskGraph::add_run_chain(const SimulationTask & task, const std::vector<TaskId> & dependencies)
+{
+    //the final diagram is always kept, so that the chain can be continued
+    SimulationTask chain_task = task;
+    chain_task.keep_final_diagram = true;
+
+    TaskId id = _nodes.size();
+    add_node(TaskKind::RUN_CHAIN, [this, id, chain_task]() { _results[id] = run_simulation(chain_task); }, dependencies);
+    _beta[id] = task.beta;
+    return id;
+}
+
+
+TaskId TaskGraph::add_continue_chain(TaskId chain, const SimulationTask & task, const std::vector<TaskId> & dependencies)
+{
+    if (chain >= _nodes.size() || (_nodes[chain].kind != TaskKind::RUN_CHAIN && _nodes[chain].kind != TaskKind::CONTINUE_CHAIN))
+        throw std::invalid_argument("only a chain node can be continued.");
+
+    SimulationTask chain_task = task;
+    chain_task.keep_final_diagram = true;
+    double scale = task.beta / _beta[chain];
+
+    std::vector<TaskId> all_dependencies = dependencies;
+    all_dependencies.push_back(chain);
+
+    TaskId id = _nodes.size();
+    add_node(TaskKind::CONTINUE_CHAIN, [this, id, chain, chain_task, scale]() mutable
+    {
+        //the diagram is mapped to the new beta rescaling the times of its vertices, as in the beta reweighting
+        DiagramSnapshot diagram = results(chain).final_diagram;
+        if (scale != 1) for (auto & vertex : diagram.vertices) vertex *= scale;
+        chain_task.initial_diagram = std::move(diagram);
+        _results[id] = run_simulation(chain_task);
+    }, all_dependencies);
+    _beta[id] = task.beta;
+    return id;
+}
+
+
+TaskId TaskGraph::add_merge(const std::vector<TaskId> & inputs, std::function<SingleRunResults(const std::vector<SingleRunResults> &)> merge)
+{
+    for (TaskId input : inputs)
+        if (input >= _nodes.size() || _nodes[input].kind == TaskKind::WRITE || _nodes[input].kind == TaskKind::GENERIC)
+            throw std::invalid_argument("only the results of chain and merge nodes can be merged.");
+
+    TaskId id = _nodes.size();
+    return add_node(TaskKind::MERGE, [this, id, inputs, merge]()
+    {
+        std::vector<SingleRunResults> input_results;
+        for (TaskId input : inputs) input_results.push_back(results(input));
+        _results[id] = merge(input_results);
+    }, inputs);
+}
+
+
+TaskId TaskGraph::add_write(TaskId input, std::function<void(const SingleRunResults &)> write)
+{
+    if (input >= _nodes.size() || _nodes[input].kind == TaskKind::WRITE || _nodes[input].kind == TaskKind::GENERIC)
+        throw std::invalid_argument("only the results of chain and merge nodes can be written.");
+
+    //each write node depends on the previous one, so that they are executed in order
+    std::vector<TaskId> dependencies = {input};
+    if (_last_write) dependencies.push_back(*_last_write);
+
+    _last_write = add_node(TaskKind::WRITE, [this, input, write]() { write(results(input)); }, dependencies);
+    return *_last_write;
+}
+
+
+size_t TaskGraph::size() const
+{
+    return _nodes.size();
+}
+
+
+TaskKind TaskGraph::kind(TaskId id) const
+{
+    if (id >= _nodes.size()) throw std::invalid_argument("the task is not a node of the graph.");
+    return _nodes[id].kind;
+}
+
+
+const SingleRunResults & TaskGraph::results(TaskId id) const
+{
+    if (id >= _nodes.size() || !_results[id]) throw std::invalid_argument("the task has no results.");
+    return *_results[id];
+}
+
+
+unsigned long long TaskGraph::N_steals() const
+{
+    return _N_steals;
+}
+
+
+void TaskGraph::execute(ThreadPool & pool)
+{
+    size_t N_workers = pool.size();
+
+    /**
+     * @brief Deque of the ready nodes of a worker: the owner takes from the back, the thieves from the front
+     */
+    struct WorkerDeque
+    {
+        std::mutex mutex;
+        std::deque<TaskId> nodes;
+    };
+    std::vector<WorkerDeque> deques(N_workers);
+
+    //number of dependencies of each node not yet executed
+    std::vector<std::atomic<unsigned int>> remaining(_nodes.size());
+    for (size_t i = 0; i < _nodes.size(); ++i) remaining[i] = _nodes[i].N_dependencies;
+
+    std::atomic<size_t> N_pending {_nodes.size()};      //nodes not yet completed
+    std::atomic<size_t> N_ready {0};                    //nodes in the deques
+    std::atomic<bool> aborted {false};                  //set when a node throws
+    std::atomic<unsigned long long> N_steals {0};
+    std::mutex idle_mutex;                              //the idle workers wait on idle until there are ready nodes, or the execution ends
+    std::condition_variable idle;
+    std::exception_ptr error;
+
+    auto wake = [&](bool all)
+    {
+        //the lock orders the change of the counters with the check of the waiting workers, so that no wake up is lost
+        { std::lock_guard<std::mutex> lock(idle_mutex); }
+        if (all) idle.notify_all();
+        else idle.notify_one();
+    };
+
+    auto push = [&](size_t worker, TaskId id)
+    {
+        {
+            std::lock_guard<std::mutex> lock(deques[worker].mutex);
+            deques[worker].nodes.push_back(id);
+        }
+        ++N_ready;
+        wake(false);
+    };
+
+    auto pop = [&](size_t worker) -> std::optional<TaskId>
+    {
+        for (size_t k = 0; k < N_workers; ++k)
+        {
+            WorkerDeque & deque = deques[(worker + k) % N_workers];
+            std::lock_guard<std::mutex> lock(deque.mutex);
+            if (deque.nodes.empty()) continue;
+
+            TaskId id;
+            if (k == 0)
+            {
+                id = deque.nodes.back();
+                deque.nodes.pop_back();
+            }
+            else
+            {
+                id = deque.nodes.front();
+                deque.nodes.pop_front();
+                ++N_steals;
+            }
+            --N_ready;
+            return id;
+        }
+        return std::nullopt;
+    };
+
+    auto worker_loop = [&](size_t worker)
+    {
+        while (true)
+        {
+            std::optional<TaskId> id = pop(worker);
+            if (!id)
+            {
+                std::unique_lock<std::mutex> lock(idle_mutex);
+                idle.wait(lock, [&]() { return N_ready > 0 || N_pending == 0 || aborted; });
+                if (N_pending == 0 || aborted) return;
+                continue;
+            }
+
+            try
+            {
+                _nodes[*id].work();
+            }
+            catch(...)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(idle_mutex);
+                    if (!error) error = std::current_exception();
+                    aborted = true;
+                }
+                idle.notify_all();
+                return;
+            }
+
+            //the successors readied by this node are pushed to the own deque, where they are taken first
+            for (TaskId successor : _nodes[*id].successors)
+                if (--remaining[successor] == 0) push(worker, successor);
+
+            if (--N_pending == 0) wake(true);
+        }
+    };
+
+    //the nodes without dependencies are distributed among the workers
+    size_t next_worker = 0;
+    for (TaskId id = 0; id < _nodes.size(); ++id)
+        if (_nodes[id].N_dependencies == 0) push(next_worker++ % N_workers, id);
+
+    std::vector<std::future<void>> workers;
+    for (size_t worker = 0; worker < N_workers; ++worker)
+        workers.push_back(pool.submit([&worker_loop, worker]() { worker_loop(worker); }));
+    for (auto & future : workers) future.get();
+
+    _N_steals = N_steals;
+    if (error) std::rethrow_exception(error);
+}
@@ -0,0 +1,105 @@
+/**
+ * @file thread_pool.cpp
+ * @brief Definitions of the methods of the ThreadPool class
+ */
+
+#include <diagmc/thread_pool.h>
+#include <stdexcept>
+#include <string>
+
+
+ThreadPool::ThreadPool(int n_threads, bool pin_workers)
+{
+    if (n_threads < 1)
+    {
+        throw std::invalid_argument( 
+            std::string("The number of threads must be >= 1, but ") 
+            + std::to_string(n_threads) + std::string(" was provided.") 
+            );
+    }
+
+    if (pin_workers)
+    {
+        std::vector<int> cpus = allowed_cpus();
+        std::vector<int> nodes;
+        for (int cpu : cpus) nodes.push_back(numa_node_of_cpu(cpu));
+        _placements = plan_worker_placement(n_threads, cpus, nodes);
+    }
+
+    for (int i = 0; i < n_threads; ++i)
+        _workers.emplace_back(&ThreadPool::worker_loop, this, i);
+
+    //wait for the workers to be pinned, so that the placement can be reported
+    if (pin_workers)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _condition.wait(lock, [this, n_threads]() { return _N_started == n_threads; });
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _condition.notify_all();
+
+    for (auto & worker : _workers) worker.join();
+}
+
+
+int ThreadPool::size() const
+{
+    return _workers.size();
+}
+
+
+const std::vector<WorkerPlacement> & ThreadPool::placements() const
+{
+    return _placements;
+}
+
+
+void ThreadPool::enqueue(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push(std::move(job));
+    }
+    _condition.notify_one();
+}
+
+
+void ThreadPool::worker_loop(int index)
+{
+    //the affinity is set before executing any job, so that the memory of the runs is first touched on the node of the worker
+    if (!_placements.empty())
+    {
+        bool pinned = pin_current_thread(_placements[index].cpu);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _placements[index].pinned = pinned;
+            ++_N_started;
+        }
+        _condition.notify_all();
+    }
+
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            //wait until a job is available, or the pool is being destroyed
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+
+            //the queue is drained before stopping, so that no submitted job is lost
+            if (_stop && _jobs.empty()) return;
+
+            job = std::move(_jobs.front());
+            _jobs.pop();
+        }
+        job();
+    }
+}
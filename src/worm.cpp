@@ -0,0 +1,276 @@
+/**
+ * @file worm.cpp
+ * @brief Definitions of the WormDiagram_core and WormDiagram classes, and of the worm algorithm
+ */
+
+#include <diagmc/worm.h>
+#include <diagmc/exact.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+#define RNG _uniform_dist(_mt_generator) //extracts a random number uniformly in [0,1]
+
+
+//Methods definitions for class WormDiagram_core ---------------------------------------------------
+WormDiagram_core::WormDiagram_core(double beta, int s0, double H, double GAMMA, std::vector<double> vertices, double worm_weight)
+    : FlatDiagram_core(beta, s0, H, GAMMA, std::move(vertices)), _worm_weight(worm_weight)
+{
+    if (!(worm_weight > 0)) throw std::invalid_argument("worm_weight must be > 0.");
+}
+
+bool WormDiagram_core::is_open() const {
+    return _open;
+}
+
+double WormDiagram_core::get_tau_head() const {
+    return _tau_head;
+}
+
+double WormDiagram_core::get_tau_tail() const {
+    return _tau_tail;
+}
+
+double WormDiagram_core::worm_tau() const {
+    double tau = _tau_tail - _tau_head;
+    return tau < 0 ? tau + _beta : tau;
+}
+
+size_t WormDiagram_core::ordinary_order() const {
+    return _open ? _vertices.size() - 2 : _vertices.size();
+}
+
+double WormDiagram_core::value() const
+{
+    double eta = _open ? _worm_weight / (_beta * _beta) : 1;
+    return eta * std::pow(_GAMMA, ordinary_order()) * std::exp(_H * _s0 *( -_beta + 2*sum_deltatau()));
+}
+
+void WormDiagram_core::restore(const DiagramSnapshot & snapshot)
+{
+    FlatDiagram_core::restore(snapshot);
+    _open = false;
+}
+
+
+double WormDiagram_core::spin_integral(double tau_min, double tau_max) const
+{
+    //spin just after tau_min, s0*(-1)^(number of vertices <= tau_min)
+    size_t i = std::upper_bound(_vertices.begin(), _vertices.end(), tau_min) - _vertices.begin();
+    double spin = i % 2 == 0 ? _s0 : -_s0;
+
+    double integral = 0, tau = tau_min;
+    for (; i < _vertices.size() && _vertices[i] < tau_max; ++i)
+    {
+        integral += spin * (_vertices[i] - tau);
+        tau = _vertices[i];
+        spin = -spin;
+    }
+    return integral + spin * (tau_max - tau);
+}
+
+void WormDiagram_core::move_vertex(double tau_old, double tau_new)
+{
+    auto old_it = std::lower_bound(_vertices.begin(), _vertices.end(), tau_old);
+    auto new_it = std::upper_bound(_vertices.begin(), _vertices.end(), tau_new);
+
+    //the vertices in between are shifted by one position, without reallocating the array
+    if (new_it > old_it)
+    {
+        std::rotate(old_it, old_it + 1, new_it);
+        *(new_it - 1) = tau_new;
+    }
+    else
+    {
+        std::rotate(new_it, old_it, old_it + 1);
+        *new_it = tau_new;
+    }
+}
+
+
+//acceptance rates for the worm updates: the spin between the old and the new configuration of the ends is flipped,
+//so the ratio of the weights is exp(2 H * integral of the current spin over the flipped interval)
+double WormDiagram_core::acceptance_rate_worm_insert(double tau_head, double tau_tail) const {
+    return _worm_weight * std::exp(2 * _H * spin_integral(std::min(tau_head, tau_tail), std::max(tau_head, tau_tail)));
+}
+
+double WormDiagram_core::acceptance_rate_worm_remove() const {
+    return std::exp(2 * _H * spin_integral(std::min(_tau_head, _tau_tail), std::max(_tau_head, _tau_tail))) / _worm_weight;
+}
+
+double WormDiagram_core::acceptance_rate_worm_move(double tau_old, double tau_new) const {
+    return std::exp(2 * _H * spin_integral(std::min(tau_old, tau_new), std::max(tau_old, tau_new)));
+}
+
+
+//update functions
+bool WormDiagram_core::attempt_remove_segment(double RN1, double RNacc) {
+
+    if (order() == 0) return false;
+
+    //same choice of the segment of FlatDiagram_core, rejected if one of its vertices is a worm end
+    if (_open)
+    {
+        size_t tau1_index = static_cast<int>(RN1 * (order() - 1) + 1) - 1;
+        for (double tau : {_vertices[tau1_index], _vertices[tau1_index + 1]})
+            if (tau == _tau_head || tau == _tau_tail) return false;
+    }
+    return FlatDiagram_core::attempt_remove_segment(RN1, RNacc);
+}
+
+bool WormDiagram_core::attempt_worm_insert(double RN1, double RN2, double RNacc) {
+
+    if (_open) return false;
+
+    double tau_head = RN1 * _beta;
+    double tau_tail = RN2 * _beta;
+
+    if (RNacc < acceptance_rate_worm_insert(tau_head, tau_tail))
+    {
+        _vertices.insert(std::upper_bound(_vertices.begin(), _vertices.end(), tau_head), tau_head);
+        _vertices.insert(std::upper_bound(_vertices.begin(), _vertices.end(), tau_tail), tau_tail);
+        _tau_head = tau_head;
+        _tau_tail = tau_tail;
+        _open = true;
+        return true;
+    }
+    return false;
+}
+
+bool WormDiagram_core::attempt_worm_remove(double RNacc) {
+
+    if (!_open) return false;
+
+    if (RNacc < acceptance_rate_worm_remove())
+    {
+        _vertices.erase(std::lower_bound(_vertices.begin(), _vertices.end(), _tau_head));
+        _vertices.erase(std::lower_bound(_vertices.begin(), _vertices.end(), _tau_tail));
+        _open = false;
+        return true;
+    }
+    return false;
+}
+
+bool WormDiagram_core::attempt_worm_move(double RN1, double RN2, double RNacc) {
+
+    if (!_open) return false;
+
+    double & tau_end = RN1 < 0.5 ? _tau_head : _tau_tail;
+    double tau_new = RN2 * _beta;
+
+    if (RNacc < acceptance_rate_worm_move(tau_end, tau_new))
+    {
+        move_vertex(tau_end, tau_new);
+        tau_end = tau_new;
+        return true;
+    }
+    return false;
+}
+//END WormDiagram_core class definition
+//--------------------------------------------------------------------------------------------------
+
+
+
+//Methods definitions for class WormDiagram --------------------------------------------------------
+WormDiagram::WormDiagram(double beta, int s0, double H, double GAMMA, std::vector<double> vertices, double worm_weight, unsigned int seed)
+    : WormDiagram_core(beta, s0, H, GAMMA, std::move(vertices), worm_weight), _uniform_dist(0,1), _mt_generator(seed) {}
+
+bool WormDiagram::attempt_add_segment() {
+    return WormDiagram_core::attempt_add_segment(RNG, RNG, RNG);
+}
+
+bool WormDiagram::attempt_remove_segment() {
+    return WormDiagram_core::attempt_remove_segment(RNG, RNG);
+}
+
+bool WormDiagram::attempt_spin_flip() {
+    return WormDiagram_core::attempt_spin_flip(RNG);
+}
+
+bool WormDiagram::attempt_worm_insert_remove() {
+    if (_open) return WormDiagram_core::attempt_worm_remove(RNG);
+    return WormDiagram_core::attempt_worm_insert(RNG, RNG, RNG);
+}
+
+bool WormDiagram::attempt_worm_move() {
+    if (!_open) return false;
+    return WormDiagram_core::attempt_worm_move(RNG, RNG, RNG);
+}
+//--------------------------------------------------------------------------------------------------
+
+
+
+GreensFunctionResults run_worm_simulation(const SimulationTask & task, unsigned int bins, double worm_weight, double worm_update_probability)
+{
+    if (bins == 0) throw std::invalid_argument("the number of bins of the Green's function must be > 0.");
+    if (!(worm_update_probability > 0 && worm_update_probability < 1))
+        throw std::invalid_argument("the probability of the worm updates must be in (0, 1).");
+
+    WormDiagram diagram(task.beta, task.initial_s0, task.H, task.GAMMA, {}, worm_weight, task.diagram_seed);
+    std::mt19937 mt_generator(task.update_choice_seed);
+    std::uniform_real_distribution<double> uniform_distribution(0, 1);
+
+    //counters of each batch of the measured steps: closed configurations, and open ones for each bin of the separation of the ends
+    unsigned long long N_measured_steps = task.N_total_steps > task.N_thermalization_steps ? task.N_total_steps - task.N_thermalization_steps : 0;
+    std::vector<unsigned long long> closed_counts(WORM_BATCHES, 0);
+    std::vector<std::vector<unsigned long long>> open_counts(WORM_BATCHES, std::vector<unsigned long long>(bins, 0));
+    double bins_per_tau = bins / task.beta;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long long step = 0; step < task.N_total_steps; ++step)
+    {
+        double which_update = uniform_distribution(mt_generator);
+
+        if (which_update < worm_update_probability / 2) diagram.attempt_worm_insert_remove();
+        else if (which_update < worm_update_probability) diagram.attempt_worm_move();
+        else if (which_update < worm_update_probability + (1 - worm_update_probability) / 3) diagram.attempt_add_segment();
+        else if (which_update < worm_update_probability + 2 * (1 - worm_update_probability) / 3) diagram.attempt_remove_segment();
+        else diagram.attempt_spin_flip();
+
+        //O(1) measurement: a single increment, whatever the order of the diagram and the number of bins
+        if (step >= task.N_thermalization_steps)
+        {
+            size_t batch = (step - task.N_thermalization_steps) * WORM_BATCHES / N_measured_steps;
+            if (diagram.is_open()) ++open_counts[batch][std::min<size_t>(diagram.worm_tau() * bins_per_tau, bins - 1)];
+            else ++closed_counts[batch];
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+
+    GreensFunctionResults results;
+    results.run_time = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    results.N_measures = N_measured_steps;
+
+    unsigned long long N_closed = 0;
+    for (auto count : closed_counts) N_closed += count;
+    results.open_fraction = N_measured_steps > 0 ? 1 - double(N_closed) / N_measured_steps : 0;
+
+    for (unsigned int i = 0; i < bins; ++i)
+    {
+        double tau = (i + 0.5) * task.beta / bins;
+        results.tau.push_back(tau);
+        results.exact_correlation_xx.push_back(exact_correlation_xx(tau, task.beta, task.H, task.GAMMA));
+
+        //estimate from all the steps, and error from the spread of the estimates of the batches
+        unsigned long long N_open = 0;
+        for (const auto & counts : open_counts) N_open += counts[i];
+        double correlation = N_closed > 0 ? double(N_open) / N_closed * bins / worm_weight : 0;
+
+        double sum_squares = 0;
+        unsigned int N_batches = 0;
+        for (unsigned int b = 0; b < WORM_BATCHES; ++b)
+        {
+            if (closed_counts[b] == 0) continue;
+            double deviation = double(open_counts[b][i]) / closed_counts[b] * bins / worm_weight - correlation;
+            sum_squares += deviation * deviation;
+            ++N_batches;
+        }
+
+        results.correlation_xx.push_back(correlation);
+        results.error_correlation_xx.push_back(N_batches > 1 ? std::sqrt(sum_squares / (N_batches - 1) / N_batches) : 0);
+    }
+
+    return results;
+}
@@ -0,0 +1,379 @@
+/**
+ * @file statistical_tests.cpp
+ * @brief File with the statistical validation tests of the Markov chain: short fixed-seed chains are compared with the exact solution,
+ * to detect any violation of detailed balance introduced by changes (e.g. optimizations) of the updates
+ */
+
+#include <gtest/gtest.h>
+#include <diagmc/diagram.h>
+#include <diagmc/flat_diagram.h>
+#include <diagmc/simulation.h>
+#include <diagmc/exact.h>
+#include <diagmc/thread_pool.h>
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+//parameters of the chains used in the tests: independent chains give the statistical error of the averages
+#define N_CHAINS 16
+#define N_STEPS_PER_CHAIN 400000
+#define N_THERMALIZATION_STEPS 20000
+
+//thresholds for the statistical tests: with fixed seeds the tests are deterministic,
+//and the thresholds are chosen so that a correct chain would fail with probability < 1e-4
+#define MAX_Z_SCORE 5.
+#define MAX_REDUCED_CHI_SQUARE 3.
+
+//minimum exact probability of the orders included in the chi-square test of the order distribution
+#define MIN_ORDER_PROBABILITY 1e-3
+
+
+/**
+ * @brief Parameters of the physical system for a statistical test
+ */
+struct TestPoint
+{
+    double beta;    ///< inverse temperature
+    double H;       ///< longitudinal field
+    double GAMMA;   ///< transverse field
+};
+
+
+/**
+ * @brief Prints the parameters of a TestPoint in the name of the tests
+ *
+ * @param point parameters of the system
+ * @param os output stream
+ */
+void PrintTo(const TestPoint & point, std::ostream * os)
+{
+    *os << "beta=" << point.beta << " H=" << point.H << " GAMMA=" << point.GAMMA;
+}
+
+
+/**
+ * @brief Mean and standard error of the mean of a set of independent samples
+ */
+struct SampleStatistics
+{
+    double mean;            ///< mean of the samples
+    double standard_error;  ///< standard deviation of the mean
+};
+
+
+/**
+ * @brief Calculates mean and standard error of the mean of independent samples
+ *
+ * @param samples values of the samples (at least 2)
+ * @return SampleStatistics
+ */
+static SampleStatistics sample_statistics(const std::vector<double> & samples)
+{
+    double n = samples.size();
+    double mean = 0;
+    for (auto x : samples) mean += x / n;
+
+    double variance = 0;
+    for (auto x : samples) variance += (x - mean) * (x - mean) / (n - 1);
+
+    return {mean, std::sqrt(variance / n)};
+}
+
+
+/**
+ * @brief Returns the z-score of the samples with respect to the expected value. If the standard error is 0
+ * (e.g. the observable is constant in every chain), the z-score is 0 only if the mean coincides with the expected value.
+ *
+ * @param statistics mean and standard error of the samples
+ * @param expected exact value
+ * @return double
+ */
+static double z_score(const SampleStatistics & statistics, double expected)
+{
+    double difference = statistics.mean - expected;
+    if (statistics.standard_error == 0) return std::abs(difference) < 1e-12 ? 0 : INFINITY;
+    return difference / statistics.standard_error;
+}
+
+
+/**
+ * @brief Runs a chain with the same algorithm of run_simulation, directly driving a Diagram or FlatDiagram object,
+ * and returns the normalized histogram of the diagram order. The last bin collects all the orders >= max_order.
+ *
+ * @param point parameters of the system
+ * @param max_order last bin of the histogram
+ * @param update_choice_seed seed for the choice of the updates
+ * @param diagram_seed seed of the diagram
+ * @param delayed_rejection use the delayed-rejection variants of ADD_SEGMENT and REMOVE_SEGMENT
+ * @return std::vector<double>
+ */
+template <class DiagramType>
+static std::vector<double> sample_order_histogram(const TestPoint & point, size_t max_order, unsigned int update_choice_seed, unsigned int diagram_seed,
+    bool delayed_rejection = false)
+{
+    std::mt19937 mt_generator(update_choice_seed);
+    std::uniform_real_distribution<double> uniform_distribution(0, 1);
+    DiagramType diagram(point.beta, 1, point.H, point.GAMMA, {}, diagram_seed);
+
+    std::vector<double> histogram(max_order + 1, 0);
+    for (int step = 0; step < N_STEPS_PER_CHAIN; ++step)
+    {
+        double which_update = uniform_distribution(mt_generator);
+        if (which_update < 1./3) delayed_rejection ? diagram.attempt_add_segment_delayed() : diagram.attempt_add_segment();
+        else if (which_update < 2./3) delayed_rejection ? diagram.attempt_remove_segment_delayed() : diagram.attempt_remove_segment();
+        else diagram.attempt_spin_flip();
+
+        if (step >= N_THERMALIZATION_STEPS) ++histogram[std::min(diagram.order(), max_order)];
+    }
+
+    for (auto & count : histogram) count /= N_STEPS_PER_CHAIN - N_THERMALIZATION_STEPS;
+    return histogram;
+}
+
+
+/**
+ * @brief Fixture for the statistical tests, parametrized on the physical parameters and on the storage engine of the diagram,
+ * so that each combination is a separate test that can be run in parallel by CTest (ctest -j)
+ */
+class StatisticalTest : public ::testing::TestWithParam<std::tuple<TestPoint, DiagramEngine>> {};
+
+
+/**
+ * @brief Runs N_CHAINS independent chains with fixed seeds with run_simulation, and checks that the z-scores of the mean sigma_x and sigma_z
+ * with respect to the exact values are below MAX_Z_SCORE
+ *
+ * @param point parameters of the system
+ * @param engine storage engine of the diagram
+ * @param delayed_rejection use the delayed-rejection variants of ADD_SEGMENT and REMOVE_SEGMENT
+ */
+static void check_magnetizations(const TestPoint & point, DiagramEngine engine, bool delayed_rejection)
+{
+    ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::future<SingleRunResults>> futures;
+    for (unsigned int i = 0; i < N_CHAINS; ++i)
+        futures.push_back(pool.submit([point, engine, delayed_rejection, i]()
+        {
+            SimulationTask task {point.beta, 1, point.H, point.GAMMA, N_STEPS_PER_CHAIN, N_THERMALIZATION_STEPS, 1000 + i, 2000 + i, engine};
+            task.delayed_rejection = delayed_rejection;
+            return run_simulation(task);
+        }));
+
+    std::vector<double> sigmax, sigmaz;
+    for (auto & future : futures)
+    {
+        SingleRunResults results = future.get();
+        sigmax.push_back(results.measured_sigmax);
+        sigmaz.push_back(results.measured_sigmaz);
+    }
+
+    double z_sigmax = z_score(sample_statistics(sigmax), exact_sigmax(point.beta, point.H, point.GAMMA));
+    double z_sigmaz = z_score(sample_statistics(sigmaz), exact_sigmaz(point.beta, point.H, point.GAMMA));
+
+    EXPECT_LT(std::abs(z_sigmax), MAX_Z_SCORE) << "sigma_x deviates from the exact value";
+    EXPECT_LT(std::abs(z_sigmaz), MAX_Z_SCORE) << "sigma_z deviates from the exact value";
+}
+
+
+/**
+ * @brief This test checks that the magnetizations measured by run_simulation agree with the exact values
+ * within the statistical error.
+ *
+ * GIVEN: N_CHAINS independent chains with fixed seeds, for the parameters of the test point
+ * WHEN: they are run with run_simulation
+ * THEN: the z-scores of the mean sigma_x and sigma_z with respect to the exact values are below MAX_Z_SCORE
+ */
+TEST_P(StatisticalTest, magnetizations_agree_with_exact_solution)
+{
+    check_magnetizations(std::get<0>(GetParam()), std::get<1>(GetParam()), false);
+}
+
+
+/**
+ * @brief This test checks that the magnetizations reweighted to nearby betas agree with the exact values
+ * within the statistical error.
+ *
+ * GIVEN: N_CHAINS independent chains with fixed seeds, for the parameters of the test point, reweighted to 0.9*beta and 1.1*beta
+ * WHEN: they are run with run_simulation
+ * THEN: the z-scores of the mean reweighted sigma_x and sigma_z with respect to the exact values at the target betas are below MAX_Z_SCORE
+ */
+TEST_P(StatisticalTest, reweighted_magnetizations_agree_with_exact_solution)
+{
+    TestPoint point = std::get<0>(GetParam());
+    DiagramEngine engine = std::get<1>(GetParam());
+    std::vector<double> target_betas = {0.9 * point.beta, 1.1 * point.beta};
+
+    ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::future<SingleRunResults>> futures;
+    for (unsigned int i = 0; i < N_CHAINS; ++i)
+        futures.push_back(pool.submit([point, engine, target_betas, i]()
+            { return run_simulation(point.beta, 1, point.H, point.GAMMA, N_STEPS_PER_CHAIN, N_THERMALIZATION_STEPS, 5000 + i, 6000 + i, engine, target_betas); }));
+
+    std::vector<std::vector<double>> sigmax(target_betas.size()), sigmaz(target_betas.size());
+    for (auto & future : futures)
+    {
+        SingleRunResults results = future.get();
+        for (size_t k = 0; k < target_betas.size(); ++k)
+        {
+            sigmax[k].push_back(results.reweighted[k].sigmax);
+            sigmaz[k].push_back(results.reweighted[k].sigmaz);
+        }
+    }
+
+    for (size_t k = 0; k < target_betas.size(); ++k)
+    {
+        double z_sigmax = z_score(sample_statistics(sigmax[k]), exact_sigmax(target_betas[k], point.H, point.GAMMA));
+        double z_sigmaz = z_score(sample_statistics(sigmaz[k]), exact_sigmaz(target_betas[k], point.H, point.GAMMA));
+
+        EXPECT_LT(std::abs(z_sigmax), MAX_Z_SCORE) << "reweighted sigma_x deviates from the exact value at beta = " << target_betas[k];
+        EXPECT_LT(std::abs(z_sigmaz), MAX_Z_SCORE) << "reweighted sigma_z deviates from the exact value at beta = " << target_betas[k];
+    }
+}
+
+
+/**
+ * @brief Collects the histogram of the diagram order of N_CHAINS independent chains with fixed seeds, and checks that
+ * for every order with exact probability above MIN_ORDER_PROBABILITY the z-score of the mean frequency is below MAX_Z_SCORE,
+ * and that the reduced chi-square over all these orders is below MAX_REDUCED_CHI_SQUARE
+ *
+ * @param point parameters of the system
+ * @param engine storage engine of the diagram
+ * @param delayed_rejection use the delayed-rejection variants of ADD_SEGMENT and REMOVE_SEGMENT
+ */
+static void check_order_distribution(const TestPoint & point, DiagramEngine engine, bool delayed_rejection)
+{
+    //the histogram extends well beyond the orders with non-negligible probability
+    size_t max_order = exact_order_quantile(1 - 1e-9, point.beta, point.H, point.GAMMA) + 2;
+    std::vector<double> exact_distribution = exact_order_distribution(max_order, point.beta, point.H, point.GAMMA);
+
+    ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::future<std::vector<double>>> futures;
+    for (unsigned int i = 0; i < N_CHAINS; ++i)
+        futures.push_back(pool.submit([point, engine, max_order, delayed_rejection, i]()
+        {
+            if (engine == DiagramEngine::FLAT) return sample_order_histogram<FlatDiagram>(point, max_order, 3000 + i, 4000 + i, delayed_rejection);
+            else return sample_order_histogram<Diagram>(point, max_order, 3000 + i, 4000 + i, delayed_rejection);
+        }));
+
+    std::vector<std::vector<double>> histograms;
+    for (auto & future : futures) histograms.push_back(future.get());
+
+    double chi_square = 0;
+    int degrees_of_freedom = 0;
+    for (size_t n = 0; n <= max_order; ++n)
+    {
+        std::vector<double> frequencies;
+        for (const auto & histogram : histograms) frequencies.push_back(histogram[n]);
+        SampleStatistics statistics = sample_statistics(frequencies);
+
+        if (exact_distribution[n] < MIN_ORDER_PROBABILITY)
+        {
+            //odd orders are never visited
+            if (n % 2 != 0)
+            {
+                EXPECT_EQ(statistics.mean, 0) << "odd order " << n << " visited";
+            }
+            continue;
+        }
+
+        double z = z_score(statistics, exact_distribution[n]);
+        EXPECT_LT(std::abs(z), MAX_Z_SCORE) << "frequency of order " << n << " deviates from the exact value";
+
+        chi_square += z * z;
+        ++degrees_of_freedom;
+    }
+
+    ASSERT_GT(degrees_of_freedom, 0);
+    EXPECT_LT(chi_square / degrees_of_freedom, MAX_REDUCED_CHI_SQUARE);
+}
+
+
+/**
+ * @brief This test checks that the distribution of the diagram order sampled by the chain
+ * agrees with the exact distribution (Poisson-like for H = 0).
+ *
+ * GIVEN: N_CHAINS independent chains with fixed seeds, for the parameters of the test point
+ * WHEN: the histogram of the diagram order is collected for each chain
+ * THEN: for every order with exact probability above MIN_ORDER_PROBABILITY, the z-score of the mean frequency is below MAX_Z_SCORE,
+ * and the reduced chi-square over all these orders is below MAX_REDUCED_CHI_SQUARE
+ */
+TEST_P(StatisticalTest, order_distribution_agrees_with_exact_solution)
+{
+    check_order_distribution(std::get<0>(GetParam()), std::get<1>(GetParam()), false);
+}
+
+
+INSTANTIATE_TEST_SUITE_P(
+    ExactSolution,
+    StatisticalTest,
+    ::testing::Combine(
+        ::testing::Values(
+            TestPoint{1, 1, 1},
+            TestPoint{4, 0, 1},
+            TestPoint{5, 0.3, 0.8},
+            TestPoint{2, -1, 0.5},
+            TestPoint{10, 0.2, -0.3}
+        ),
+        ::testing::Values(DiagramEngine::LIST, DiagramEngine::FLAT)
+    ),
+    [](const ::testing::TestParamInfo<std::tuple<TestPoint, DiagramEngine>> & info)
+    {
+        //point index, followed by the engine
+        return "point" + std::to_string(info.index / 2) + (std::get<1>(info.param) == DiagramEngine::FLAT ? "_flat" : "_list");
+    }
+);
+
+
+/**
+ * @brief Fixture for the statistical tests of the delayed-rejection variants of ADD_SEGMENT and REMOVE_SEGMENT,
+ * parametrized as StatisticalTest, on points with large |H| * beta where the second stage is used most
+ */
+class DelayedRejectionTest : public ::testing::TestWithParam<std::tuple<TestPoint, DiagramEngine>> {};
+
+
+/**
+ * @brief This test checks that the delayed-rejection updates sample the exact magnetizations
+ *
+ * GIVEN: N_CHAINS independent chains with fixed seeds and the delayed-rejection updates, for the parameters of the test point
+ * WHEN: they are run with run_simulation
+ * THEN: the z-scores of the mean sigma_x and sigma_z with respect to the exact values are below MAX_Z_SCORE
+ */
+TEST_P(DelayedRejectionTest, magnetizations_agree_with_exact_solution)
+{
+    check_magnetizations(std::get<0>(GetParam()), std::get<1>(GetParam()), true);
+}
+
+
+/**
+ * @brief This test checks that the delayed-rejection updates sample the exact distribution of the diagram order
+ *
+ * GIVEN: N_CHAINS independent chains with fixed seeds and the delayed-rejection updates, for the parameters of the test point
+ * WHEN: the histogram of the diagram order is collected for each chain
+ * THEN: the frequencies agree with the exact distribution, as in StatisticalTest.order_distribution_agrees_with_exact_solution
+ */
+TEST_P(DelayedRejectionTest, order_distribution_agrees_with_exact_solution)
+{
+    check_order_distribution(std::get<0>(GetParam()), std::get<1>(GetParam()), true);
+}
+
+
+INSTANTIATE_TEST_SUITE_P(
+    ExactSolution,
+    DelayedRejectionTest,
+    ::testing::Combine(
+        ::testing::Values(
+            TestPoint{1, 1, 1},
+            TestPoint{4, 1.5, 0.7},
+            TestPoint{10, -0.8, 0.5}
+        ),
+        ::testing::Values(DiagramEngine::LIST, DiagramEngine::FLAT)
+    ),
+    [](const ::testing::TestParamInfo<std::tuple<TestPoint, DiagramEngine>> & info)
+    {
+        return "point" + std::to_string(info.index / 2) + (std::get<1>(info.param) == DiagramEngine::FLAT ? "_flat" : "_list");
+    }
+);
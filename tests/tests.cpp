@@ -7,7 +7,42 @@
 
 #include <gtest/gtest.h>
 #include <diagmc/diagram.h>
+#include <diagmc/flat_diagram.h>
+#include <diagmc/lockstep.h>
+#include <diagmc/setup.h>
+#include <diagmc/reweighting.h>
+#include <diagmc/mbar.h>
+#include <diagmc/accumulators.h>
+#include <diagmc/measurements.h>
+#include <diagmc/ring_buffer.h>
 #include <diagmc/simulation.h>
+#include <diagmc/planner.h>
+#include <diagmc/scaling.h>
+#include <diagmc/kernel_benchmark.h>
+#include <diagmc/server.h>
+#include <diagmc/thread_pool.h>
+#include <diagmc/affinity.h>
+#include <diagmc/autotune.h>
+#include <diagmc/convergence.h>
+#include <diagmc/task_graph.h>
+#include <diagmc/worm.h>
+#include <diagmc/simd.h>
+#include <diagmc/diagmc_c.h>
+#include <diagmc/exact.h>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 
 
@@ -1021,3 +1056,2121 @@ TEST(Simulation, run_simulation_results_are_correct)
 
 }
 
+
+
+
+//#########################################################################################
+
+//Series of tests for the dry-run planner
+
+/**
+ * @brief This test checks that the predicted_makespan function distributes the tasks
+ * among the workers as expected
+ * 
+ * GIVEN: a list of task durations {4, 3, 3, 2}
+ * WHEN: the predicted wall time is calculated for 1, 2 and 4 workers
+ * THEN: it is 12 (the sum) for 1 worker, 6 for 2 workers ({4,2} and {3,3}), and 4 (the longest task) for 4 workers
+ */
+TEST(Planner, predicted_makespan_returns_correct_value)
+{
+    std::vector<double> task_times {3, 2, 4, 3};
+
+    EXPECT_DOUBLE_EQ(predicted_makespan(task_times, 1), 12);
+    EXPECT_DOUBLE_EQ(predicted_makespan(task_times, 2), 6);
+    EXPECT_DOUBLE_EQ(predicted_makespan(task_times, 4), 4);
+}
+
+
+/**
+ * @brief This test checks the memory of the diagram predicted for each engine
+ * 
+ * GIVEN: the same run with the list and the flat engine
+ * WHEN: the memory of the diagram is predicted
+ * THEN: the list engine needs LIST_NODE_BYTES per vertex, while the flat engine needs 8 bytes per vertex of the capacity of the vector,
+ * which holds the expected maximum order and is less than twice as large
+ */
+TEST(Planner, predicted_diagram_memory_depends_on_the_engine)
+{
+    SimulationTask task {16, 1, 0, 1, 1000000, 0, 1, 2};
+    double max_order = expected_max_diagram_order(task);
+    task.engine = DiagramEngine::LIST;
+    double list_memory = predicted_diagram_memory(task);
+    task.engine = DiagramEngine::FLAT;
+    double flat_memory = predicted_diagram_memory(task);
+
+    EXPECT_DOUBLE_EQ(list_memory, sizeof(Diagram) + sizeof(std::mt19937) + 32 * max_order);
+    double capacity = (flat_memory - sizeof(FlatDiagram) - sizeof(std::mt19937)) / sizeof(double);
+    EXPECT_GE(capacity, max_order);
+    EXPECT_LT(capacity, 2 * max_order);
+    EXPECT_LT(flat_memory, list_memory);
+}
+
+
+
+//#########################################################################################
+
+//Series of tests for the thread pool and the server mode
+
+/**
+ * @brief This test checks that the ThreadPool executes all the submitted jobs, returning their results
+ * 
+ * GIVEN: a pool with 3 worker threads
+ * WHEN: 100 jobs returning their own index are submitted
+ * THEN: each future returns the index of the corresponding job
+ */
+TEST(ThreadPool, executes_all_jobs)
+{
+    ThreadPool pool(3);
+
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < 100; ++i) futures.push_back(pool.submit([i]() { return i; }));
+
+    for (int i = 0; i < 100; ++i) EXPECT_EQ(futures[i].get(), i);
+}
+
+
+/**
+ * @brief This test checks that handle_job streams back the header, one row per run and the final #done line
+ * 
+ * GIVEN: a sweep job with 3 values of H
+ * WHEN: it is passed to handle_job
+ * THEN: the response has 5 lines: the csv header, 3 rows with the H values in order, and #done
+ */
+TEST(Server, handle_job_streams_rows)
+{
+    ThreadPool pool(2);
+    std::vector<std::string> lines;
+
+    handle_job(R"({"CALC_TYPE": "sweep", "beta": 1, "GAMMA": 1, "H_min": -1, "H_max": 1, "H_step": 1, "N_total_steps": 1000})", 
+        pool, [&](const std::string & line) { lines.push_back(line); });
+
+    ASSERT_EQ(lines.size(), 5);
+    EXPECT_EQ(lines[0] + '\n', SingleRunResults::ostream_output_header());
+    EXPECT_EQ(lines[1].rfind("1,1,-1,1,", 0), 0);
+    EXPECT_EQ(lines[2].rfind("1,1,0,1,", 0), 0);
+    EXPECT_EQ(lines[3].rfind("1,1,1,1,", 0), 0);
+    EXPECT_EQ(lines[4], JOB_DONE_LINE);
+}
+
+
+/**
+ * @brief This test checks that handle_job reports invalid jobs with an #error line, instead of terminating the program
+ * 
+ * GIVEN: a job that is not valid json, and a job with missing parameters
+ * WHEN: they are passed to handle_job
+ * THEN: the response is a single line starting with #error
+ */
+TEST(Server, handle_job_reports_errors)
+{
+    ThreadPool pool(1);
+
+    for (std::string job : {"not json", R"({"CALC_TYPE": "single", "beta": 1})"})
+    {
+        std::vector<std::string> lines;
+        handle_job(job, pool, [&](const std::string & line) { lines.push_back(line); });
+
+        ASSERT_EQ(lines.size(), 1);
+        EXPECT_EQ(lines[0].rfind(JOB_ERROR_PREFIX, 0), 0);
+    }
+}
+
+
+/**
+ * @brief This test checks that handle_job rejects the calculations that cannot be served
+ * 
+ * GIVEN: valid lockstep-check, worm and mbar jobs
+ * WHEN: they are passed to handle_job
+ * THEN: the response is a single #error line naming the CALC_TYPE, instead of the rows of plain runs
+ */
+TEST(Server, handle_job_rejects_unsupported_calculations)
+{
+    ThreadPool pool(1);
+
+    for (std::string calc_type : {"lockstep-check", "worm", "mbar"})
+    {
+        json job = {{"CALC_TYPE", calc_type}, {"beta", 1}, {"H", 0.5}, {"GAMMA", 1}, {"N_total_steps", 1000}};
+        std::vector<std::string> lines;
+        handle_job(job.dump(), pool, [&](const std::string & line) { lines.push_back(line); });
+
+        ASSERT_EQ(lines.size(), 1);
+        EXPECT_EQ(lines[0].rfind(JOB_ERROR_PREFIX, 0), 0);
+        EXPECT_NE(lines[0].find(calc_type), std::string::npos);
+    }
+}
+
+
+#ifndef _WIN32
+/**
+ * @brief This test checks the communication between run_server and submit_job through a Unix domain socket
+ * 
+ * GIVEN: a server listening on a socket in a separate thread
+ * WHEN: a single-run job and then the shutdown command are submitted
+ * THEN: the client receives the header and one row, and the server thread terminates
+ */
+TEST(Server, submit_job_to_running_server)
+{
+    std::string socket_path = "diagmc_test_server.sock";
+    std::thread server([&]() { run_server(socket_path, 2); });
+
+    //wait for the server to be listening
+    std::ostringstream out;
+    bool success = false;
+    for (int attempt = 0; attempt < 100; ++attempt)
+    {
+        try
+        {
+            success = submit_job(socket_path, R"({"CALC_TYPE": "single", "beta": 1, "H": 1, "GAMMA": 1, "N_total_steps": 1000, "update_choice_seed": 1, "diagram_seed": 2})", out);
+            break;
+        }
+        catch(const std::runtime_error &)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+    std::ostringstream shutdown_out;
+    submit_job(socket_path, R"({"command": "shutdown"})", shutdown_out);
+    server.join();
+
+    EXPECT_TRUE(success);
+    EXPECT_EQ(out.str().rfind(SingleRunResults::ostream_output_header(), 0), 0);
+    EXPECT_NE(out.str().find("\n1,1,1,1,"), std::string::npos);
+}
+
+
+/**
+ * @brief This test checks that a long-lived server does not accumulate the threads of the closed connections
+ * 
+ * GIVEN: a server listening on a socket in a separate thread
+ * WHEN: many tiny jobs are submitted one after the other, each on its own connection, and then the status command
+ * THEN: every job succeeds, and only the connection of the status command is still open
+ */
+TEST(Server, closed_connections_are_joined)
+{
+    std::string socket_path = "diagmc_test_server_jobs.sock";
+    std::thread server([&]() { run_server(socket_path, 2); });
+
+    std::string job = R"({"CALC_TYPE": "single", "beta": 1, "H": 1, "GAMMA": 1, "N_total_steps": 100, "update_choice_seed": 1, "diagram_seed": 2})";
+    //wait for the server to be listening
+    for (int attempt = 0; attempt < 100; ++attempt)
+    {
+        try
+        {
+            std::ostringstream out;
+            submit_job(socket_path, R"({"command": "status"})", out);
+            break;
+        }
+        catch(const std::runtime_error &)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+    int N_succeeded = 0;
+    for (int i = 0; i < 200; ++i)
+    {
+        std::ostringstream out;
+        N_succeeded += submit_job(socket_path, job, out);
+    }
+
+    //the closed connections are joined at the latest after a timeout of the poll of the server
+    std::this_thread::sleep_for(std::chrono::milliseconds(600));
+    std::ostringstream status;
+    EXPECT_TRUE(submit_job(socket_path, R"({"command": "status"})", status));
+
+    std::ostringstream shutdown_out;
+    submit_job(socket_path, R"({"command": "shutdown"})", shutdown_out);
+    server.join();
+
+    EXPECT_EQ(N_succeeded, 200);
+    EXPECT_EQ(status.str(), "connections 1\n");
+}
+#endif
+
+
+
+//#########################################################################################
+
+//Series of tests for the C interface of the libdiagmc shared library
+
+/**
+ * @brief This test checks that diagmc_run_batch writes in each element of the output array
+ * the same results obtained by running the corresponding task with run_simulation
+ * 
+ * GIVEN: 4 tasks with fixed seeds and different H
+ * WHEN: they are run with diagmc_run_batch on 2 threads, and one by one with run_simulation
+ * THEN: the magnetizations and statistics are the same
+ */
+TEST(C_API, run_batch_matches_run_simulation)
+{
+    std::vector<diagmc_task> tasks;
+    for (int i = 0; i < 4; ++i) tasks.push_back({1, 1, -1. + i * 0.5, 1, 10000, 100, 10ull + i, 20ull + i});
+
+    std::vector<diagmc_result> results(tasks.size());
+    ASSERT_EQ(diagmc_run_batch(tasks.data(), tasks.size(), results.data(), 2), DIAGMC_SUCCESS);
+
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        SingleRunResults expected = run_simulation(tasks[i].beta, tasks[i].initial_s0, tasks[i].H, tasks[i].GAMMA, 
+            tasks[i].N_total_steps, tasks[i].N_thermalization_steps, tasks[i].update_choice_seed, tasks[i].diagram_seed);
+
+        EXPECT_DOUBLE_EQ(results[i].measured_sigmax, expected.measured_sigmax);
+        EXPECT_DOUBLE_EQ(results[i].measured_sigmaz, expected.measured_sigmaz);
+        EXPECT_EQ(results[i].N_measures, expected.N_measures);
+        EXPECT_EQ(results[i].N_accepted_addsegment, expected.N_accepted_addsegment);
+    }
+}
+
+
+/**
+ * @brief This test checks that the C interface reports invalid parameters with an error code and message,
+ * instead of throwing exceptions across the library boundary
+ * 
+ * GIVEN: a task with beta < 0
+ * WHEN: it is passed to diagmc_run_simulation, and a NULL result pointer is passed
+ * THEN: DIAGMC_ERROR_INVALID_ARGUMENT is returned, and diagmc_last_error returns a non-empty message
+ */
+TEST(C_API, run_simulation_reports_invalid_arguments)
+{
+    EXPECT_EQ(diagmc_abi_version(), DIAGMC_ABI_VERSION);
+
+    diagmc_task task {-1, 1, 1, 1, 1000, 0, 1, 2};
+    diagmc_result result;
+
+    EXPECT_EQ(diagmc_run_simulation(&task, &result), DIAGMC_ERROR_INVALID_ARGUMENT);
+    EXPECT_STRNE(diagmc_last_error(), "");
+
+    EXPECT_EQ(diagmc_run_simulation(&task, nullptr), DIAGMC_ERROR_INVALID_ARGUMENT);
+}
+
+
+
+//#########################################################################################
+
+//Series of tests for the exact solution of the two-level system
+
+/**
+ * @brief This test checks that exact_average_order returns the average order
+ * corresponding to the exact magnetization along x, <n> = -beta * GAMMA * <sigma_x>
+ * 
+ * GIVEN: the parameters of the run_simulation test, with exact <sigma_x> = -0.09215
+ * WHEN: they are passed to the exact_average_order function
+ * THEN: the returned value is equal to -beta * GAMMA * <sigma_x>
+ */
+TEST(Exact, average_order_returns_correct_value)
+{
+    double beta = 1;
+    double H = -0.5;
+    double GAMMA = 0.1;
+
+    EXPECT_NEAR(exact_average_order(beta, H, GAMMA), beta * GAMMA * 0.09215, 1e-5);
+    EXPECT_NEAR(exact_sigmax(beta, H, GAMMA), -0.09215, 1e-5);
+    EXPECT_NEAR(exact_sigmaz(beta, H, GAMMA), 0.46074, 1e-5);
+}
+
+
+/**
+ * @brief This test checks that the exact order distribution is normalized, has the exact average order, 
+ * and reduces to the Poisson-like form for H = 0
+ * 
+ * GIVEN: a set of parameters with H != 0, and a set with H = 0
+ * WHEN: the exact order distribution is calculated up to an order much larger than the average
+ * THEN: the sum of the probabilities is 1, the average is exact_average_order, the odd orders have zero probability,
+ * and for H = 0 P(2k) = (beta*GAMMA)^2k / (2k)! / cosh(beta*GAMMA)
+ */
+TEST(Exact, order_distribution_is_correct)
+{
+    double beta = 5;
+    double H = 0.7;
+    double GAMMA = 1.3;
+
+    std::vector<double> distribution = exact_order_distribution(200, beta, H, GAMMA);
+    double norm = 0, average = 0;
+    for (size_t n = 0; n < distribution.size(); ++n)
+    {
+        norm += distribution[n];
+        average += n * distribution[n];
+    }
+    EXPECT_NEAR(norm, 1, 1e-12);
+    EXPECT_NEAR(average, exact_average_order(beta, H, GAMMA), 1e-10);
+    EXPECT_EQ(distribution[3], 0);
+
+    for (int k = 0; k < 5; ++k)
+        EXPECT_NEAR(exact_order_probability(2*k, beta, 0, GAMMA), std::pow(beta*GAMMA, 2*k) / std::tgamma(2*k + 1) / std::cosh(beta*GAMMA), 1e-12);
+}
+
+
+/**
+ * @brief This test checks the boundary values and the symmetry of the exact correlation functions
+ * 
+ * GIVEN: a set of parameters
+ * WHEN: the correlation functions are evaluated at tau = 0, beta, and at symmetric times tau, beta - tau
+ * THEN: they are 1 at tau = 0 and beta (sigma^2 = 1), and symmetric around beta/2
+ */
+TEST(Exact, correlation_functions_are_correct)
+{
+    double beta = 3;
+    double H = 0.4;
+    double GAMMA = 0.8;
+
+    EXPECT_NEAR(exact_correlation_zz(0, beta, H, GAMMA), 1, 1e-12);
+    EXPECT_NEAR(exact_correlation_xx(beta, beta, H, GAMMA), 1, 1e-12);
+    EXPECT_NEAR(exact_correlation_xx(0.7, beta, H, GAMMA), exact_correlation_xx(beta - 0.7, beta, H, GAMMA), 1e-12);
+
+    //for very large beta*E, the correlation at beta/2 tends to the squared magnetization of the ground state
+    EXPECT_NEAR(exact_correlation_zz(500, 1000, H, GAMMA), std::pow(exact_sigmaz(1000, H, GAMMA), 2), 1e-12);
+}
+
+
+/**
+ * @brief This test checks that the vectorized evaluation of the exact observables gives the same results of the scalar functions
+ * 
+ * GIVEN: a grid of points in beta, H and GAMMA
+ * WHEN: the exact observables are evaluated with evaluate_exact
+ * THEN: they are equal to the values calculated point by point with the scalar functions
+ */
+TEST(Exact, vectorized_evaluation_matches_scalar)
+{
+    std::vector<double> beta, H, GAMMA;
+    for (double b : {0.5, 10.})
+        for (double h = -1; h <= 1; h += 0.25)
+            for (double g : {-0.3, 0.2, 1.})
+            {
+                beta.push_back(b);
+                H.push_back(h);
+                GAMMA.push_back(g);
+            }
+
+    ExactValues values = evaluate_exact(beta, H, GAMMA);
+
+    for (size_t i = 0; i < beta.size(); ++i)
+    {
+        EXPECT_DOUBLE_EQ(values.sigmax[i], exact_sigmax(beta[i], H[i], GAMMA[i]));
+        EXPECT_DOUBLE_EQ(values.sigmaz[i], exact_sigmaz(beta[i], H[i], GAMMA[i]));
+        EXPECT_DOUBLE_EQ(values.energy[i], exact_energy(beta[i], H[i], GAMMA[i]));
+        EXPECT_NEAR(values.average_order[i], exact_average_order(beta[i], H[i], GAMMA[i]), 1e-12);
+    }
+
+    EXPECT_THROW(evaluate_exact({1, 2}, {1}, {1}), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks that the FlatDiagram_core constructor validates the parameters as the reference Diagram_core
+ * 
+ * GIVEN: invalid beta, s0, GAMMA, or vertices (odd number, > beta, not sorted)
+ * WHEN: they are provided as parameters to the FlatDiagram_core constructor
+ * THEN: a std::invalid_argument exception is thrown
+ */
+TEST(TestFlatDiagram_core, constructor_throws_for_invalid_parameters)
+{
+    EXPECT_THROW( FlatDiagram_core(-10, 1, 1, 1) , std::invalid_argument );
+    EXPECT_THROW( FlatDiagram_core(1, 0, 1, 1) , std::invalid_argument );
+    EXPECT_THROW( FlatDiagram_core(1, 1, 1, 0) , std::invalid_argument );
+    EXPECT_THROW( FlatDiagram_core(1, 1, 1, 1, {0.1, 0.2, 0.3}) , std::invalid_argument );
+    EXPECT_THROW( FlatDiagram_core(1, 1, 1, 1, {0.1, 2}) , std::invalid_argument );
+    EXPECT_THROW( FlatDiagram_core(1, 1, 1, 1, {0.2, 0.1}) , std::invalid_argument );
+}
+
+
+/**
+ * @brief This test checks that the optimized engine takes the same decisions of the reference engine,
+ * running the lockstep checker on long chains for different regimes (small and large orders, positive and negative fields)
+ * 
+ * GIVEN: a set of parameters and fixed seeds
+ * WHEN: the reference and optimized engines are run in lockstep with the same random numbers
+ * THEN: no divergence is reported, and all the steps are checked
+ */
+TEST(Lockstep, engines_never_diverge)
+{
+    for (auto task : {
+        SimulationTask{1, 1, 1, 1, 200000, 0, 1, 2},
+        SimulationTask{20, -1, 0.3, 2, 200000, 0, 3, 4},
+        SimulationTask{5, 1, -1, 0.5, 200000, 0, 5, 6} })
+    {
+        LockstepReport report = run_lockstep_check(task);
+
+        std::stringstream context;
+        print_lockstep_report(report, context);
+        EXPECT_FALSE(report.diverged) << context.str();
+        EXPECT_EQ(report.N_steps_checked, task.N_total_steps);
+    }
+}
+
+
+/**
+ * @brief This test checks that run_simulation gives the same results with the two storage engines
+ * 
+ * GIVEN: a set of parameters and fixed seeds
+ * WHEN: run_simulation is called with the list and the flat engines
+ * THEN: the measured values and the statistics of the updates are identical
+ */
+TEST(Simulation, run_simulation_engines_give_same_results)
+{
+    SingleRunResults list_results = run_simulation(3, 1, 0.5, 1, 100000, 1000, 7, 8, DiagramEngine::LIST);
+    SingleRunResults flat_results = run_simulation(3, 1, 0.5, 1, 100000, 1000, 7, 8, DiagramEngine::FLAT);
+
+    EXPECT_EQ(list_results.measured_sigmax, flat_results.measured_sigmax);
+    EXPECT_NEAR(list_results.measured_sigmaz, flat_results.measured_sigmaz, EPSILON);
+    EXPECT_EQ(list_results.N_accepted_addsegment, flat_results.N_accepted_addsegment);
+    EXPECT_EQ(list_results.N_accepted_removesegment, flat_results.N_accepted_removesegment);
+    EXPECT_EQ(list_results.N_accepted_flips, flat_results.N_accepted_flips);
+    EXPECT_EQ(list_results.max_diagram_order, flat_results.max_diagram_order);
+}
+
+
+/**
+ * @brief This test checks the detection of the points related by the symmetries H -> -H and GAMMA -> -GAMMA
+ * 
+ * GIVEN: a list of tasks with H = -0.6, 0, 0.6000000000000001 (as produced by a range) and GAMMA = +-1, with two samples per point
+ * WHEN: symmetry_sources is called
+ * THEN: only the samples of the first point of each class are run, and the k-th sample of a mirrored point is obtained from the k-th run,
+ * unless the beta, engine, flip probability or kernels of the tasks differ
+ */
+TEST(Setup, symmetry_sources_maps_mirrored_points)
+{
+    std::vector<SimulationTask> tasks;
+    for (double H : {-0.6, 0., 0.6000000000000001})
+        for (double GAMMA : {-1., 1.})
+            for (int sample = 0; sample < 2; ++sample)
+                tasks.push_back({2, 1, H, GAMMA, 1000, 0, 1, 2});
+
+    std::vector<size_t> sources = symmetry_sources(tasks);
+
+    std::vector<size_t> expected = {0, 1, 0, 1, 4, 5, 4, 5, 0, 1, 0, 1};
+    EXPECT_EQ(sources, expected);
+
+    //tasks with different beta, or tuned to different chains, are never related
+    tasks[2].beta = 3;
+    EXPECT_EQ(symmetry_sources(tasks)[2], 2);
+    tasks[3].flip_probability = 0.5;
+    EXPECT_EQ(symmetry_sources(tasks)[3], 3);
+    tasks[8].delayed_rejection = true;
+    EXPECT_EQ(symmetry_sources(tasks)[8], 8);
+    tasks[9].engine = DiagramEngine::FLAT;
+    EXPECT_EQ(symmetry_sources(tasks)[9], 9);
+}
+
+
+/**
+ * @brief This test checks that the results synthesized by symmetry are equal to the mirrored results of the canonical run
+ * 
+ * GIVEN: a sweep over H = +-0.5 and GAMMA = +-1
+ * WHEN: the tasks are run with use_symmetries
+ * THEN: only the first row is simulated, and the other rows have the sign of sigma_z (sigma_x) flipped when H (GAMMA) is flipped
+ */
+TEST(Setup, run_tasks_synthesizes_mirrored_rows)
+{
+    std::vector<SimulationTask> tasks;
+    for (double H : {0.5, -0.5})
+        for (double GAMMA : {1., -1.})
+            tasks.push_back({2, 1, H, GAMMA, 10000, 0, 1, 2});
+
+    ThreadPool pool(2);
+    std::vector<SingleRunResults> rows;
+    run_tasks(tasks, pool, [&](const SingleRunResults & results) { rows.push_back(results); }, true);
+
+    ASSERT_EQ(rows.size(), 4);
+    EXPECT_FALSE(rows[0].synthesized);
+    for (int i = 1; i < 4; ++i) EXPECT_TRUE(rows[i].synthesized);
+
+    EXPECT_EQ(rows[1].measured_sigmax, -rows[0].measured_sigmax);
+    EXPECT_EQ(rows[1].measured_sigmaz, rows[0].measured_sigmaz);
+    EXPECT_EQ(rows[2].measured_sigmax, rows[0].measured_sigmax);
+    EXPECT_EQ(rows[2].measured_sigmaz, -rows[0].measured_sigmaz);
+    EXPECT_EQ(rows[3].measured_sigmax, -rows[0].measured_sigmax);
+    EXPECT_EQ(rows[3].measured_sigmaz, -rows[0].measured_sigmaz);
+    EXPECT_EQ(rows[3].N_accepted_addsegment, rows[0].N_accepted_addsegment);
+}
+
+
+/**
+ * @brief This test checks that reweighting to the same beta gives back the plain averages, with ESS equal to the number of samples
+ * 
+ * GIVEN: a BetaReweighter with target beta equal to the beta of the simulation
+ * WHEN: some samples are added
+ * THEN: the reweighted magnetizations are the plain averages of the estimators, and ESS_fraction is 1
+ */
+TEST(Reweighting, same_beta_gives_plain_averages)
+{
+    double beta = 2;
+    double GAMMA = 0.5;
+    BetaReweighter reweighter(beta, 0.3, GAMMA, {beta});
+
+    reweighter.add_sample(0, 1);
+    reweighter.add_sample(2, 0.5);
+    reweighter.add_sample(4, -0.2);
+
+    ReweightedResult result = reweighter.results().front();
+    EXPECT_NEAR(result.sigmaz, (1 + 0.5 - 0.2) / 3, 1e-12);
+    EXPECT_NEAR(result.sigmax, -(0 + 2 + 4) / 3. / (beta * GAMMA), 1e-12);
+    EXPECT_NEAR(result.ESS_fraction, 1, 1e-12);
+
+    EXPECT_THROW(BetaReweighter(beta, 0.3, GAMMA, {-1}), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks that the magnetizations of a run reweighted to nearby betas agree with the exact values
+ * 
+ * GIVEN: a run at beta = 2 with fixed seeds, with reweight_betas 1.8 and 2.2
+ * WHEN: run_simulation is executed
+ * THEN: the reweighted magnetizations agree with the exact ones at the target betas, and ESS_fraction is large
+ */
+TEST(Reweighting, run_simulation_reweights_to_nearby_betas)
+{
+    SingleRunResults results = run_simulation(2, 1, 0.5, 1, 2000000, 10000, 11, 12, DiagramEngine::FLAT, {1.8, 2.2});
+
+    ASSERT_EQ(results.reweighted.size(), 2);
+    for (const auto & result : results.reweighted)
+    {
+        EXPECT_NEAR(result.sigmaz, exact_sigmaz(result.target_beta, 0.5, 1), 0.01);
+        EXPECT_NEAR(result.sigmax, exact_sigmax(result.target_beta, 0.5, 1), 0.01);
+        EXPECT_GT(result.ESS_fraction, 0.5);
+    }
+}
+
+
+/**
+ * @brief This test checks the binning of the sufficient statistics histogram, and its mirroring M -> -M
+ * 
+ * GIVEN: a histogram with 4 bins at beta = 2 (M in [-2, 2])
+ * WHEN: samples are added, and the histogram is mirrored
+ * THEN: the samples are in the expected cells (including the edges), and the mirrored histogram has the reversed bins and opposite sums
+ */
+TEST(MBAR, histogram_bins_and_mirroring)
+{
+    SufficientStatisticsHistogram histogram(2, 4);
+    histogram.add_sample(0, -2);    //left edge: cell 0
+    histogram.add_sample(0, 2);     //right edge: cell 3
+    histogram.add_sample(2, 0.5);   //order 2, bin 2: cell 6
+
+    std::vector<unsigned long long> expected_counts = {1, 0, 0, 1, 0, 0, 1, 0};
+    EXPECT_EQ(histogram.get_counts(), expected_counts);
+    EXPECT_EQ(histogram.N_samples(), 3);
+
+    SufficientStatisticsHistogram mirrored = histogram.mirrored();
+    std::vector<unsigned long long> expected_mirrored_counts = {1, 0, 0, 1, 0, 1, 0, 0};
+    EXPECT_EQ(mirrored.get_counts(), expected_mirrored_counts);
+    EXPECT_DOUBLE_EQ(mirrored.get_sum_M()[5], -0.5);
+
+    EXPECT_THROW(SufficientStatisticsHistogram(2, 0), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the multi-histogram analysis against the exact solution
+ * 
+ * GIVEN: runs with fixed seeds at beta = 3, for H = -0.4, 0, 0.4 and GAMMA = 0.7, 1.1
+ * WHEN: their histograms are combined by MultiHistogramSolver
+ * THEN: the log partition functions agree with log(Z_k/Z_0), Z = 2cosh(beta*E), and the magnetizations evaluated
+ * at points between the runs agree with the exact values
+ */
+TEST(MBAR, solver_agrees_with_exact_solution)
+{
+    double beta = 3;
+    std::vector<SufficientStatisticsHistogram> histograms;
+    std::vector<double> H_values, GAMMA_values;
+    for (double H : {-0.4, 0., 0.4})
+        for (double GAMMA : {0.7, 1.1})
+        {
+            SingleRunResults results = run_simulation(beta, 1, H, GAMMA, 500000, 5000, 21, 22, DiagramEngine::FLAT, {}, HISTOGRAM_BINS_DEFAULT);
+            histograms.push_back(results.histogram);
+            H_values.push_back(H);
+            GAMMA_values.push_back(GAMMA);
+        }
+
+    ThreadPool pool(2);
+    MultiHistogramSolver solver(histograms, H_values, GAMMA_values, pool);
+    solver.solve();
+
+    auto log_Z = [beta](double H, double GAMMA) { return std::log(2 * std::cosh(beta * std::sqrt(H*H + GAMMA*GAMMA))); };
+    for (size_t k = 0; k < histograms.size(); ++k)
+        EXPECT_NEAR(solver.log_partition_functions()[k], log_Z(H_values[k], GAMMA_values[k]) - log_Z(H_values[0], GAMMA_values[0]), 0.02);
+
+    for (double H : {-0.2, 0.3})
+    {
+        MultiHistogramEstimate estimate = solver.evaluate(H, 0.9);
+        EXPECT_NEAR(estimate.sigmax, exact_sigmax(beta, H, 0.9), 0.01);
+        EXPECT_NEAR(estimate.sigmaz, exact_sigmaz(beta, H, 0.9), 0.01);
+    }
+
+    EXPECT_THROW(MultiHistogramSolver({}, {}, {}, pool), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the behaviour of the single-producer single-consumer ring buffer
+ * 
+ * GIVEN: a ring buffer with capacity 4
+ * WHEN: elements are pushed until it is full, and then popped
+ * THEN: the push fails when the buffer is full, the elements are popped in FIFO order, and a capacity that is not a power of 2 is rejected
+ */
+TEST(Measurements, ring_buffer_is_fifo_and_bounded)
+{
+    SpscRingBuffer<int> buffer(4);
+    EXPECT_EQ(buffer.try_front(), nullptr);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        int * slot = buffer.try_begin_push();
+        ASSERT_NE(slot, nullptr);
+        *slot = i;
+        buffer.commit_push();
+    }
+    EXPECT_EQ(buffer.try_begin_push(), nullptr);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        int * front = buffer.try_front();
+        ASSERT_NE(front, nullptr);
+        EXPECT_EQ(*front, i);
+        buffer.pop();
+    }
+    EXPECT_EQ(buffer.try_front(), nullptr);
+
+    EXPECT_THROW(SpscRingBuffer<int>(6), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the correlation function of a single diagram, computed by hand
+ * 
+ * GIVEN: the diagram at beta = 4 with s0 = +1 and vertices at 1 and 2
+ * WHEN: diagram_correlation_zz is evaluated at tau = 0, 0.5, 1, and for the 0-th order diagram
+ * THEN: it returns 1, 0.5, 0, and 1 for the 0-th order diagram
+ */
+TEST(Measurements, diagram_correlation_zz_of_single_diagram)
+{
+    std::vector<double> vertices = {1, 2};
+    EXPECT_NEAR(diagram_correlation_zz(1, vertices, 4, 0), 1, 1e-12);
+    EXPECT_NEAR(diagram_correlation_zz(1, vertices, 4, 0.5), 0.5, 1e-12);
+    EXPECT_NEAR(diagram_correlation_zz(1, vertices, 4, 1), 0, 1e-12);
+    EXPECT_NEAR(diagram_correlation_zz(-1, vertices, 4, 0.5), 0.5, 1e-12);
+    EXPECT_NEAR(diagram_correlation_zz(1, {}, 4, 1.5), 1, 1e-12);
+}
+
+
+/**
+ * @brief This test checks the observables measured by the asynchronous pipeline during a run
+ * 
+ * GIVEN: a run at beta = 2 with fixed seeds, measuring the correlation function and the segment lengths on 2 measurement threads
+ * WHEN: run_simulation is executed (with backpressure, so that no snapshot is dropped)
+ * THEN: every decimated snapshot is measured, the correlation function agrees with the exact one, and the density of the segment lengths is normalized
+ */
+TEST(Measurements, pipeline_correlation_agrees_with_exact)
+{
+    MeasurementOptions measurements;
+    measurements.correlation_bins = 8;
+    measurements.segment_length_bins = 10;
+    measurements.measure_interval = 10;
+    measurements.N_measurement_threads = 2;
+    measurements.buffer_size = 16;
+
+    SingleRunResults results = run_simulation(2, 1, 0.5, 1, 1000000, 10000, 21, 22, DiagramEngine::FLAT, {}, 0, measurements);
+
+    EXPECT_EQ(results.observables.N_dropped, 0);
+    EXPECT_EQ(results.observables.N_snapshots, (results.N_measures + 9) / 10);
+
+    ASSERT_EQ(results.observables.correlation_zz.size(), 8);
+    for (size_t i = 0; i < 8; ++i)
+        EXPECT_NEAR(results.observables.correlation_zz[i], exact_correlation_zz(results.observables.tau[i], 2, 0.5, 1), 0.02);
+
+    double integral = 0;
+    for (double density : results.observables.segment_length_density) integral += density * 2. / 10;
+    EXPECT_NEAR(integral, 1, 1e-9);
+}
+
+
+/**
+ * @brief This test checks the drop policy of the measurement pipeline
+ * 
+ * GIVEN: a pipeline with a buffer of size 1 and drop_when_full
+ * WHEN: many snapshots are pushed in a tight loop, and the pipeline is finished
+ * THEN: every snapshot is either measured or counted as dropped
+ */
+TEST(Measurements, pipeline_counts_dropped_snapshots)
+{
+    MeasurementOptions measurements;
+    measurements.correlation_bins = 4;
+    measurements.buffer_size = 1;
+    measurements.drop_when_full = true;
+
+    MeasurementPipeline pipeline(1, measurements);
+    std::vector<double> vertices = {0.1, 0.2, 0.5, 0.7};
+    for (int i = 0; i < 10000; ++i) pipeline.push(1, vertices.begin(), vertices.end());
+
+    MeasuredObservables observables = pipeline.finish();
+    EXPECT_EQ(observables.N_snapshots + observables.N_dropped, 10000);
+
+    EXPECT_THROW(MeasurementPipeline(0, measurements), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks that the idle measurement threads and the producer waiting for a full buffer sleep instead of spinning
+ * 
+ * GIVEN: a pipeline with four measurement threads, and one with a buffer of size 1 and backpressure
+ * WHEN: nothing is pushed for a while, and then many snapshots are pushed in a tight loop
+ * THEN: the idle threads use almost no CPU time, and with backpressure every snapshot is measured
+ */
+TEST(Measurements, idle_pipeline_threads_sleep)
+{
+    MeasurementOptions measurements;
+    measurements.correlation_bins = 4;
+    measurements.N_measurement_threads = 4;
+
+    {
+        MeasurementPipeline pipeline(1, measurements);
+        std::clock_t cpu_start = std::clock();
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        double cpu_seconds = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+        EXPECT_LT(cpu_seconds, 0.05); //four spinning threads would use about 1.2 s
+        EXPECT_EQ(pipeline.finish().N_snapshots, 0);
+    }
+
+    measurements.N_measurement_threads = 1;
+    measurements.buffer_size = 1;
+    MeasurementPipeline pipeline(1, measurements);
+    std::vector<double> vertices = {0.1, 0.2, 0.5, 0.7};
+    for (int i = 0; i < 10000; ++i) pipeline.push(1, vertices.begin(), vertices.end());
+
+    MeasuredObservables observables = pipeline.finish();
+    EXPECT_EQ(observables.N_snapshots, 10000);
+    EXPECT_EQ(observables.N_dropped, 0);
+}
+
+
+/**
+ * @brief This test checks that interleaving the chains on the same thread does not change their results
+ * 
+ * GIVEN: three runs with different parameters, lengths and seeds, for both diagram engines
+ * WHEN: they are run interleaved with run_simulation_interleaved, and separately with run_simulation
+ * THEN: the results of each run are identical, and mixing the engines is rejected
+ */
+TEST(Simulation, interleaved_chains_give_same_results)
+{
+    for (DiagramEngine engine : {DiagramEngine::LIST, DiagramEngine::FLAT})
+    {
+        std::vector<SimulationTask> tasks = {
+            {2, 1, 0.5, 1, 30000, 100, 1, 2, engine},
+            {5, -1, -0.3, 2, 50000, 0, 3, 4, engine},
+            {1, 1, 0, 0.5, 10000, 1000, 5, 6, engine}
+        };
+
+        std::vector<SingleRunResults> interleaved = run_simulation_interleaved(tasks);
+        ASSERT_EQ(interleaved.size(), tasks.size());
+
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+            SingleRunResults single = run_simulation(tasks[i]);
+            EXPECT_EQ(interleaved[i].measured_sigmax, single.measured_sigmax);
+            EXPECT_EQ(interleaved[i].measured_sigmaz, single.measured_sigmaz);
+            EXPECT_EQ(interleaved[i].N_measures, single.N_measures);
+            EXPECT_EQ(interleaved[i].N_accepted_addsegment, single.N_accepted_addsegment);
+            EXPECT_EQ(interleaved[i].max_diagram_order, single.max_diagram_order);
+        }
+    }
+
+    std::vector<SimulationTask> mixed = {{2, 1, 0.5, 1, 100, 0, 1, 2, DiagramEngine::LIST}, {2, 1, 0.5, 1, 100, 0, 1, 2, DiagramEngine::FLAT}};
+    EXPECT_THROW(run_simulation_interleaved(mixed), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks that run_tasks gives the same rows, in the same order, when the chains are interleaved on the workers
+ * 
+ * GIVEN: five runs with different seeds
+ * WHEN: they are executed by run_tasks with 1 and with 2 interleaved chains per worker
+ * THEN: the rows are the same, in the order of the tasks
+ */
+TEST(Setup, run_tasks_with_interleaved_chains)
+{
+    std::vector<SimulationTask> tasks;
+    for (unsigned long long seed = 0; seed < 5; ++seed)
+        tasks.push_back({2, 1, 0.5, 1, 20000, 0, seed, seed + 100});
+
+    ThreadPool pool(2);
+    std::vector<SingleRunResults> rows, interleaved_rows;
+    run_tasks(tasks, pool, [&](const SingleRunResults & results) { rows.push_back(results); });
+    run_tasks(tasks, pool, [&](const SingleRunResults & results) { interleaved_rows.push_back(results); }, false, 2);
+
+    ASSERT_EQ(interleaved_rows.size(), tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        EXPECT_EQ(interleaved_rows[i].measured_sigmaz, rows[i].measured_sigmaz);
+        EXPECT_EQ(interleaved_rows[i].N_accepted_flips, rows[i].N_accepted_flips);
+    }
+
+    EXPECT_THROW(run_tasks(tasks, pool, [](const SingleRunResults &) {}, false, 0), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the assignment of the workers to the cpus of the NUMA nodes
+ * 
+ * GIVEN: 4 cpus, 0 and 1 on node 0, 2 and 3 on node 1
+ * WHEN: plan_worker_placement is called for 5 workers
+ * THEN: the workers alternate between the nodes (0, 2, 1, 3), the cpus are then reused cyclically, and invalid inputs are rejected
+ */
+TEST(Affinity, placement_alternates_numa_nodes)
+{
+    std::vector<WorkerPlacement> placements = plan_worker_placement(5, {0, 1, 2, 3}, {0, 0, 1, 1});
+
+    ASSERT_EQ(placements.size(), 5);
+    std::vector<int> expected_cpus = {0, 2, 1, 3, 0};
+    std::vector<int> expected_nodes = {0, 1, 0, 1, 0};
+    for (int i = 0; i < 5; ++i)
+    {
+        EXPECT_EQ(placements[i].worker, i);
+        EXPECT_EQ(placements[i].cpu, expected_cpus[i]);
+        EXPECT_EQ(placements[i].node, expected_nodes[i]);
+        EXPECT_FALSE(placements[i].pinned);
+    }
+
+    EXPECT_THROW(plan_worker_placement(2, {}, {}), std::invalid_argument);
+    EXPECT_THROW(plan_worker_placement(2, {0, 1}, {0}), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks that the workers of a pinned pool run on the cpus allowed to the process, as reported by the pool
+ * 
+ * GIVEN: a ThreadPool with 2 pinned workers
+ * WHEN: jobs reporting the cpu on which they run are executed
+ * THEN: there is one placement per worker on an allowed cpu, and the jobs run on the cpus of the pinned workers
+ */
+TEST(Affinity, pinned_pool_runs_on_allowed_cpus)
+{
+    std::vector<int> cpus = allowed_cpus();
+    ASSERT_FALSE(cpus.empty());
+
+    ThreadPool pool(2, true);
+    ASSERT_EQ(pool.placements().size(), 2);
+
+    std::vector<int> pinned_cpus;
+    for (const auto & placement : pool.placements())
+    {
+        EXPECT_NE(std::find(cpus.begin(), cpus.end(), placement.cpu), cpus.end());
+        if (placement.pinned) pinned_cpus.push_back(placement.cpu);
+    }
+
+    //the check is possible only if both workers were pinned, and the cpu can be read
+    if (pinned_cpus.size() == 2 && current_cpu() >= 0)
+        for (int i = 0; i < 10; ++i)
+        {
+            int cpu = pool.submit([]() { return current_cpu(); }).get();
+            EXPECT_NE(std::find(pinned_cpus.begin(), pinned_cpus.end(), cpu), pinned_cpus.end());
+        }
+
+    EXPECT_TRUE(ThreadPool(2).placements().empty());
+}
+
+
+/**
+ * @brief This test checks that the per-chain statistics occupy whole cache lines, so that chains on different threads never share one
+ * 
+ * GIVEN: an array of ChainStatistics, as they would be laid out by the workers
+ * WHEN: the addresses of consecutive elements are compared
+ * THEN: each element starts at a cache line boundary, and no two elements share a cache line
+ */
+TEST(Simulation, chain_statistics_are_cache_line_isolated)
+{
+    EXPECT_EQ(alignof(ChainStatistics), CACHE_LINE_SIZE);
+    EXPECT_EQ(sizeof(ChainStatistics) % CACHE_LINE_SIZE, 0);
+
+    std::vector<ChainStatistics> statistics(4);
+    for (size_t i = 0; i < statistics.size(); ++i)
+    {
+        auto address = reinterpret_cast<std::uintptr_t>(&statistics[i]);
+        EXPECT_EQ(address % CACHE_LINE_SIZE, 0);
+        if (i > 0)
+        {
+            auto last_byte_of_previous = reinterpret_cast<std::uintptr_t>(&statistics[i-1]) + sizeof(ChainStatistics) - 1;
+            EXPECT_NE(last_byte_of_previous / CACHE_LINE_SIZE, address / CACHE_LINE_SIZE);
+        }
+    }
+}
+
+
+/**
+ * @brief This test checks that runs executed concurrently on all the cores give the same results as when run alone
+ * 
+ * GIVEN: one run per core (at least 4), with different seeds
+ * WHEN: they are executed by run_tasks on a pool with one worker per run, and then one by one
+ * THEN: the results are identical, since every chain only writes to its own state
+ */
+TEST(Simulation, concurrent_runs_give_same_results)
+{
+    int N_runs = std::max(4u, std::thread::hardware_concurrency());
+    std::vector<SimulationTask> tasks;
+    for (int i = 0; i < N_runs; ++i)
+        tasks.push_back({2, 1, 0.5, 1, 50000, 0, (unsigned long long) i, (unsigned long long) i + 1000, DiagramEngine::FLAT});
+
+    ThreadPool pool(N_runs);
+    std::vector<SingleRunResults> rows;
+    run_tasks(tasks, pool, [&](const SingleRunResults & results) { rows.push_back(results); });
+
+    for (int i = 0; i < N_runs; ++i)
+    {
+        SingleRunResults single = run_simulation(tasks[i]);
+        EXPECT_EQ(rows[i].measured_sigmaz, single.measured_sigmaz);
+        EXPECT_EQ(rows[i].N_accepted_removesegment, single.N_accepted_removesegment);
+    }
+}
+
+
+/**
+ * @brief This test checks that the exact sum does not depend on the order of the additions, nor on the split into partial sums
+ * 
+ * GIVEN: values in [-1, 1] with very different magnitudes, whose floating point sum depends on the order
+ * WHEN: they are summed forward, backward, and split into three partial sums that are merged
+ * THEN: the three results are bit-identical, and equal to the exact sum within the fixed point resolution
+ */
+TEST(Accumulators, bounded_exact_sum_is_order_independent)
+{
+    std::vector<double> values;
+    for (int i = 0; i < 1000; ++i) values.push_back((i % 2 ? -1 : 1) * (i % 7 == 0 ? 1 : 1e-9 * i) );
+
+    BoundedExactSum forward, backward, merged;
+    for (double value : values) forward.add(value);
+    for (auto it = values.rbegin(); it != values.rend(); ++it) backward.add(*it);
+
+    std::vector<BoundedExactSum> partial(3);
+    for (size_t i = 0; i < values.size(); ++i) partial[i % 3].add(values[i]);
+    merged.merge(partial[2]);
+    merged.merge(partial[0]);
+    merged.merge(partial[1]);
+
+    EXPECT_EQ(forward.value(), backward.value());
+    EXPECT_EQ(forward.value(), merged.value());
+
+    long double exact = 0;
+    for (double value : values) exact += value;
+    EXPECT_NEAR(forward.value(), (double) exact, 1e-12);
+
+    BoundedExactSum negative;
+    negative.add(-1e-15);
+    EXPECT_NEAR(negative.value(), -1e-15, 1e-18);
+
+    EXPECT_THROW(forward.add(1.5), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks that a sweep with a base seed is reproducible, independently of the number of threads
+ * 
+ * GIVEN: the settings of a sweep with a base seed and 2 samples per point
+ * WHEN: the tasks are enumerated twice, and run on 1 and on 3 threads
+ * THEN: the seeds are the same in both enumerations and different among the runs, and the results are bit-identical
+ */
+TEST(Setup, sweep_with_seed_is_reproducible)
+{
+    json settings = json::parse(R"({"CALC_TYPE": "sweep", "beta": 2, "GAMMA": 1, "H_min": -0.5, "H_max": 0.5, "H_step": 0.5,
+        "N_total_steps": 20000, "samples_per_point": 2, "seed": 42, "diagram_engine": "flat"})");
+
+    std::vector<SimulationTask> tasks = enumerate_tasks(settings);
+    std::vector<SimulationTask> tasks_again = enumerate_tasks(settings);
+    ASSERT_EQ(tasks.size(), 6);
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        EXPECT_EQ(tasks[i].update_choice_seed, tasks_again[i].update_choice_seed);
+        EXPECT_EQ(tasks[i].diagram_seed, tasks_again[i].diagram_seed);
+        EXPECT_NE(tasks[i].update_choice_seed, tasks[i].diagram_seed);
+        if (i > 0) { EXPECT_NE(tasks[i].update_choice_seed, tasks[i-1].update_choice_seed); }
+    }
+
+    std::vector<SingleRunResults> rows_1, rows_3;
+    ThreadPool pool_1(1), pool_3(3);
+    run_tasks(tasks, pool_1, [&](const SingleRunResults & results) { rows_1.push_back(results); });
+    run_tasks(tasks_again, pool_3, [&](const SingleRunResults & results) { rows_3.push_back(results); });
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        EXPECT_EQ(rows_1[i].measured_sigmax, rows_3[i].measured_sigmax);
+        EXPECT_EQ(rows_1[i].measured_sigmaz, rows_3[i].measured_sigmaz);
+    }
+}
+
+
+/**
+ * @brief This test checks that the observables of the measurement pipeline do not depend on the number of measurement threads
+ * 
+ * GIVEN: the same run with 1 and with 3 measurement threads
+ * WHEN: run_simulation is executed
+ * THEN: the measured correlation functions are bit-identical
+ */
+TEST(Measurements, pipeline_is_independent_of_thread_count)
+{
+    MeasurementOptions measurements;
+    measurements.correlation_bins = 5;
+    measurements.measure_interval = 7;
+
+    measurements.N_measurement_threads = 1;
+    SingleRunResults results_1 = run_simulation(2, 1, 0.5, 1, 100000, 0, 31, 32, DiagramEngine::FLAT, {}, 0, measurements);
+    measurements.N_measurement_threads = 3;
+    SingleRunResults results_3 = run_simulation(2, 1, 0.5, 1, 100000, 0, 31, 32, DiagramEngine::FLAT, {}, 0, measurements);
+
+    EXPECT_EQ(results_1.observables.correlation_zz, results_3.observables.correlation_zz);
+}
+
+
+/**
+ * @brief This test checks that the multi-histogram solver gives the same results for any number of threads
+ * 
+ * GIVEN: the histograms of three runs at beta = 6, with enough cells to be split in several chunks
+ * WHEN: the equations are solved with pools of 1 and 3 threads
+ * THEN: the partition functions and the evaluated magnetizations are bit-identical
+ */
+TEST(MBAR, solver_is_independent_of_thread_count)
+{
+    std::vector<SufficientStatisticsHistogram> histograms;
+    std::vector<double> H_values = {-0.3, 0, 0.3}, GAMMA_values = {1.5, 1.5, 1.5};
+    for (size_t k = 0; k < H_values.size(); ++k)
+        histograms.push_back(run_simulation(6, 1, H_values[k], GAMMA_values[k], 200000, 1000, k, k + 10, DiagramEngine::FLAT, {}, 200).histogram);
+
+    ThreadPool pool_1(1), pool_3(3);
+    MultiHistogramSolver solver_1(histograms, H_values, GAMMA_values, pool_1), solver_3(histograms, H_values, GAMMA_values, pool_3);
+    solver_1.solve();
+    solver_3.solve();
+
+    EXPECT_EQ(solver_1.log_partition_functions(), solver_3.log_partition_functions());
+    MultiHistogramEstimate estimate_1 = solver_1.evaluate(0.1, 1.4), estimate_3 = solver_3.evaluate(0.1, 1.4);
+    EXPECT_EQ(estimate_1.sigmax, estimate_3.sigmax);
+    EXPECT_EQ(estimate_1.sigmaz, estimate_3.sigmaz);
+}
+
+
+/**
+ * @brief This test checks the compensated sum on a sequence with catastrophic cancellation
+ * 
+ * GIVEN: the values 1, 1e100, 1, -1e100
+ * WHEN: they are added to a CompensatedSum and to a plain double
+ * THEN: the compensated sum is exactly 2, while the plain sum is 0; merging two partial sums also gives 2
+ */
+TEST(Accumulators, compensated_sum_recovers_cancellation)
+{
+    CompensatedSum sum, first_half, second_half;
+    double plain = 0;
+    for (double value : {1., 1e100, 1., -1e100})
+    {
+        sum.add(value);
+        plain += value;
+    }
+    EXPECT_EQ(sum.value(), 2);
+    EXPECT_EQ(plain, 0);
+
+    first_half.add(1);
+    first_half.add(1e100);
+    second_half.add(1);
+    second_half.add(-1e100);
+    first_half.merge(second_half);
+    EXPECT_EQ(first_half.value(), 2);
+}
+
+
+/**
+ * @brief This test checks that the blocked sum keeps full precision for long sequences
+ * 
+ * GIVEN: 10^7 copies of the value 0.1 (not exactly representable)
+ * WHEN: they are summed with a BlockedSum and with a plain double
+ * THEN: the relative error of the blocked sum is bounded by that of a single block (BLOCKED_SUM_BLOCK_SIZE * epsilon),
+ * while the plain sum has a much larger error
+ */
+TEST(Accumulators, blocked_sum_keeps_precision)
+{
+    const long N_values = 10000000;
+    BlockedSum blocked;
+    double plain = 0;
+    for (long i = 0; i < N_values; ++i)
+    {
+        blocked.add(0.1);
+        plain += 0.1;
+    }
+
+    long double exact = N_values * (long double) 0.1;
+    double blocked_error = std::abs(blocked.value() - (double) exact);
+    double plain_error = std::abs(plain - (double) exact);
+
+    EXPECT_LT(blocked_error / (double) exact, BLOCKED_SUM_BLOCK_SIZE * std::numeric_limits<double>::epsilon());
+    EXPECT_GT(plain_error, 100 * blocked_error);
+}
+
+
+/**
+ * @brief This test checks the exact quantiles and the sigma_z resolved by order of the order histogram
+ * 
+ * GIVEN: 100 samples, 50 at order 0 with sigma_z = 1, 49 at order 2 with sigma_z = -0.5, and 1 at order 6
+ * WHEN: the distribution is extracted from the histogram
+ * THEN: the counts and the averages of sigma_z are those of the samples, p50 = 0, p99 = 2, p99.9 = 6,
+ * and a probability outside (0, 1] throws an std::invalid_argument exception
+ */
+TEST(OrderStatistics, quantiles_and_sigmaz_by_order)
+{
+    OrderHistogram histogram;
+    for (int i = 0; i < 50; ++i) histogram.add_sample(0, 1);
+    for (int i = 0; i < 49; ++i) histogram.add_sample(2, -0.5);
+    histogram.add_sample(6, 0.25);
+
+    OrderDistribution distribution = histogram.distribution();
+    EXPECT_EQ(distribution.N_samples(), 100);
+    EXPECT_EQ(distribution.counts, (std::vector<unsigned long long>{50, 49, 0, 1}));
+    EXPECT_EQ(distribution.sigmaz, (std::vector<double>{1, -0.5, 0, 0.25}));
+
+    EXPECT_EQ(distribution.quantile(0.5), 0);
+    EXPECT_EQ(distribution.quantile(0.99), 2);
+    EXPECT_EQ(distribution.quantile(0.999), 6);
+    EXPECT_EQ(distribution.quantile(1), 6);
+    EXPECT_EQ(OrderDistribution().quantile(0.5), 0);
+    EXPECT_THROW(distribution.quantile(0), std::invalid_argument);
+    EXPECT_THROW(distribution.quantile(1.5), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the order distribution collected by run_simulation
+ * 
+ * GIVEN: a run with an average order of a few units
+ * WHEN: it is executed, and mirrored in H
+ * THEN: the histogram counts all the measures, the average order is not truncated and agrees with the exact one,
+ * the median agrees with the exact median, the sigma_z averaged over the orders gives measured_sigmaz,
+ * and the mirrored results have the opposite sigma_z at each order
+ */
+TEST(Simulation, order_distribution_agrees_with_exact)
+{
+    double beta = 2, H = 0.5, GAMMA = 1.5;
+    SingleRunResults results = run_simulation(beta, 1, H, GAMMA, 2000000, 10000, 11, 12);
+    const OrderDistribution & distribution = results.order_distribution;
+
+    EXPECT_EQ(distribution.N_samples(), results.N_measures);
+    EXPECT_NEAR(results.avg_diagram_order, exact_average_order(beta, H, GAMMA), 0.05);
+    EXPECT_NE(results.avg_diagram_order, std::floor(results.avg_diagram_order));
+    EXPECT_NEAR((double) distribution.quantile(0.5), (double) exact_order_quantile(0.5, beta, H, GAMMA), 2);
+    EXPECT_LE(distribution.quantile(0.999), results.max_diagram_order);
+
+    double sigmaz = 0;
+    for (size_t i = 0; i < distribution.counts.size(); ++i) sigmaz += distribution.counts[i] * distribution.sigmaz[i];
+    EXPECT_NEAR(sigmaz / results.N_measures, results.measured_sigmaz, 1e-12);
+
+    SingleRunResults mirrored = results.mirrored(true, false);
+    for (size_t i = 0; i < distribution.sigmaz.size(); ++i)
+        EXPECT_EQ(mirrored.order_distribution.sigmaz[i], -distribution.sigmaz[i]);
+}
+
+
+/**
+ * @brief This test checks that all the variants of the SIMD search kernels supported by the CPU give the same index of the standard library
+ * 
+ * GIVEN: sorted arrays of random times with sizes from 0 to 200 (crossing SIMD_SEARCH_BLOCK and the vector widths),
+ * and values equal to the elements, between them, and outside the array
+ * WHEN: they are searched with every supported variant of simd_upper_bound and simd_lower_bound
+ * THEN: the indices are equal to those of std::upper_bound and std::lower_bound
+ */
+TEST(Simd, search_variants_match_standard_library)
+{
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    for (size_t n = 0; n <= 200; ++n)
+    {
+        std::vector<double> vertices(n);
+        for (auto & vertex : vertices) vertex = uniform(generator);
+        std::sort(vertices.begin(), vertices.end());
+
+        std::vector<double> values = {-1, 0.5, 2};
+        for (size_t i = 0; i < n; i += 7) values.insert(values.end(), {vertices[i], std::nextafter(vertices[i], 0.)});
+
+        for (int level = 0; level <= static_cast<int>(supported_simd_level()); ++level)
+            for (double x : values)
+            {
+                SimdLevel simd_level = static_cast<SimdLevel>(level);
+                EXPECT_EQ(simd_upper_bound(vertices.data(), n, x, simd_level), std::upper_bound(vertices.begin(), vertices.end(), x) - vertices.begin());
+                EXPECT_EQ(simd_lower_bound(vertices.data(), n, x, simd_level), std::lower_bound(vertices.begin(), vertices.end(), x) - vertices.begin());
+            }
+    }
+}
+
+
+/**
+ * @brief This test checks the selection of the variant of the SIMD kernels
+ * 
+ * GIVEN: the instruction set selected at startup
+ * WHEN: the scalar variant is selected, a run is executed, and the startup variant is selected back
+ * THEN: the selected level is reported, the results are the same of the startup variant,
+ * and invalid names or unsupported instruction sets throw an std::invalid_argument exception
+ */
+TEST(Simd, selected_variant_gives_same_results)
+{
+    SimdLevel startup_level = selected_simd_level();
+    EXPECT_LE(startup_level, supported_simd_level());
+
+    SimulationTask task {2, 1, 0.5, 1, 200000, 0, 5, 6, DiagramEngine::FLAT};
+    SingleRunResults vector_results = run_simulation(task);
+
+    select_simd_level(SimdLevel::SCALAR);
+    EXPECT_EQ(selected_simd_level(), SimdLevel::SCALAR);
+    SingleRunResults scalar_results = run_simulation(task);
+    select_simd_level(startup_level);
+
+    EXPECT_EQ(scalar_results.measured_sigmaz, vector_results.measured_sigmaz);
+    EXPECT_EQ(scalar_results.N_accepted_addsegment, vector_results.N_accepted_addsegment);
+
+    EXPECT_EQ(parse_simd_level(simd_level_name(SimdLevel::AVX2)), SimdLevel::AVX2);
+    EXPECT_THROW(parse_simd_level("avx1024"), std::invalid_argument);
+    if (supported_simd_level() < SimdLevel::AVX512)
+    {
+        EXPECT_THROW(select_simd_level(SimdLevel::AVX512), std::invalid_argument);
+    }
+}
+
+
+/**
+ * @brief This test checks the tasks of the weak scaling points
+ * 
+ * GIVEN: the tasks of a sweep with a fixed seed
+ * WHEN: the tasks of the weak scaling point with 3 threads are generated
+ * THEN: they are 3 copies of the sweep, the first with the same seeds of the sweep, and all with different seeds
+ */
+TEST(Scaling, weak_scaling_tasks_copy_the_sweep)
+{
+    json settings = {{"CALC_TYPE", "sweep"}, {"output_file", "unused.csv"}, {"beta", 1}, {"H_min", 0}, {"H_max", 1}, {"H_step", 0.5},
+        {"GAMMA", 1}, {"N_total_steps", 1000}, {"seed", 42}};
+    std::vector<SimulationTask> tasks = enumerate_tasks(settings);
+    std::vector<SimulationTask> weak_tasks = weak_scaling_tasks(tasks, 3, 42);
+
+    ASSERT_EQ(weak_tasks.size(), 3 * tasks.size());
+    for (size_t i = 0; i < weak_tasks.size(); ++i)
+    {
+        EXPECT_EQ(weak_tasks[i].H, tasks[i % tasks.size()].H);
+        if (i < tasks.size())
+        {
+            EXPECT_EQ(weak_tasks[i].update_choice_seed, tasks[i].update_choice_seed);
+        }
+        for (size_t j = 0; j < i; ++j) EXPECT_NE(weak_tasks[i].update_choice_seed, weak_tasks[j].update_choice_seed);
+    }
+    EXPECT_THROW(weak_scaling_tasks(tasks, 0, 42), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the points of the scaling benchmark
+ * 
+ * GIVEN: a small sweep, and thread counts 1 and 2
+ * WHEN: the scaling benchmark is run, and its reports are written
+ * THEN: there are a strong and a weak point for each thread count, with the expected number of runs and steps,
+ * unit speedup at 1 thread, consistent latencies and writer fractions, and the reports contain all the points
+ */
+TEST(Scaling, benchmark_reports_strong_and_weak_points)
+{
+    json settings = {{"CALC_TYPE", "sweep"}, {"output_file", "unused.csv"}, {"beta", 1}, {"H_min", 0}, {"H_max", 1}, {"H_step", 0.5},
+        {"GAMMA", 1}, {"N_total_steps", 20000}, {"scaling_threads", {2}}};
+    std::vector<ScalingPoint> points = run_scaling_benchmark(settings);
+
+    ASSERT_EQ(points.size(), 4);
+    for (const auto & point : points)
+    {
+        size_t N_copies = point.mode == "weak" ? point.N_threads : 1;
+        EXPECT_EQ(point.N_runs, 3 * N_copies);
+        EXPECT_EQ(point.N_steps, 60000 * N_copies);
+        EXPECT_GT(point.throughput, 0);
+        if (point.N_threads == 1)
+        {
+            EXPECT_DOUBLE_EQ(point.speedup, 1);
+        }
+        EXPECT_LE(point.latency_p50, point.latency_p99);
+        EXPECT_LE(point.latency_p99, point.latency_max);
+        EXPECT_GE(point.writer_fraction, 0);
+        EXPECT_LE(point.writer_fraction, 1);
+    }
+    EXPECT_EQ(points[0].mode, "strong");
+    EXPECT_EQ(points[3].mode, "weak");
+
+    std::ostringstream csv;
+    write_scaling_rows(points, csv);
+    std::string rows = csv.str();
+    EXPECT_EQ(std::count(rows.begin(), rows.end(), '\n'), 4);
+    EXPECT_EQ(scaling_report(points, settings)["points"].size(), 4);
+    EXPECT_EQ(scaling_report(points, settings)["seed"], SCALING_SEED_DEFAULT);
+
+    settings["CALC_TYPE"] = "single";
+    EXPECT_THROW(run_scaling_benchmark(settings), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the points of the kernel benchmark
+ * 
+ * GIVEN: a small sweep over two values of H
+ * WHEN: the kernel benchmark is run twice, and its report is written
+ * THEN: each parameter point is run with both engines and both versions of the updates, with the same counts for both engines
+ * and for both executions of the benchmark, the delayed-rejection updates accept more segments per attempt,
+ * and the ratios and timings are consistent with the counts
+ */
+TEST(KernelBenchmark, reports_both_engines_and_kernels)
+{
+    json settings = {{"CALC_TYPE", "sweep"}, {"output_file", "unused.csv"}, {"beta", 3}, {"H_min", 1}, {"H_max", 2}, {"H_step", 1},
+        {"GAMMA", 1}, {"N_total_steps", 100000}};
+    std::vector<KernelBenchmarkPoint> points = run_kernel_benchmark(settings);
+    std::vector<KernelBenchmarkPoint> repeated = run_kernel_benchmark(settings);
+
+    ASSERT_EQ(points.size(), 8);
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        const auto & point = points[i];
+        EXPECT_EQ(point.engine, i % 4 < 2 ? DiagramEngine::LIST : DiagramEngine::FLAT);
+        EXPECT_EQ(point.delayed_rejection, i % 2 == 1);
+        EXPECT_DOUBLE_EQ(point.H, i < 4 ? 1 : 2);
+        EXPECT_EQ(point.N_steps, 100000);
+        EXPECT_GT(point.N_draws, point.N_steps);
+        EXPECT_DOUBLE_EQ(point.accepted_per_draw, double(point.N_accepted) / point.N_draws);
+        EXPECT_GT(point.ns_per_step, 0);
+        EXPECT_GT(point.accepted_per_ns, 0);
+        EXPECT_GT(point.ESS_per_second_sigmaz, 0);
+
+        //the engines take the same decisions, and the counts do not depend on the machine
+        EXPECT_EQ(point.N_accepted, points[i % 4 < 2 ? i + 2 : i - 2].N_accepted);
+        EXPECT_EQ(point.N_draws, repeated[i].N_draws);
+        EXPECT_EQ(point.N_accepted, repeated[i].N_accepted);
+        if (point.delayed_rejection)
+        {
+            EXPECT_GT(point.acceptance_add, points[i - 1].acceptance_add);
+        }
+    }
+
+    std::ostringstream csv;
+    write_kernel_benchmark_rows(points, csv);
+    std::string rows = csv.str();
+    EXPECT_EQ(std::count(rows.begin(), rows.end(), '\n'), 8);
+
+    settings["CALC_TYPE"] = "single";
+    EXPECT_THROW(run_kernel_benchmark(settings), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the benchmark of the cost of the statistics collected at every step
+ * 
+ * GIVEN: a small sweep over two values of H
+ * WHEN: the cost of the statistics is measured, and its report is written
+ * THEN: there is one point for each parameter point, with the samples after thermalization,
+ * positive timings and an overhead consistent with them
+ */
+TEST(KernelBenchmark, measures_the_cost_of_the_statistics)
+{
+    json settings = {{"CALC_TYPE", "sweep"}, {"output_file", "unused.csv"}, {"beta", 3}, {"H_min", 1}, {"H_max", 2}, {"H_step", 1},
+        {"GAMMA", 1}, {"N_total_steps", 100000}, {"N_thermalization_steps", 1000}};
+    std::vector<AccumulatorBenchmarkPoint> points = run_accumulator_benchmark(settings);
+
+    ASSERT_EQ(points.size(), 2);
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        const auto & point = points[i];
+        EXPECT_DOUBLE_EQ(point.H, i + 1);
+        EXPECT_EQ(point.N_samples, 99000);
+        EXPECT_GT(point.ns_per_step, 0);
+        EXPECT_GT(point.ns_per_sample_baseline, 0);
+        EXPECT_GT(point.ns_per_sample_statistics, 0);
+        EXPECT_DOUBLE_EQ(point.overhead, (point.ns_per_sample_statistics - point.ns_per_sample_baseline) / point.ns_per_step);
+    }
+
+    std::ostringstream csv;
+    write_accumulator_benchmark_rows(points, csv);
+    std::string rows = csv.str();
+    EXPECT_EQ(std::count(rows.begin(), rows.end(), '\n'), 2);
+
+    settings["CALC_TYPE"] = "single";
+    EXPECT_THROW(run_accumulator_benchmark(settings), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the errors and autocorrelation times estimated by the binning analysis
+ * 
+ * GIVEN: 2^20 uncorrelated gaussian values, and 2^20 values of an AR(1) process x_t = a x_(t-1) + noise with a = 0.9,
+ * whose integrated autocorrelation time is (1+a)/(2(1-a)) = 9.5
+ * WHEN: they are added to two binning analyses
+ * THEN: the counts and means are those of the values, the autocorrelation time is about 0.5 for the uncorrelated values
+ * and 9.5 for the correlated ones, and the effective sample size is count / (2 tau)
+ */
+TEST(Accumulators, binning_analysis_estimates_correlated_errors)
+{
+    const size_t N_values = 1 << 20;
+    std::mt19937 generator(3);
+    std::normal_distribution<double> gaussian(0, 1);
+
+    BinningAnalysis uncorrelated, correlated;
+    double x = 0, sum = 0;
+    for (size_t i = 0; i < N_values; ++i)
+    {
+        uncorrelated.add(gaussian(generator));
+        x = 0.9 * x + gaussian(generator);
+        correlated.add(x);
+        sum += x;
+    }
+
+    EXPECT_EQ(correlated.count(), N_values);
+    EXPECT_NEAR(correlated.mean(), sum / N_values, 1e-12);
+    EXPECT_NEAR(uncorrelated.autocorrelation_time(), 0.5, 0.1);
+    EXPECT_NEAR(correlated.autocorrelation_time(), 9.5, 2);
+    EXPECT_NEAR(correlated.effective_sample_size(), N_values / (2 * correlated.autocorrelation_time()), 1e-6 * N_values);
+    EXPECT_GT(correlated.error(), 3 * uncorrelated.error());
+}
+
+
+/**
+ * @brief This test checks the errors and the efficiency of the magnetizations of a run, and the choice of the update probabilities
+ * 
+ * GIVEN: the same parameter point run with the default flip probability and with flip probability 0.5
+ * WHEN: the runs are executed
+ * THEN: the magnetizations agree with the exact ones within 5 errors, the effective sample sizes are positive and at most
+ * the number of measures, the efficiency is ESS per second of run time, and a flip probability outside (0, 1) throws
+ */
+TEST(Simulation, errors_and_efficiency_of_magnetizations)
+{
+    double beta = 2, H = 0.3, GAMMA = 1;
+    SimulationTask task {beta, 1, H, GAMMA, 1000000, 10000, 21, 22, DiagramEngine::FLAT};
+    for (double flip_probability : {FLIP_PROBABILITY_DEFAULT, 0.5})
+    {
+        task.flip_probability = flip_probability;
+        SingleRunResults results = run_simulation(task);
+
+        EXPECT_NEAR(results.measured_sigmaz, exact_sigmaz(beta, H, GAMMA), 5 * results.error_sigmaz);
+        EXPECT_NEAR(results.measured_sigmax, exact_sigmax(beta, H, GAMMA), 5 * results.error_sigmax);
+        EXPECT_GT(results.ESS_sigmaz, 0);
+        EXPECT_LE(results.ESS_sigmaz, results.N_measures);
+        EXPECT_LE(results.ESS_sigmax, results.N_measures);
+        EXPECT_DOUBLE_EQ(results.ESS_per_second(results.ESS_sigmaz), results.ESS_sigmaz / (results.run_time / 1e9));
+    }
+
+    task.flip_probability = 1;
+    EXPECT_THROW(run_simulation(task), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the choices of the autotuner
+ * 
+ * GIVEN: two tasks on the same parameter point and one on another point, with the measurement pipeline enabled
+ * WHEN: they are tuned with short pilot chains
+ * THEN: each tuning has a trial for every candidate, the best trial has the highest score and is the fastest engine for its flip probability
+ * and kernels, its parameters are copied to the task and to the results of its runs, a second tuning chooses the same chain,
+ * the measure_interval is set from the autocorrelation time, the tasks of the same point get the same parameters,
+ * the seeds and number of steps are unchanged, and with symmetry sources a mirrored point is not tuned but takes the tuning of its source
+ */
+TEST(Autotune, picks_best_candidate_per_point)
+{
+    SimulationTask task {2, 1, 0.5, 1, 100000, 0, 1, 2};
+    task.measurements.correlation_bins = 4;
+    AutotuneOptions options;
+    options.pilot_steps = 20000;
+
+    TuningResult result = autotune_task(task, options);
+    ASSERT_EQ(result.trials.size(), options.engines.size() * options.flip_probabilities.size() * options.delayed_rejection.size());
+    for (const auto & trial : result.trials)
+    {
+        EXPECT_LE(trial.score(), result.trials[result.best].score());
+        //the engines give the same chain, so only their speed differs, and the fastest one is chosen
+        if (trial.flip_probability == result.trials[result.best].flip_probability && trial.delayed_rejection == result.trials[result.best].delayed_rejection)
+        {
+            EXPECT_EQ(trial.score(), result.trials[result.best].score());
+            EXPECT_LE(trial.ESS_per_second(), result.trials[result.best].ESS_per_second());
+        }
+    }
+
+    //the parameters of the chain do not depend on the run time of the pilots
+    TuningResult repeated = autotune_task(task, options);
+    EXPECT_EQ(repeated.task.flip_probability, result.task.flip_probability);
+    EXPECT_EQ(repeated.task.delayed_rejection, result.task.delayed_rejection);
+    EXPECT_EQ(repeated.task.measurements.measure_interval, result.task.measurements.measure_interval);
+    SingleRunResults tuned_run = run_simulation(result.task);
+    EXPECT_EQ(tuned_run.flip_probability, result.task.flip_probability);
+    EXPECT_EQ(tuned_run.delayed_rejection, result.task.delayed_rejection);
+    EXPECT_EQ(result.task.engine, result.trials[result.best].engine);
+    EXPECT_EQ(result.task.flip_probability, result.trials[result.best].flip_probability);
+    EXPECT_EQ(result.task.delayed_rejection, result.trials[result.best].delayed_rejection);
+    EXPECT_EQ(result.task.measurements.measure_interval, 
+        std::max(1u, (unsigned int) std::ceil(2 * result.trials[result.best].autocorrelation_time)));
+    EXPECT_EQ(result.task.N_total_steps, task.N_total_steps);
+
+    std::vector<SimulationTask> tasks = {task, task, task};
+    tasks[1].update_choice_seed = 3;
+    tasks[2].H = -0.5;
+    ThreadPool pool(2);
+    std::ostringstream log;
+    autotune_tasks(tasks, pool, options, log);
+
+    EXPECT_EQ(tasks[0].engine, tasks[1].engine);
+    EXPECT_EQ(tasks[0].flip_probability, tasks[1].flip_probability);
+    EXPECT_EQ(tasks[1].update_choice_seed, 3);
+    std::string report = log.str();
+    EXPECT_EQ(std::count(report.begin(), report.end(), '\n'), 3); //header and two parameter points
+
+    //with symmetries, the mirrored point is not tuned, and stays related to its source
+    std::vector<SimulationTask> mirrored_tasks = {task, task};
+    mirrored_tasks[1].H = -0.5;
+    std::ostringstream mirrored_log;
+    autotune_tasks(mirrored_tasks, pool, options, mirrored_log, symmetry_sources(mirrored_tasks));
+    report = mirrored_log.str();
+    EXPECT_EQ(std::count(report.begin(), report.end(), '\n'), 2); //header and one parameter point
+    EXPECT_EQ(mirrored_tasks[1].engine, mirrored_tasks[0].engine);
+    EXPECT_EQ(mirrored_tasks[1].flip_probability, mirrored_tasks[0].flip_probability);
+    EXPECT_EQ(mirrored_tasks[1].delayed_rejection, mirrored_tasks[0].delayed_rejection);
+    EXPECT_EQ(symmetry_sources(mirrored_tasks), std::vector<size_t>({0, 0}));
+    EXPECT_THROW(autotune_tasks(mirrored_tasks, pool, options, mirrored_log, {0}), std::invalid_argument);
+
+    options.engines.clear();
+    EXPECT_THROW(autotune_task(task, options), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the Gelman-Rubin R-hat and the combined error of the chains of a point
+ * 
+ * GIVEN: summaries of chains with the same mean, with different means, with means differing by a few errors, and with constant values
+ * WHEN: R-hat and the error of their average are computed
+ * THEN: R-hat is close to 1 for agreeing chains and large for disagreeing ones, also when their means differ by only a few errors
+ * (which the within-chain variance of the samples would hide), it is 1 or infinity for constant chains,
+ * the combined error is the error of the average of independent means, and invalid inputs throw
+ */
+TEST(Convergence, gelman_rubin_diagnostics)
+{
+    std::vector<ChainSummary> agreeing = {{10000, 0.5, 1, 0.01, 100, 0.01}, {10000, 0.5, 1, 0.01, 100, 0.01}, {10000, 0.5, 1, 0.02, 100, 0.04}};
+    EXPECT_NEAR(gelman_rubin(agreeing), std::sqrt(99. / 100), 1e-12);
+    EXPECT_NEAR(combined_error(agreeing), std::sqrt(0.0006) / 3, 1e-12);
+
+    std::vector<ChainSummary> disagreeing = {{10000, 0, 1, 0.01, 100, 0.01}, {10000, 1, 1, 0.01, 100, 0.01}};
+    EXPECT_GT(gelman_rubin(disagreeing), 1.1);
+
+    //5 errors apart: sqrt(0.99 + 0.00125 / 0.01), while with the variance of the samples it would be sqrt(0.9999 + 0.00125 / 1)
+    std::vector<ChainSummary> not_mixed = {{10000, 0.5, 1, 0.01, 100, 0.01}, {10000, 0.55, 1, 0.01, 100, 0.01}};
+    EXPECT_NEAR(gelman_rubin(not_mixed), std::sqrt(0.99 + 0.125), 1e-12);
+    EXPECT_GT(gelman_rubin(not_mixed), RHAT_THRESHOLD_DEFAULT);
+
+    EXPECT_EQ(gelman_rubin({{10, 1, 0, 0, 10, 0}, {10, 1, 0, 0, 10, 0}}), 1);
+    EXPECT_TRUE(std::isinf(gelman_rubin({{10, 1, 0, 0, 10, 0}, {10, -1, 0, 0, 10, 0}})));
+
+    EXPECT_THROW(gelman_rubin({{10, 1, 1, 0, 10, 1}}), std::invalid_argument);
+    EXPECT_THROW(gelman_rubin({{10, 1, 1, 0, 10, 1}, {1, 1, 1, 0, 1, 1}}), std::invalid_argument);
+    EXPECT_THROW(gelman_rubin({{10, 1, 1, 0, 10, 1}, {10, 1, 1, 0, 1, 1}}), std::invalid_argument);
+    EXPECT_THROW(ConvergenceMonitor(1, 2, 1, 0.01), std::invalid_argument);
+    EXPECT_THROW(ConvergenceMonitor(2, 2, 1, 0), std::invalid_argument);
+    EXPECT_THROW(ConvergenceMonitor(2, 2, 1, 0.01, 1), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the early stop of the chains of a point by their convergence monitor
+ * 
+ * GIVEN: the runs of a sweep with three samples per point and a reachable target error, executed in parallel,
+ * and the same runs with an unreachable target error
+ * WHEN: the runs are executed
+ * THEN: with the reachable target all the runs stop before N_total_steps, at a report of the monitor, with R-hat below the threshold,
+ * the error of their average below the target and magnetizations compatible with the exact ones;
+ * with the unreachable target all the steps are performed, and R-hat is still reported
+ */
+TEST(Simulation, monitored_chains_stop_early)
+{
+    json settings = {
+        {"CALC_TYPE", "sweep"},
+        {"beta", 2}, {"H", 0.5}, {"GAMMA", 1},
+        {"N_total_steps", 50000000}, {"N_thermalization_steps", 1000},
+        {"samples_per_point", 3},
+        {"seed", 12},
+        {"target_error", 0.003}
+    };
+    std::vector<SimulationTask> tasks = enumerate_tasks(settings);
+    ASSERT_EQ(tasks.size(), 3);
+    EXPECT_EQ(tasks[0].monitor, tasks[2].monitor);
+    EXPECT_EQ(tasks[2].monitor_chain, 2);
+
+    std::vector<SingleRunResults> results;
+    ThreadPool pool(3);
+    run_tasks(tasks, pool, [&](const SingleRunResults & result) { results.push_back(result); });
+
+    double sigmax = 0, sigmaz = 0;
+    for (const auto & result : results)
+    {
+        EXPECT_TRUE(result.stopped_early);
+        EXPECT_LT(result.N_measures, settings["N_total_steps"]);
+        EXPECT_EQ(result.N_measures % CONVERGENCE_REPORT_INTERVAL, 0);
+        sigmax += result.measured_sigmax / 3;
+        sigmaz += result.measured_sigmaz / 3;
+    }
+    EXPECT_TRUE(tasks[0].monitor->stop_requested());
+    EXPECT_LT(tasks[0].monitor->R_hat(), RHAT_THRESHOLD_DEFAULT);
+    EXPECT_NEAR(sigmax, exact_sigmax(2, 0.5, 1), 5 * 0.003);
+    EXPECT_NEAR(sigmaz, exact_sigmaz(2, 0.5, 1), 5 * 0.003);
+
+    settings["N_total_steps"] = 200000;
+    settings["target_error"] = 1e-9;
+    results = run_simulation_interleaved(enumerate_tasks(settings));
+    for (const auto & result : results)
+    {
+        EXPECT_FALSE(result.stopped_early);
+        EXPECT_EQ(result.N_measures, 200000 - 1000);
+        EXPECT_GT(result.R_hat, 0); //R-hat of the last report of the chains
+    }
+
+    settings["samples_per_point"] = 1;
+    EXPECT_THROW(enumerate_tasks(settings), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks that the early stop of the monitored chains does not depend on their scheduling
+ * 
+ * GIVEN: a sweep over two points with three samples per point and a reachable target error, with a fixed seed
+ * WHEN: the runs are executed on one worker, on three workers with interleaved chains, and with each chain of a point on its own thread
+ * THEN: the results are the same in all the cases, the chains of a point stop at the same step, and the warm-started runs cannot be monitored
+ */
+TEST(Simulation, monitored_chains_stop_reproducibly)
+{
+    json settings = {
+        {"CALC_TYPE", "sweep"},
+        {"beta", 2}, {"H_min", 0.4}, {"H_max", 0.5}, {"H_step", 0.1}, {"GAMMA", 1},
+        {"N_total_steps", 50000000}, {"N_thermalization_steps", 1000},
+        {"samples_per_point", 3},
+        {"seed", 21},
+        {"target_error", 0.004}
+    };
+
+    auto run = [&](unsigned int N_threads, unsigned int interleaved_chains)
+    {
+        std::vector<SingleRunResults> results;
+        ThreadPool pool(N_threads);
+        run_tasks(enumerate_tasks(settings), pool, [&](const SingleRunResults & result) { results.push_back(result); }, false, interleaved_chains);
+        return results;
+    };
+    std::vector<SingleRunResults> serial = run(1, 1);
+    std::vector<SingleRunResults> parallel = run(3, 4);
+
+    //the chains of the first point on separate threads, waiting for each other at the reports
+    std::vector<SimulationTask> tasks = enumerate_tasks(settings);
+    std::vector<std::optional<SingleRunResults>> threaded(3);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 3; ++i) threads.emplace_back([&, i]() { threaded[i] = run_simulation(tasks[i]); });
+    for (auto & thread : threads) thread.join();
+
+    ASSERT_EQ(serial.size(), 6);
+    ASSERT_EQ(parallel.size(), 6);
+    for (size_t i = 0; i < serial.size(); ++i)
+    {
+        EXPECT_TRUE(serial[i].stopped_early);
+        EXPECT_EQ(serial[i].N_measures, serial[i / 3 * 3].N_measures);
+        EXPECT_EQ(serial[i].N_measures, parallel[i].N_measures);
+        EXPECT_EQ(serial[i].measured_sigmaz, parallel[i].measured_sigmaz);
+        EXPECT_EQ(serial[i].R_hat, parallel[i].R_hat);
+        if (i < 3)
+        {
+            EXPECT_EQ(serial[i].N_measures, threaded[i]->N_measures);
+            EXPECT_EQ(serial[i].measured_sigmax, threaded[i]->measured_sigmax);
+            EXPECT_EQ(serial[i].R_hat, threaded[i]->R_hat);
+        }
+    }
+
+    ThreadPool pool(1);
+    EXPECT_THROW(run_tasks_warm_started(tasks, pool, [](const SingleRunResults &) {}), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks that the chains of a monitored point run in parallel
+ * 
+ * GIVEN: a point with three monitored chains, and a pool with as many workers
+ * WHEN: the runs are executed
+ * THEN: the three chains are started by three different workers, and they stop at the same step
+ */
+TEST(Simulation, monitored_chains_run_on_different_threads)
+{
+    json settings = {
+        {"CALC_TYPE", "sweep"},
+        {"beta", 2}, {"H", 0.4}, {"GAMMA", 1},
+        {"N_total_steps", 50000000}, {"N_thermalization_steps", 1000},
+        {"samples_per_point", 3},
+        {"seed", 21},
+        {"target_error", 0.004}
+    };
+
+    std::vector<SingleRunResults> results;
+    {
+        ThreadPool pool(3);
+        run_tasks(enumerate_tasks(settings), pool, [&](const SingleRunResults & result) { results.push_back(result); }, false, 4);
+    }
+
+    ASSERT_EQ(results.size(), 3);
+    EXPECT_NE(results[0].worker_thread, results[1].worker_thread);
+    EXPECT_NE(results[0].worker_thread, results[2].worker_thread);
+    EXPECT_NE(results[1].worker_thread, results[2].worker_thread);
+    for (const auto & result : results)
+    {
+        EXPECT_NE(result.worker_thread, std::this_thread::get_id());
+        EXPECT_TRUE(result.stopped_early);
+        EXPECT_EQ(result.N_measures, results.front().N_measures);
+    }
+}
+
+
+/**
+ * @brief This test checks the coarse-to-fine ordering of the points of a sweep
+ * 
+ * GIVEN: a sweep over a 5x5 grid of H and GAMMA, with two samples per point and a base seed, in nested and progressive order
+ * WHEN: the tasks are enumerated
+ * THEN: the van der Corput order spreads the first indices over the axis, the first four points of the progressive order are
+ * the corners of the grid, the two orders contain the same runs with the same seeds, and the samples of a point are consecutive
+ */
+TEST(Setup, progressive_task_order_is_coarse_to_fine)
+{
+    EXPECT_EQ(van_der_corput_order(5), std::vector<size_t>({0, 4, 2, 1, 3}));
+    EXPECT_EQ(van_der_corput_order(8), std::vector<size_t>({0, 4, 2, 6, 1, 5, 3, 7}));
+
+    json settings = {
+        {"CALC_TYPE", "sweep"},
+        {"beta", 2},
+        {"H_min", -1}, {"H_max", 1}, {"H_step", 0.5},
+        {"GAMMA_min", 0.5}, {"GAMMA_max", 2.5}, {"GAMMA_step", 0.5},
+        {"N_total_steps", 1000},
+        {"samples_per_point", 2},
+        {"seed", 3}
+    };
+    std::vector<SimulationTask> nested = enumerate_tasks(settings);
+    settings["task_order"] = "progressive";
+    std::vector<SimulationTask> progressive = enumerate_tasks(settings);
+    ASSERT_EQ(nested.size(), 50);
+    ASSERT_EQ(progressive.size(), nested.size());
+
+    for (size_t i = 0; i < 8; i += 2)
+    {
+        EXPECT_TRUE(std::abs(progressive[i].H) == 1) << i;
+        EXPECT_TRUE(progressive[i].GAMMA == 0.5 || progressive[i].GAMMA == 2.5) << i;
+        EXPECT_EQ(progressive[i].H, progressive[i + 1].H);
+        EXPECT_EQ(progressive[i].GAMMA, progressive[i + 1].GAMMA);
+    }
+
+    auto key = [](const SimulationTask & task) { return std::make_tuple(task.H, task.GAMMA, task.update_choice_seed, task.diagram_seed); };
+    std::vector<std::tuple<double, double, unsigned long long, unsigned long long>> nested_keys, progressive_keys;
+    for (size_t i = 0; i < nested.size(); ++i)
+    {
+        nested_keys.push_back(key(nested[i]));
+        progressive_keys.push_back(key(progressive[i]));
+    }
+    EXPECT_NE(nested_keys, progressive_keys);
+    std::sort(nested_keys.begin(), nested_keys.end());
+    std::sort(progressive_keys.begin(), progressive_keys.end());
+    EXPECT_EQ(nested_keys, progressive_keys);
+
+    settings["task_order"] = "random";
+    EXPECT_THROW(enumerate_tasks(settings), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the execution of a TaskGraph with dependencies on several workers
+ * 
+ * GIVEN: a graph of generic nodes, with many independent nodes, a node depending on all of them, and a chain of write nodes
+ * WHEN: it is executed on a pool of 4 workers
+ * THEN: every node is executed once, after its dependencies, the writes are in order, a node throwing an exception stops the execution
+ * and the exception is rethrown, and invalid dependencies throw
+ */
+TEST(TaskGraph, respects_dependencies_and_write_order)
+{
+    TaskGraph graph;
+    std::mutex mutex;
+    std::vector<TaskId> executed;
+    auto record = [&](TaskId id) { return [&, id]() { std::lock_guard<std::mutex> lock(mutex); executed.push_back(id); }; };
+
+    std::vector<TaskId> independent;
+    for (int i = 0; i < 200; ++i) independent.push_back(graph.add(TaskKind::GENERIC, record(graph.size())));
+    TaskId last = graph.add(TaskKind::GENERIC, record(graph.size()), independent);
+
+    std::vector<int> written;
+    SimulationTask task {1, 1, 0.5, 1, 1000, 0, 1, 2};
+    TaskId chain = graph.add_run_chain(task, {last});
+    for (int i = 0; i < 20; ++i) graph.add_write(chain, [&written, i](const SingleRunResults &) { written.push_back(i); });
+    EXPECT_EQ(graph.kind(chain), TaskKind::RUN_CHAIN);
+
+    ThreadPool pool(4);
+    graph.execute(pool);
+    ASSERT_EQ(executed.size(), 201);
+    EXPECT_EQ(executed.back(), last);
+    std::sort(executed.begin(), executed.end());
+    EXPECT_EQ(std::unique(executed.begin(), executed.end()), executed.end());
+    for (int i = 0; i < 20; ++i) EXPECT_EQ(written[i], i);
+    EXPECT_EQ(graph.results(chain).N_measures, 1000);
+
+    TaskGraph failing;
+    bool dependent_executed = false;
+    TaskId thrower = failing.add(TaskKind::GENERIC, []() { throw std::runtime_error("failed node"); });
+    failing.add(TaskKind::GENERIC, [&]() { dependent_executed = true; }, {thrower});
+    EXPECT_THROW(failing.execute(pool), std::runtime_error);
+    EXPECT_FALSE(dependent_executed);
+
+    EXPECT_THROW(failing.add(TaskKind::GENERIC, []() {}, {5}), std::invalid_argument);
+    EXPECT_THROW(failing.add_continue_chain(thrower, task), std::invalid_argument);
+    EXPECT_THROW(failing.results(thrower), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the chain, continue chain and merge nodes of a TaskGraph, and the warm-started execution of a sweep
+ * 
+ * GIVEN: a chain at beta = 2, continued with 0 steps at beta = 4 and with some steps at beta = 2, whose magnetizations are merged,
+ * and the runs of a sweep with two samples per point
+ * WHEN: they are executed
+ * THEN: the continued chain starts from the final diagram of the first one, with the times rescaled to the new beta,
+ * the merge node receives the results of its inputs, and the results of the warm-started sweep are written in the order of the tasks
+ */
+TEST(TaskGraph, continued_chains_start_from_final_diagram)
+{
+    TaskGraph graph;
+    SimulationTask task {2, 1, 0.5, 1, 10000, 0, 1, 2};
+    TaskId first = graph.add_run_chain(task);
+
+    SimulationTask rescaled = task;
+    rescaled.beta = 4;
+    rescaled.N_total_steps = 0;
+    TaskId second = graph.add_continue_chain(first, rescaled);
+    TaskId third = graph.add_continue_chain(first, task);
+    TaskId merged = graph.add_merge({first, third}, [](const std::vector<SingleRunResults> & inputs)
+    {
+        SingleRunResults results = inputs[0];
+        results.measured_sigmaz = 0.5 * (inputs[0].measured_sigmaz + inputs[1].measured_sigmaz);
+        return results;
+    });
+
+    ThreadPool pool(2);
+    graph.execute(pool);
+
+    const DiagramSnapshot & final_diagram = graph.results(first).final_diagram;
+    const DiagramSnapshot & continued = graph.results(second).final_diagram;
+    ASSERT_GT(final_diagram.vertices.size(), 0);
+    ASSERT_EQ(continued.vertices.size(), final_diagram.vertices.size());
+    EXPECT_EQ(continued.s0, final_diagram.s0);
+    for (size_t i = 0; i < continued.vertices.size(); ++i) EXPECT_DOUBLE_EQ(continued.vertices[i], 2 * final_diagram.vertices[i]);
+    EXPECT_DOUBLE_EQ(graph.results(merged).measured_sigmaz, 0.5 * (graph.results(first).measured_sigmaz + graph.results(third).measured_sigmaz));
+
+    json settings = {
+        {"CALC_TYPE", "sweep"},
+        {"beta", 2}, {"H_min", -0.5}, {"H_max", 0.5}, {"H_step", 0.5},
+        {"GAMMA_min", 0.5}, {"GAMMA_max", 1.5}, {"GAMMA_step", 0.5},
+        {"N_total_steps", 20000}, {"samples_per_point", 2}, {"seed", 4}
+    };
+    std::vector<SimulationTask> tasks = enumerate_tasks(settings);
+    std::vector<std::string> rows;
+    run_tasks_warm_started(tasks, pool, [&](const SingleRunResults & results)
+    {
+        std::ostringstream row;
+        row << results;
+        rows.push_back(row.str());
+    });
+    ASSERT_EQ(rows.size(), tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        std::ostringstream prefix;
+        prefix << tasks[i].beta << ',' << tasks[i].initial_s0 << ',' << tasks[i].H << ',' << tasks[i].GAMMA << ',';
+        EXPECT_EQ(rows[i].substr(0, prefix.str().size()), prefix.str());
+    }
+}
+
+
+/**
+ * @brief This test checks the cloning of diagrams through snapshots
+ * 
+ * GIVEN: a FlatDiagram and a Diagram evolved for some steps with the same seed, and a copy of the FlatDiagram
+ * WHEN: snapshots of them are taken, and restored into other diagrams (also of the other engine)
+ * THEN: the snapshots are equal, the restored diagrams have the same state, a diagram restored into a copy of the original
+ * (with the same random number generator) continues identically, and invalid snapshots throw
+ */
+TEST(TestDiagram, snapshots_clone_the_state)
+{
+    FlatDiagram flat(2, 1, 0.5, 1, {}, 7);
+    Diagram list(2, 1, 0.5, 1, {}, 7);
+    for (int i = 0; i < 2000; ++i)
+    {
+        flat.attempt_add_segment(); flat.attempt_spin_flip(); flat.attempt_remove_segment();
+        list.attempt_add_segment(); list.attempt_spin_flip(); list.attempt_remove_segment();
+    }
+    ASSERT_GT(flat.order(), 0);
+
+    DiagramSnapshot snapshot = flat.snapshot();
+    DiagramSnapshot list_snapshot;
+    list.snapshot_into(list_snapshot);
+    EXPECT_EQ(snapshot.s0, list_snapshot.s0);
+    EXPECT_EQ(snapshot.vertices, list_snapshot.vertices);
+    EXPECT_TRUE(snapshot.is_valid(2));
+
+    Diagram restored_list(2, -1, 0.5, 1, {0.1, 0.2, 0.3, 0.4}, 1);
+    restored_list.restore(snapshot);
+    EXPECT_TRUE(lists_are_float_equal(restored_list.vertices(), list.vertices(), EPSILON));
+    EXPECT_EQ(restored_list.get_s0(), list.get_s0());
+
+    //a copy of the diagram with a different state, restored to the snapshot, continues as the original
+    FlatDiagram copy = flat;
+    copy.restore({-snapshot.s0, {}});
+    copy.restore(snapshot);
+    for (int i = 0; i < 1000; ++i)
+    {
+        EXPECT_EQ(copy.attempt_add_segment(), flat.attempt_add_segment());
+        EXPECT_EQ(copy.attempt_remove_segment(), flat.attempt_remove_segment());
+    }
+    EXPECT_EQ(copy.vertices(), flat.vertices());
+
+    EXPECT_THROW(copy.restore({0, {}}), std::invalid_argument);
+    EXPECT_THROW(copy.restore({1, {0.1}}), std::invalid_argument);
+    EXPECT_THROW(copy.restore({1, {0.2, 0.1}}), std::invalid_argument);
+    EXPECT_THROW(restored_list.restore({1, {0.1, 2.5}}), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the deterministic part of the worm updates
+ * 
+ * GIVEN: a WormDiagram_core with two segments
+ * WHEN: the worm is inserted, its ends are moved (also across the vertices and across each other) and it is removed
+ * THEN: each acceptance rate is the ratio of the weights of the configurations after and before the update (times beta^2 for the insertion,
+ * whose ends are extracted with density 1/beta^2, and divided by beta^2 for the removal), the ends are kept
+ * in the sorted array of the vertices, the segments ending on a worm end are not removed, and the removal restores the original diagram
+ */
+TEST(Worm, updates_respect_the_weights)
+{
+    WormDiagram_core diagram(2, 1, 0.4, 0.7, {0.2, 0.5, 1.1, 1.6}, 1.5);
+    WormDiagram_core original = diagram;
+    EXPECT_THROW(WormDiagram_core(2, 1, 0.4, 0.7, {}, 0), std::invalid_argument);
+
+    double value = diagram.value();
+    double rate = diagram.acceptance_rate_worm_insert(1.3, 0.3);
+    ASSERT_TRUE(diagram.attempt_worm_insert(1.3 / 2, 0.3 / 2, 0));
+    EXPECT_TRUE(diagram.is_open());
+    EXPECT_EQ(diagram.ordinary_order(), 4);
+    EXPECT_EQ(diagram.vertices(), std::vector<double>({0.2, 0.3, 0.5, 1.1, 1.3, 1.6}));
+    EXPECT_NEAR(diagram.worm_tau(), 2 - 1.0, EPSILON);
+    EXPECT_NEAR(rate, 2 * 2 * diagram.value() / value, EPSILON);
+    EXPECT_FALSE(diagram.attempt_worm_insert(0.1, 0.2, 0));
+
+    //moves of the head forward across two vertices and the tail, and of the tail backward before the first vertex
+    for (auto [RN1, tau_new] : std::vector<std::tuple<double, double>>{{0.2, 1.8}, {0.7, 0.1}, {0.2, 0.9}})
+    {
+        value = diagram.value();
+        double tau_old = RN1 < 0.5 ? diagram.get_tau_head() : diagram.get_tau_tail();
+        rate = diagram.acceptance_rate_worm_move(tau_old, tau_new);
+        ASSERT_TRUE(diagram.attempt_worm_move(RN1, tau_new / 2, 0));
+        EXPECT_NEAR(rate, diagram.value() / value, EPSILON);
+        EXPECT_TRUE(std::is_sorted(diagram.vertices().begin(), diagram.vertices().end()));
+        EXPECT_EQ(diagram.order(), 6);
+    }
+    EXPECT_EQ(diagram.vertices(), std::vector<double>({0.1, 0.2, 0.5, 0.9, 1.1, 1.6}));
+
+    //the segments (0.1, 0.2) and (0.5, 0.9) end on the worm ends, while (1.1, 1.6) can be removed
+    EXPECT_FALSE(diagram.attempt_remove_segment(0.01, 0));
+    EXPECT_FALSE(diagram.attempt_remove_segment(0.5, 0));
+    value = diagram.value();
+    ASSERT_TRUE(diagram.attempt_remove_segment(0.99, 0));
+    EXPECT_EQ(diagram.ordinary_order(), 2);
+
+    //the removal is the reverse of the insertion
+    value = diagram.value();
+    rate = diagram.acceptance_rate_worm_remove();
+    ASSERT_TRUE(diagram.attempt_worm_remove(0));
+    EXPECT_FALSE(diagram.is_open());
+    EXPECT_NEAR(rate, diagram.value() / value / (2 * 2), EPSILON);
+    EXPECT_NEAR(rate * diagram.acceptance_rate_worm_insert(0.9, 0.1), 1, EPSILON);
+    EXPECT_EQ(diagram.vertices(), std::vector<double>({0.2, 0.5}));
+    EXPECT_FALSE(diagram.attempt_worm_remove(0));
+    EXPECT_FALSE(diagram.attempt_worm_move(0.2, 0.5, 0));
+
+    //the spin flip is valid also with the worm open
+    ASSERT_TRUE(original.attempt_worm_insert(0.3, 0.6, 0));
+    value = original.value();
+    rate = original.acceptance_rate_flip();
+    original.attempt_spin_flip(0);
+    EXPECT_NEAR(rate, original.value() / value, EPSILON);
+}
+
+
+/**
+ * @brief This test checks the Green's function measured by the worm algorithm
+ * 
+ * GIVEN: the parameters of a run with a non-zero field H
+ * WHEN: the worm algorithm is run
+ * THEN: the measured <sigma_x(0) sigma_x(tau)> agrees with the exact value at every point within its statistical error,
+ * also with a different probability of the worm updates, and the worm is open in a finite fraction of the steps
+ */
+TEST(Worm, greens_function_matches_exact)
+{
+    SimulationTask task {2, 1, 0.4, 0.6, 4000000, 10000, 31, 32};
+    GreensFunctionResults results = run_worm_simulation(task, 8);
+
+    ASSERT_EQ(results.tau.size(), 8);
+    EXPECT_GT(results.open_fraction, 0.1);
+    EXPECT_LT(results.open_fraction, 0.9);
+    for (size_t i = 0; i < results.tau.size(); ++i)
+    {
+        EXPECT_GT(results.error_correlation_xx[i], 0);
+        EXPECT_LT(results.error_correlation_xx[i], 0.02);
+        //the tolerance includes the difference between the average over the bin and the value at its center
+        EXPECT_NEAR(results.correlation_xx[i], results.exact_correlation_xx[i], 5 * results.error_correlation_xx[i] + 0.005);
+    }
+
+    GreensFunctionResults other_probability = run_worm_simulation(task, 8, WORM_WEIGHT_DEFAULT, 0.2);
+    for (size_t i = 0; i < other_probability.tau.size(); ++i)
+        EXPECT_NEAR(other_probability.correlation_xx[i], other_probability.exact_correlation_xx[i], 5 * other_probability.error_correlation_xx[i] + 0.005);
+
+    EXPECT_THROW(run_worm_simulation(task, 0), std::invalid_argument);
+    EXPECT_THROW(run_worm_simulation(task, 8, WORM_WEIGHT_DEFAULT, 0), std::invalid_argument);
+    EXPECT_THROW(run_worm_simulation(task, 8, WORM_WEIGHT_DEFAULT, 1), std::invalid_argument);
+}
+
+
+/**
+ * @brief This test checks the delayed-rejection variants of the ADD_SEGMENT and REMOVE_SEGMENT updates
+ * 
+ * GIVEN: the windows of the second stage for several first-stage rates, and a chain at large |H| * beta
+ * WHEN: the acceptance rates of the two stages and of the reverse removal are evaluated, and the chain is run with both kernels
+ * THEN: the rejection probability of the window is the integral of the rejection of the first stage, the total probability of adding
+ * a segment through both stages satisfies detailed balance with the removal, the two engines take the same decisions,
+ * and more segments are added and removed than with the single-stage updates
+ */
+TEST(TestDiagram, delayed_rejection_satisfies_detailed_balance)
+{
+    //no second stage for favourable segments, or when the first stage is never rejected
+    EXPECT_EQ(delayed_rejection_window(5, 2, -1).width, 0);
+    EXPECT_EQ(delayed_rejection_window(0.5, 2, 1).width, 0);
+    EXPECT_EQ(delayed_rejection_window(5, 0.5, 2).width, 0);
+
+    for (auto [C, L, k] : std::vector<std::tuple<double, double, double>>{{20, 3, 4}, {2, 10, 0.5}, {300, 8, 6}})
+    {
+        DelayedRejectionWindow window = delayed_rejection_window(C, L, k);
+        ASSERT_GT(window.width, 0);
+        EXPECT_NEAR(C * std::exp(-k * window.width), 1, EPSILON);
+
+        //midpoint-rule integral of the rejection probability of the first stage
+        int N_points = 100000;
+        double rejection = 0;
+        for (int i = 0; i < N_points; ++i) rejection += std::max(0., 1 - C * std::exp(-k * (i + 0.5) * L / N_points)) / N_points;
+        EXPECT_NEAR(window.rejection_probability, rejection, 1e-6);
+
+        //flux through both stages (in units of the first-stage proposal density) against the flux of the removal
+        for (double d = 0.01; d < L; d += 0.05)
+        {
+            double R = C * std::exp(-k * d);
+            double second_stage = d < window.width ? L * window.rejection_probability / window.width * std::min(1., acceptance_rate_add_second_stage(R, L, window)) : 0;
+            double remove_rate = acceptance_rate_remove_delayed(R, L, d, window);
+            if (d < window.width) { EXPECT_LE(remove_rate, 1 + EPSILON); }
+            EXPECT_NEAR(std::min(1., R) + second_stage, R * std::min(1., remove_rate), 1e-9);
+        }
+    }
+
+    //the two engines take the same decisions also with the delayed-rejection updates
+    SimulationTask task {10, 1, 1.5, 0.8, 200000, 0, 3, 4};
+    task.delayed_rejection = true;
+    LockstepReport report = run_lockstep_check(task);
+    std::stringstream context;
+    print_lockstep_report(report, context);
+    EXPECT_FALSE(report.diverged) << context.str();
+
+    //at large |H| * beta the second stage recovers a large part of the rejected additions
+    task.engine = DiagramEngine::FLAT;
+    SingleRunResults delayed = run_simulation(task);
+    task.delayed_rejection = false;
+    SingleRunResults single_stage = run_simulation(task);
+    EXPECT_GT(delayed.N_accepted_addsegment, 1.3 * single_stage.N_accepted_addsegment);
+    EXPECT_GT(delayed.N_accepted_removesegment, 1.3 * single_stage.N_accepted_removesegment);
+}